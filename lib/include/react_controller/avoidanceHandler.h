@@ -2,10 +2,45 @@
 #define __AVOIDANCEHANDLER_H__
 
 #include <vector>
+#include <memory>
+#include <unordered_map>
 
 #include <stdarg.h>
 
 #include "react_controller/baxterChain.h"
+#include "react_controller/obstacleGrid.h"
+#include "react_controller/collisionGeometry.h"
+#include "react_controller/signedDistanceField.h"
+#include "react_controller/threadPool.h"
+#include "react_controller/tactileSkin.h"
+
+/**
+ * Timing counters of the avoidance stage, accumulated over the updates
+ */
+struct AvoidanceStats
+{
+    size_t  n_updates;  // number of updates
+    size_t n_recomputed;  // number of collision points recomputed from scratch
+    size_t   n_reused;  // number of collision points reused from the previous updates
+    double    t_links;  // time spent on the forward kinematics of the links [s]
+    double    t_query;  // time spent on culling the obstacles [s]
+    double   t_points;  // time spent on computing the collision points [s]
+    double     t_self;  // time spent on the self-collisions with the other arm [s]
+    size_t n_self_pairs;  // number of link pairs that survived the broad phase
+    double  t_tactile;  // time spent on the contacts of the skin [s]
+    size_t n_remapped;  // number of slots that followed their obstacle to a new index
+    size_t    n_local;  // number of collision points seeded by the previous link or point
+    double    t_total;  // time spent on the whole update [s]
+
+    AvoidanceStats() { reset(); };
+
+    void reset();
+
+    /**
+     * Prints the statistics in a single line
+     */
+    std::string toString();
+};
 
 /****************************************************************/
 class AvoidanceHandler
@@ -13,6 +48,135 @@ class AvoidanceHandler
 private:
     BaxterChain chain;
 
+    std::vector<double> radii;  // Radii of the capsules, one per joint
+
+    // Custom chains, i.e. the prefixes of the chain up to every link
+    std::vector<BaxterChain>                             customChains;
+
+    // Pose of every link when its collision points were last refreshed, and how much
+    // the link had moved (the max over its endpoints) when the pose was refreshed
+    std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d> > links_ref;
+    std::vector<double>                                        links_disp;
+
+    /**
+     * State of an obstacle, i.e. of a slot of ctrlChains and collPoints.
+     * Obstacles are identified by their index in the grid. The static obstacles
+     * in the signed distance field (if any) take one more slot per link, after
+     * the ones of the grid, the links of the other arm (if any) one slot each,
+     * after the ones of the static obstacles, and the contacts of the skin (if any)
+     * one slot each, after the ones of the other arm. Obstacles in the grid that
+     * have an ID keep their slot when their index changes (see remapSlots).
+     */
+    struct Slot
+    {
+        bool            valid;  // true if the collision point has been computed
+        bool           active;  // true if the obstacle yields a collision point
+        size_t           link;  // index of the custom chain the collision point is on
+        Obstacle     obstacle;  // obstacle when the collision point was computed
+        Eigen::VectorXd  dist;  // lower bound of the distance from every link [m]
+        double           seed;  // position of the closest point along the link (-1 if none)
+        double          drift;  // displacement of the link since the seed was searched for [m]
+
+        Slot() : valid(false), active(false), link(0), obstacle(0.0, Eigen::Vector3d::Zero()),
+                 seed(-1.0), drift(0.0) {};
+    };
+
+    std::vector<Slot>      slots;
+    std::vector<size_t>    candidates;  // obstacles that survived the culling in the last update
+
+    const SignedDistanceField *sdf;     // Field of the static obstacles (NULL if none, not owned)
+
+    Capsules other;                     // Links of the other arm (empty if none)
+
+    std::vector<TactileContact> contacts;   // Contacts of the skin (empty if none)
+
+    double update_thres;    // Displacement that triggers the recomputation [m]
+    double   hysteresis;    // Margin the previous link or point is kept within [m]
+
+    // ID of the obstacle in every slot of the grid, and slot of every ID, as of the
+    // last update, and the slots that follow their obstacle in this update (from, to)
+    std::vector<int>                        slot_ids;
+    std::unordered_map<int, size_t>         id_slots;
+    std::vector<std::pair<size_t, size_t> >    moves;
+    std::vector<Slot>                    moved_slots;
+    std::vector<BaxterChain>            moved_chains;
+    std::vector<CollisionPoint>         moved_points;
+
+    Spheres                  spheres;  // buffers of the collision points to recompute
+    std::vector<uint8_t>       state;  // outcome of the check of every candidate
+    std::vector<uint8_t>      seeded;  // dirty obstacles that kept their previous link
+
+    AvoidanceStats stats;
+
+    /**
+     * Builds the custom chains, once and for all.
+     */
+    void buildCustomChains();
+
+    /**
+     * Moves the slots of the obstacles whose index in the grid changed since the
+     * last update, as given by their IDs, so that their collision points can
+     * still be reused. Slots are taken out before the slots are resized, and put
+     * back afterwards, see gatherMovedSlots and scatterMovedSlots. Obstacles
+     * without an ID (-1) are identified by their index, as usual.
+     *
+     * @param _grid the grid of the obstacles
+     */
+    void gatherMovedSlots(const ObstacleGrid &_grid);
+
+    /**
+     * Puts the slots taken out by gatherMovedSlots back at their new index.
+     *
+     * @param _prev_candidates the candidates of the last update, which are
+     *                         translated to the new indexes (and sorted)
+     */
+    void scatterMovedSlots(std::vector<size_t> &_prev_candidates);
+
+    /**
+     * Computes the collision point of the static obstacles onto a link,
+     * from the signed distance field. The search walks from the previous
+     * closest point, unless the link moved more than the hysteresis since
+     * the last full search along the link.
+     *
+     * @param _i the slot of the link
+     * @param _l the index of the link
+     */
+    void computeStaticPoint(size_t _i, size_t _l);
+
+    /**
+     * Computes the collision points of the links of the other arm. Pairs of links
+     * are first culled by their bounding spheres, and the distance between the
+     * capsules is only computed for the pairs that are close enough.
+     *
+     * @param _offset the slot of the first link of the other arm
+     */
+    void computeSelfCollisionPoints(size_t _offset);
+
+    /**
+     * Computes the collision points of the contacts of the skin, which are
+     * already expressed in the frame of their link.
+     *
+     * @param _offset the slot of the first contact
+     */
+    void computeTactilePoints(size_t _offset);
+
+    /**
+     * Attaches a collision point to its link, i.e. expresses it in the frame
+     * of the link and builds the control chain that ends up in it.
+     *
+     * @param _i the slot of the collision point
+     * @param _l the index of the link
+     */
+    void attachCollisionPoint(size_t _i, size_t _l);
+
+    /**
+     * Moves a collision point that is still valid along with its link.
+     *
+     * @param _i the slot of the collision point
+     * @param _q the joint angles of the chain [rad]
+     */
+    void moveCollisionPoint(size_t _i, const Eigen::VectorXd &_q);
+
     /**
      * Creates a full transform as given by a DCM matrix at the pos and norm w.r.t.
      * the original frame, from the pos and norm (one axis set arbitrarily)
@@ -23,23 +187,177 @@ private:
      */
     bool computeFoR(const Eigen::VectorXd &pos,
                     const Eigen::VectorXd &norm,
-                          Eigen::Matrix4d &FoR);
+                        Eigen::Isometry3d &FoR);
 
 protected:
     std::string type;
 
+    // Capsules of the links (the last link of every custom chain), and the frames
+    // of the custom chains, in the world reference frame as of the last update
+    std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d> > links;
+    std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d> > H;
+    Capsules caps;
+
+    // Obstacles whose collision point is recomputed in this update, and
+    // their distances from every link (one row per dirty obstacle)
+    std::vector<size_t>    dirty;
+    SphereCapsuleDistances dists;
+
+    // Control chains and collision points, one slot per obstacle in the
+    // grid. Only the slots listed in active are meaningful.
     std::vector<BaxterChain>    ctrlChains;
     std::vector<CollisionPoint> collPoints;
+    std::vector<size_t>         active;
+
+    size_t n_candidates;    // Number of obstacles that survived the culling
+
+    // First slot of the static obstacles, of the other arm and of the skin, as of
+    // the last update. The sections move whenever the size of one before them does.
+    size_t static_start, self_start, tactile_start;
+
+    std::unique_ptr<ThreadPool> pool;   // Threads the obstacles are processed with
+
+    /**
+     * Computes the collision points of the dirty obstacles, each onto its closest
+     * link, with a magnitude given by distanceToMagnitude. An obstacle stays on its
+     * previous link unless another link is closer by more than the hysteresis, so
+     * that collision points do not jump back and forth between two links that are
+     * about as close. Derived handlers can replace it to compute the points and
+     * their magnitudes in other ways.
+     *
+     * @param _grid the grid of the obstacles
+     */
+    virtual void computeCollisionPoints(const ObstacleGrid &_grid);
+
+    /**
+     * Stores the collision point of a dirty obstacle in its slot, and attaches
+     * it to its link if active. Position, normal, obstacle center and size of the
+     * collision point have to be set already, unless it is not active.
+     *
+     * @param _i    the index of the obstacle in the grid (i.e. the slot)
+     * @param _k    the index of the obstacle in dirty
+     * @param _o    the obstacle
+     * @param _l    the index of the link
+     * @param _mag  the magnitude of the collision point in [0, 1]
+     */
+    void storeCollisionPoint(size_t _i, size_t _k, const Obstacle &_o, size_t _l, double _mag);
 
 public:
+    /**
+     * Constructor. Builds the handler without any obstacle, so that it
+     * can be created once and then updated at every control cycle.
+     *
+     * @param _chain the chain to avoid the obstacles with
+     * @param _radii the radii of the capsules, one per joint (see capsuleRadiiFromURDF).
+     *               If empty, links are approximated by segments.
+     * @param _type  the type of the avoidance handler
+     */
+    AvoidanceHandler(const BaxterChain &_chain,
+                             const std::vector<double> &_radii,
+                             const std::string _type = "none");
+
     AvoidanceHandler(const BaxterChain &_chain,
                              const std::vector<Obstacle> &_obstacles,
                              const std::string _type = "none");
 
+    /**
+     * Constructor from an obstacle grid, equivalent to constructing the
+     * handler and updating it with the current joint angles of the chain.
+     *
+     * @param _chain the chain to avoid the obstacles with
+     * @param _grid  the grid of the obstacles in the world reference frame
+     * @param _type  the type of the avoidance handler
+     * @param _radii the radii of the capsules, one per joint
+     */
+    AvoidanceHandler(const BaxterChain &_chain,
+                             const ObstacleGrid &_grid,
+                             const std::string _type = "none",
+                             const std::vector<double> &_radii = std::vector<double>());
+
+    /**
+     * Updates the collision points for a new joint configuration and/or new obstacles.
+     * Every link is modeled as a capsule, and only the obstacles within ACTIVATION_DIST
+     * from the capsules are processed, the others would not activate any collision point
+     * anyway. Every obstacle yields at most one collision point, on the closest capsule.
+     *
+     * Collision points are recomputed only if their obstacle, or any link in its activation
+     * range, has moved more than update_thres since they were computed; otherwise only
+     * their control chains are updated with the new joint angles.
+     *
+     * @param _q    the joint angles of the chain [rad]
+     * @param _grid the grid of the obstacles in the world reference frame
+     */
+    void update(const Eigen::VectorXd &_q, const ObstacleGrid &_grid);
+
+    /**
+     * Sets the displacement that triggers the recomputation of the collision
+     * points [m]. Set to 0 to recompute every collision point at every update.
+     */
+    void set_update_thres(double _update_thres) { update_thres = _update_thres; };
+
+    /**
+     * Sets the margin the previous closest link (or closest point along the link, for
+     * the static obstacles) is kept within, rather than searching for it again [m].
+     * Set to 0 (default) to search for the closest link and point at every recomputation.
+     */
+    void set_hysteresis(double _hysteresis) { hysteresis = _hysteresis; };
+
+    /**
+     * Sets the signed distance field of the static obstacles, which are then
+     * looked up in the field rather than computed from their geometry. Every
+     * link gets at most one collision point from the static obstacles, at its
+     * point closest to them. The field is not copied, and it has to outlive
+     * the handler (or to be unset with NULL).
+     */
+    void set_static_field(const SignedDistanceField *_sdf);
+
+    /**
+     * Sets the links of the other arm, to be avoided as any other obstacle
+     * (i.e. self-collision mode) at the next updates. Every link of the other
+     * arm yields at most one collision point, on the closest link of this arm.
+     *
+     * @param _other the capsules of the other arm (see chainCapsules), in the
+     *               world reference frame. Empty to disable self-collisions.
+     */
+    void set_other_links(const Capsules &_other) { other = _other; };
+
+    /**
+     * Sets the contacts of the skin (see TactileSkin::aggregate), to be avoided
+     * at the next updates. Every contact yields a collision point on its link,
+     * pointing along its normal and with its magnitude.
+     *
+     * @param _contacts the contacts of the skin. Empty to disable them.
+     */
+    void set_tactile_contacts(const std::vector<TactileContact> &_contacts) { contacts = _contacts; };
+
+    /**
+     * Sets the number of threads the obstacles and the collision points are
+     * processed with (0 to use all the available cores, 1 to run serially).
+     * The results do not depend on the number of threads.
+     */
+    void set_n_threads(size_t _n_threads);
+
+    size_t getNrOfThreads() { return pool->getNrOfThreads(); };
+
     std::string getType() { return type; };
 
     virtual Eigen::MatrixXd getV_LIM(const Eigen::MatrixXd &v_lim);
 
+    /**
+     * Gets the collision points as constraints on the joint velocities, as an
+     * alternative to shaping the velocity limits (see getV_LIM). Every collision
+     * point may approach its obstacle at most at a speed that decreases with its
+     * magnitude, i.e. n.J_c.v <= (1 - mag) * _v_approach, where n is the normal
+     * towards the obstacle, J_c the positional Jacobian of the collision point and v
+     * the velocities the joints move at (see ControllerNLP::set_coll_constraints).
+     * The constraints are returned as -n.J_c.v >= -(1 - mag) * _v_approach, and
+     * only involve the joints that move the collision point.
+     *
+     * @param  _v_approach the approach speed allowed to inactive collision points [m/s]
+     * @return             one constraint per collision point
+     */
+    std::vector<VelocityConstraint> getVelocityConstraints(double _v_approach);
+
     /**
      * Gets the control chains
      *
@@ -54,6 +372,17 @@ public:
      */
     std::vector<CollisionPoint> getCtrlPoints();
 
+    /**
+     * Gets the number of obstacles that survived the culling, i.e. that
+     * have been checked against every link of the chain.
+     */
+    size_t getNrOfCandidates() { return n_candidates; };
+
+    /**
+     * Methods to get and reset the timing counters of the avoidance stage
+     */
+    AvoidanceStats getStats()   { return stats; };
+    void         resetStats()   { stats.reset(); };
 
     /**
      * Convert the control chains to a set of RVIZmarkers for
@@ -73,14 +402,98 @@ class AvoidanceHandlerTactile : public virtual AvoidanceHandler
 private:
     double avoidingSpeed;
 
+    // Projection of the normal of every collision point onto the joint space,
+    // one column per collision point
+    Eigen::MatrixXd S;
+
 public:
+    AvoidanceHandlerTactile(const BaxterChain &_chain,
+                            const std::vector<double> &_radii);
+
     AvoidanceHandlerTactile(const BaxterChain &_chain,
                             const std::vector<Obstacle> &_obstacles);
 
+    AvoidanceHandlerTactile(const BaxterChain &_chain,
+                            const ObstacleGrid &_grid,
+                            const std::vector<double> &_radii = std::vector<double>());
+
     Eigen::MatrixXd getV_LIM(const Eigen::MatrixXd &v_lim);
 
     ~AvoidanceHandlerTactile();
 };
 
+/****************************************************************/
+/**
+ * Avoidance handler with visual peripersonal space (PPS) receptive fields.
+ * The surface of every link is covered with virtual taxels, arranged in rings
+ * along the capsule, each with a receptive field shaped as a cone along its
+ * normal (see receptiveFieldActivations). The fields of every taxel are evaluated
+ * against every dirty obstacle in a single batched pass, and the taxel with the
+ * highest activation yields the collision point of the obstacle, with its
+ * activation as magnitude. This replaces the sigmoid of the distance for the
+ * obstacles in the grid, while the velocity limits are shaped as in the tactile
+ * handler.
+ */
+class AvoidanceHandlerPPS : public AvoidanceHandlerTactile
+{
+private:
+    size_t   n_rings;   // Rings of taxels per link
+    size_t n_sectors;   // Taxels per ring
+    double  rf_depth;   // Depth of the receptive fields [m]
+    double    rf_cos;   // Cosine of the half-angle of the receptive fields
+
+    // Taxels on the surface of the links in the world reference frame, one row per taxel
+    Eigen::MatrixX3d   points;
+    Eigen::MatrixX3d  normals;
+    std::vector<size_t> point_link;
+
+    // Dirty obstacles within reach of the receptive fields, and their
+    // activations, one column per obstacle
+    std::vector<size_t> near;
+    Eigen::Matrix3Xd centers;
+    Eigen::ArrayXd     sizes;
+    Eigen::ArrayXXd      act;
+
+    /**
+     * Places the taxels onto the links, as of the last update. The first taxel
+     * of every ring lies along the x axis of the frame of the link, so that the
+     * taxels are fixed onto the links.
+     */
+    void updateSurfacePoints();
+
+protected:
+    void computeCollisionPoints(const ObstacleGrid &_grid);
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param _chain the chain to avoid the obstacles with
+     * @param _radii the radii of the capsules, one per joint (see capsuleRadiiFromURDF)
+     */
+    AvoidanceHandlerPPS(const BaxterChain &_chain,
+                        const std::vector<double> &_radii);
+
+    /**
+     * Sets the shape of the receptive fields.
+     *
+     * @param _depth      the depth of the cones [m], up to ACTIVATION_DIST
+     * @param _half_angle the half-angle of the cones [rad], in (0, PI/2]
+     */
+    void set_receptive_fields(double _depth, double _half_angle);
+
+    /**
+     * Sets how many taxels cover every link.
+     *
+     * @param _n_rings   the number of rings of taxels along the link
+     * @param _n_sectors the number of taxels per ring
+     */
+    void set_surface_sampling(size_t _n_rings, size_t _n_sectors);
+
+    size_t getNrOfSurfacePoints() { return links.size() * n_rings * n_sectors; };
+
+    ~AvoidanceHandlerPPS();
+};
+
 
 #endif
@@ -0,0 +1,113 @@
+#ifndef __BATCHIKSOLVER_H__
+#define __BATCHIKSOLVER_H__
+
+#include <vector>
+#include <atomic>
+
+#include "react_controller/controllerNLP.h"
+
+/**
+ * A single IK problem, i.e. a start state and a target pose.
+ */
+struct BatchIKProblem
+{
+    Eigen::VectorXd    q_0;  // start joint configuration [rad]
+    Eigen::VectorXd    v_0;  // start joint velocities [rad/s]
+    Eigen::Vector3d    p_r;  // reference 3D position
+    Eigen::Quaterniond o_r;  // reference orientation
+
+    BatchIKProblem(const Eigen::VectorXd &_q_0, const Eigen::VectorXd &_v_0,
+                   const Eigen::Vector3d &_p_r, const Eigen::Quaterniond &_o_r) :
+                   q_0(_q_0), v_0(_v_0), p_r(_p_r), o_r(_o_r) {};
+};
+
+/**
+ * The solution of a single IK problem.
+ */
+struct BatchIKResult
+{
+    Eigen::VectorXd v_e;     // estimated joint velocities [rad/s]
+    int       exit_code;     // exit code of the IpoptApplication
+    double   solve_time;     // wall time spent on the problem [s]
+
+    BatchIKResult() : exit_code(-1), solve_time(0.0) {};
+};
+
+/**
+ * Solves batches of IK problems with the same NLP formulation used by the
+ * controller, spreading them over a pool of worker threads. Every worker owns
+ * its own ControllerNLP and IpoptApplication, so that nothing is shared
+ * across threads but the (read-only) batch of problems.
+ *
+ * IPOPT is only as re-entrant as its linear solver: MUMPS (the default) is not,
+ * so with it the batch is solved by a single worker whatever the number asked
+ * for. A thread-safe linear solver (e.g. ma27 or ma57) has to be set through
+ * set_linear_solver() for the workers to run in parallel.
+ */
+class BatchIKSolver
+{
+private:
+    BaxterChain chain;      // Chain to solve the IK against
+
+    size_t n_workers;       // Number of worker threads
+
+    double dt;              // Period of the control thread [s]
+    double tol;             // Tolerance of the solver
+    bool   ctrl_ori;        // Flag to know if to control the orientation or not
+
+    std::string linear_solver;  // Linear solver used by IPOPT (empty for default)
+
+    Eigen::MatrixXd v_lim;  // Joint velocity limits [deg/s]
+
+    /**
+     * Solves the problems assigned to a single worker. Problems are picked
+     * from the batch one at a time, so that workers are kept busy until the
+     * batch is finished regardless of how long every problem takes.
+     *
+     * @param _problems the batch of problems
+     * @param _results  the results of the batch
+     * @param _next     the index of the next problem to be solved
+     */
+    void worker(const std::vector<BatchIKProblem> &_problems,
+                      std::vector<BatchIKResult>  &_results,
+                      std::atomic<size_t>         &_next);
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param _chain     the chain to solve the IK against
+     * @param _n_workers the number of worker threads (0 to use all the available cores)
+     * @param _dt        the period of the control thread [s]
+     * @param _tol       the tolerance of the solver
+     */
+    BatchIKSolver(const BaxterChain &_chain, size_t _n_workers = 0,
+                  double _dt = 0.02, double _tol = 1e-6);
+
+    /**
+     * Sets the joint velocity limits [deg/s], one row per joint (min, max).
+     * By default the limits from the URDF are used.
+     */
+    void set_v_lim(const Eigen::MatrixXd &_v_lim);
+
+    void set_ctrl_ori(const bool _ctrl_ori)                 { ctrl_ori = _ctrl_ori; };
+    void set_linear_solver(const std::string &_linear_solver) { linear_solver = _linear_solver; };
+
+    /**
+     * Returns the number of workers the batches are solved with, i.e. one if
+     * the linear solver is not re-entrant (see set_linear_solver)
+     */
+    size_t getNrOfWorkers();
+
+    /**
+     * Solves a batch of IK problems.
+     *
+     * @param  _problems the batch of problems
+     * @return           the results, in the same order as the problems
+     */
+    std::vector<BatchIKResult> solve(const std::vector<BatchIKProblem> &_problems);
+
+    ~BatchIKSolver();
+};
+
+#endif
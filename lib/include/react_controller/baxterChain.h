@@ -225,6 +225,17 @@ public:
      */
     Eigen::Matrix4d getH(const size_t _i);
 
+    /**
+     * Same as getH() and getH(_i), as rigid transforms. Prefer these when the
+     * pose is going to be inverted (e.g. by changeFoR) or composed.
+     *
+     * @param _i [index of joint in chain]
+     *
+     * @return pose of the end-effector or of the _i'th joint
+     */
+    Eigen::Isometry3d getIsometry();
+    Eigen::Isometry3d getIsometry(const size_t _i);
+
     /**
      * Removes a segment from the chain. The segment may or may not include a joint.
      * Decrements nrOfSegments and if there is a joint also being removed, decrements
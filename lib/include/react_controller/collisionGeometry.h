@@ -0,0 +1,175 @@
+#ifndef __COLLISIONGEOMETRY_H__
+#define __COLLISIONGEOMETRY_H__
+
+#include <vector>
+
+#include "react_controller/baxterChain.h"
+
+/**
+ * A set of capsules (i.e. segments with a radius), stored as a structure of
+ * arrays so that distance computations can be vectorized across capsules.
+ */
+struct Capsules
+{
+    Eigen::ArrayXd ax, ay, az;  // base of the segments in the world reference frame
+    Eigen::ArrayXd bx, by, bz;  //  tip of the segments in the world reference frame
+    Eigen::ArrayXd          r;  // radii [m]
+
+    void   resize(size_t _n);
+    size_t size() const { return r.size(); };
+
+    void set(size_t _i, const Eigen::Vector3d &_a, const Eigen::Vector3d &_b, double _r);
+};
+
+/**
+ * A set of spheres, stored as a structure of arrays so that distance
+ * computations can be vectorized across spheres.
+ */
+struct Spheres
+{
+    Eigen::ArrayXd x, y, z;     // centers in the world reference frame
+    Eigen::ArrayXd       r;     // radii [m]
+
+    void   resize(size_t _n);
+    size_t size() const { return r.size(); };
+
+    void set(size_t _i, const Eigen::Vector3d &_c, double _r);
+};
+
+/**
+ * Distances between a set of N spheres and a set of L capsules. Every
+ * array is N x L, i.e. one column per capsule and one row per sphere.
+ */
+struct SphereCapsuleDistances
+{
+    Eigen::ArrayXXd   dist;     // distance between the surfaces [m] (negative if penetrating)
+    Eigen::ArrayXXd      t;     // position of the closest point along the segment, in [0, 1]
+    Eigen::ArrayXXd nx, ny, nz; // unit normal from the segment to the center of the sphere
+                                // (null if the center lies on the segment)
+
+    /**
+     * Computes the closest point on the surface of a capsule.
+     *
+     * @param  _caps the capsules the distances have been computed for
+     * @param  _i    the index of the sphere
+     * @param  _l    the index of the capsule
+     * @return       the closest point in the world reference frame
+     */
+    Eigen::Vector3d closestPoint(const Capsules &_caps, size_t _i, size_t _l) const;
+
+    Eigen::Vector3d normal(size_t _i, size_t _l) const;
+};
+
+/**
+ * Outcome of a swept collision check (see sweptCapsuleCheck)
+ */
+struct SweptCollision
+{
+    bool   collision;   // true if any capsule hits any sphere during the motion
+    double       toi;   // time of impact, as a fraction of the motion in [0, 1] (1 if none)
+    size_t      link;   // index of the capsule that hits first
+    size_t    sphere;   // index of the sphere it hits
+    size_t   n_iters;   // number of advancement steps, over all the capsules
+
+    SweptCollision() : collision(false), toi(1.0), link(0), sphere(0), n_iters(0) {};
+};
+
+/**
+ * Computes the distances, closest points and normals between every sphere
+ * and every capsule in a single pass. The loop over the spheres is written
+ * in terms of Eigen arrays, so that it is vectorized by Eigen.
+ *
+ * @param _caps    the capsules
+ * @param _spheres the spheres
+ * @param _res     the result (resized if needed)
+ */
+void sphereCapsuleDistances(const Capsules &_caps, const Spheres &_spheres,
+                            SphereCapsuleDistances &_res);
+
+/**
+ * Computes the closest points between two segments.
+ *
+ * @param  _p0 the first  end of the first  segment
+ * @param  _p1 the second end of the first  segment
+ * @param  _q0 the first  end of the second segment
+ * @param  _q1 the second end of the second segment
+ * @param  _cp the closest point on the first  segment
+ * @param  _cq the closest point on the second segment
+ * @return     the distance between the two segments [m]
+ */
+double segmentSegmentDistance(const Eigen::Vector3d &_p0, const Eigen::Vector3d &_p1,
+                              const Eigen::Vector3d &_q0, const Eigen::Vector3d &_q1,
+                              Eigen::Vector3d &_cp, Eigen::Vector3d &_cq);
+
+/**
+ * Checks whether a set of capsules that move from _from to _to hits any of a set
+ * of spheres along the way, by conservative advancement. The endpoints of every
+ * capsule move linearly, so no point of the capsule moves faster than its fastest
+ * endpoint: if the capsule is d away from the spheres, it can not hit them before
+ * advancing d/v along the motion. The motion of every capsule is advanced by that
+ * much at every step, until the capsule gets within _tol from a sphere (a hit)
+ * or the motion ends. Spheres that are out of reach of the whole motion are
+ * skipped, as well as the ones that the capsule already touches at the start,
+ * since shortening the motion would not avoid them anyway.
+ *
+ * @param  _from      the capsules at the start of the motion
+ * @param  _to        the capsules at the end   of the motion
+ * @param  _spheres   the spheres
+ * @param  _tol       the distance that counts as a hit [m]
+ * @param  _max_iters the advancement steps per capsule, after which a hit is
+ *                    assumed (i.e. the check errs on the safe side)
+ * @return            the earliest hit, if any
+ */
+SweptCollision sweptCapsuleCheck(const Capsules &_from, const Capsules &_to,
+                                 const Spheres &_spheres, double _tol = 1e-3,
+                                 size_t _max_iters = 32);
+
+/**
+ * Computes the activations of the peripersonal space (PPS) receptive fields of a
+ * set of P points on the surface of the arm, caused by a set of M spheres, in a
+ * single pass. The receptive field of every point is a cone along its normal: the
+ * activation is 1 if the sphere touches the point, and fades out smoothly (as
+ * 1 - smoothstep) to 0 at a distance of _depth from the point, and linearly to 0
+ * from the normal to the border of the cone. Every sphere is evaluated against
+ * all the points at once, with Eigen arrays.
+ *
+ * @param _points   the points (P x 3) in the world reference frame
+ * @param _normals  the unit outward normals of the points (P x 3)
+ * @param _centers  the centers of the spheres (3 x M)
+ * @param _sizes    the radii of the spheres (M) [m]
+ * @param _depth    the depth of the receptive fields [m]
+ * @param _cos_half_angle the cosine of the half-angle of the cones
+ * @param _act      the activations (P x M) in [0, 1], one column per sphere
+ */
+void receptiveFieldActivations(const Eigen::MatrixX3d &_points, const Eigen::MatrixX3d &_normals,
+                               const Eigen::Matrix3Xd &_centers, const Eigen::ArrayXd &_sizes,
+                               double _depth, double _cos_half_angle, Eigen::ArrayXXd &_act);
+
+/**
+ * Computes the capsules that approximate the links of a chain in its current
+ * configuration, with the same convention as capsuleRadiiFromURDF: capsule
+ * j-1 goes from joint j-1 to joint j, with radius _radii[j].
+ *
+ * @param _chain the chain
+ * @param _radii the radii, one per joint (if empty, links are segments)
+ * @param _caps  the capsules, one per joint but the first
+ */
+void chainCapsules(BaxterChain &_chain, const std::vector<double> &_radii, Capsules &_caps);
+
+/**
+ * Reads the radii of the capsules that approximate the links of a chain
+ * from the collision geometries in the URDF. Capsule j goes from joint j-1 to
+ * joint j (see BaxterChain::getH(j)), and its radius is the biggest among the
+ * links in between: the radius of spheres and cylinders, and half the second
+ * biggest side of boxes. Meshes (or links without collision geometry) are
+ * assigned _default.
+ *
+ * @param  _robot   the URDF model
+ * @param  _chain   the chain
+ * @param  _default the radius to use if no geometry is available [m]
+ * @return          the radii, one per joint (the first one is unused) [m]
+ */
+std::vector<double> capsuleRadiiFromURDF(const urdf::Model &_robot, BaxterChain _chain,
+                                         double _default = 0.0);
+
+#endif
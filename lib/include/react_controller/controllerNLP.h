@@ -11,6 +11,10 @@
 #include <math.h>
 
 #include "react_controller/baxterChain.h"
+#include "react_controller/react_control_utils.h"
+#include "react_controller/nlpKernels.h"
+#include "react_controller/kinematicsCache.h"
+#include "react_controller/warmStartModel.h"
 
 /****************************************************************/
 class ControllerNLP : public Ipopt::TNLP
@@ -31,33 +35,60 @@ private:
     // K value of the (proportional?) gain of a PID controller
     double pid;
 
+    // Formulation of the positional task
+    PosFormulation formulation;
+
+    double w_xyz;    // Weight of the positional error in the objective (POS_SOFT)
+    double w_slack;  // Weight of the slack variable  in the objective (POS_SLACK)
+
+    // Characteristic displacements, i.e. how far the end-effector can
+    // move in one step within the current bounds. Used for user scaling.
+    double l_xyz;    // positional displacement [m]
+    double l_ang;    // angular    displacement [rad]
+
     Eigen::Vector3d     p_0;  // Initial 3D position
     Eigen::VectorXd     q_0;  // Initial ND joint configuration
     Eigen::VectorXd     v_0;  // Initial ND joint velocities
-    Eigen::Matrix3d     R_0;  // Initial 3x3 rotation matrix
+    Eigen::Quaterniond  o_0;  // Initial quaternion orientation
     Eigen::MatrixXd J_0_xyz;  // Initial Jacobian (positional component)
     Eigen::MatrixXd J_0_ang;  // Initial Jacobian (orientation component)
 
     Eigen::Vector3d      p_r; // Reference 3D  position
     Eigen::Quaterniond   o_r; // Reference quaternion orientation
-    Eigen::Matrix3d      R_r; // Reference 4x4 transform matrix
-    Eigen::MatrixXd  skew_nr; // Skew-symmetric matrix of the first  column of R_r
-    Eigen::MatrixXd  skew_sr; // Skew-symmetric matrix of the second column of R_r
-    Eigen::MatrixXd  skew_ar; // Skew-symmetric matrix of the third  column of R_r
 
     Eigen::VectorXd v_e;      // Estimated joint velocities
     Eigen::Vector3d p_e;      // Estimated 3D position
-    Eigen::Matrix3d R_e;      // Estimated 3x3 rotation matrix
+    Eigen::Quaterniond o_e;   // Estimated quaternion orientation
 
     Eigen::Vector3d  err_xyz; // Positional error
     Eigen::Vector3d  err_ang; // Orientation error
-    Eigen::MatrixXd Derr_ang; // Derivative of the orientation error
+
+    // Values and derivatives of the objective and of the positional constraint
+    NLPKernels kernels;
+
+    // If to provide the exact Hessian of the Lagrangian (see eval_h), rather
+    // than leaving IPOPT to approximate it (hessian_approximation option)
+    bool exact_hessian;
+
+    // If to predict the pose of the end-effector with the forward kinematics
+    // at q_0 + pid*dt*v, rather than with the Jacobian at q_0 (see set_nonlinear_fk)
+    bool nonlinear_fk;
+
+    KinematicsCache kin;    // Kinematics of the chain, for the nonlinear prediction
+    Eigen::VectorXd q_fk;   // Joint configuration the kinematics are evaluated at
+
+    // Model that predicts the starting point of the solver (NULL to start from v_0)
+    const WarmStartModel *warm_start;
 
     Eigen::MatrixX2d q_lim;
     Eigen::MatrixX2d v_lim;
 
     Eigen::MatrixX2d bounds;
 
+    // Linear constraints on the velocities (e.g. from the collision points),
+    // one row of the constraints each, after the positional one (if any)
+    std::vector<VelocityConstraint> coll;
+
     Eigen::VectorXd qGuard;
     Eigen::VectorXd qGuardMinExt;
     Eigen::VectorXd qGuardMinInt;
@@ -70,16 +101,63 @@ private:
     void computeGuard();
     void computeBounds();
 
+    /**
+     * Computes the characteristic displacements used to scale the problem,
+     * from pid, dt, the velocity bounds and the norms of the Jacobians.
+     */
+    void computeScaling();
+
+    /**
+     * Returns the number of rows of the positional task in the constraints (0 or 1)
+     */
+    Ipopt::Index n_pos_rows() { return formulation == POS_SOFT ? 0 : 1; };
+
+    /**
+     * Hands the current problem over to the kernels. Called at the beginning
+     * of every solve (by get_nlp_info), since nothing the kernels depend on
+     * changes during a solve.
+     */
+    void updateKernels();
+
+    /**
+     * Moves the kinematics to the joint configuration the velocities x lead to.
+     * The frames of the joints are only recomputed if the configuration changed,
+     * and the Jacobian only when it is asked for (see KinematicsCache).
+     *
+     * @param x the variables
+     */
+    void updateFK(const Ipopt::Number *x);
+
+    /**
+     * Same as NLPKernels::objective and NLPKernels::posConstraint, with the pose
+     * of the end-effector predicted by the forward kinematics.
+     *
+     * @param  x    the variables
+     * @param  n    the number of variables
+     * @param  grad the gradient / the Jacobian (NULL if not needed)
+     * @return      the objective / the positional constraint
+     */
+    double fkObjective(const Ipopt::Number *x, Ipopt::Index n, Ipopt::Number *grad);
+    double fkPosConstraint(const Ipopt::Number *x, Ipopt::Index n, Ipopt::Number *jac);
+
 public:
     ControllerNLP(BaxterChain chain_, double dt_ = 0.01, bool ctrl_ori_ = false);
 
     /**
-     * Initializes the variables in the NLP problem (q_0, R_0, p_0, J_0), plus
+     * Initializes the variables in the NLP problem (q_0, o_0, p_0, J_0), plus
      * computes the variable bounds (i.e. velocity limits given the one provided by
      * the URDF and the current joint configuration)
      */
     void init();
 
+    /**
+     * Drops what the last solve left behind, i.e. the estimated velocities, the
+     * constraints of the collision points and the warm start model, so that the
+     * NLP can be reused for the next one without compiling its chain again.
+     * Everything else is set anew before every solve (see set_q_0 and init()).
+     */
+    void reset();
+
     /**
      * Returns the estimated velocities
      * @return the estimated velocities that solve the NLP problem
@@ -98,16 +176,64 @@ public:
      */
     double get_dt()   { return dt; };
 
+    /**
+     * Returns the gain the velocities are integrated with, i.e. the estimated
+     * joint configuration is q_0 + pid*dt*v (see get_est_conf)
+     */
+    double get_pid()  { return pid; };
+
+    /**
+     * Returns the initial position of the end-effector (computed by init())
+     */
+    Eigen::Vector3d get_p_0() { return p_0; };
+
+    /**
+     * Returns the target position, i.e. the one the NLP is solved for
+     */
+    Eigen::Vector3d get_p_r() { return p_r; };
+
+    /**
+     * Returns how far the end-effector can move in one step within the
+     * current velocity bounds (computed by init())
+     */
+    double get_l_xyz()        { return l_xyz; };
+
+    /**
+     * Returns the bounds of the joint velocities (computed by init())
+     */
+    Eigen::MatrixX2d get_bounds() { return bounds; };
+
+    /**
+     * Sets the estimated velocities without solving the NLP, e.g. when they come from
+     * a cache of past solutions. They are clipped to the current bounds, and the
+     * estimated pose of the end-effector is updated accordingly. To be called after init().
+     *
+     * @param _v_e the estimated velocities
+     */
+    void set_est_vels(const Eigen::VectorXd &_v_e);
+
     void computeQuantities(const Ipopt::Number *x, const bool new_x);
     bool eval_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x, Ipopt::Number &obj_value);
     bool eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Number *grad_f);
     bool eval_g(Ipopt::Index n, const Ipopt::Number *x, bool new_x,Ipopt::Index m, Ipopt::Number *g);
     bool eval_jac_g(Ipopt::Index n, const Ipopt::Number *x, bool new_x, Ipopt::Index m, Ipopt::Index nele_jac,
                     Ipopt::Index *iRow, Ipopt::Index *jCol, Ipopt::Number *values);
+    bool eval_h(Ipopt::Index n, const Ipopt::Number *x, bool new_x, Ipopt::Number obj_factor,
+                Ipopt::Index m, const Ipopt::Number *lambda, bool new_lambda, Ipopt::Index nele_hess,
+                Ipopt::Index *iRow, Ipopt::Index *jCol, Ipopt::Number *values);
     void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n, const Ipopt::Number *x, const Ipopt::Number *z_L,
                            const Ipopt::Number *z_U, Ipopt::Index m, const Ipopt::Number *g, const Ipopt::Number *lambda,
                            Ipopt::Number obj_value, const Ipopt::IpoptData *ip_data, Ipopt::IpoptCalculatedQuantities *ip_cq);
 
+    /**
+     * Sets the joint configuration of the chain the IK is solved against.
+     * It is used as q_0 the next time init() is called.
+     *
+     * @param  _q_0 the initial joint configuration
+     * @return      true/false if success/failure
+     */
+    bool set_q_0(const Eigen::VectorXd &_q_0);
+
     void set_x_r(const Eigen::Vector3d &_p_r, const Eigen::Quaterniond &_o_r);
     void set_v_lim(const Eigen::MatrixXd &_v_lim);
     void set_ctrl_ori(const bool _ctrl_ori);
@@ -115,14 +241,88 @@ public:
     void set_v_0(const Eigen::VectorXd &_v_0);
     void set_print_level(size_t _print_level);
 
+    /**
+     * Sets if to provide the exact Hessian of the Lagrangian. The application has to
+     * be told as well, i.e. its hessian_approximation option has to be "exact".
+     *
+     * @param _exact_hessian true to provide the exact Hessian, false to leave it to IPOPT
+     */
+    void set_exact_hessian(bool _exact_hessian) { exact_hessian = _exact_hessian; };
+
+    /**
+     * Sets how the pose of the end-effector at the end of the step is predicted:
+     * to first order, with the Jacobian at q_0 (the default), or with the forward
+     * kinematics at q_0 + pid*dt*v. The latter stays accurate over large steps, at
+     * the price of one update of the kinematics per new iterate of the solver. The
+     * exact Hessian is not available with it, so set_exact_hessian is ignored.
+     *
+     * @param _nonlinear_fk true for the forward kinematics, false for the Jacobian
+     */
+    void set_nonlinear_fk(bool _nonlinear_fk) { nonlinear_fk = _nonlinear_fk; };
+
+    /**
+     * Sets a model that predicts the solution from (q_0, p_r - p_0, v_0), which is
+     * then used as the starting point of the solver instead of v_0 (clipped to the
+     * bounds). The model is not owned, and has to outlive the solves.
+     *
+     * @param _warm_start the model (NULL to start from v_0)
+     */
+    void set_warm_start(const WarmStartModel *_warm_start) { warm_start = _warm_start; };
+
+    /**
+     * Sets the formulation of the positional task.
+     *
+     * @param  _formulation either "hard", "soft" or "slack"
+     * @param  _weight      the weight of the positional error (soft) or
+     *                      of the slack variable (slack) in the objective
+     * @return              true/false if success/failure
+     */
+    bool set_formulation(const std::string &_formulation, double _weight);
+
+    /**
+     * Sets the linear constraints on the velocities, e.g. the ones of the collision
+     * points (see AvoidanceHandler::getVelocityConstraints). Every constraint is a
+     * row of the constraints, whose Jacobian only has the entries of the joints it
+     * involves. They are used from the next call to the solver on. The constraints
+     * are on the velocities the joints actually move at, i.e. _gain times the variables,
+     * so their bounds are divided by _gain here.
+     *
+     * @param _coll the constraints (empty to remove them)
+     * @param _gain the ratio between the velocities the joints move at and the variables:
+     *              get_pid() if the configuration is commanded (see get_est_conf),
+     *              1 if the velocities are (see get_est_vels)
+     */
+    void set_coll_constraints(const std::vector<VelocityConstraint> &_coll, double _gain);
+
     bool get_nlp_info(Ipopt::Index &n, Ipopt::Index &m, Ipopt::Index &nnz_jac_g,
                       Ipopt::Index &nnz_h_lag, IndexStyleEnum &index_style);
     bool get_bounds_info(Ipopt::Index n, Ipopt::Number *x_l, Ipopt::Number *x_u,
                          Ipopt::Index m, Ipopt::Number *g_l, Ipopt::Number *g_u);
+    /**
+     * Returns the user scaling of the problem (used if the nlp_scaling_method
+     * option is set to user-scaling). Velocities are normalized by their bounds,
+     * the positional constraint and the slack by the squared positional
+     * displacement, and the objective by its expected magnitude.
+     */
+    bool get_scaling_parameters(Ipopt::Number &obj_scaling,
+                                bool &use_x_scaling, Ipopt::Index n, Ipopt::Number *x_scaling,
+                                bool &use_g_scaling, Ipopt::Index m, Ipopt::Number *g_scaling);
     bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number *x,
                             bool init_z, Ipopt::Number *z_L, Ipopt::Number *z_U,
                             Ipopt::Index m, bool init_lambda, Ipopt::Number *lambda);
     ~ControllerNLP();
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
+/**
+ * Creates an IpoptApplication with the options the controller uses to solve
+ * the NLP problem. The application still needs to be initialized.
+ *
+ * @param  _tol          tolerance for the solver and for constraint violations
+ * @param  _max_cpu_time maximum CPU time allowed for a single optimization [s]
+ * @return               the newly created IpoptApplication
+ */
+Ipopt::SmartPtr<Ipopt::IpoptApplication> newControllerApp(double _tol, double _max_cpu_time);
+
 #endif
@@ -1,8 +1,53 @@
+#include <map>
+#include <mutex>
+
+#include <std_msgs/String.h>
+
 #include <robot_utils/utils.h>
 #include <robot_interface/robot_interface.h>
 
+#include "baxter_react_controller/BatchIK.h"
+#include "baxter_react_controller/ObstacleArray.h"
+#include "baxter_react_controller/TaxelActivations.h"
+
 #include "react_controller/controllerNLP.h"
 #include "react_controller/avoidanceHandler.h"
+#include "react_controller/batchIKSolver.h"
+#include "react_controller/reachabilityMap.h"
+#include "react_controller/pointCloudObstacles.h"
+#include "react_controller/tripleBuffer.h"
+#include "react_controller/tactileSkin.h"
+#include "react_controller/obstacleScene.h"
+#include "react_controller/ikCache.h"
+
+/**
+ * Statistics of the controller, accumulated over the control cycles
+ */
+struct CtrlStats
+{
+    size_t   n_cycles;  // number of control cycles solved with IPOPT
+    size_t     n_idle;  // number of control cycles skipped because already at target
+    size_t n_unreachable;  // number of targets rejected by the reachability map
+    size_t n_projected;    // number of targets projected onto a reachable step
+    size_t   n_cached;  // number of control cycles answered by the IK cache, without solving
+    size_t    n_iters;  // number of IPOPT iterations
+    double solve_time;  // wall time spent in the solver [s]
+    double avoid_time;  // wall time spent in the avoidance handler [s]
+    size_t    n_swept;  // number of commanded steps checked for collisions
+    size_t n_swept_hits;   // number of commanded steps shortened because of a collision
+    double swept_time;  // wall time spent in the swept collision check [s]
+
+    std::map<int, size_t> exit_codes;  // number of cycles per IPOPT exit code
+
+    CtrlStats() { reset(); };
+
+    void reset();
+
+    /**
+     * Prints the statistics in a single line
+     */
+    std::string toString();
+};
 
 class CtrlThread : public RobotInterface
 {
@@ -18,6 +63,27 @@ private:
     // IPOPT params
     bool        ctrl_ori;  // Flag to know if to control the orientation or not
     bool derivative_test;  // String to enable the derivative test
+    bool   exact_hessian;  // Flag to provide the exact Hessian rather than approximating it
+    bool    nonlinear_fk;  // Flag to predict the end-effector with the forward kinematics
+
+    std::string formulation;        // Formulation of the positional task (hard, soft or slack)
+    double      formulation_weight; // Weight of the positional task in the objective
+    std::string nlp_scaling;        // Scaling method of the NLP (nlp_scaling_method in IPOPT)
+
+    double idle_tol_xyz;  // Position    tolerance below which the target is considered reached [m]
+    double idle_tol_ang;  // Orientation tolerance below which the target is considered reached [rad]
+
+    ReachabilityMap reach_map;  // Reachability map of the limb (if any)
+    std::string    reach_mode;  // How to use the map: off, reject or project
+
+    IKCache         ik_cache;  // Cache of the IK solutions, used as warm starts or as they are
+    bool         ik_cache_on;  // Flag to know if to use the cache
+    std::string ik_cache_file; // Snapshot the cache is loaded from and saved to (empty if none)
+
+    WarmStartModel  ws_model;  // Model that predicts the starting point of the solver (if loaded)
+    WarmStartLog      ws_log;  // Log of the solves, to train the model on (if open)
+
+    CtrlStats stats;       // Statistics of the controller
 
     Eigen::Vector3d    x_n;  // Desired next end-effector position
     Eigen::Quaterniond o_n;  // Desired next end-effector orientation
@@ -29,8 +95,59 @@ private:
                                // limited by the collision points
 
     std::vector<Obstacle>         obstacles; // Vector of 3D obstacles in the world reference frame
+    std::vector<Obstacle>   cloud_obstacles; // Obstacles from the last point cloud
+    ObstacleGrid              obstacle_grid; // Grid of both kinds of obstacles, to cull the far ones
+    bool                         grid_dirty; // True if the grid needs to be rebuilt
+    double               avoid_update_thres; // Displacement that triggers the update of a collision point [m]
+    double                 avoid_hysteresis; // Hysteresis of the closest links and points [m]
+    std::string                  avoid_mode; // How to avoid the obstacles: bounds (shaping) or constraints
+    double                   avoid_approach; // Approach speed allowed in constraints mode [m/s]
+    bool                        swept_check; // True to check the commanded step, as a chord, for collisions (see checkStep)
+    double                        swept_tol; // Distance that counts as a hit in the swept check [m]
+    Capsules           swept_from, swept_to; // Links at the start and at the end of the commanded step
+    Spheres                   swept_spheres; // Obstacles within reach of the commanded step
+    std::vector<double>       capsule_radii; // Radii of the capsules that approximate the links [m]
+    SignedDistanceField          static_sdf; // Distance field of the static obstacles (if any)
+
+    typedef std::shared_ptr<std::vector<Obstacle> > ObstaclesPtr;
+
+    std::string                  scene_file;  // Scene the obstacles are read from (empty if from the parameter server)
+    std::string                  scene_last;  // Scene loaded last, only used by the reload callback
+    double                    scene_spacing;  // Largest cell the boxes of the scene are split into [m]
+    ros::Subscriber               scene_sub;  // Subscriber to the requests to reload the scene
+    ros::Publisher                scene_pub;  // Latched markers of the scene, published when it changes
+    TripleBuffer<ObstaclesPtr>    scene_buf;  // Hands the obstacles of a new scene over to the control thread
     std::unique_ptr<AvoidanceHandler> avhdl; // Pointer to the avoidance handler
 
+    BaxterChain                          *other_chain;  // Chain of the other arm (NULL if no self-collisions)
+    std::vector<std::string>             other_joints;  // Names of the joints of the other arm
+    std::vector<double>                   other_radii;  // Radii of the capsules of the other arm [m]
+    Capsules                               other_caps;  // Capsules of the other arm
+    ros::Subscriber                         other_sub;  // Subscriber to the joint states of the other arm
+    TripleBuffer<sensor_msgs::JointStateConstPtr> other_buf;  // Hands them over to the control thread
+
+    ros::ServiceServer batch_ik_srv;  // Service server for the batch IK requests
+    BaxterChain       *batch_chain;   // Chain of the batch IK, never moved: the service runs
+                                      // on the spinner thread, while the control thread moves chain
+
+    ros::Subscriber                     cloud_sub;  // Subscriber to the point cloud
+    sensor_msgs::PointCloud2ConstPtr    cloud_msg;  // Last point cloud, not processed yet
+    std::mutex                          cloud_mtx;  // Mutex to protect cloud_msg
+    PointCloudObstacles                cloud_proc;  // Converter from point clouds to obstacles
+
+    typedef baxter_react_controller::ObstacleArrayConstPtr ObstacleArrayConstPtr;
+
+    ros::Subscriber                  obstacle_sub;  // Subscriber to the obstacle stream
+    TripleBuffer<ObstacleArrayConstPtr> obstacle_buf;  // Hands the stream over to the control thread
+    ObstacleArrayConstPtr            obstacle_msg;  // Last message of the stream in use
+
+    typedef baxter_react_controller::TaxelActivationsConstPtr TaxelActivationsConstPtr;
+
+    TactileSkin                          skin;  // Table of the taxels of the skin (if any)
+    std::vector<TactileContact>  skin_contacts;  // Contacts from the last frame of the skin
+    ros::Subscriber                  skin_sub;  // Subscriber to the activations of the skin
+    TripleBuffer<TaxelActivationsConstPtr> skin_buf;  // Hands them over to the control thread
+
     double    dT;       // time constraint for IpOpt solver time per optimization [s]
     double   tol;       // tolerance for constraint violations
     double  vMax;       // maximum velocity of joints
@@ -41,6 +158,132 @@ private:
      */
     void publishRVIZMarkers();
 
+    /**
+     * Publishes the obstacles of the scene to RVIZ, as one sphere list per size of
+     * the obstacles. Scenes can be made of tens of thousands of obstacles, so they
+     * are published on a latched topic when they change, rather than every cycle.
+     */
+    void publishSceneMarkers();
+
+    /**
+     * Checks if the end-effector is already at the desired pose (x_n, o_n),
+     * within idle_tol_xyz and idle_tol_ang (the latter only if ctrl_ori is on).
+     *
+     * @return true/false if the target is reached/not reached
+     */
+    bool isAtTarget();
+
+    /**
+     * Reads the options isAtTarget depends on (ctrl_ori and the idle tolerances)
+     * from the parameter server. They are read before the check rather than with
+     * the other NLP options, which are only read when the NLP is solved.
+     */
+    void idleOptionsFromParameterServer();
+
+    /**
+     * Checks the desired pose against the reachability map (if loaded).
+     * In reject mode, targets outside the workspace are rejected. In project
+     * mode, targets are also projected onto a reachable step, i.e. no farther
+     * than the NLP can move in one dT. Needs the NLP to be initialized.
+     *
+     * @return true if the NLP should be solved, false if the target is unreachable
+     */
+    bool prefilterTarget();
+
+    /**
+     * Returns the ratio between the velocities the joints move at and the ones
+     * estimated by the NLP, in the current control mode: pid in position mode, since
+     * the configuration q_0 + pid*dt*v is commanded, and 1 in velocity mode, since
+     * the velocities are commanded as they are.
+     */
+    double commandGain();
+
+    /**
+     * Checks the step the current control mode commands (see commandGain) for
+     * collisions with the obstacles in the grid, i.e. the links are swept along
+     * the step rather than checked at the current configuration only (see
+     * sweptCapsuleCheck). The sweep is the chord of the step: the end points of every
+     * capsule are interpolated linearly between the two configurations, rather than
+     * moved along the arcs of the joints, so links that rotate a lot within a step
+     * may cut corners the check misses. If any link hits an obstacle, the step is
+     * shortened to the time of impact. Needs the NLP to be solved.
+     *
+     * @param  _est the command, either a configuration or a velocity depending on
+     *              the control mode (shortened in place)
+     * @return      true if the step is collision-free, false if it was shortened
+     */
+    bool checkStep(Eigen::VectorXd &_est);
+
+    /**
+     * Callback for the point cloud. It only stores the message, which is
+     * processed by the control thread in updateObstacles().
+     */
+    void pointCloudCb(const sensor_msgs::PointCloud2ConstPtr& _msg);
+
+    /**
+     * Callback for the joint states of the other arm. The message is only
+     * handed over to the control thread, which processes it in updateOtherArm().
+     */
+    void otherJointStatesCb(const sensor_msgs::JointStateConstPtr& _msg);
+
+    /**
+     * Updates the links of the other arm in the avoidance handler, if
+     * new joint states of the other arm have been received.
+     */
+    void updateOtherArm();
+
+    /**
+     * Callback for the activations of the skin. The message is only handed
+     * over to the control thread, which processes it in updateSkin().
+     */
+    void skinCb(const TaxelActivationsConstPtr& _msg);
+
+    /**
+     * Aggregates the last frame of activations of the skin (if new) into
+     * contacts, and hands them over to the avoidance handler.
+     */
+    void updateSkin();
+
+    /**
+     * Loads an obstacle scene, and converts it into obstacles.
+     *
+     * @param  _file the scene file
+     * @return       the obstacles (empty pointer on failure)
+     */
+    ObstaclesPtr loadScene(const std::string &_file);
+
+    /**
+     * Callback for the requests to reload the scene, with the path of the new
+     * scene file (or an empty string to reload the last one). The scene is loaded
+     * and converted in the callback thread, and the obstacles are handed over to
+     * the control thread, which swaps them in at the next updateObstacles().
+     */
+    void sceneReloadCb(const std_msgs::StringConstPtr& _msg);
+
+    /**
+     * Callback for the obstacle stream. The message is not copied, but handed
+     * over to the control thread as it is, without locking.
+     */
+    void obstacleStreamCb(const ObstacleArrayConstPtr& _msg);
+
+    /**
+     * Converts the last point cloud (if any) into obstacles, and rebuilds the
+     * obstacle grid if either the point cloud, the obstacle stream, the scene
+     * or the obstacles have changed.
+     */
+    void updateObstacles();
+
+    /**
+     * Callback for the batch IK service. Solves a batch of IK problems with
+     * the same formulation used by the controller, without moving the robot.
+     *
+     * @param  _req the request, i.e. the poses and the start configurations
+     * @param  _res the response, i.e. the velocities, exit codes and timing
+     * @return      true/false if success/failure
+     */
+    bool batchIKCb(baxter_react_controller::BatchIK::Request  &_req,
+                   baxter_react_controller::BatchIK::Response &_res);
+
 public:
     CtrlThread(const std::string& _name, const std::string&        _limb,
                 bool _use_robot =  true, double _ctrl_freq = THREAD_FREQ,
@@ -86,6 +329,22 @@ public:
      */
     bool getInternalState() { return internal_state; };
 
+    /**
+     * Methods to get and reset the statistics of the controller
+     */
+    CtrlStats getStats()   { return stats; };
+    void    resetStats()   { stats.reset(); if (avhdl) { avhdl->resetStats(); } };
+
+    /**
+     * Gets the timing counters of the avoidance handler (empty if collision avoidance is off)
+     */
+    AvoidanceStats getAvoidanceStats() { return avhdl?avhdl->getStats():AvoidanceStats(); };
+
+    /**
+     * Gets the chain the IK is solved against
+     */
+    const BaxterChain* getChain() { return chain; };
+
     Eigen::VectorXd solveIK(int &_exit_code);
 
     ~CtrlThread();
@@ -0,0 +1,231 @@
+#ifndef __IKCACHE_H__
+#define __IKCACHE_H__
+
+#include <list>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+#include <Eigen/Dense>
+
+/**
+ * An IK problem as seen by the cache: the state the controller starts from,
+ * the target, and the bounds of the joint velocities (i.e. the ones of the
+ * NLP, after the joint limits and the avoidance shaped them).
+ */
+struct IKCacheQuery
+{
+    Eigen::VectorXd    q_0;     // start joint configuration [rad]
+    Eigen::VectorXd    v_0;     // start joint velocities [rad/s]
+    Eigen::Vector3d    p_r;     // target position [m]
+    Eigen::Quaterniond o_r;     // target orientation
+    Eigen::MatrixX2d   bounds;  // bounds of the joint velocities (min, max) [rad/s]
+
+    IKCacheQuery() : p_r(Eigen::Vector3d::Zero()), o_r(Eigen::Quaterniond::Identity()) {};
+
+    IKCacheQuery(const Eigen::VectorXd &_q_0, const Eigen::VectorXd    &_v_0,
+                 const Eigen::Vector3d &_p_r, const Eigen::Quaterniond &_o_r,
+                 const Eigen::MatrixX2d &_bounds) :
+                 q_0(_q_0), v_0(_v_0), p_r(_p_r), o_r(_o_r), bounds(_bounds) {};
+};
+
+/**
+ * Statistics of an IKCache
+ */
+struct IKCacheStats
+{
+    size_t n_lookups;   // number of lookups
+    size_t n_hits;      // number of lookups that found a solution
+    size_t n_direct;    // number of hits close enough to be used as they are
+    size_t n_inserts;   // number of solutions inserted
+    size_t n_evictions; // number of solutions evicted because the cache was full
+    size_t n_clears;    // number of times the cache was cleared because the context changed
+
+    IKCacheStats() { reset(); };
+
+    void reset();
+
+    /**
+     * Prints the statistics in a single line
+     */
+    std::string toString() const;
+};
+
+/**
+ * Header of an IK cache snapshot. The file is made of this header, followed by
+ * the entries from the least to the most recently used one, each made of its
+ * n_inputs inputs and its n_outputs joint velocities (as doubles). Values are
+ * stored with the byte order of the machine the snapshot was saved on.
+ */
+struct IKCacheHeader
+{
+    char     magic[8];      // "BRCIKC" (null terminated)
+    uint32_t version;       // version of the file format
+    uint32_t n_entries;     // number of entries
+    uint32_t n_inputs;      // number of inputs of an entry
+    uint32_t n_outputs;     // number of joint velocities of an entry
+    uint64_t context;       // hash of the context of the solutions (see set_context)
+};
+
+/**
+ * Bounded, least recently used cache of IK solutions. Controllers tend to repeat
+ * the same motions (e.g. a loop of waypoints), so the problem of a cycle is often
+ * one that has been solved before. Problems are keyed by their inputs, quantized
+ * with one resolution per kind of input: a lookup that falls in the same cell as a
+ * stored problem returns its solution, which can be used as a warm start. If the
+ * inputs are also within a fraction of the resolution from the stored ones (see
+ * set_direct_tol), the solution can be used as it is.
+ *
+ * Anything else the solutions depend on (e.g. the formulation, the weights, dt) is
+ * the context of the cache: solutions of different contexts are never mixed.
+ * The cache can be saved to a snapshot and loaded back, e.g. across restarts.
+ */
+class IKCache
+{
+private:
+    struct Entry
+    {
+        std::vector<int64_t> cells;     // quantized inputs
+        Eigen::VectorXd     inputs;     // inputs (see toInputs)
+        Eigen::VectorXd        v_e;     // solution
+        uint64_t              hash;     // hash of the cells
+    };
+
+    typedef std::list<Entry> Entries;
+
+    size_t capacity;    // Maximum number of entries
+
+    double res_q;       // Resolution of the joint angles [rad]
+    double res_v;       // Resolution of the joint velocities and of their bounds [rad/s]
+    double res_p;       // Resolution of the target position [m]
+    double res_o;       // Resolution of the components of the target quaternion
+
+    double direct_tol;  // Largest distance of a direct answer, as a fraction of the resolutions
+    uint64_t  context;  // Hash of the context the entries were solved in
+
+    Entries                                       entries;  // Most recently used first
+    std::unordered_map<uint64_t, Entries::iterator> index;  // Entries by the hash of their cells
+
+    IKCacheStats stats;
+
+    /**
+     * Flattens a query into [q_0, v_0, bounds(:,0), bounds(:,1), p_r, o_r], with
+     * the quaternion as (w, x, y, z) and its sign picked so that w >= 0.
+     */
+    static Eigen::VectorXd toInputs(const IKCacheQuery &_query);
+
+    /**
+     * Resolution of each of the inputs
+     */
+    Eigen::VectorXd toResolutions(size_t _n_inputs) const;
+
+    /**
+     * Quantizes the inputs, and hashes the result.
+     *
+     * @param  _inputs the inputs
+     * @param  _cells  the quantized inputs
+     * @return         the hash of the quantized inputs
+     */
+    uint64_t toCells(const Eigen::VectorXd &_inputs, std::vector<int64_t> &_cells) const;
+
+    /**
+     * Inserts a solution as the most recently used one, replacing the one with the
+     * same hash (if any) and evicting the least recently used one if full.
+     */
+    void add(const Eigen::VectorXd &_inputs, const Eigen::VectorXd &_v_e);
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param _capacity the maximum number of solutions
+     */
+    IKCache(size_t _capacity = 1000);
+
+    /**
+     * Sets the maximum number of solutions, evicting the least recently used ones if needed.
+     */
+    void set_capacity(size_t _capacity);
+
+    /**
+     * Sets the resolutions the inputs are quantized with. The cache is cleared,
+     * as the stored solutions are keyed with the old ones.
+     *
+     * @param _res_q the resolution of the joint angles [rad]
+     * @param _res_v the resolution of the joint velocities and of their bounds [rad/s]
+     * @param _res_p the resolution of the target position [m]
+     * @param _res_o the resolution of the components of the target quaternion
+     */
+    void set_resolutions(double _res_q, double _res_v, double _res_p, double _res_o);
+
+    /**
+     * Sets how close the inputs of a hit have to be to the stored ones for the solution
+     * to be used as it is, as a fraction of the resolutions (in the max norm).
+     *
+     * @param _direct_tol the tolerance, within [0, 1] (0 to only use warm starts)
+     */
+    void set_direct_tol(double _direct_tol) { direct_tol = _direct_tol; };
+
+    /**
+     * Sets the context of the solutions, i.e. anything they depend on besides the
+     * query (e.g. the formulation and its weight, dt, the tolerance). If it differs
+     * from the current one, the cache is cleared.
+     *
+     * @param  _context the context, in any form (e.g. the options as a string)
+     * @return          true if the cache was cleared
+     */
+    bool set_context(const std::string &_context);
+
+    /**
+     * Looks a problem up. A hit makes the solution the most recently used one.
+     * A solution is only used as it is if it is also within the bounds of the query.
+     *
+     * @param  _query  the problem
+     * @param  _v_e    the solution (if found)
+     * @param  _direct true if the solution can be used as it is, false if only as a warm start
+     * @return         true/false if hit/miss
+     */
+    bool lookup(const IKCacheQuery &_query, Eigen::VectorXd &_v_e, bool &_direct);
+
+    /**
+     * Inserts the solution of a problem, e.g. after a successful solve.
+     *
+     * @param _query the problem
+     * @param _v_e   the solution
+     */
+    void insert(const IKCacheQuery &_query, const Eigen::VectorXd &_v_e);
+
+    /**
+     * Removes all the solutions
+     */
+    void clear();
+
+    /**
+     * Saves the cache (with its context) to a snapshot.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure
+     */
+    bool save(const std::string &_path) const;
+
+    /**
+     * Loads a snapshot, replacing the solutions and the context of the cache.
+     * Entries are keyed with the current resolutions, and the least recently
+     * used ones are dropped if the snapshot holds more than the capacity.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure. The cache is empty on failure.
+     */
+    bool load(const std::string &_path);
+
+    size_t size()        const { return entries.size(); };
+    size_t getCapacity() const { return capacity;       };
+
+    const IKCacheStats& getStats() const { return stats; };
+    void resetStats()                    { stats.reset(); };
+
+    ~IKCache();
+};
+
+#endif
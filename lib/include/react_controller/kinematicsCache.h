@@ -0,0 +1,88 @@
+#ifndef __KINEMATICSCACHE_H__
+#define __KINEMATICSCACHE_H__
+
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+#include "react_controller/baxterChain.h"
+
+/**
+ * Forward kinematics and geometric Jacobian of the end-effector of a chain,
+ * for evaluations at many configurations in a row (e.g. within a solve).
+ *
+ * The chain is compiled once into one fixed transform and one axis per joint
+ * (fixed segments are folded into them), so an update is a single pass of
+ * rigid transforms with no KDL objects and no allocations. The frames of the
+ * joints are kept across updates: an update recomputes them from the first
+ * joint whose angle changed, and is free if none did. The Jacobian is only
+ * computed when asked for, once per configuration.
+ *
+ * Joints are assumed to have no scale, as kdl_parser builds them. Unlike
+ * BaxterChain::setAng, the angles are not clamped to the joint limits.
+ */
+class KinematicsCache
+{
+private:
+    typedef std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d> > Isometries;
+
+    size_t nrOfJoints;
+
+    Isometries        P;    // From the previous joint (or the base) to each joint, at zero angle
+    Eigen::Isometry3d E;    // From the last joint to the end-effector
+    Eigen::Matrix3Xd  a;    // Axis of each joint, in its own frame
+    std::vector<bool> rot;  // If each joint is rotational (true) or translational (false)
+
+    Eigen::VectorXd   q;    // Joint angles the frames are computed at
+    Isometries      pre;    // Frame of each joint in the base frame, before its motion
+    Isometries     post;    // Frame of each joint in the base frame, after  its motion
+    Eigen::Isometry3d H;    // Pose of the end-effector
+
+    Eigen::MatrixXd   J;    // Geometric Jacobian of the end-effector
+    bool      valid_fwd;    // If the frames are computed at q
+    bool      valid_jac;    // If the Jacobian is computed at q
+
+    // Statistics
+    size_t n_updates;       // Number of calls to setAng
+    size_t n_joint_updates; // Number of joint frames recomputed by them
+
+public:
+    KinematicsCache();
+
+    /**
+     * Compiles a chain. The joint angles of the chain are not used.
+     *
+     * @param _chain the chain
+     */
+    KinematicsCache(const BaxterChain &_chain);
+
+    /**
+     * Sets the joint angles, updating the frames of the joints from the first one
+     * whose angle changed.
+     *
+     * @param  _q the joint angles [rad]
+     * @return    the number of joints whose frames were recomputed (0 if none changed)
+     */
+    size_t setAng(const Eigen::VectorXd &_q);
+
+    /**
+     * Pose of the end-effector at the current joint angles, as BaxterChain::getIsometry()
+     */
+    const Eigen::Isometry3d& getIsometry() const { return H; };
+
+    /**
+     * Geometric Jacobian of the end-effector at the current joint angles, as
+     * BaxterChain::GeoJacobian() (i.e. linear velocities of the end-effector first,
+     * angular velocities next, both in the base frame)
+     */
+    const Eigen::MatrixXd& GeoJacobian();
+
+    size_t getNrOfJoints()       const { return nrOfJoints;      };
+    size_t getNrOfUpdates()      const { return n_updates;       };
+    size_t getNrOfJointUpdates() const { return n_joint_updates; };
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif
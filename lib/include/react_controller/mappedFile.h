@@ -0,0 +1,47 @@
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+
+#include <string>
+#include <stdint.h>
+
+/**
+ * Read-only memory mapping of a whole file. The mapping is released when
+ * the object is destroyed (or when a new file is opened).
+ */
+class MappedFile
+{
+private:
+    void*       data;   // Address of the mapping (NULL if no file is mapped)
+    size_t      size;   // Size of the mapping [bytes]
+    std::string path;   // Path of the mapped file
+
+    // Mappings can not be copied
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+public:
+    MappedFile();
+
+    /**
+     * Maps a file in memory, releasing the previous mapping if any.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure
+     */
+    bool open(const std::string &_path);
+
+    /**
+     * Releases the mapping.
+     */
+    void close();
+
+    bool isOpen()      const { return data != NULL; };
+
+    const uint8_t* getData() const { return static_cast<const uint8_t*>(data); };
+    size_t         getSize() const { return size; };
+    std::string    getPath() const { return path; };
+
+    ~MappedFile();
+};
+
+#endif
@@ -0,0 +1,336 @@
+#ifndef __NLPKERNELS_H__
+#define __NLPKERNELS_H__
+
+#include <Eigen/Dense>
+#include <unsupported/Eigen/AutoDiff>
+
+/**
+ * Largest number of variables of the controller NLP, i.e. the joints of the
+ * arm plus the slack variable. It bounds the size of every vector and matrix
+ * of the kernels, which then live on the stack.
+ */
+#define NLP_MAX_VARS 8
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, NLP_MAX_VARS, 1>                       NLPVector;
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, NLP_MAX_VARS, NLP_MAX_VARS> NLPMatrix;
+typedef Eigen::Matrix<double, 3, Eigen::Dynamic, 0, 3, NLP_MAX_VARS>                         NLPJacobian;
+
+/**
+ * Formulations of the positional task:
+ *  - POS_HARD : ||err_xyz||^2 is constrained to zero (within 1e-11)
+ *  - POS_SOFT : ||err_xyz||^2 is a weighted term of the objective
+ *  - POS_SLACK: ||err_xyz||^2 is constrained to be lower than a slack
+ *               variable s >= 0, which is a weighted term of the objective
+ */
+enum PosFormulation { POS_HARD, POS_SOFT, POS_SLACK };
+
+/**
+ * Dual number with N fixed-size directions, i.e. a value and its derivatives, for
+ * the forward-mode automatic differentiation of the first derivatives. Unlike
+ * Eigen::AutoDiffScalar, every operation is a plain, forcibly inlined function on a
+ * fixed-size vector, with no expression templates, so that the derivative kernels
+ * compile into straight-line code.
+ */
+template<int N>
+struct Dual
+{
+    typedef Eigen::Matrix<double, N, 1> Derivatives;
+
+    double         a;   // value
+    Derivatives    v;   // derivatives
+
+    Dual() : a(0.0), v(Derivatives::Zero()) { };
+    Dual(double _a) : a(_a), v(Derivatives::Zero()) { };
+    Dual(double _a, const Derivatives &_v) : a(_a), v(_v) { };
+
+    /**
+     * The _i-th variable, with value _a
+     */
+    Dual(double _a, int _i) : a(_a), v(Derivatives::Unit(_i)) { };
+
+    EIGEN_ALWAYS_INLINE Dual& operator+=(const Dual &_o) { a += _o.a; v += _o.v;                  return *this; };
+    EIGEN_ALWAYS_INLINE Dual& operator-=(const Dual &_o) { a -= _o.a; v -= _o.v;                  return *this; };
+    EIGEN_ALWAYS_INLINE Dual& operator*=(const Dual &_o) { v = _o.a * v + a * _o.v; a *= _o.a;    return *this; };
+    EIGEN_ALWAYS_INLINE Dual& operator/=(const Dual &_o) { *this = *this / _o;                    return *this; };
+
+    friend EIGEN_ALWAYS_INLINE Dual operator+(const Dual &_x)                 { return _x;                                           }
+    friend EIGEN_ALWAYS_INLINE Dual operator-(const Dual &_x)                 { return Dual(-_x.a, -_x.v);                           }
+    friend EIGEN_ALWAYS_INLINE Dual operator+(const Dual &_x, const Dual &_y) { return Dual(_x.a + _y.a, _x.v + _y.v);               }
+    friend EIGEN_ALWAYS_INLINE Dual operator-(const Dual &_x, const Dual &_y) { return Dual(_x.a - _y.a, _x.v - _y.v);               }
+    friend EIGEN_ALWAYS_INLINE Dual operator*(const Dual &_x, const Dual &_y) { return Dual(_x.a * _y.a, _y.a * _x.v + _x.a * _y.v); }
+    friend EIGEN_ALWAYS_INLINE Dual operator/(const Dual &_x, const Dual &_y)
+    {
+        double inv = 1.0 / _y.a;
+        return Dual(_x.a * inv, inv * (_x.v - (_x.a * inv) * _y.v));
+    }
+    friend EIGEN_ALWAYS_INLINE Dual operator*(double _s, const Dual &_x)      { return Dual(_s * _x.a, _s * _x.v);                   }
+    friend EIGEN_ALWAYS_INLINE Dual operator*(const Dual &_x, double _s)      { return Dual(_s * _x.a, _s * _x.v);                   }
+
+    friend EIGEN_ALWAYS_INLINE Dual sqrt(const Dual &_x) { double r = std::sqrt(_x.a); return Dual(r, (0.5 / r) * _x.v);   }
+    friend EIGEN_ALWAYS_INLINE Dual  cos(const Dual &_x) { return Dual(std::cos(_x.a), -std::sin(_x.a) * _x.v);             }
+    friend EIGEN_ALWAYS_INLINE Dual  sin(const Dual &_x) { return Dual(std::sin(_x.a),  std::cos(_x.a) * _x.v);             }
+};
+
+namespace Eigen
+{
+    template<int N>
+    struct NumTraits<Dual<N> > : NumTraits<double>
+    {
+        typedef Dual<N> Real;
+        typedef Dual<N> NonInteger;
+        typedef Dual<N> Nested;
+        typedef Dual<N> Literal;
+
+        enum { IsComplex = 0, IsInteger = 0, IsSigned = 1, RequireInitialization = 1,
+               ReadCost  = N + 1, AddCost = N + 1, MulCost = 2 * N + 1 };
+    };
+}
+
+/**
+ * Returns the value of a scalar, be it a double, a Dual or an (arbitrarily nested)
+ * Eigen::AutoDiffScalar. Used to take branches on values only.
+ */
+inline double scalarValue(double _s)    { return _s; }
+
+template<int N>
+double scalarValue(const Dual<N> &_s)   { return _s.a; }
+
+template<typename Derivatives>
+double scalarValue(const Eigen::AutoDiffScalar<Derivatives> &_s)    { return scalarValue(_s.value()); }
+
+/**
+ * Terms of the controller NLP. Every term is a function of a 3D quantity, which is
+ * in turn an affine function of the joint velocities (see NLPKernels). Terms are
+ * written once for a generic scalar type T, and they are instantiated with doubles
+ * for their values, with Duals for their first derivatives and with second order
+ * Eigen::AutoDiffScalars for their Hessians, so a new term only needs its value.
+ * Constants are converted to T explicitly, so that nested scalars work as well.
+ */
+struct SquaredNormTerm
+{
+    /**
+     * ||_y||^2, e.g. of the positional error
+     */
+    template<typename T>
+    T operator()(const Eigen::Matrix<T, 3, 1> &_y) const
+    {
+        return _y[0]*_y[0] + _y[1]*_y[1] + _y[2]*_y[2];
+    }
+};
+
+struct OrientationTerm
+{
+    Eigen::Quaterniond o_0;     // Initial   orientation
+    Eigen::Quaterniond o_r;     // Reference orientation
+
+    OrientationTerm() : o_0(Eigen::Quaterniond::Identity()), o_r(Eigen::Quaterniond::Identity()) { };
+
+    /**
+     * Orientation at the end of the step, as the scalar (_w) and vector (_v) parts
+     * of a quaternion: the initial one is rotated by the angular increment _inc.
+     */
+    template<typename T>
+    void estOrientation(const Eigen::Matrix<T, 3, 1> &_inc, T &_w, Eigen::Matrix<T, 3, 1> &_v) const
+    {
+        using std::sqrt;
+        using std::cos;
+        using std::sin;
+
+        // The increment as a quaternion (c, s * _inc). Close to zero, the series
+        // keep sqrt (whose derivative blows up) out of the way
+        T th2 = _inc[0]*_inc[0] + _inc[1]*_inc[1] + _inc[2]*_inc[2];
+        T c, s;
+
+        if (scalarValue(th2) < 1e-6)
+        {
+            c = T(1.0) - th2 * T(1.0 / 8.0);
+            s = T(0.5) - th2 * T(1.0 / 48.0);
+        }
+        else
+        {
+            T th = sqrt(th2);
+            c = cos(T(0.5) * th);
+            s = sin(T(0.5) * th) / th;
+        }
+
+        Eigen::Matrix<T, 3, 1> v_0(T(o_0.x()), T(o_0.y()), T(o_0.z()));
+        T                      w_0(o_0.w());
+
+        // Cross products are spelled out: Eigen expressions of non-builtin scalars
+        // do not inline as well
+        _w = c * w_0 - s * (_inc[0]*v_0[0] + _inc[1]*v_0[1] + _inc[2]*v_0[2]);
+        for (int i = 0, j = 1, k = 2; i < 3; ++i, j = (j + 1) % 3, k = (k + 1) % 3)
+        {
+            _v[i] = c * v_0[i] + (s * w_0) * _inc[i] + s * (_inc[j]*v_0[k] - _inc[k]*v_0[j]);
+        }
+    }
+
+    /**
+     * Orientation error at the end of the step, as in orientationError
+     */
+    template<typename T>
+    Eigen::Matrix<T, 3, 1> error(const Eigen::Matrix<T, 3, 1> &_inc) const
+    {
+        T                      w_e;
+        Eigen::Matrix<T, 3, 1> v_e;
+        estOrientation(_inc, w_e, v_e);
+
+        Eigen::Matrix<T, 3, 1> v_r(T(o_r.x()), T(o_r.y()), T(o_r.z()));
+        T                      w_r(o_r.w());
+
+        T eta = w_e * w_r + (v_e[0]*v_r[0] + v_e[1]*v_r[1] + v_e[2]*v_r[2]);
+        T sgn(scalarValue(eta) < 0.0 ? -2.0 : 2.0);
+
+        Eigen::Matrix<T, 3, 1> err;
+        for (int i = 0, j = 1, k = 2; i < 3; ++i, j = (j + 1) % 3, k = (k + 1) % 3)
+        {
+            err[i] = sgn * (w_e * v_r[i] - w_r * v_e[i] - (v_r[j]*v_e[k] - v_r[k]*v_e[j]));
+        }
+
+        return err;
+    }
+
+    /**
+     * ||error(_inc)||^2
+     */
+    template<typename T>
+    T operator()(const Eigen::Matrix<T, 3, 1> &_inc) const
+    {
+        return SquaredNormTerm()(error(_inc));
+    }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/**
+ * Everything the terms of the controller NLP depend on, besides the variables.
+ * The Jacobians are scaled by pid*dt, i.e. they map the joint velocities onto
+ * the displacement of the end-effector over one step.
+ */
+struct NLPTermData
+{
+    size_t         n_joints;        // Number of joint velocities (the slack, if any, follows them)
+    PosFormulation formulation;     // Formulation of the positional task
+    bool           ctrl_ori;        // If to control the orientation
+    double         w_xyz;           // Weight of the positional error (POS_SOFT)
+    double         w_slack;         // Weight of the slack variable   (POS_SLACK)
+
+    Eigen::Vector3d p_0;            // Initial   position
+    Eigen::Vector3d p_r;            // Reference position
+    NLPJacobian     J_xyz;          // Positional  Jacobian
+    NLPJacobian     J_ang;          // Orientation Jacobian
+    OrientationTerm ori;            // Initial and reference orientations
+
+    NLPTermData() : n_joints(0), formulation(POS_HARD), ctrl_ori(false), w_xyz(1e3), w_slack(1e4),
+                    p_0(Eigen::Vector3d::Zero()), p_r(Eigen::Vector3d::Zero()) { };
+
+    /**
+     * Positional error at the end of the step, i.e. p_r - p_e
+     */
+    Eigen::Vector3d posError(const double *_x) const
+    {
+        return p_r - p_0 - J_xyz * Eigen::Map<const NLPVector>(_x, n_joints);
+    }
+
+    /**
+     * Angular increment over the step
+     */
+    Eigen::Vector3d angIncrement(const double *_x) const
+    {
+        return J_ang * Eigen::Map<const NLPVector>(_x, n_joints);
+    }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/**
+ * Derivative kernels of the controller NLP. Every nonlinear term is a function of
+ * a 3D quantity y = b + A * v that is affine in the joint velocities v (i.e. the
+ * positional error and the angular increment), so the terms are differentiated with
+ * respect to y with fixed-size, forward-mode automatic differentiation (Dual for the
+ * first derivatives, which IPOPT asks for at every iteration, nested AutoDiffScalars
+ * for the Hessian), and the derivatives are brought back to the joint velocities by
+ * the chain rule (A^T g and A^T H A). The slack variable and the velocity constraints
+ * are linear, so they are added as they are. No evaluation allocates memory.
+ */
+class NLPKernels
+{
+private:
+    NLPTermData data;
+
+    /**
+     * Adds the weighted value of a term, and its derivatives, to the ones of the
+     * Lagrangian.
+     *
+     * @param _term the term, as a function of y
+     * @param _w    the weight of the term
+     * @param _A    the linear part of y as a function of the joint velocities
+     * @param _y    y at the joint velocities of interest
+     * @param _f    the value (incremented)
+     * @param _grad the gradient (incremented, if not NULL)
+     * @param _H    the Hessian  (incremented, if not NULL)
+     */
+    template<typename Term>
+    void addTerm(const Term &_term, double _w, const NLPJacobian &_A, const Eigen::Vector3d &_y,
+                 double &_f, double *_grad, NLPMatrix *_H) const;
+
+public:
+    NLPKernels() { };
+
+    /**
+     * Sets the data the terms depend on. Every kernel uses it from then on.
+     */
+    void set_data(const NLPTermData &_data) { data = _data; };
+    const NLPTermData& get_data() const     { return data;  };
+
+    /**
+     * Value of the objective
+     *
+     * @param  _x the variables (as many as ControllerNLP has)
+     * @param  _n the number of variables
+     * @return    the objective
+     */
+    double objective(const double *_x, int _n) const;
+
+    /**
+     * Value and gradient of the objective
+     *
+     * @param  _x    the variables
+     * @param  _n    the number of variables
+     * @param  _grad the gradient (_n elements)
+     * @return       the objective
+     */
+    double objective(const double *_x, int _n, double *_grad) const;
+
+    /**
+     * Value of the positional constraint
+     */
+    double posConstraint(const double *_x, int _n) const;
+
+    /**
+     * Value and Jacobian of the positional constraint
+     *
+     * @param  _x   the variables
+     * @param  _n   the number of variables
+     * @param  _jac the Jacobian (_n elements)
+     * @return      the constraint
+     */
+    double posConstraint(const double *_x, int _n, double *_jac) const;
+
+    /**
+     * Hessian of the Lagrangian, i.e. _obj_factor times the Hessian of the objective,
+     * plus _lambda_pos times the one of the positional constraint (the velocity
+     * constraints are linear, so they do not contribute).
+     *
+     * @param _x          the variables
+     * @param _n          the number of variables
+     * @param _obj_factor the factor of the objective
+     * @param _lambda_pos the multiplier of the positional constraint (0 if there is none)
+     * @param _H          the Hessian (_n x _n, symmetric)
+     */
+    void hessian(const double *_x, int _n, double _obj_factor, double _lambda_pos, NLPMatrix &_H) const;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef __OBSTACLEGRID_H__
+#define __OBSTACLEGRID_H__
+
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "react_controller/react_control_utils.h"
+
+/**
+ * Uniform grid over a set of obstacles, used to cull the obstacles that are
+ * too far from the arm before computing any collision point. Obstacles are
+ * binned by the cell their center falls into, and queried with a set of
+ * segments (i.e. the links of the arm) inflated by a distance.
+ */
+class ObstacleGrid
+{
+private:
+    std::vector<Obstacle> obstacles;
+
+    double cell_size;   // Side of a cell [m]
+    double  max_size;   // Size of the biggest obstacle [m]
+
+    // Obstacle indices, sorted by cell, and the range of each (non-empty) cell in it
+    std::vector<size_t>                                         sorted;
+    std::unordered_map<int64_t, std::pair<size_t, size_t> >     cells;
+
+    /**
+     * Computes the integer coordinates of the cell a point falls into.
+     */
+    void toCell(const Eigen::Vector3d &_p, int64_t &_ix, int64_t &_iy, int64_t &_iz) const;
+
+    /**
+     * Packs the integer coordinates of a cell into a single key.
+     */
+    static int64_t toKey(int64_t _ix, int64_t _iy, int64_t _iz);
+
+public:
+    /**
+     * Constructors.
+     *
+     * @param _obstacles the obstacles to index
+     * @param _cell_size the side of a cell [m]. Queries are fastest when it is
+     *                   in the order of the query distance.
+     */
+    ObstacleGrid(double _cell_size = ACTIVATION_DIST);
+    explicit ObstacleGrid(const std::vector<Obstacle> &_obstacles,
+                          double _cell_size = ACTIVATION_DIST);
+
+    /**
+     * (Re)builds the grid from a set of obstacles.
+     *
+     * @param _obstacles the obstacles to index
+     */
+    void build(const std::vector<Obstacle> &_obstacles);
+
+    /**
+     * (Re)builds the grid from a set of obstacles, taking ownership of them
+     * rather than copying them.
+     *
+     * @param _obstacles the obstacles to index
+     */
+    void build(std::vector<Obstacle> &&_obstacles);
+
+    /**
+     * Finds the obstacles whose surface is within a given distance from
+     * any of a set of segments.
+     *
+     * @param  _segments the segments as (base, tip) pairs, in the world reference frame
+     * @param  _dist     the distance [m]
+     * @return           the indices of the obstacles, in ascending order
+     */
+    std::vector<size_t> query(const std::vector<std::pair<Eigen::Vector3d,
+                                                          Eigen::Vector3d> > &_segments,
+                              double _dist) const;
+
+    const std::vector<Obstacle>& getObstacles() const { return obstacles; };
+    const Obstacle& getObstacle(size_t _i)      const { return obstacles[_i]; };
+
+    size_t getNrOfObstacles() const { return obstacles.size(); };
+    size_t getNrOfCells()     const { return     cells.size(); };
+
+    ~ObstacleGrid();
+};
+
+#endif
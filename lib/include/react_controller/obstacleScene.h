@@ -0,0 +1,156 @@
+#ifndef __OBSTACLESCENE_H__
+#define __OBSTACLESCENE_H__
+
+#include <vector>
+
+#include "react_controller/react_control_utils.h"
+#include "react_controller/mappedFile.h"
+
+/**
+ * Primitives of an obstacle scene, as stored in the scene file. Coordinates
+ * are in the base frame [m], in single precision to keep the files compact.
+ */
+struct SceneSphere
+{
+    float c[3];     // center
+    float r;        // radius
+};
+
+struct SceneCapsule
+{
+    float a[3];     // first  end of the axis
+    float b[3];     // second end of the axis
+    float r;        // radius
+    float pad;      // unused, keeps the records 8-byte aligned
+};
+
+struct SceneBox
+{
+    float c[3];     // center
+    float h[3];     // half extents along the axes of the box
+    float q[4];     // orientation of the box as a quaternion (x, y, z, w)
+};
+
+/**
+ * Header of an obstacle scene file. The file is made of this header, followed
+ * by the spheres, the capsules and the boxes, with no gaps in between. Values
+ * are stored with the byte order of the machine the scene was saved on.
+ */
+struct ObstacleSceneHeader
+{
+    char     magic[8];      // "BRCSCN" (null terminated)
+    uint32_t version;       // version of the file format
+    uint32_t n_spheres;     // number of spheres
+    uint32_t n_capsules;    // number of capsules
+    uint32_t n_boxes;       // number of boxes
+};
+
+/**
+ * A scene of static obstacles made of spheres, capsules and boxes. Scenes are
+ * converted once from the parameter server (see fromParam) and saved to a binary
+ * file, which is then memory-mapped rather than parsed, so that loading a scene
+ * with tens of thousands of primitives takes about as long as reading them.
+ */
+class ObstacleScene
+{
+private:
+    ObstacleSceneHeader header;
+
+    // Primitives, if the scene was built in memory
+    std::vector<SceneSphere>   sphere_buf;
+    std::vector<SceneCapsule> capsule_buf;
+    std::vector<SceneBox>         box_buf;
+
+    MappedFile file;    // Primitives, if the scene was loaded from file
+
+    // Point to either of the two (NULL if empty)
+    const SceneSphere*   spheres;
+    const SceneCapsule* capsules;
+    const SceneBox*        boxes;
+
+    bool loaded;        // True if the scene has been built or loaded
+
+    /**
+     * Points the primitives to the buffers.
+     */
+    void fromBuffers();
+
+    // Scenes can not be copied
+    ObstacleScene(const ObstacleScene&);
+    ObstacleScene& operator=(const ObstacleScene&);
+
+public:
+    ObstacleScene();
+
+    /**
+     * Builds the scene from its primitives.
+     *
+     * @param  _spheres  the spheres
+     * @param  _capsules the capsules
+     * @param  _boxes    the boxes
+     * @return           true/false if success/failure (i.e. any negative size)
+     */
+    bool build(const std::vector<SceneSphere>  &_spheres,
+               const std::vector<SceneCapsule> &_capsules,
+               const std::vector<SceneBox>     &_boxes);
+
+    /**
+     * Builds the scene from the parameter server. The parameter is either a list
+     * of spheres as [x, y, z, size] (i.e. the format of the obstacles of the
+     * controller), or a dictionary with any of these lists:
+     *  - spheres:  [x, y, z, radius]
+     *  - capsules: [ax, ay, az, bx, by, bz, radius]
+     *  - boxes:    [x, y, z, hx, hy, hz] or [x, y, z, hx, hy, hz, qx, qy, qz, qw],
+     *              with half extents and an optional orientation
+     * Unlike readFromParamServer, malformed entries are reported, not asserted.
+     *
+     * @param  _param the parameter
+     * @return        true/false if success/failure
+     */
+    bool fromParam(XmlRpc::XmlRpcValue &_param);
+
+    /**
+     * Saves the scene to file.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure
+     */
+    bool save(const std::string &_path) const;
+
+    /**
+     * Loads a scene from file. The file is memory-mapped, not read, and it
+     * has to be replaced (e.g. renamed over) rather than rewritten in place
+     * while it is loaded.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure. The scene is empty on failure.
+     */
+    bool load(const std::string &_path);
+
+    /**
+     * Converts the scene into spherical obstacles, as the obstacle grid expects.
+     * Spheres are converted as they are, while capsules and boxes are covered by
+     * spheres, i.e. every point of the primitive is within one of the spheres.
+     * Capsules take spheres along their axis, one every radius, and boxes are
+     * split into cells up to _spacing wide, with one sphere per cell.
+     *
+     * @param  _obstacles the obstacles (cleared first)
+     * @param  _spacing   the largest cell of the boxes [m]
+     * @return            the number of obstacles
+     */
+    size_t toObstacles(std::vector<Obstacle> &_obstacles, double _spacing = 0.05) const;
+
+    bool isLoaded() const { return loaded; };
+
+    size_t getNrOfSpheres()  const { return  header.n_spheres; };
+    size_t getNrOfCapsules() const { return header.n_capsules; };
+    size_t getNrOfBoxes()    const { return    header.n_boxes; };
+
+    const SceneSphere&   getSphere(size_t _i)  const { return  spheres[_i]; };
+    const SceneCapsule&  getCapsule(size_t _i) const { return capsules[_i]; };
+    const SceneBox&      getBox(size_t _i)     const { return    boxes[_i]; };
+
+    ~ObstacleScene();
+};
+
+#endif
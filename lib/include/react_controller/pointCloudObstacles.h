@@ -0,0 +1,111 @@
+#ifndef __POINTCLOUDOBSTACLES_H__
+#define __POINTCLOUDOBSTACLES_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include "react_controller/react_control_utils.h"
+
+/**
+ * Converts point clouds into obstacles: points are binned into voxels, and
+ * every occupied voxel becomes a sphere centered in the centroid of its points
+ * (and big enough to contain the voxel). Buffers are allocated once, when the
+ * limits are set, so that processing a cloud never allocates memory per point.
+ *
+ * Processing is bounded in two ways: clouds bigger than max_points are
+ * subsampled with a constant stride, and points are no longer read once
+ * max_time has elapsed. Only the max_obstacles most populated voxels are kept.
+ */
+class PointCloudObstacles
+{
+private:
+    struct VoxelPoint
+    {
+        uint64_t  key;      // packed coordinates of the voxel
+        float   x, y, z;    // point in the world reference frame
+
+        bool operator<(const VoxelPoint &_v) const { return key < _v.key; };
+    };
+
+    struct Voxel
+    {
+        uint32_t        count;  // number of points in the voxel
+        Eigen::Vector3d   sum;  // sum of the points in the voxel
+    };
+
+    double    voxel_size;   // Side of a voxel [m]
+    size_t    max_points;   // Maximum number of points read per cloud
+    size_t max_obstacles;   // Maximum number of obstacles per cloud
+    double      max_time;   // Maximum processing time per cloud [s]
+
+    Eigen::Matrix3d R;      // Rotation    from the cloud frame to the world reference frame
+    Eigen::Vector3d p;      // Translation from the cloud frame to the world reference frame
+
+    std::vector<VoxelPoint> points;     // preallocated to max_points
+    std::vector<Voxel>      voxels;     // preallocated to max_points
+
+    // Statistics of the last processed cloud
+    size_t n_read;          // number of points read
+    size_t n_voxels;        // number of occupied voxels
+    bool   truncated;       // true if max_time was hit
+    double proc_time;       // processing time [s]
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param _voxel_size    the side of a voxel [m]
+     * @param _max_points    the maximum number of points read per cloud
+     * @param _max_obstacles the maximum number of obstacles per cloud
+     * @param _max_time      the maximum processing time per cloud [s]
+     */
+    PointCloudObstacles(double _voxel_size = 0.05, size_t _max_points = 50000,
+                        size_t _max_obstacles = 500, double _max_time = 0.005);
+
+    /**
+     * Sets the limits of the processing, and (re)allocates the buffers.
+     */
+    void set_limits(double _voxel_size, size_t _max_points,
+                    size_t _max_obstacles, double _max_time);
+
+    /**
+     * Sets the transform from the frame of the clouds to the world reference
+     * frame. By default, clouds are assumed to be in the world reference frame.
+     */
+    void set_transform(const Eigen::Matrix4d &_H);
+
+    /**
+     * Converts a point cloud into obstacles. The cloud needs x, y and z
+     * fields of type FLOAT32; non-finite points are skipped.
+     *
+     * @param  _cloud     the point cloud
+     * @param  _obstacles the obstacles in the world reference frame (cleared first)
+     * @return            true/false if success/failure
+     */
+    bool process(const sensor_msgs::PointCloud2 &_cloud, std::vector<Obstacle> &_obstacles);
+
+    size_t getNrOfRead()     const { return    n_read; };
+    size_t getNrOfVoxels()   const { return  n_voxels; };
+    bool   isTruncated()     const { return truncated; };
+    double getProcTime()     const { return proc_time; };
+
+    ~PointCloudObstacles();
+};
+
+/**
+ * Fills a point cloud with points sampled on the surface of a set of spheres,
+ * with xyz FLOAT32 fields. Meant to test the point cloud pipeline without a
+ * real sensor.
+ *
+ * @param _cloud    the point cloud (header excluded)
+ * @param _spheres  the spheres to sample
+ * @param _n_points the number of points per sphere
+ * @param _noise    the standard deviation of the gaussian noise on every point [m]
+ * @param _seed     the seed of the random generator
+ */
+void syntheticPointCloud(sensor_msgs::PointCloud2 &_cloud, const std::vector<Obstacle> &_spheres,
+                         size_t _n_points, double _noise = 0.0, unsigned int _seed = 1);
+
+#endif
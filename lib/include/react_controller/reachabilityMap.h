@@ -0,0 +1,119 @@
+#ifndef __REACHABILITYMAP_H__
+#define __REACHABILITYMAP_H__
+
+#include <vector>
+
+#include "react_controller/baxterChain.h"
+#include "react_controller/mappedFile.h"
+
+/**
+ * Header of a reachability map file. The file is made of this header,
+ * followed by one bit per voxel (1 if reachable), with voxels ordered
+ * x first, then y, then z, i.e. idx = (iz*ny + iy)*nx + ix. Values are
+ * stored with the byte order of the machine the map was built on.
+ */
+struct ReachabilityMapHeader
+{
+    char     magic[8];      // "BRCRMAP" (null terminated)
+    uint32_t version;       // version of the file format
+    uint32_t nx, ny, nz;    // number of voxels along each axis
+    double   resolution;    // side of a voxel [m]
+    double   origin[3];     // position of the corner of voxel (0,0,0) in the base frame [m]
+    uint64_t n_samples;     // number of FK samples the map was built from
+    uint64_t n_reachable;   // number of reachable voxels
+};
+
+/**
+ * Voxelized map of the positions the end-effector of a chain can reach,
+ * built offline by sampling the forward kinematics within the joint limits.
+ * It is meant as a cheap prefilter for targets the IK can not reach.
+ */
+class ReachabilityMap
+{
+private:
+    ReachabilityMapHeader header;
+
+    std::vector<uint8_t> buffer;  // voxels, if the map was built in memory
+    MappedFile             file;  // voxels, if the map was loaded from file
+    const uint8_t*       voxels;  // points to either of the two (NULL if empty)
+
+    /**
+     * Computes the voxel a point falls in.
+     *
+     * @param  _p   the 3D point in the base frame
+     * @param  _idx the (linear) index of the voxel
+     * @return      true if the point is within the map, false otherwise
+     */
+    bool toIndex(const Eigen::Vector3d &_p, size_t &_idx) const;
+
+    // Maps can not be copied
+    ReachabilityMap(const ReachabilityMap&);
+    ReachabilityMap& operator=(const ReachabilityMap&);
+
+public:
+    ReachabilityMap();
+
+    /**
+     * Builds the map by sampling joint configurations uniformly within the
+     * joint limits, and marking the voxels the end-effector falls into.
+     * The result is dilated to fill the holes left by the sampling, so that
+     * the map overestimates (rather than underestimates) the workspace.
+     *
+     * @param  _chain      the chain to build the map for
+     * @param  _resolution the side of a voxel [m]
+     * @param  _n_samples  the number of joint configurations to sample
+     * @param  _dilate     the number of dilation steps
+     * @param  _seed       the seed of the random generator
+     * @return             true/false if success/failure
+     */
+    bool build(BaxterChain _chain, double _resolution, size_t _n_samples,
+               int _dilate = 1, unsigned int _seed = 1);
+
+    /**
+     * Saves the map to file.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure
+     */
+    bool save(const std::string &_path) const;
+
+    /**
+     * Loads a map from file. The file is memory-mapped, not read.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure
+     */
+    bool load(const std::string &_path);
+
+    bool isLoaded() const { return voxels != NULL; };
+
+    /**
+     * Checks if a point is reachable, i.e. it falls in a reachable voxel.
+     *
+     * @param  _p the 3D point in the base frame
+     * @return    true/false if reachable/unreachable
+     */
+    bool isReachable(const Eigen::Vector3d &_p) const;
+
+    /**
+     * Projects a target onto a step the end-effector can take: the target is
+     * moved towards the current position until it is no farther than _max_step,
+     * and then until it falls into a reachable voxel.
+     *
+     * @param  _p_0      the current position of the end-effector
+     * @param  _p_r      the target position
+     * @param  _max_step the maximum displacement of a single step [m]
+     * @param  _p_s      the projected target
+     * @return           true if a reachable step was found, false otherwise
+     */
+    bool projectStep(const Eigen::Vector3d &_p_0, const Eigen::Vector3d &_p_r,
+                     double _max_step, Eigen::Vector3d &_p_s) const;
+
+    double getResolution()    const { return header.resolution; };
+    size_t getNrOfVoxels()    const { return size_t(header.nx) * header.ny * header.nz; };
+    size_t getNrOfReachable() const { return header.n_reachable; };
+
+    ~ReachabilityMap();
+};
+
+#endif
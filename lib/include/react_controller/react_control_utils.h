@@ -20,6 +20,9 @@
 #define RAD2DEG (180.0 /  M_PI)
 #define DEG2RAD ( M_PI / 180.0)
 
+// Distance [m] beyond which obstacles do not activate the avoidance
+#define ACTIVATION_DIST 0.5
+
 /**
  * [cross description]
  * @param  A    [description]
@@ -43,7 +46,17 @@ Eigen::Matrix3d skew(const Eigen::Vector3d &w);
  * @param _f KDL::Frame to turn into a pose Eigen::Matrix
  * return    Eigen 4X4 pose matrix
 */
-Eigen::Matrix4d toMatrix4d(KDL::Frame _f);
+Eigen::Matrix4d toMatrix4d(const KDL::Frame &_f);
+
+/**
+ * Takes a KDL::Frame and returns it as a rigid transform. Prefer it to
+ * toMatrix4d when the transform is going to be inverted or composed, since
+ * Eigen::Isometry3d knows that its inverse is just a transpose.
+ *
+ * @param  _f KDL::Frame to convert
+ * @return    the rigid transform
+ */
+Eigen::Isometry3d toIsometry3d(const KDL::Frame &_f);
 
 /**
  * Computes the angular error between two rotation matrices.
@@ -68,13 +81,52 @@ Eigen::Vector3d angularError(const Eigen::Matrix3d& _a, const Eigen::Matrix3d& _
 Eigen::Vector3d angularError(const Eigen::Quaterniond& _a, const Eigen::Quaterniond& _b);
 
 /**
- * TODO documentation
- * @param  orig      [description]
- * @param  transform [description]
- * @param  new_pt    [description]
- * @return           [description]
+ * Computes the orientation error between two unit quaternions, together with its
+ * derivative. The error is 2 * vec(_r * _e^-1), with the sign of the quaternion
+ * picked so that its scalar part is positive: it is the axis of the rotation from
+ * _e to _r scaled by 2*sin(angle/2), so it differs from angularError(Matrix3d) by
+ * less than angle^3/24, it is null only if the orientations match, and it needs
+ * neither trigonometric functions nor an eigen-decomposition.
+ *
+ * @param  _r The reference orientation
+ * @param  _e The estimated orientation
+ * @param  _J The derivative of the error with respect to the angular velocity of _e
+ *            (in the base frame), i.e. -(|eta| I + S(err)/2) with eta the scalar
+ *            part of _r * _e^-1
+ * @return    the orientation error
  */
-bool changeFoR(const Eigen::Vector3d orig, const Eigen::Matrix4d transform, Eigen::Vector3d &new_pt);
+Eigen::Vector3d orientationError(const Eigen::Quaterniond& _r, const Eigen::Quaterniond& _e,
+                                 Eigen::Matrix3d& _J);
+Eigen::Vector3d orientationError(const Eigen::Quaterniond& _r, const Eigen::Quaterniond& _e);
+
+/**
+ * Computes the orientation error (see orientationError) of _0 rotated by an
+ * angular increment _inc (in the base frame), i.e. of exp(_inc) * _0, together
+ * with its derivative with respect to the increment. The latter is the derivative
+ * with respect to the angular velocity of the rotated orientation, times the left
+ * Jacobian of the exponential map of SO(3) at _inc (which is I at rest).
+ *
+ * @param  _r   The reference orientation
+ * @param  _0   The initial orientation
+ * @param  _inc The angular increment (axis times angle)
+ * @param  _J   The derivative of the error with respect to _inc
+ * @return      the orientation error
+ */
+Eigen::Vector3d incrementOrientationError(const Eigen::Quaterniond& _r, const Eigen::Quaterniond& _0,
+                                          const Eigen::Vector3d& _inc, Eigen::Matrix3d& _J);
+
+/**
+ * Expresses a point in the frame of reference of a rigid transform, i.e. it
+ * computes transform^-1 * orig. The transform is assumed to be rigid, so it
+ * is inverted by transposing its rotation rather than by a general inverse.
+ *
+ * @param  orig      the point, in the frame the transform is expressed in
+ * @param  transform the (rigid) transform of the new frame of reference
+ * @param  new_pt    the point, in the new frame of reference
+ * @return           true/false if success/failure
+ */
+bool changeFoR(const Eigen::Vector3d &orig, const Eigen::Matrix4d   &transform, Eigen::Vector3d &new_pt);
+bool changeFoR(const Eigen::Vector3d &orig, const Eigen::Isometry3d &transform, Eigen::Vector3d &new_pt);
 
 /**
  * Takes a 4x4 Eigen matrix and converts it to a KDL Frame.
@@ -82,7 +134,15 @@ bool changeFoR(const Eigen::Vector3d orig, const Eigen::Matrix4d transform, Eige
  * @param  mat          4d matrix to convert
  * @return              KDL Frame of converted matrix
  */
-KDL::Frame toKDLFrame(Eigen::Matrix4d mat);
+KDL::Frame toKDLFrame(const Eigen::Matrix4d &mat);
+
+/**
+ * Takes a rigid transform and converts it to a KDL Frame.
+ *
+ * @param  H the rigid transform to convert
+ * @return   KDL Frame of converted transform
+ */
+KDL::Frame toKDLFrame(const Eigen::Isometry3d &H);
 
 /**
  * TODO documentation
@@ -100,6 +160,27 @@ Eigen::VectorXd stdToEigen(std::vector<double> vec);
  */
 Eigen::Vector3d projectOntoSegment(Eigen::Vector3d base, Eigen::Vector3d tip, Eigen::Vector3d point);
 
+/**
+ * Computes the distance between a 3D point and a segment composed of base and tip.
+ * Contrarily to projectOntoSegment, the projection is clamped to the segment.
+ *
+ * @param  base  the base of the segment
+ * @param  tip   the  tip of the segment
+ * @param  point the point to compute the distance from
+ * @return       the distance between the point and the segment
+ */
+double distanceToSegment(const Eigen::Vector3d &base, const Eigen::Vector3d &tip,
+                         const Eigen::Vector3d &point);
+
+/**
+ * Computes the activation level (magnitude) of a collision point, i.e. a
+ * sigmoid that is 1 at contact and vanishes at ACTIVATION_DIST.
+ *
+ * @param  dist the distance between the obstacle and the robot [m]
+ * @return      the magnitude, in [0, 1]
+ */
+double distanceToMagnitude(double dist);
+
 /**
  * TODO documentation
  */
@@ -117,15 +198,29 @@ struct CollisionPoint
     Eigen::Vector3d o_wrf; // position (x,y,z) of the obstacle in the world reference frame
 };
 
+/**
+ * A linear constraint on the joint velocities v of a chain, i.e. a.v >= lb, which
+ * only involves the first a.size() joints (e.g. the ones that move a collision point)
+ */
+struct VelocityConstraint
+{
+    Eigen::VectorXd a; // coefficients of the first joints
+    double         lb; // lower bound
+
+    VelocityConstraint() : lb(0.0) {};
+};
+
 struct Obstacle
 {
     double size;           // size (in meters) of a sphere that approximates the obstacle
     Eigen::Vector3d x_wrf; // position (x,y,z) in the world reference frame
+    int               id;  // persistent ID of the obstacle across updates (-1 if unknown)
 
     /**
-     * Constructor that assigns a size and position to the obstacle
+     * Constructor that assigns a size, position and (optionally) an ID to the obstacle
      */
-    Obstacle(double _size, Eigen::Vector3d _x_wrf) : size(_size), x_wrf(_x_wrf) {};
+    Obstacle(double _size, Eigen::Vector3d _x_wrf, int _id = -1) :
+             size(_size), x_wrf(_x_wrf), id(_id) {};
 };
 
 /**
@@ -0,0 +1,164 @@
+#ifndef __SIGNEDDISTANCEFIELD_H__
+#define __SIGNEDDISTANCEFIELD_H__
+
+#include <vector>
+
+#include "react_controller/react_control_utils.h"
+#include "react_controller/mappedFile.h"
+
+/**
+ * Header of a signed distance field file. The file is made of this header,
+ * followed by one float per grid vertex (the signed distance in meters), with
+ * vertices ordered x first, then y, then z, i.e. idx = (iz*ny + iy)*nx + ix.
+ * Values are stored with the byte order of the machine the field was built on.
+ */
+struct SignedDistanceFieldHeader
+{
+    char     magic[8];      // "BRCSDF" (null terminated)
+    uint32_t version;       // version of the file format
+    uint32_t nx, ny, nz;    // number of vertices along each axis
+    double   resolution;    // distance between two neighboring vertices [m]
+    double   origin[3];     // position of vertex (0,0,0) in the base frame [m]
+    double   max_dist;      // distances are truncated to this value [m]
+    uint64_t n_obstacles;   // number of obstacles the field was built from
+};
+
+/**
+ * Signed distance field of a set of static obstacles, sampled on a regular grid
+ * and built once (offline, or at startup). Distances and their gradients are
+ * trilinearly interpolated between the vertices of the grid, so that the cost of
+ * a lookup does not depend on how many obstacles the field was built from.
+ */
+class SignedDistanceField
+{
+private:
+    SignedDistanceFieldHeader header;
+
+    std::vector<float> buffer;  // distances, if the field was built in memory
+    MappedFile           file;  // distances, if the field was loaded from file
+    const float*       values;  // points to either of the two (NULL if empty)
+
+    /**
+     * Computes the cell a point falls in, i.e. the index of its lowest vertex
+     * and the position of the point within the cell (in [0, 1] along every axis).
+     *
+     * @param  _p   the 3D point in the base frame
+     * @param  _idx the (linear) index of the lowest vertex of the cell
+     * @param  _f   the position of the point within the cell
+     * @return      true if the point is within the field, false otherwise
+     */
+    bool toCell(const Eigen::Vector3d &_p, size_t &_idx, Eigen::Vector3d &_f) const;
+
+    // Fields can not be copied
+    SignedDistanceField(const SignedDistanceField&);
+    SignedDistanceField& operator=(const SignedDistanceField&);
+
+public:
+    SignedDistanceField();
+
+    /**
+     * Builds the field from a set of obstacles. The grid covers the obstacles,
+     * plus _max_dist on every side, so that any point outside of the grid is
+     * farther than _max_dist from every obstacle.
+     *
+     * @param  _obstacles  the obstacles in the base frame
+     * @param  _resolution the distance between two neighboring vertices [m]
+     * @param  _max_dist   the distance the field is truncated to [m]
+     * @return             true/false if success/failure
+     */
+    bool build(const std::vector<Obstacle> &_obstacles, double _resolution,
+               double _max_dist = ACTIVATION_DIST);
+
+    /**
+     * Saves the field to file.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure
+     */
+    bool save(const std::string &_path) const;
+
+    /**
+     * Loads a field from file. The file is memory-mapped, not read.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure
+     */
+    bool load(const std::string &_path);
+
+    bool isLoaded() const { return values != NULL; };
+
+    /**
+     * Interpolates the signed distance of a point from the obstacles.
+     *
+     * @param  _p the 3D point in the base frame
+     * @param  _d the signed distance [m] (negative if within an obstacle)
+     * @return    true if the point is within the field, false otherwise
+     *            (i.e. it is farther than getMaxDistance() from every obstacle)
+     */
+    bool distance(const Eigen::Vector3d &_p, double &_d) const;
+
+    /**
+     * Interpolates the signed distance of a point from the obstacles, and its
+     * gradient (i.e. the direction that moves the point away from the obstacles).
+     *
+     * @param  _p    the 3D point in the base frame
+     * @param  _d    the signed distance [m] (negative if within an obstacle)
+     * @param  _grad the gradient of the distance (not normalized)
+     * @return       true if the point is within the field, false otherwise
+     */
+    bool distance(const Eigen::Vector3d &_p, double &_d, Eigen::Vector3d &_grad) const;
+
+    /**
+     * Finds the point of a segment that is closest to the obstacles, by sampling
+     * the segment every half a vertex spacing.
+     *
+     * @param  _a    the first  end of the segment
+     * @param  _b    the second end of the segment
+     * @param  _x    the closest point on the segment
+     * @param  _d    the signed distance of _x from the obstacles [m]
+     * @param  _grad the gradient of the distance at _x (not normalized)
+     * @return       true if any point of the segment is closer than
+     *               getMaxDistance() to the obstacles, false otherwise
+     */
+    bool closestPoint(const Eigen::Vector3d &_a, const Eigen::Vector3d &_b,
+                      Eigen::Vector3d &_x, double &_d, Eigen::Vector3d &_grad) const;
+
+    /**
+     * Same as above, but also returns where the closest point is along the
+     * segment, to seed the local search at the next update (see closestPointLocal).
+     *
+     * @param  _t the position of _x along the segment, in [0, 1]
+     */
+    bool closestPoint(const Eigen::Vector3d &_a, const Eigen::Vector3d &_b,
+                      Eigen::Vector3d &_x, double &_d, Eigen::Vector3d &_grad,
+                      double &_t) const;
+
+    /**
+     * Finds the point of a segment that is closest to the obstacles, by walking
+     * along the segment from a seed (with the same sampling as closestPoint) as
+     * long as the distance decreases. The result is a local minimum, i.e. it is
+     * the closest point only if the seed comes from a full search of a segment
+     * that has not moved much since.
+     *
+     * @param  _a    the first  end of the segment
+     * @param  _b    the second end of the segment
+     * @param  _t    the position of the seed along the segment, in [0, 1] (in),
+     *               and the position of the closest point (out)
+     * @param  _x    the closest point on the segment
+     * @param  _d    the signed distance of _x from the obstacles [m]
+     * @param  _grad the gradient of the distance at _x (not normalized)
+     * @return       true if the closest point is closer than getMaxDistance()
+     *               to the obstacles, false otherwise
+     */
+    bool closestPointLocal(const Eigen::Vector3d &_a, const Eigen::Vector3d &_b, double &_t,
+                           Eigen::Vector3d &_x, double &_d, Eigen::Vector3d &_grad) const;
+
+    double getResolution()    const { return header.resolution; };
+    double getMaxDistance()   const { return header.max_dist; };
+    size_t getNrOfVertices()  const { return size_t(header.nx) * header.ny * header.nz; };
+    size_t getNrOfObstacles() const { return header.n_obstacles; };
+
+    ~SignedDistanceField();
+};
+
+#endif
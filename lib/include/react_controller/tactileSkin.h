@@ -0,0 +1,103 @@
+#ifndef __TACTILESKIN_H__
+#define __TACTILESKIN_H__
+
+#include <vector>
+
+#include "react_controller/react_control_utils.h"
+
+/**
+ * A taxel of the skin, i.e. a single tactile sensor. Positions and normals are
+ * expressed in the frame of the link the taxel is on, that is the frame of the
+ * tip of capsule _link (BaxterChain::getH(link+1), see AvoidanceHandler).
+ */
+struct Taxel
+{
+    uint32_t           id;  // ID of the taxel, as in the activations of the skin
+    size_t           link;  // index of the link the taxel is on
+    size_t          patch;  // index of the patch the taxel belongs to (unique across links)
+    Eigen::Vector3d   pos;  // position of the taxel in the link frame [m]
+    Eigen::Vector3d normal; // outward normal of the taxel in the link frame
+
+    Taxel(uint32_t _id, size_t _link, size_t _patch,
+          const Eigen::Vector3d &_pos, const Eigen::Vector3d &_normal) :
+          id(_id), link(_link), patch(_patch), pos(_pos), normal(_normal) {};
+};
+
+/**
+ * A contact on the skin, i.e. the activations of a patch aggregated into a single
+ * control point. Position and normal are expressed in the frame of the link.
+ */
+struct TactileContact
+{
+    size_t            link;  // index of the link the contact is on
+    Eigen::Vector3d  x_erf;  // activation-weighted position of the contact [m]
+    Eigen::Vector3d  n_erf;  // activation-weighted outward normal of the contact
+    double             mag;  // magnitude of the contact, i.e. the highest activation in [0, 1]
+    size_t        n_taxels;  // number of active taxels
+};
+
+/**
+ * Converts the activations of a tactile skin into a few control points. Taxels
+ * are mapped from their ID to their link-local position and normal through a
+ * table built once, and stored patch by patch as a structure of arrays, so that
+ * the activations of every patch are reduced with vectorized Eigen expressions.
+ */
+class TactileSkin
+{
+private:
+    std::vector<int64_t> rows;  // row of the table of every taxel ID (-1 if unknown)
+
+    Eigen::ArrayXd px, py, pz;  // positions of the taxels, sorted by patch [m]
+    Eigen::ArrayXd nx, ny, nz;  // normals of the taxels, sorted by patch
+    Eigen::ArrayXd        act;  // activations of the taxels, sorted by patch
+
+    std::vector<size_t> patch_begin;  // first row of every patch (plus the end of the table)
+    std::vector<size_t> patch_link;   // link of every patch
+
+    double threshold;   // activations up to the threshold are ignored
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param _threshold the activation below which taxels are considered inactive
+     */
+    explicit TactileSkin(double _threshold = 0.05);
+
+    /**
+     * Builds the table of the taxels.
+     *
+     * @param  _taxels the taxels (IDs have to be unique)
+     * @return         true/false if success/failure
+     */
+    bool build(const std::vector<Taxel> &_taxels);
+
+    /**
+     * Loads the table of the taxels from a text file, with one taxel per line
+     * as "id link patch x y z nx ny nz". Lines starting with # are skipped.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure
+     */
+    bool load(const std::string &_path);
+
+    /**
+     * Aggregates a frame of activations into one contact per active patch.
+     * Activations are clamped to [0, 1], and unknown IDs are skipped.
+     *
+     * @param  _ids         the IDs of the taxels
+     * @param  _activations the activations of the taxels, in the same order
+     * @param  _n           the number of activations
+     * @param  _contacts    the contacts (cleared first)
+     * @return              the number of activations with a known ID
+     */
+    size_t aggregate(const uint32_t *_ids, const float *_activations, size_t _n,
+                     std::vector<TactileContact> &_contacts);
+
+    void set_threshold(double _threshold) { threshold = _threshold; };
+
+    size_t getNrOfTaxels()  const { return act.size(); };
+    size_t getNrOfPatches() const { return patch_link.size(); };
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * Pool of worker threads for the data-parallel loops of the control cycle.
+ * Threads are created once, and then woken up for every loop. Items are handed
+ * out in chunks from a shared counter, so that threads that finish early keep
+ * taking work from the others until the loop is over (as in BatchIKSolver).
+ * The calling thread takes part in the loop as thread 0.
+ */
+class ThreadPool
+{
+private:
+    std::vector<std::thread> threads;   // Worker threads (the calling thread excluded)
+
+    std::mutex                  mtx;    // Mutex to protect the state of the loop
+    std::condition_variable cv_start;   // Signals the workers that a loop has started
+    std::condition_variable  cv_done;   // Signals the caller that the workers are done
+
+    const std::function<void(size_t, size_t)> *job;  // Body of the current loop
+    size_t                                  n_items;  // Number of items of the current loop
+    size_t                                    chunk;  // Number of items taken at a time
+    std::atomic<size_t>                        next;  // Next item to be taken
+
+    size_t generation;  // Number of loops started so far
+    size_t     n_busy;  // Number of workers still busy on the current loop
+    bool         stop;  // True if the workers have to quit
+
+    /**
+     * Main loop of a worker thread.
+     *
+     * @param _id the index of the thread (from 1)
+     */
+    void worker(size_t _id);
+
+    /**
+     * Takes chunks of items until the loop is over.
+     *
+     * @param _id the index of the thread
+     */
+    void run(size_t _id);
+
+    // Pools can not be copied
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param _n_threads the number of threads, the calling one included
+     *                   (0 to use all the available cores, 1 to run every loop serially)
+     */
+    explicit ThreadPool(size_t _n_threads = 1);
+
+    /**
+     * Runs _fun(i, thread) for every i in [0, _n), and returns when they are all
+     * done. Items are processed in no particular order, so _fun must only write to
+     * outputs owned by item i, or to scratch buffers owned by the thread. Loops
+     * with no more than _chunk items are run serially by the calling thread.
+     *
+     * @param _n     the number of items
+     * @param _fun   the body of the loop
+     * @param _chunk the number of items a thread takes at a time
+     */
+    void parallelFor(size_t _n, const std::function<void(size_t, size_t)> &_fun,
+                     size_t _chunk = 1);
+
+    size_t getNrOfThreads() const { return threads.size() + 1; };
+
+    ~ThreadPool();
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __TRIPLEBUFFER_H__
+#define __TRIPLEBUFFER_H__
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Lock-free hand-over of the latest value from one writer thread (e.g. a ROS
+ * callback) to one reader thread (e.g. the control thread). The writer fills its
+ * back buffer and swaps it with a spare one, the reader swaps its front buffer
+ * with the spare one if the latter holds a value it has not read yet. Every swap
+ * is a single atomic exchange, so neither side ever waits for the other, and
+ * values that are overwritten before being read are simply dropped.
+ *
+ * It is meant for cheap to copy values, such as shared pointers to messages.
+ */
+template<typename T>
+class TripleBuffer
+{
+private:
+    // The index of the spare buffer is in the lower bits, and the flag
+    // that signals a value not read yet is in the FRESH bit
+    enum { INDEX = 3, FRESH = 4 };
+
+    T buffers[3];
+
+    std::atomic<uint8_t> spare; // Index of the spare buffer, plus the FRESH flag
+    uint8_t               back; // Index of the buffer owned by the writer
+    uint8_t              front; // Index of the buffer owned by the reader
+
+    // Buffers can not be copied
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer& operator=(const TripleBuffer&);
+
+public:
+    TripleBuffer() : spare(1), back(0), front(2) {};
+
+    /**
+     * Publishes a new value. Only to be called by the writer thread.
+     *
+     * @param _value the value
+     */
+    void write(const T &_value)
+    {
+        buffers[back] = _value;
+        back = spare.exchange(back | FRESH) & INDEX;
+    }
+
+    /**
+     * Gets the latest value, if there is any not read yet. Only to be called
+     * by the reader thread.
+     *
+     * @param  _value the latest value (untouched if there is none)
+     * @return        true if a new value was read, false otherwise
+     */
+    bool read(T &_value)
+    {
+        if ((spare.load() & FRESH) == 0)    { return false; }
+
+        front  = spare.exchange(front) & INDEX;
+        _value = buffers[front];
+
+        // The reader's copy is the only one that has to survive
+        buffers[front] = T();
+
+        return true;
+    }
+};
+
+#endif
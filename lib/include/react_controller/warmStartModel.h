@@ -0,0 +1,219 @@
+#ifndef __WARMSTARTMODEL_H__
+#define __WARMSTARTMODEL_H__
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <Eigen/Dense>
+
+/**
+ * A solve of the controller, as recorded in a warm start log: the problem
+ * (enough of it to solve it again offline) and its solution.
+ */
+struct WarmStartSample
+{
+    Eigen::VectorXd    q_0;     // start joint configuration [rad]
+    Eigen::VectorXd    v_0;     // start joint velocities [rad/s]
+    Eigen::Vector3d    p_0;     // start end-effector position [m]
+    Eigen::Vector3d    p_r;     // target position [m]
+    Eigen::Quaterniond o_r;     // target orientation
+    Eigen::MatrixXd  v_lim;     // velocity limits given to the NLP (min, max) [deg/s]
+    double              dt;     // dt of the NLP [s]
+    bool          ctrl_ori;     // true if the orientation was controlled
+    Eigen::VectorXd    v_e;     // solution [rad/s]
+    size_t         n_iters;     // number of IPOPT iterations of the solve
+
+    WarmStartSample() : p_0(Eigen::Vector3d::Zero()), p_r(Eigen::Vector3d::Zero()),
+                        o_r(Eigen::Quaterniond::Identity()), dt(0.0), ctrl_ori(false), n_iters(0) {};
+};
+
+/**
+ * Header of a warm start log. The file is made of this header, followed by the
+ * samples in the order they were recorded, each made of 5*n_joints + 13 doubles:
+ * q_0, v_0, p_0, p_r, o_r (w, x, y, z), v_lim (column-major), dt, ctrl_ori, v_e
+ * and n_iters. Values are stored with the byte order of the machine they were
+ * recorded on.
+ */
+struct WarmStartLogHeader
+{
+    char     magic[8];      // "BRCWSL" (null terminated)
+    uint32_t version;       // version of the file format
+    uint32_t n_joints;      // number of joints of the chain
+};
+
+/**
+ * Header of a warm start model file. The file is made of this header, followed
+ * by the normalization of the inputs (mean, then standard deviation) and of the
+ * outputs, and by the weights and biases of the hidden and of the output layer,
+ * as doubles (matrices are column-major).
+ */
+struct WarmStartModelHeader
+{
+    char     magic[8];      // "BRCWSM" (null terminated)
+    uint32_t version;       // version of the file format
+    uint32_t n_joints;      // number of joints of the chain
+    uint32_t n_hidden;      // number of hidden units
+    uint32_t pad;           // unused, keeps the header 8-byte aligned
+};
+
+/**
+ * Appends the samples of the controller to a warm start log, which is the
+ * training set of WarmStartModel (see train_warm_start).
+ */
+class WarmStartLog
+{
+private:
+    std::ofstream out;
+    size_t   n_joints;
+
+public:
+    WarmStartLog();
+
+    /**
+     * Opens a log for appending. A new (or empty) log is given a header, while the
+     * header of an existing one has to match.
+     *
+     * @param  _path     the path of the file
+     * @param  _n_joints the number of joints of the chain
+     * @return           true/false if success/failure
+     */
+    bool open(const std::string &_path, size_t _n_joints);
+
+    bool isOpen() const { return out.is_open(); };
+
+    /**
+     * Appends a sample to the log
+     *
+     * @param  _sample the sample
+     * @return         true/false if success/failure
+     */
+    bool append(const WarmStartSample &_sample);
+
+    void close();
+
+    /**
+     * Reads all the samples of a log.
+     *
+     * @param  _path    the path of the file
+     * @param  _samples the samples, in the order they were recorded
+     * @return          true/false if success/failure. A truncated last sample is dropped.
+     */
+    static bool read(const std::string &_path, std::vector<WarmStartSample> &_samples);
+
+    ~WarmStartLog();
+};
+
+/**
+ * Options of WarmStartModel::train
+ */
+struct WarmStartTraining
+{
+    size_t n_hidden;        // number of hidden units
+    size_t n_epochs;        // number of passes over the samples
+    size_t batch_size;      // number of samples per step
+    double learning_rate;   // step size of Adam
+    double weight_decay;    // L2 regularization of the weights
+    unsigned int seed;      // seed of the initialization and of the shuffling
+
+    WarmStartTraining() : n_hidden(32), n_epochs(200), batch_size(64),
+                          learning_rate(1e-3), weight_decay(1e-5), seed(0) {};
+};
+
+/**
+ * A tiny regression model of the solution of the NLP, used as the starting point
+ * of IPOPT (see ControllerNLP::set_warm_start). It maps the features of a problem,
+ * i.e. (q_0, p_r - p_0, v_0), to the change of the velocities v_e - v_0 through a
+ * multilayer perceptron with one hidden layer of tanh units. Inputs and outputs are
+ * normalized with the statistics of the training set. Predicting the change rather
+ * than v_e means that a model that knows nothing starts the solver from v_0, as
+ * without a model.
+ *
+ * Models are trained offline on the logs of the controller (see WarmStartLog and
+ * train_warm_start). A prediction takes about a microsecond for the arms of Baxter.
+ */
+class WarmStartModel
+{
+private:
+    size_t n_joints;
+    size_t n_hidden;
+
+    Eigen::VectorXd mu_x, sigma_x;  // normalization of the inputs
+    Eigen::VectorXd mu_y, sigma_y;  // normalization of the outputs
+
+    Eigen::MatrixXd W_1;    // weights of the hidden layer (n_hidden x n_inputs)
+    Eigen::VectorXd b_1;    // biases  of the hidden layer
+    Eigen::MatrixXd W_2;    // weights of the output layer (n_joints x n_hidden)
+    Eigen::VectorXd b_2;    // biases  of the output layer
+
+    bool loaded;            // True if the model has been trained or loaded
+
+    size_t getNrOfInputs() const { return 2 * n_joints + 3; };
+
+public:
+    WarmStartModel();
+
+    /**
+     * Features of a problem, i.e. the inputs of the model, as [q_0, p_r - p_0, v_0]
+     */
+    static Eigen::VectorXd toFeatures(const Eigen::VectorXd &_q_0, const Eigen::Vector3d &_p_0,
+                                      const Eigen::Vector3d &_p_r, const Eigen::VectorXd &_v_0);
+
+    /**
+     * Predicts the solution of a problem.
+     *
+     * @param  _q_0 the start joint configuration [rad]
+     * @param  _p_0 the start end-effector position [m]
+     * @param  _p_r the target position [m]
+     * @param  _v_0 the start joint velocities [rad/s]
+     * @param  _v_e the predicted solution [rad/s]
+     * @return      true/false if success/failure (i.e. no model, or wrong size)
+     */
+    bool predict(const Eigen::VectorXd &_q_0, const Eigen::Vector3d &_p_0,
+                 const Eigen::Vector3d &_p_r, const Eigen::VectorXd &_v_0,
+                 Eigen::VectorXd &_v_e) const;
+
+    /**
+     * Trains the model on some samples with Adam, minimizing the squared error of
+     * the normalized outputs. Any previous model is replaced.
+     *
+     * @param  _samples the samples (of the same number of joints)
+     * @param  _options the options of the training
+     * @return          true/false if success/failure
+     */
+    bool train(const std::vector<WarmStartSample> &_samples,
+               const WarmStartTraining &_options = WarmStartTraining());
+
+    /**
+     * Evaluates the model on some samples.
+     *
+     * @param  _samples the samples
+     * @return          the root mean squared error of the predicted velocities [rad/s]
+     */
+    double evaluate(const std::vector<WarmStartSample> &_samples) const;
+
+    /**
+     * Saves the model to file.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure
+     */
+    bool save(const std::string &_path) const;
+
+    /**
+     * Loads a model from file.
+     *
+     * @param  _path the path of the file
+     * @return       true/false if success/failure
+     */
+    bool load(const std::string &_path);
+
+    bool   isLoaded()       const { return loaded;   };
+    size_t getNrOfJoints()  const { return n_joints; };
+    size_t getNrOfHidden()  const { return n_hidden; };
+
+    ~WarmStartModel();
+};
+
+#endif
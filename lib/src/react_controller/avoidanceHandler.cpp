@@ -1,118 +1,704 @@
+#include <algorithm>
+
 #include "react_controller/avoidanceHandler.h"
 
 using namespace   std;
 using namespace Eigen;
 
+void AvoidanceStats::reset()
+{
+    n_updates    =   0;
+    n_recomputed =   0;
+    n_reused     =   0;
+    t_links      = 0.0;
+    t_query      = 0.0;
+    t_points     = 0.0;
+    t_self       = 0.0;
+    n_self_pairs =   0;
+    t_tactile    = 0.0;
+    n_remapped   =   0;
+    n_local      =   0;
+    t_total      = 0.0;
+}
+
+string AvoidanceStats::toString()
+{
+    double n = n_updates?double(n_updates):1.0;
+
+    return "updates " + std::to_string(n_updates) + " recomputed " + std::to_string(n_recomputed) +
+           " reused " + std::to_string(n_reused) + " remapped " + std::to_string(n_remapped) +
+           " local " + std::to_string(n_local) + " time/update [ms]: links " +
+           std::to_string(1e3*t_links/n) + " query " + std::to_string(1e3*t_query/n) +
+           " points " + std::to_string(1e3*t_points/n) + " self " + std::to_string(1e3*t_self/n) +
+           " (" + std::to_string(n_self_pairs/n) + " pairs) tactile " + std::to_string(1e3*t_tactile/n) +
+           " total " + std::to_string(1e3*t_total/n);
+}
+
+/****************************************************************/
+/****************************************************************/
+AvoidanceHandler::AvoidanceHandler(const BaxterChain &_chain,
+                                   const vector<double> &_radii,
+                                   const string _type) :
+                                   chain(_chain), radii(_radii), sdf(NULL), update_thres(0.005),
+                                   hysteresis(0.0),
+                                   type(_type), n_candidates(0), static_start(0), self_start(0),
+                                   tactile_start(0), pool(new ThreadPool(1))
+{
+    buildCustomChains();
+}
+
 AvoidanceHandler::AvoidanceHandler(const BaxterChain &_chain,
                                    const vector<Obstacle> &_obstacles,
                                    const string _type) :
-                                   chain(_chain), type(_type)
+                                   AvoidanceHandler(_chain, ObstacleGrid(_obstacles), _type)
+{
+
+}
+
+AvoidanceHandler::AvoidanceHandler(const BaxterChain &_chain,
+                                   const ObstacleGrid &_grid,
+                                   const string _type,
+                                   const vector<double> &_radii) :
+                                   AvoidanceHandler(_chain, _radii, _type)
+{
+    update(chain.getAng(), _grid);
+}
+
+void AvoidanceHandler::buildCustomChains()
 {
     // ROS_INFO_STREAM("Chain Angles: " << chain.getAng().transpose());
 
-    std::vector<BaxterChain>    tmpCC;  // temporary array of control chains
-    std::vector<CollisionPoint> tmpCP;  // temporary array of collision points
+    // Let's start by creating a custom chain with only one joint
+    BaxterChain customChain;
+
+    Eigen::VectorXd angles(1);
+    angles[0] = chain.getAng(0);
+
+    while (customChain.getNrOfJoints() == 0)
+    {
+        customChain.addSegment(chain.getSegment(customChain.getNrOfSegments()));
+    }
+
+    customChain.setAng(angles);
 
-    for (size_t i = 0; i < _obstacles.size(); ++i)
+    // This while loop incrementally creates bigger chains (up to the end-effector)
+    while (customChain.getNrOfSegments() < chain.getNrOfSegments())
     {
-        // Let's start by creating a custom chain with only one joint
-        BaxterChain customChain;
+        angles.conservativeResize(angles.rows()+1);
+        angles[angles.rows()-1] = chain.getAng(customChain.getNrOfJoints());
 
-        Eigen::VectorXd angles(1);
-        angles[0] = chain.getAng(0);
+        customChain.addSegment(chain.getSegment(customChain.getNrOfSegments()));
 
-        while (customChain.getNrOfJoints() == 0)
+        customChain.setAng(angles);
+
+        while (chain.getSegment(customChain.getNrOfSegments()).getJoint().getType() == KDL::Joint::None)
         {
+            if (customChain.getNrOfSegments()==chain.getNrOfSegments())  { break; };
+
             customChain.addSegment(chain.getSegment(customChain.getNrOfSegments()));
         }
 
-        customChain.setAng(angles);
+        // ROS_INFO_STREAM("Get Angles:  " << customChain.getAng().transpose());
+        // ROS_INFO_STREAM("Real Angles: " <<       chain.getAng().transpose());
 
-        // This while loop incrementally creates bigger chains (up to the end-effector)
-        while (customChain.getNrOfSegments() < _chain.getNrOfSegments())
+        customChains.push_back(customChain);
+    }
+
+    size_t n_links = customChains.size();
+
+    links.resize(n_links);
+    H    .resize(n_links);
+    caps .resize(n_links);
+
+    // The reference poses are far away, so that the first update refreshes them
+    Vector3d far = Vector3d::Constant(1e6);
+    links_ref .assign(n_links, std::make_pair(far, far));
+    links_disp.assign(n_links, 0.0);
+}
+
+void AvoidanceHandler::update(const VectorXd &_q, const ObstacleGrid &_grid)
+{
+    ros::WallTime start = ros::WallTime::now();
+
+    chain.setAng(_q);
+
+    // Every link is approximated by a capsule
+    double max_radius = 0.0;
+
+    for (size_t l = 0; l < customChains.size(); ++l)
+    {
+        size_t n_joints = customChains[l].getNrOfJoints();
+        double r = n_joints-1 < radii.size() ? radii[n_joints-1] : 0.0;
+
+        customChains[l].setAng(_q.head(n_joints));
+
+        // getH() is getH(n_joints-1), so the tip of the link comes from the frame
+        H[l]            = customChains[l].getIsometry();
+        links[l].first  = customChains[l].getIsometry(n_joints-2).translation();
+        links[l].second = H[l].translation();
+
+        caps.set(l, links[l].first, links[l].second, r);
+        max_radius = std::max(max_radius, r);
+
+        // Any point of the capsule moved at most as much as the farthest endpoint
+        double disp = std::max((links[l].first  - links_ref[l].first ).norm(),
+                               (links[l].second - links_ref[l].second).norm());
+
+        links_disp[l] = 0.0;
+
+        if (disp > update_thres)
         {
-            angles.conservativeResize(angles.rows()+1);
-            angles[angles.rows()-1] = chain.getAng(customChain.getNrOfJoints());
+            // Collision points may have been computed up to update_thres away from the reference
+            links_ref [l] = links[l];
+            links_disp[l] = disp + update_thres;
+        }
+    }
 
-            customChain.addSegment(chain.getSegment(customChain.getNrOfSegments()));
+    ros::WallTime t_links = ros::WallTime::now();
 
-            customChain.setAng(angles);
+    // Only the obstacles close enough to the links can activate a collision point
+    std::vector<size_t> prev_candidates;
+    prev_candidates.swap(candidates);
 
-            while (chain.getSegment(customChain.getNrOfSegments()).getJoint().getType() == KDL::Joint::None)
-            {
-                if (customChain.getNrOfSegments()==chain.getNrOfSegments())  { break; };
+    candidates   = _grid.query(links, ACTIVATION_DIST + max_radius);
+    n_candidates = candidates.size();
 
-                customChain.addSegment(chain.getSegment(customChain.getNrOfSegments()));
-            }
+    ros::WallTime t_query = ros::WallTime::now();
 
-            // ROS_INFO_STREAM("Get Angles:  " << customChain.getAng().transpose());
-            // ROS_INFO_STREAM("Real Angles: " <<       chain.getAng().transpose());
+    // Slots follow their obstacles, if these got a new index
+    gatherMovedSlots(_grid);
 
-            // Compute collision points
-            // obstacles are expressed in the world reference frame [WRF]
-            // coll_pt is in the end-effector reference frame [ERF]
-            CollisionPoint coll_pt;
+    size_t n_obstacles = _grid.getNrOfObstacles();
+    size_t n_static    = sdf ? customChains.size() : 0;
+    size_t n_self      = other.size();
+    size_t n_tactile   = contacts.size();
+    size_t n_slots     = n_obstacles + n_static + n_self + n_tactile;
 
-            if (customChain.obstacleToCollisionPoint(_obstacles[i], coll_pt))
-            {
-                tmpCP.push_back(coll_pt);
-
-                // create new segment to add to the custom chain that ends up in the collision point
-                Matrix4d HN(Matrix4d::Identity());
-                // Compute new segment to add to the chain
-                computeFoR(coll_pt.x_erf, coll_pt.n_erf, HN);
-                KDL::Segment s = KDL::Segment(KDL::Joint(KDL::Joint::None), toKDLFrame(HN));
-
-                BaxterChain chainToAdd = customChain;
-                chainToAdd.addSegment(s);
-                tmpCC.push_back(chainToAdd);
-                // ROS_INFO("adding chain with %zu joints and %zu segments", chainToAdd.getNrOfJoints(), chainToAdd.getNrOfSegments());
-            }
+    if (slots.size() != n_slots)
+    {
+        slots     .resize(n_slots);
+        ctrlChains.resize(n_slots);
+        collPoints.resize(n_slots);
+    }
+
+    // The sections after the grid move whenever the size of one before them changes,
+    // even if the total does not (e.g. one more obstacle and one less contact). Their
+    // slots then hold the points of other links or contacts, and the seeds with them.
+    if (static_start != n_obstacles || self_start  != n_obstacles + n_static ||
+        tactile_start != n_obstacles + n_static + n_self)
+    {
+        for (size_t i = n_obstacles; i < n_slots; ++i)
+        {
+            slots[i].valid = false;
+            slots[i].seed  = -1.0;
+        }
+
+        static_start  = n_obstacles;
+        self_start    = n_obstacles + n_static;
+        tactile_start = n_obstacles + n_static + n_self;
+    }
 
-            // ROS_INFO("tmpCP.size %lu tmpCC.size %lu", tmpCP.size(), tmpCC.size());
+    scatterMovedSlots(prev_candidates);
+
+    // Obstacles that did not survive the culling need to be recomputed from scratch
+    // when they do. The candidates are sorted, so one pass over both lists is enough.
+    for (size_t p = 0, c = 0; p < prev_candidates.size(); ++p)
+    {
+        while (c < candidates.size() && candidates[c] < prev_candidates[p])    { ++c; }
+
+        if ((c == candidates.size() || candidates[c] != prev_candidates[p]) &&
+             prev_candidates[p] < slots.size())
+        {
+            slots[prev_candidates[p]].valid = false;
         }
+    }
 
-        // Cycle through the newfound collision points to find the max, and stick to that one
-        double max_mag = 0.0;
-        int    max_idx =  -1;
-        string  cp_str =  "";
+    // Every candidate only touches its own slot, so they can be checked in parallel
+    enum { DIRTY, REUSED, REUSED_ACTIVE };
+    state.resize(candidates.size());
 
-        for (size_t i = 0; i < tmpCP.size(); ++i)
+    pool->parallelFor(candidates.size(), [&](size_t c, size_t)
+    {
+        size_t          i = candidates[c];
+        Slot           &s = slots[i];
+        const Obstacle &o = _grid.getObstacle(i);
+
+        bool clean = s.valid && o.id == s.obstacle.id && o.size == s.obstacle.size &&
+                     (o.x_wrf - s.obstacle.x_wrf).norm() <= update_thres;
+
+        // Links that moved can only have gotten closer by as much as they moved
+        for (size_t l = 0; clean && l < customChains.size(); ++l)
         {
-            cp_str = cp_str + " " + toString(tmpCP[i].mag);
+            s.dist[l] -= links_disp[l];
 
-            if (tmpCP[i].mag > 1e-2)
-            {
-                if (tmpCP[i].mag > max_mag)
-                {
-                    max_mag = tmpCP[i].mag;
-                    max_idx =     int(i);
-                }
-            }
+            if (links_disp[l] > 0.0 && s.dist[l] <= ACTIVATION_DIST)    { clean = false; }
         }
 
-        if (max_idx != -1)
+        if      (not clean)    { state[c] = DIRTY;                                     }
+        else if (s.active)     { state[c] = REUSED_ACTIVE;  moveCollisionPoint(i, _q); }
+        else                   { state[c] = REUSED;                                    }
+    }, 64);
+
+    active.clear();
+    dirty .clear();
+
+    for (size_t c = 0; c < candidates.size(); ++c)
+    {
+        if      (state[c] == DIRTY)            {  dirty.push_back(candidates[c]); }
+        else if (state[c] == REUSED_ACTIVE)    { active.push_back(candidates[c]); }
+    }
+
+    stats.n_reused += candidates.size() - dirty.size();
+
+    // Distances between every dirty obstacle and every link, all at once
+    spheres.resize(dirty.size());
+
+    for (size_t k = 0; k < dirty.size(); ++k)
+    {
+        spheres.set(k, _grid.getObstacle(dirty[k]).x_wrf, _grid.getObstacle(dirty[k]).size);
+    }
+
+    sphereCapsuleDistances(caps, spheres, dists);
+
+    seeded.assign(dirty.size(), 0);
+
+    computeCollisionPoints(_grid);
+
+    for (size_t k = 0; k < dirty.size(); ++k)
+    {
+        if (slots[dirty[k]].active)    { active.push_back(dirty[k]); }
+
+        stats.n_local += seeded[k];
+    }
+
+    // Static obstacles are looked up in the field, and only for the links that moved
+    size_t n_static_dirty = 0;
+
+    for (size_t l = 0; l < n_static; ++l)
+    {
+        size_t i = n_obstacles + l;
+
+        // A seed is only meaningful along the link it was found on
+        if (slots[i].link != l)
+        {
+            slots[i].valid = false;
+            slots[i].seed  = -1.0;
+        }
+
+        if (slots[i].valid && links_disp[l] == 0.0)
+        {
+            stats.n_reused++;
+
+            if (slots[i].active)    { moveCollisionPoint(i, _q); }
+        }
+        else
+        {
+            computeStaticPoint(i, l);
+            n_static_dirty++;
+        }
+
+        if (slots[i].active)    { active.push_back(i); }
+    }
+
+    ros::WallTime t_points = ros::WallTime::now();
+
+    // The other arm moves all the time, so its collision points are always recomputed
+    computeSelfCollisionPoints(n_obstacles + n_static);
+
+    for (size_t m = 0; m < n_self; ++m)
+    {
+        if (slots[n_obstacles + n_static + m].active)    { active.push_back(n_obstacles + n_static + m); }
+    }
+
+    ros::WallTime t_self = ros::WallTime::now();
+
+    // Contacts of the skin change at every frame, so they are always recomputed
+    computeTactilePoints(n_obstacles + n_static + n_self);
+
+    for (size_t m = 0; m < n_tactile; ++m)
+    {
+        size_t i = n_obstacles + n_static + n_self + m;
+
+        if (slots[i].active)    { active.push_back(i); }
+    }
+
+    std::sort(active.begin(), active.end());
+
+    ros::WallTime end = ros::WallTime::now();
+
+    stats.n_updates++;
+    stats.n_recomputed += dirty.size() + n_static_dirty;
+    stats.t_links   += (t_links  - start   ).toSec();
+    stats.t_query   += (t_query  - t_links ).toSec();
+    stats.t_points  += (t_points - t_query ).toSec();
+    stats.t_self    += (t_self   - t_points).toSec();
+    stats.t_tactile += (end      - t_self  ).toSec();
+    stats.t_total   += (end      - start   ).toSec();
+}
+
+void AvoidanceHandler::computeCollisionPoints(const ObstacleGrid &_grid)
+{
+    pool->parallelFor(dirty.size(), [&](size_t k, size_t)
+    {
+        size_t          i = dirty[k];
+        const Obstacle &o = _grid.getObstacle(i);
+
+        // The closest link is the one with the highest magnitude, let's stick to that one
+        size_t l = 0;
+        double dist = dists.dist.row(k).minCoeff(&l);
+
+        // ... unless the previous link of the obstacle is about as close
+        const Slot &s = slots[i];
+
+        if (hysteresis > 0.0 && s.valid && s.active && s.link != l &&
+            s.obstacle.id == o.id && dists.dist(k, s.link) <= dist + hysteresis)
         {
-            // ROS_INFO("Collision points with magnitude: %s Selected: %i", cp_str.c_str(), max_idx);
+            l         = s.link;
+            dist      = dists.dist(k, l);
+            seeded[k] = 1;
+        }
+
+        double mag  = distanceToMagnitude(dist);
 
-            collPoints.push_back(tmpCP[max_idx]);
-            ctrlChains.push_back(tmpCC[max_idx]);
+        // obstacles are expressed in the world reference frame [WRF]
+        if (mag > 1e-2)
+        {
+            CollisionPoint &coll_pt = collPoints[i];
+            coll_pt.o_wrf = o.x_wrf;
+            coll_pt.size  = o.size;
+            coll_pt.x_wrf = dists.closestPoint(caps, k, l);
+            coll_pt.n_wrf = dists.normal(k, l);
         }
 
-        tmpCC.clear();
-        tmpCP.clear();
+        storeCollisionPoint(i, k, o, l, mag);
+    }, 4);
+}
+
+void AvoidanceHandler::storeCollisionPoint(size_t _i, size_t _k, const Obstacle &_o,
+                                           size_t _l, double _mag)
+{
+    Slot &s = slots[_i];
+
+    s.valid    = true;
+    s.obstacle = _o;
+    s.dist     = dists.dist.row(_k).transpose().matrix();
+    s.active   = _mag > 1e-2;
+    s.link     = _l;
+
+    collPoints[_i].mag = _mag;
+
+    // coll_pt is in the end-effector reference frame [ERF] of the custom chain
+    if (s.active)    { attachCollisionPoint(_i, _l); }
+}
+
+void AvoidanceHandler::computeStaticPoint(size_t _i, size_t _l)
+{
+    Slot &s = slots[_i];
+
+    s.valid  = true;
+    s.active = false;
+    s.link   = _l;
+
+    // Closest point of the axis of the link to the static obstacles, searched
+    // for along the whole link only if it moved too much since the last time
+    Vector3d x, grad;
+    double   dist = 0.0;
+    bool     found;
+
+    if (s.seed >= 0.0 && s.drift + links_disp[_l] <= hysteresis)
+    {
+        s.drift += links_disp[_l];
+        found    = sdf->closestPointLocal(links[_l].first, links[_l].second, s.seed, x, dist, grad);
+        stats.n_local++;
+    }
+    else
+    {
+        double t = 0.0;
+        found    = sdf->closestPoint(links[_l].first, links[_l].second, x, dist, grad, t);
+        s.seed   = found ? t : -1.0;
+        s.drift  = 0.0;
     }
 
+    if (not found || grad.squaredNorm() < 1e-12)    { return; }
+
+    CollisionPoint &coll_pt = collPoints[_i];
+    coll_pt.mag = distanceToMagnitude(dist - caps.r[_l]);
+
+    s.active = coll_pt.mag > 1e-2;
+
+    if (not s.active)    { return; }
+
+    // The gradient points away from the obstacles, the normal towards them
+    coll_pt.n_wrf = -grad.normalized();
+    coll_pt.x_wrf = x + caps.r[_l] * coll_pt.n_wrf;
+    coll_pt.o_wrf = x +       dist * coll_pt.n_wrf;
+    coll_pt.size  = 0.0;
+
+    attachCollisionPoint(_i, _l);
+}
+
+void AvoidanceHandler::computeSelfCollisionPoints(size_t _offset)
+{
+    size_t n_links = caps.size();
+
+    // Bounding spheres of the links of this arm
+    std::vector<Vector3d> centers(n_links);
+    VectorXd              radii_b(n_links);
+
+    for (size_t l = 0; l < n_links; ++l)
+    {
+        centers[l] = 0.5 * (links[l].first + links[l].second);
+        radii_b[l] = 0.5 * (links[l].second - links[l].first).norm() + caps.r[l];
+    }
+
+    for (size_t m = 0; m < other.size(); ++m)
+    {
+        Slot &s = slots[_offset + m];
+
+        s.valid  = true;
+        s.active = false;
+
+        Vector3d a(other.ax[m], other.ay[m], other.az[m]);
+        Vector3d b(other.bx[m], other.by[m], other.bz[m]);
+        Vector3d c = 0.5 * (a + b);
+        double   R = 0.5 * (b - a).norm() + other.r[m];
+
+        // Broad phase with the bounding spheres, narrow phase with the capsules
+        double   dist = std::numeric_limits<double>::max();
+        size_t   l    = 0;
+        Vector3d p, q, cp, cq;
+
+        for (size_t k = 0; k < n_links; ++k)
+        {
+            if ((centers[k] - c).norm() - radii_b[k] - R > ACTIVATION_DIST)    { continue; }
+
+            stats.n_self_pairs++;
+
+            double d = segmentSegmentDistance(links[k].first, links[k].second,
+                                              a, b, cp, cq) - caps.r[k] - other.r[m];
+
+            if (d < dist)    { dist = d;  l = k;  p = cp;  q = cq; }
+        }
+
+        // Segments that touch do not tell where the obstacle is
+        if (dist > ACTIVATION_DIST || (q - p).squaredNorm() < 1e-12)    { continue; }
+
+        CollisionPoint &coll_pt = collPoints[_offset + m];
+        coll_pt.mag = distanceToMagnitude(dist);
+
+        s.active = coll_pt.mag > 1e-2;
+        s.link   = l;
+
+        if (not s.active)    { continue; }
+
+        coll_pt.n_wrf = (q - p).normalized();
+        coll_pt.x_wrf = p + caps.r[l]  * coll_pt.n_wrf;
+        coll_pt.o_wrf = q - other.r[m] * coll_pt.n_wrf;
+        coll_pt.size  = other.r[m];
+
+        attachCollisionPoint(_offset + m, l);
+    }
+}
+
+void AvoidanceHandler::computeTactilePoints(size_t _offset)
+{
+    for (size_t m = 0; m < contacts.size(); ++m)
+    {
+        Slot                 &s = slots[_offset + m];
+        const TactileContact &c = contacts[m];
+
+        s.valid  = true;
+        s.active = c.link < customChains.size() && c.mag > 1e-2;
+        s.link   = c.link;
+
+        if (not s.active)    { continue; }
+
+        // The contact is on the skin, i.e. the obstacle is right there along the normal
+        CollisionPoint &coll_pt = collPoints[_offset + m];
+        coll_pt.mag   = std::min(c.mag, 1.0);
+        coll_pt.n_wrf = H[c.link].linear() * c.n_erf;
+        coll_pt.x_wrf = H[c.link]          * c.x_erf;
+        coll_pt.o_wrf = coll_pt.x_wrf;
+        coll_pt.size  = 0.0;
+
+        attachCollisionPoint(_offset + m, c.link);
+    }
+}
+
+void AvoidanceHandler::attachCollisionPoint(size_t _i, size_t _l)
+{
+    CollisionPoint &coll_pt = collPoints[_i];
+
+    changeFoR(coll_pt.x_wrf, H[_l], coll_pt.x_erf);
+    coll_pt.n_erf = H[_l].linear().transpose() * coll_pt.n_wrf;
+
+    // create new segment to add to the custom chain that ends up in the collision point
+    Isometry3d HN(Isometry3d::Identity());
+    // Compute new segment to add to the chain
+    computeFoR(coll_pt.x_erf, coll_pt.n_erf, HN);
+    KDL::Segment seg = KDL::Segment(KDL::Joint(KDL::Joint::None), toKDLFrame(HN));
+
+    // If the control chain in the slot already ends up on the same link, only the last
+    // segment changes; otherwise the assignment reuses the memory of the previous chain
+    BaxterChain &ctrl = ctrlChains[_i];
+
+    if (ctrl.getNrOfSegments() == customChains[_l].getNrOfSegments() + 1)
+    {
+        ctrl.segments.back() = seg;
+        ctrl.setAng(customChains[_l].getAng());
+    }
+    else
+    {
+        ctrl = customChains[_l];
+        ctrl.addSegment(seg);
+    }
+}
+
+void AvoidanceHandler::gatherMovedSlots(const ObstacleGrid &_grid)
+{
+    moves.clear();
+
+    size_t n_obstacles = _grid.getNrOfObstacles();
+    bool   same_ids    = slot_ids.size() == n_obstacles;
+
+    for (size_t i = 0; same_ids && i < n_obstacles; ++i)
+    {
+        same_ids = slot_ids[i] == _grid.getObstacle(i).id;
+    }
+
+    // Most of the times obstacles come in the same order as in the last update
+    if (same_ids)    { return; }
+
+    for (size_t i = 0; i < n_obstacles; ++i)
+    {
+        auto it = id_slots.find(_grid.getObstacle(i).id);
+
+        if (it == id_slots.end())    { continue; }
+
+        // Every slot follows one obstacle only, even if IDs are repeated
+        if (it->second != i && it->second < slots.size())
+        {
+            moves.push_back(std::make_pair(it->second, i));
+        }
+
+        id_slots.erase(it);
+    }
+
+    // Slots are taken out first, so that they can be swapped around
+    moved_slots .resize(moves.size());
+    moved_chains.resize(moves.size());
+    moved_points.resize(moves.size());
+
+    for (size_t m = 0; m < moves.size(); ++m)
+    {
+        std::swap(slots     [moves[m].first], moved_slots [m]);
+        std::swap(ctrlChains[moves[m].first], moved_chains[m]);
+        std::swap(collPoints[moves[m].first], moved_points[m]);
+
+        slots[moves[m].first].valid = false;
+    }
+
+    slot_ids.resize(n_obstacles);
+    id_slots.clear();
+
+    for (size_t i = 0; i < n_obstacles; ++i)
+    {
+        slot_ids[i] = _grid.getObstacle(i).id;
+
+        if (slot_ids[i] >= 0)    { id_slots[slot_ids[i]] = i; }
+    }
+
+    stats.n_remapped += moves.size();
+}
+
+void AvoidanceHandler::scatterMovedSlots(std::vector<size_t> &_prev_candidates)
+{
+    if (moves.empty())    { return; }
+
+    for (size_t m = 0; m < moves.size(); ++m)
+    {
+        std::swap(slots     [moves[m].second], moved_slots [m]);
+        std::swap(ctrlChains[moves[m].second], moved_chains[m]);
+        std::swap(collPoints[moves[m].second], moved_points[m]);
+    }
+
+    // Candidates follow their slots, and the slots that got overwritten are not candidates
+    std::vector<size_t> to(moves.size());
+    for (size_t m = 0; m < moves.size(); ++m)    { to[m] = moves[m].second; }
+
+    std::sort(moves.begin(), moves.end());
+    std::sort(to   .begin(), to   .end());
+
+    std::vector<size_t> prev;
+    prev.reserve(_prev_candidates.size());
+
+    for (size_t p = 0; p < _prev_candidates.size(); ++p)
+    {
+        size_t c  = _prev_candidates[p];
+        auto   it = std::lower_bound(moves.begin(), moves.end(), std::make_pair(c, size_t(0)));
+
+        if      (it != moves.end() && it->first == c)               { prev.push_back(it->second); }
+        else if (not std::binary_search(to.begin(), to.end(), c))   { prev.push_back(c);          }
+    }
+
+    std::sort(prev.begin(), prev.end());
+    _prev_candidates.swap(prev);
+}
+
+void AvoidanceHandler::moveCollisionPoint(size_t _i, const VectorXd &_q)
+{
+    // The collision point is fixed in the frame of its link, but
+    // the control chain needs to be updated with the new angles
+    ctrlChains[_i].setAng(_q.head(ctrlChains[_i].getNrOfJoints()));
+
+    const Isometry3d &H_l     = H[slots[_i].link];
+    CollisionPoint   &coll_pt = collPoints[_i];
+
+    coll_pt.x_wrf = H_l          * coll_pt.x_erf;
+    coll_pt.n_wrf = H_l.linear() * coll_pt.n_erf.normalized();
+}
+
+void AvoidanceHandler::set_n_threads(size_t _n_threads)
+{
+    pool.reset(new ThreadPool(_n_threads));
+}
+
+void AvoidanceHandler::set_static_field(const SignedDistanceField *_sdf)
+{
+    sdf = _sdf && _sdf->isLoaded() ? _sdf : NULL;
+
+    // Every collision point is recomputed at the next update
+    slots     .clear();
+    ctrlChains.clear();
+    collPoints.clear();
+    candidates.clear();
+    active    .clear();
+
+    static_start = self_start = tactile_start = 0;
 }
 
 std::vector<BaxterChain> AvoidanceHandler::getCtrlChains()
 {
-    return ctrlChains;
+    std::vector<BaxterChain> res;
+
+    for (size_t a = 0; a < active.size(); ++a)
+    {
+        res.push_back(ctrlChains[active[a]]);
+    }
+
+    return res;
 }
 
 std::vector<CollisionPoint> AvoidanceHandler::getCtrlPoints()
 {
-    return collPoints;
+    std::vector<CollisionPoint> res;
+
+    for (size_t a = 0; a < active.size(); ++a)
+    {
+        res.push_back(collPoints[active[a]]);
+    }
+
+    return res;
 }
 
 MatrixXd AvoidanceHandler::getV_LIM(const MatrixXd &v_lim)
@@ -120,9 +706,28 @@ MatrixXd AvoidanceHandler::getV_LIM(const MatrixXd &v_lim)
     return v_lim;
 }
 
+vector<VelocityConstraint> AvoidanceHandler::getVelocityConstraints(double _v_approach)
+{
+    vector<VelocityConstraint> res(active.size());
+
+    pool->parallelFor(active.size(), [&](size_t a, size_t)
+    {
+        size_t i = active[a];
+
+        // The z-axis of the last frame of the control chain is the normal of the collision point
+        MatrixXd J_xyz = ctrlChains[i].GeoJacobian().block(0, 0, 3, ctrlChains[i].getNrOfJoints());
+        Vector3d nrm   = ctrlChains[i].getIsometry().linear().col(2);
+
+        res[a].a  = -J_xyz.transpose() * nrm;
+        res[a].lb = -(1.0 - collPoints[i].mag) * _v_approach;
+    }, 4);
+
+    return res;
+}
+
 bool AvoidanceHandler::computeFoR(const VectorXd &pos,
                                   const VectorXd &norm,
-                                        Matrix4d &FoR)
+                                      Isometry3d &FoR)
 {
     Vector3d zeros;
     zeros.setZero();
@@ -151,10 +756,10 @@ bool AvoidanceHandler::computeFoR(const VectorXd &pos,
     z = z / z.norm();
 
     FoR.setIdentity();
-    FoR.block<3,1>(0,0) =   x;
-    FoR.block<3,1>(0,1) =   y;
-    FoR.block<3,1>(0,2) =   z;
-    FoR.block<3,1>(0,3) = pos;
+    FoR.linear().col(0) =   x;
+    FoR.linear().col(1) =   y;
+    FoR.linear().col(2) =   z;
+    FoR.translation()   = pos;
 
     return true;
 }
@@ -165,8 +770,10 @@ std::vector<RVIZMarker> AvoidanceHandler::toRVIZMarkers()
 
     vector <RVIZMarker> rvzcc;
 
-    for (size_t i = 0; i < ctrlChains.size(); ++i)
+    for (size_t a = 0; a < active.size(); ++a)
     {
+        size_t i = active[a];
+
         rvzcc = asRVIZMarkers(ctrlChains[i], false, false, true);
 
         // Let's use the magnitude of the collision point as length
@@ -190,6 +797,14 @@ AvoidanceHandler::~AvoidanceHandler()
 
 /****************************************************************/
 /****************************************************************/
+AvoidanceHandlerTactile::AvoidanceHandlerTactile(const BaxterChain &_chain,
+                                                 const vector<double> &_radii) :
+                                                 AvoidanceHandler(_chain, _radii, "tactile"),
+                                                 avoidingSpeed(0.25)
+{
+
+}
+
 AvoidanceHandlerTactile::AvoidanceHandlerTactile(const BaxterChain &_chain,
                                                  const vector<Obstacle> &_obstacles) :
                                                  AvoidanceHandler(_chain, _obstacles, "tactile"),
@@ -198,12 +813,26 @@ AvoidanceHandlerTactile::AvoidanceHandlerTactile(const BaxterChain &_chain,
 
 }
 
+AvoidanceHandlerTactile::AvoidanceHandlerTactile(const BaxterChain &_chain,
+                                                 const ObstacleGrid &_grid,
+                                                 const vector<double> &_radii) :
+                                                 AvoidanceHandler(_chain, _grid, "tactile", _radii),
+                                                 avoidingSpeed(0.25)
+{
+
+}
+
 MatrixXd AvoidanceHandlerTactile::getV_LIM(const MatrixXd &v_lim)
 {
     MatrixXd V_LIM = v_lim;
 
-    for (size_t i = 0; i < collPoints.size(); ++i)
+    // The projections are independent of each other, and computed in parallel
+    S.resize(v_lim.rows(), active.size());
+
+    pool->parallelFor(active.size(), [&](size_t a, size_t)
     {
+        size_t i = active[a];
+
         // ROS_INFO("Chain with control point - index %d (last index %d), nDOF: %d.",
         //           i, ctrlChains.size()-1, ctrlChains[i].getNrOfJoints());
         // First 3 rows ~ dPosition/dJoints
@@ -212,12 +841,20 @@ MatrixXd AvoidanceHandlerTactile::getV_LIM(const MatrixXd &v_lim)
         // Get the end-effector frame of the standard or custom chain (control point derived from skin),
         // takes the z-axis (3rd column in transform matrix) ~ normal, only its first three elements of the
         // four in the homogeneous transformation format
-        VectorXd nrm = ctrlChains[i].getH().block<3,1>(0,2);
+        VectorXd nrm = ctrlChains[i].getIsometry().linear().col(2);
 
         // Project movement along the normal into joint velocity space and scale by default
         // avoidingSpeed and m of skin (or PPS) activation
         // VectorXd s = -1.0 * J_xyz.transpose()*nrm;   // This is for reaching
-        VectorXd s = J_xyz.transpose()*nrm; // This is for avoiding
+        S.col(a).head(J_xyz.cols()) = J_xyz.transpose()*nrm; // This is for avoiding
+    }, 4);
+
+    // The limits are then shaped serially, in the order of the collision points,
+    // so that the result does not depend on the number of threads
+    for (size_t a = 0; a < active.size(); ++a)
+    {
+        size_t i = active[a];
+        auto   s = S.col(a).head(ctrlChains[i].getNrOfJoints());
 
         for (size_t j = 0; j < size_t(s.rows()); ++j)
         {
@@ -285,3 +922,129 @@ AvoidanceHandlerTactile::~AvoidanceHandlerTactile()
 {
 
 }
+
+/****************************************************************/
+/****************************************************************/
+AvoidanceHandlerPPS::AvoidanceHandlerPPS(const BaxterChain &_chain,
+                                         const vector<double> &_radii) :
+                                         AvoidanceHandler(_chain, _radii, "pps"),
+                                         AvoidanceHandlerTactile(_chain, _radii),
+                                         n_rings(4), n_sectors(8), rf_depth(0.2),
+                                         rf_cos(cos(40.0 * M_PI / 180.0))
+{
+
+}
+
+void AvoidanceHandlerPPS::set_receptive_fields(double _depth, double _half_angle)
+{
+    // Obstacles farther than ACTIVATION_DIST from the links are culled anyway
+    rf_depth = std::min(std::max(_depth, 1e-3), ACTIVATION_DIST);
+    rf_cos   = cos(std::min(std::max(_half_angle, 1e-3), M_PI / 2.0));
+}
+
+void AvoidanceHandlerPPS::set_surface_sampling(size_t _n_rings, size_t _n_sectors)
+{
+    n_rings   = std::max(_n_rings,   size_t(1));
+    n_sectors = std::max(_n_sectors, size_t(1));
+}
+
+void AvoidanceHandlerPPS::updateSurfacePoints()
+{
+    size_t n_per_link = n_rings * n_sectors;
+
+    points .resize(links.size() * n_per_link, 3);
+    normals.resize(links.size() * n_per_link, 3);
+    point_link.resize(links.size() * n_per_link);
+
+    for (size_t l = 0; l < links.size(); ++l)
+    {
+        Vector3d axis = links[l].second - links[l].first;
+        Vector3d u    = axis.norm() > 1e-9 ? Vector3d(axis.normalized())
+                                           : Vector3d(H[l].linear().col(2));
+
+        // Two directions orthogonal to the link, fixed onto the link
+        Vector3d e1 = H[l].linear().col(0) - H[l].linear().col(0).dot(u) * u;
+        if (e1.norm() < 1e-6)    { e1 = H[l].linear().col(1) - H[l].linear().col(1).dot(u) * u; }
+        e1.normalize();
+        Vector3d e2 = u.cross(e1);
+
+        for (size_t i = 0; i < n_rings; ++i)
+        {
+            Vector3d c = links[l].first + (i + 0.5) / n_rings * axis;
+
+            for (size_t j = 0; j < n_sectors; ++j)
+            {
+                size_t   p = l * n_per_link + i * n_sectors + j;
+                double   a = 2.0 * M_PI * j / n_sectors;
+                Vector3d n = cos(a) * e1 + sin(a) * e2;
+
+                points .row(p) = (c + caps.r[l] * n).transpose();
+                normals.row(p) = n.transpose();
+                point_link[p]  = l;
+            }
+        }
+    }
+}
+
+void AvoidanceHandlerPPS::computeCollisionPoints(const ObstacleGrid &_grid)
+{
+    if (dirty.empty())    { return; }
+
+    updateSurfacePoints();
+
+    // The taxels lie on the capsules, so obstacles farther than rf_depth
+    // from every capsule do not activate any receptive field
+    near.clear();
+
+    for (size_t k = 0; k < dirty.size(); ++k)
+    {
+        if (dists.dist.row(k).minCoeff() < rf_depth)    { near.push_back(k); }
+    }
+
+    centers.resize(3, near.size());
+    sizes  .resize(near.size());
+
+    for (size_t c = 0; c < near.size(); ++c)
+    {
+        centers.col(c) = _grid.getObstacle(dirty[near[c]]).x_wrf;
+        sizes[c]       = _grid.getObstacle(dirty[near[c]]).size;
+    }
+
+    // Every taxel against every obstacle in reach, all at once
+    receptiveFieldActivations(points, normals, centers, sizes, rf_depth, rf_cos, act);
+
+    pool->parallelFor(dirty.size(), [&](size_t k, size_t)
+    {
+        size_t          i = dirty[k];
+        const Obstacle &o = _grid.getObstacle(i);
+
+        // The taxel with the highest activation gets the collision point. The
+        // columns of act follow near, which holds the indices k of the obstacles
+        // in reach in increasing order (it is filled by a loop over k), so the
+        // column of this obstacle, if it is in reach at all, is found by a
+        // binary search of k in near.
+        size_t c = std::lower_bound(near.begin(), near.end(), k) - near.begin();
+        Eigen::Index p = 0;
+        double mag = 0.0;
+
+        if (c < near.size() && near[c] == k && act.rows() > 0)    { mag = act.col(c).maxCoeff(&p); }
+
+        size_t l = mag > 0.0 ? point_link[p] : 0;
+
+        if (mag > 1e-2)
+        {
+            CollisionPoint &coll_pt = collPoints[i];
+            coll_pt.o_wrf = o.x_wrf;
+            coll_pt.size  = o.size;
+            coll_pt.x_wrf = points .row(p).transpose();
+            coll_pt.n_wrf = normals.row(p).transpose();
+        }
+
+        storeCollisionPoint(i, k, o, l, mag);
+    }, 4);
+}
+
+AvoidanceHandlerPPS::~AvoidanceHandlerPPS()
+{
+
+}
@@ -0,0 +1,117 @@
+#include <thread>
+
+#include "react_controller/batchIKSolver.h"
+
+using namespace   std;
+using namespace Eigen;
+
+BatchIKSolver::BatchIKSolver(const BaxterChain &_chain, size_t _n_workers,
+                             double _dt, double _tol) :
+                             chain(_chain), n_workers(_n_workers), dt(_dt),
+                             tol(_tol), ctrl_ori(false), linear_solver(""),
+                             v_lim(_chain.getNrOfJoints(), 2)
+{
+    if (n_workers == 0)
+    {
+        n_workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t r = 0; r < chain.getNrOfJoints(); ++r)
+    {
+        v_lim(r, 0) = -RAD2DEG*chain.getVLim(r);
+        v_lim(r, 1) =  RAD2DEG*chain.getVLim(r);
+    }
+}
+
+void BatchIKSolver::set_v_lim(const MatrixXd &_v_lim)
+{
+    ROS_ASSERT(_v_lim.rows() == v_lim.rows() && _v_lim.cols() == v_lim.cols());
+    v_lim = _v_lim;
+}
+
+void BatchIKSolver::worker(const vector<BatchIKProblem> &_problems,
+                                 vector<BatchIKResult>  &_results,
+                                 atomic<size_t>         &_next)
+{
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = newControllerApp(tol, 0.95 * dt);
+    app->Options()->SetIntegerValue("print_level",     0);
+    app->Options()->SetStringValue ("sb",          "yes");
+    if (not linear_solver.empty())
+    {
+        app->Options()->SetStringValue("linear_solver", linear_solver);
+    }
+    app->Initialize();
+
+    Ipopt::SmartPtr<ControllerNLP> nlp = new ControllerNLP(chain, dt, ctrl_ori);
+
+    for (size_t i = _next++; i < _problems.size(); i = _next++)
+    {
+        const BatchIKProblem &pb = _problems[i];
+        ros::WallTime start = ros::WallTime::now();
+
+        if (not nlp->set_q_0(pb.q_0))
+        {
+            ROS_ERROR("Problem %lu: start configuration has %li joints instead of %lu",
+                                               i, pb.q_0.size(), chain.getNrOfJoints());
+            continue;
+        }
+
+        nlp->set_v_lim(v_lim);
+        nlp->set_ctrl_ori(ctrl_ori);
+        nlp->set_dt(dt);
+        nlp->set_x_r(pb.p_r, pb.o_r);
+        nlp->set_v_0(pb.v_0);
+        nlp->init();
+
+        _results[i].exit_code  = app->OptimizeTNLP(GetRawPtr(nlp));
+        _results[i].v_e        = nlp->get_est_vels();
+        _results[i].solve_time = (ros::WallTime::now() - start).toSec();
+    }
+}
+
+size_t BatchIKSolver::getNrOfWorkers()
+{
+    // MUMPS keeps global state, so concurrent solves would corrupt each other
+    if (n_workers > 1 && (linear_solver.empty() || linear_solver == "mumps"))
+    {
+        ROS_WARN_ONCE("[batch_ik] MUMPS is not re-entrant, so batches are solved by one worker "
+                      "instead of %lu. Set a thread-safe linear solver (e.g. ma27) to use them.",
+                      n_workers);
+        return 1;
+    }
+
+    return n_workers;
+}
+
+vector<BatchIKResult> BatchIKSolver::solve(const vector<BatchIKProblem> &_problems)
+{
+    vector<BatchIKResult> results(_problems.size());
+    atomic<size_t> next(0);
+
+    size_t n_threads = std::min(getNrOfWorkers(), _problems.size());
+
+    if (n_threads <= 1)
+    {
+        worker(_problems, results, next);
+        return results;
+    }
+
+    vector<thread> threads;
+    for (size_t i = 0; i < n_threads; ++i)
+    {
+        threads.push_back(thread(&BatchIKSolver::worker, this,
+                                 std::cref(_problems), std::ref(results), std::ref(next)));
+    }
+
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+
+    return results;
+}
+
+BatchIKSolver::~BatchIKSolver()
+{
+
+}
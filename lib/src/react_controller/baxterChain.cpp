@@ -356,10 +356,20 @@ geometry_msgs::Pose BaxterChain::getPose()
 
 Matrix4d BaxterChain::getH()
 {
-    return toMatrix4d(JntToCart());
+    return getIsometry().matrix();
 }
 
 Matrix4d BaxterChain::getH(const size_t _i)
+{
+    return getIsometry(_i).matrix();
+}
+
+Isometry3d BaxterChain::getIsometry()
+{
+    return toIsometry3d(JntToCart());
+}
+
+Isometry3d BaxterChain::getIsometry(const size_t _i)
 {
     // if i > than num_joints
     ROS_ASSERT_MSG(_i < getNrOfJoints(), "_i %lu, num_joints %lu", _i, getNrOfJoints());
@@ -376,7 +386,7 @@ Matrix4d BaxterChain::getH(const size_t _i)
         }
     }
 
-    return toMatrix4d(JntToCart(s));
+    return toIsometry3d(JntToCart(s));
 }
 
 void BaxterChain::removeSegment()
@@ -418,7 +428,7 @@ bool BaxterChain::is_between(Eigen::Vector3d _a, Eigen::Vector3d _b, Eigen::Vect
 {
     double dot_product = (_b - _a).dot(_c - _a);
 
-    if (dot_product > 0 && dot_product < (_a - _b).norm())
+    if (dot_product > 0 && dot_product < (_a - _b).squaredNorm())
     {
         return true;
     }
@@ -434,21 +444,20 @@ bool BaxterChain::obstacleToCollisionPoint(const Obstacle& _obstacle,
 
 
     // Project the point onto the last segment of the chain
-    Vector3d pos_ee           = getH(getNrOfJoints()-1).block<3,1>(0,3);
-    Vector3d pos_ee_minus_one = getH(getNrOfJoints()-2).block<3,1>(0,3);
+    // getH() is getH(getNrOfJoints()-1), so the end-effector is computed only once
+    Isometry3d H_ee             = getIsometry();
+    Vector3d   pos_ee           = H_ee.translation();
+    Vector3d   pos_ee_minus_one = getIsometry(getNrOfJoints()-2).translation();
 
     _coll_pt.x_wrf = projectOntoSegment(pos_ee_minus_one, pos_ee, _obstacle.x_wrf);
     _coll_pt.n_wrf = _obstacle.x_wrf - _coll_pt.x_wrf;
 
     // Convert the collision point from the wrf to end-effector reference frame
-    Vector4d tmp(0, 0, 0, 1);
-    tmp.block<3,1>(0,0) = _coll_pt.x_wrf;
-
-    changeFoR(_coll_pt.x_wrf, getH(), _coll_pt.x_erf);
+    changeFoR(_coll_pt.x_wrf, H_ee, _coll_pt.x_erf);
 
     // Convert the obstacle point from the wrf to end-effector reference frame
     Vector3d obstacle_erf;
-    changeFoR(_obstacle.x_wrf, getH(), obstacle_erf);
+    changeFoR(_obstacle.x_wrf, H_ee, obstacle_erf);
 
     // Compute the norm vector in the end-effector reference frame
     _coll_pt.n_erf = ( obstacle_erf - _coll_pt.x_erf);
@@ -463,18 +472,8 @@ bool BaxterChain::obstacleToCollisionPoint(const Obstacle& _obstacle,
 
     _coll_pt.n_erf /= dist;
 
-    double rho   = 0.4;
-    double alpha = 6.0;
-    double thres = 0.5;
     // Compute the magnitude
-    if (dist > thres)
-    {
-        _coll_pt.mag = 0.0;
-    }
-    else
-    {
-        _coll_pt.mag = 1.0/(1.0+exp((dist*(2.0/rho)-1.0)*alpha));
-    }
+    _coll_pt.mag = distanceToMagnitude(dist);
 
     ROS_ASSERT(_coll_pt.mag >= 0.0 && _coll_pt.mag <= 1.0);
 
@@ -0,0 +1,324 @@
+#include <limits>
+#include <algorithm>
+
+#include "react_controller/collisionGeometry.h"
+
+using namespace   std;
+using namespace Eigen;
+
+void Capsules::resize(size_t _n)
+{
+    ax.resize(_n); ay.resize(_n); az.resize(_n);
+    bx.resize(_n); by.resize(_n); bz.resize(_n);
+    r .resize(_n);
+}
+
+void Capsules::set(size_t _i, const Vector3d &_a, const Vector3d &_b, double _r)
+{
+    ax[_i] = _a[0]; ay[_i] = _a[1]; az[_i] = _a[2];
+    bx[_i] = _b[0]; by[_i] = _b[1]; bz[_i] = _b[2];
+    r [_i] = _r;
+}
+
+void Spheres::resize(size_t _n)
+{
+    x.resize(_n); y.resize(_n); z.resize(_n);
+    r.resize(_n);
+}
+
+void Spheres::set(size_t _i, const Vector3d &_c, double _r)
+{
+    x[_i] = _c[0]; y[_i] = _c[1]; z[_i] = _c[2];
+    r[_i] = _r;
+}
+
+Vector3d SphereCapsuleDistances::closestPoint(const Capsules &_caps, size_t _i, size_t _l) const
+{
+    Vector3d a(_caps.ax[_l], _caps.ay[_l], _caps.az[_l]);
+    Vector3d b(_caps.bx[_l], _caps.by[_l], _caps.bz[_l]);
+
+    return a + t(_i, _l) * (b - a) + _caps.r[_l] * normal(_i, _l);
+}
+
+Vector3d SphereCapsuleDistances::normal(size_t _i, size_t _l) const
+{
+    return Vector3d(nx(_i, _l), ny(_i, _l), nz(_i, _l));
+}
+
+void sphereCapsuleDistances(const Capsules &_caps, const Spheres &_spheres,
+                            SphereCapsuleDistances &_res)
+{
+    const size_t n = _spheres.size();
+    const size_t l =    _caps.size();
+
+    _res.dist.resize(n, l);
+    _res.t   .resize(n, l);
+    _res.nx  .resize(n, l);
+    _res.ny  .resize(n, l);
+    _res.nz  .resize(n, l);
+
+    // Spheres are processed in blocks that fit in the L1 cache, since every
+    // step below is a separate (vectorized) pass over the block
+    const size_t block = 256;
+    Array<double, Dynamic, 1, 0, block, 1> inv_norm;
+
+    for (size_t b = 0; b < n; b += block)
+    {
+        const size_t nb = std::min(block, n - b);
+
+        auto x = _spheres.x.segment(b, nb);
+        auto y = _spheres.y.segment(b, nb);
+        auto z = _spheres.z.segment(b, nb);
+
+        for (size_t c = 0; c < l; ++c)
+        {
+            double abx = _caps.bx[c] - _caps.ax[c];
+            double aby = _caps.by[c] - _caps.ay[c];
+            double abz = _caps.bz[c] - _caps.az[c];
+
+            double den = abx*abx + aby*aby + abz*abz;
+            double inv = den > 0.0 ? 1.0 / den : 0.0;
+
+            auto t    = _res.t   .col(c).segment(b, nb);
+            auto nx   = _res.nx  .col(c).segment(b, nb);
+            auto ny   = _res.ny  .col(c).segment(b, nb);
+            auto nz   = _res.nz  .col(c).segment(b, nb);
+            auto dist = _res.dist.col(c).segment(b, nb);
+
+            t = (((x - _caps.ax[c]) * abx + (y - _caps.ay[c]) * aby +
+                  (z - _caps.az[c]) * abz) * inv).max(0.0).min(1.0);
+
+            // Difference vectors between the centers and the closest points on the segment
+            nx = x - (_caps.ax[c] + t * abx);
+            ny = y - (_caps.ay[c] + t * aby);
+            nz = z - (_caps.az[c] + t * abz);
+
+            dist     = (nx.square() + ny.square() + nz.square()).sqrt();
+            inv_norm = dist.max(1e-12).inverse();
+
+            nx *= inv_norm;
+            ny *= inv_norm;
+            nz *= inv_norm;
+
+            dist -= _spheres.r.segment(b, nb) + _caps.r[c];
+        }
+    }
+}
+
+/**
+ * Closest points between two segments, by clamping the parameters of the closest
+ * points of the two lines to [0, 1] (see Ericson, Real-Time Collision Detection, 5.1.9).
+ *
+ * @param  _p0 the first  end of the first  segment
+ * @param  _p1 the second end of the first  segment
+ * @param  _q0 the first  end of the second segment
+ * @param  _q1 the second end of the second segment
+ * @param  _cp the closest point on the first  segment
+ * @param  _cq the closest point on the second segment
+ * @return     the distance between the two segments [m]
+ */
+double segmentSegmentDistance(const Vector3d &_p0, const Vector3d &_p1,
+                              const Vector3d &_q0, const Vector3d &_q1,
+                              Vector3d &_cp, Vector3d &_cq)
+{
+    Vector3d d1 = _p1 - _p0, d2 = _q1 - _q0, r = _p0 - _q0;
+
+    double a = d1.squaredNorm(), e = d2.squaredNorm(), f = d2.dot(r);
+    double s = 0.0, t = 0.0;
+
+    // Degenerate segments (i.e. points) are handled separately
+    if (a > 1e-12 && e > 1e-12)
+    {
+        double b = d1.dot(d2), c = d1.dot(r);
+        double denom = a * e - b * b;
+
+        // For parallel segments any s is fine, let's start from _p0
+        if (denom > 1e-12)    { s = std::min(std::max((b * f - c * e) / denom, 0.0), 1.0); }
+
+        t = (b * s + f) / e;
+
+        if      (t < 0.0) { t = 0.0; s = std::min(std::max(     -c  / a, 0.0), 1.0); }
+        else if (t > 1.0) { t = 1.0; s = std::min(std::max((b - c) / a, 0.0), 1.0); }
+    }
+    else if (a > 1e-12)
+    {
+        s = std::min(std::max(-d1.dot(r) / a, 0.0), 1.0);
+    }
+    else if (e > 1e-12)
+    {
+        t = std::min(std::max(f / e, 0.0), 1.0);
+    }
+
+    _cp = _p0 + s * d1;
+    _cq = _q0 + t * d2;
+
+    return (_cp - _cq).norm();
+}
+
+void receptiveFieldActivations(const MatrixX3d &_points, const MatrixX3d &_normals,
+                               const Matrix3Xd &_centers, const ArrayXd &_sizes,
+                               double _depth, double _cos_half_angle, ArrayXXd &_act)
+{
+    size_t n_points = _points.rows();
+    _act.resize(n_points, _centers.cols());
+
+    // Columns of the points and of the normals are contiguous, and every sphere
+    // is evaluated against all the points at once
+    ArrayXd dx(n_points), dy(n_points), dz(n_points), dist(n_points), cos_ang(n_points);
+
+    for (int m = 0; m < _centers.cols(); ++m)
+    {
+        dx = _centers(0,m) - _points.col(0).array();
+        dy = _centers(1,m) - _points.col(1).array();
+        dz = _centers(2,m) - _points.col(2).array();
+
+        dist    = (dx * dx + dy * dy + dz * dz).sqrt();
+        cos_ang =  dx * _normals.col(0).array() + dy * _normals.col(1).array() +
+                   dz * _normals.col(2).array();
+
+        // Angular profile, with centers on the points considered along the normal
+        cos_ang = (dist > 1e-9).select(cos_ang / dist, 1.0);
+        cos_ang = ((cos_ang - _cos_half_angle) / (1.0 - _cos_half_angle)).max(0.0).min(1.0);
+
+        // Radial profile from the surface of the sphere, i.e. 1 - smoothstep(h / _depth)
+        dist = ((dist - _sizes[m]) / _depth).max(0.0).min(1.0);
+
+        _act.col(m) = cos_ang * (1.0 - dist * dist * (3.0 - 2.0 * dist));
+    }
+}
+
+SweptCollision sweptCapsuleCheck(const Capsules &_from, const Capsules &_to,
+                                 const Spheres &_spheres, double _tol, size_t _max_iters)
+{
+    SweptCollision res;
+    vector<size_t> near;
+
+    for (size_t l = 0; l < _from.size() && l < _to.size(); ++l)
+    {
+        Vector3d a_0(_from.ax[l], _from.ay[l], _from.az[l]), da = Vector3d(_to.ax[l], _to.ay[l], _to.az[l]) - a_0;
+        Vector3d b_0(_from.bx[l], _from.by[l], _from.bz[l]), db = Vector3d(_to.bx[l], _to.by[l], _to.bz[l]) - b_0;
+        double   v = std::max(da.norm(), db.norm());
+
+        if (v < 1e-9)    { continue; }
+
+        // Every point of the swept capsule is within v/2 from the capsule halfway through
+        Vector3d a_m = a_0 + 0.5 * da, b_m = b_0 + 0.5 * db;
+
+        near.clear();
+        for (size_t s = 0; s < _spheres.size(); ++s)
+        {
+            Vector3d c(_spheres.x[s], _spheres.y[s], _spheres.z[s]);
+            double   r = _from.r[l] + _spheres.r[s];
+
+            if (distanceToSegment(a_m, b_m, c) - r > 0.5 * v + _tol)    { continue; }
+            if (distanceToSegment(a_0, b_0, c) - r < _tol)              { continue; }
+
+            near.push_back(s);
+        }
+
+        // There is no need to look past an earlier hit of another capsule
+        double t = 0.0;
+        for (size_t it = 0; not near.empty() && t < res.toi; ++it)
+        {
+            Vector3d a = a_0 + t * da, b = b_0 + t * db;
+
+            double d = std::numeric_limits<double>::max();
+            size_t k = 0;
+            for (size_t n = 0; n < near.size(); ++n)
+            {
+                size_t   s = near[n];
+                double d_s = distanceToSegment(a, b, Vector3d(_spheres.x[s], _spheres.y[s], _spheres.z[s]))
+                             - _from.r[l] - _spheres.r[s];
+
+                if (d_s < d)    { d = d_s;  k = s; }
+            }
+
+            res.n_iters++;
+
+            if (d < _tol || it >= _max_iters)
+            {
+                res.collision = true;
+                res.toi       = t;
+                res.link      = l;
+                res.sphere    = k;
+                break;
+            }
+
+            t += d / v;
+        }
+    }
+
+    return res;
+}
+
+void chainCapsules(BaxterChain &_chain, const vector<double> &_radii, Capsules &_caps)
+{
+    size_t n_joints = _chain.getNrOfJoints();
+
+    _caps.resize(n_joints > 0 ? n_joints - 1 : 0);
+
+    Vector3d a = n_joints > 0 ? Vector3d(_chain.getH(0).block<3,1>(0,3)) : Vector3d::Zero();
+    for (size_t j = 1; j < n_joints; ++j)
+    {
+        Vector3d b = _chain.getH(j).block<3,1>(0,3);
+        _caps.set(j - 1, a, b, j < _radii.size() ? _radii[j] : 0.0);
+        a = b;
+    }
+}
+
+/**
+ * Computes the radius of the collision geometry of a link (-1 if not available).
+ */
+static double linkRadius(const urdf::Model &_robot, const string &_link)
+{
+    boost::shared_ptr<const urdf::Link> link = _robot.getLink(_link);
+
+    if (!link || !link->collision || !link->collision->geometry)    { return -1.0; }
+
+    boost::shared_ptr<urdf::Geometry> geom = link->collision->geometry;
+
+    switch (geom->type)
+    {
+        case urdf::Geometry::SPHERE:
+            return boost::static_pointer_cast<urdf::Sphere>(geom)->radius;
+        case urdf::Geometry::CYLINDER:
+            return boost::static_pointer_cast<urdf::Cylinder>(geom)->radius;
+        case urdf::Geometry::BOX:
+        {
+            urdf::Vector3 dim = boost::static_pointer_cast<urdf::Box>(geom)->dim;
+            double d[3] = {dim.x, dim.y, dim.z};
+            std::sort(d, d + 3);
+            return 0.5 * d[1];
+        }
+        default:
+            return -1.0;
+    }
+}
+
+vector<double> capsuleRadiiFromURDF(const urdf::Model &_robot, BaxterChain _chain,
+                                    double _default)
+{
+    size_t n_joints = _chain.getNrOfJoints();
+    vector<double> res(n_joints, -1.0);
+
+    // The geometry of the child link of the segment with joint j lies after joint
+    // j, i.e. on capsule j+1 (the fixed segments after it as well). The geometry
+    // after the last joint ends up in the last capsule, since getH(n_joints-1)
+    // is the tip of the chain.
+    size_t j = 0;
+    for (size_t s = 0; s < _chain.getNrOfSegments(); ++s)
+    {
+        if (_chain.getSegment(s).getJoint().getType() != KDL::Joint::None)    { ++j; }
+        if (j == 0)    { continue; }
+
+        size_t c = std::min(j, n_joints - 1);
+        res[c]   = std::max(res[c], linkRadius(_robot, _chain.getSegment(s).getName()));
+    }
+
+    for (size_t c = 0; c < res.size(); ++c)
+    {
+        if (res[c] < 0.0)    { res[c] = _default; }
+    }
+
+    return res;
+}
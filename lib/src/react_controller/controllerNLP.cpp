@@ -9,20 +9,27 @@ using namespace   std;
 
 ControllerNLP::ControllerNLP(BaxterChain chain_, double dt_, bool ctrl_ori_) :
                              chain(chain_), dt(dt_), ctrl_ori(ctrl_ori_), print_level(0), pid(10.0),
+                             formulation(POS_HARD), w_xyz(1e3), w_slack(1e4), l_xyz(1.0), l_ang(1.0),
                              q_0(chain_.getNrOfJoints()), v_0(chain_.getNrOfJoints()),
                              J_0_xyz(3,chain_.getNrOfJoints()), J_0_ang(3,chain_.getNrOfJoints()),
-                             v_e(chain_.getNrOfJoints()), q_lim(chain_.getNrOfJoints(),2),
+                             v_e(chain_.getNrOfJoints()), exact_hessian(false), nonlinear_fk(false),
+                             kin(chain_), q_fk(chain_.getNrOfJoints()), warm_start(NULL),
+                             q_lim(chain_.getNrOfJoints(),2),
                              v_lim(chain_.getNrOfJoints(),2), bounds(chain_.getNrOfJoints(),2),
                              qGuard(chain_.getNrOfJoints()),
                              qGuardMinExt(chain_.getNrOfJoints()), qGuardMinInt(chain_.getNrOfJoints()),
                              qGuardMinCOG(chain_.getNrOfJoints()), qGuardMaxExt(chain_.getNrOfJoints()),
                              qGuardMaxInt(chain_.getNrOfJoints()), qGuardMaxCOG(chain_.getNrOfJoints())
 {
+    ROS_ASSERT_MSG(chain_.getNrOfJoints() < NLP_MAX_VARS, "The chain has %lu joints, the NLP takes up to %i",
+                   chain_.getNrOfJoints(), NLP_MAX_VARS - 1);
+
     v_0.setZero();
     v_e.setZero();
 
-    R_e.setIdentity();
-    R_r.setIdentity();
+    o_0.setIdentity();
+    o_e.setIdentity();
+    o_r.setIdentity();
 
     for (size_t r=0; r<chain_.getNrOfJoints(); r++)
     {
@@ -99,15 +106,26 @@ void ControllerNLP::computeBounds()
     // }
 }
 
+bool ControllerNLP::set_q_0(const VectorXd &_q_0)
+{
+    return chain.setAng(_q_0);
+}
+
+void ControllerNLP::computeScaling()
+{
+    // Largest velocity allowed for each joint
+    VectorXd v_max = bounds.cwiseAbs().rowwise().maxCoeff();
+
+    l_xyz = pid * dt * (J_0_xyz * v_max.asDiagonal()).norm();
+    l_ang = pid * dt * (J_0_ang * v_max.asDiagonal()).norm();
+
+    ROS_INFO_COND(print_level>=4, "Scaling: l_xyz %g l_ang %g", l_xyz, l_ang);
+}
+
 void ControllerNLP::set_x_r(const Eigen::Vector3d &_p_r, const Eigen::Quaterniond &_o_r)
 {
     p_r = _p_r;
-    o_r = _o_r;
-    R_r =  o_r.toRotationMatrix();
-
-    skew_nr = skew(R_r.col(0));
-    skew_sr = skew(R_r.col(1));
-    skew_ar = skew(R_r.col(2));
+    o_r = _o_r.normalized();
 }
 
 void ControllerNLP::set_v_lim(const MatrixXd &_v_lim)
@@ -149,6 +167,46 @@ void ControllerNLP::set_print_level(size_t _print_level)
     print_level = _print_level;
 }
 
+bool ControllerNLP::set_formulation(const string &_formulation, double _weight)
+{
+    if (_weight <= 0.0)
+    {
+        ROS_ERROR("Weight of the %s formulation should be positive, got %g",
+                                                _formulation.c_str(), _weight);
+        return false;
+    }
+
+    if      (_formulation ==  "hard") { formulation = POS_HARD;                     }
+    else if (_formulation ==  "soft") { formulation = POS_SOFT;  w_xyz   = _weight; }
+    else if (_formulation == "slack") { formulation = POS_SLACK; w_slack = _weight; }
+    else
+    {
+        ROS_ERROR("Unknown formulation %s. Allowed ones are hard, soft and slack.",
+                                                              _formulation.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void ControllerNLP::set_coll_constraints(const vector<VelocityConstraint> &_coll, double _gain)
+{
+    ROS_ASSERT(_gain > 0.0);
+
+    for (size_t c = 0; c < _coll.size(); ++c)
+    {
+        ROS_ASSERT(size_t(_coll[c].a.size()) <= chain.getNrOfJoints());
+    }
+
+    coll = _coll;
+
+    // The joints move at gain*v, so a.(gain*v) >= lb is a.v >= lb/gain
+    for (size_t c = 0; c < coll.size(); ++c)
+    {
+        coll[c].lb /= _gain;
+    }
+}
+
 void ControllerNLP::init()
 {
     q_0 = chain.getAng();
@@ -157,12 +215,12 @@ void ControllerNLP::init()
     ROS_INFO_STREAM_COND(print_level>=2, "q_0: [" << q_0.transpose() << "]");
     ROS_INFO_STREAM_COND(print_level>=2, "v_0: [" << v_0.transpose() << "]");
 
-    Matrix4d H_0 = chain.getH();
-    R_0 = H_0.block<3,3>(0,0);
-    p_0 = H_0.block<3,1>(0,3);
+    Isometry3d H_0 = chain.getIsometry();
+    o_0 = Quaterniond(H_0.linear());
+    p_0 = H_0.translation();
 
-    ROS_INFO_STREAM_COND(print_level>=6, "H_0: \n" << H_0);
-    ROS_INFO_STREAM_COND(print_level>=6, "R_0: \n" << R_0);
+    ROS_INFO_STREAM_COND(print_level>=6, "H_0: \n" << H_0.matrix());
+    ROS_INFO_STREAM_COND(print_level>=6, "o_0: \t" << o_0.vec().transpose() << " " << o_0.w());
     ROS_INFO_STREAM_COND(print_level>=6, "p_0: \t" << p_0.transpose());
 
     MatrixXd J_0 = chain.GeoJacobian();
@@ -175,6 +233,14 @@ void ControllerNLP::init()
     ROS_INFO_STREAM_COND(print_level>=3 && ctrl_ori, "J_0_ang:\n" << J_0_ang);
 
     computeBounds();
+    computeScaling();
+}
+
+void ControllerNLP::reset()
+{
+    v_e.setZero();
+    coll.clear();
+    warm_start = NULL;
 }
 
 VectorXd ControllerNLP::get_est_vels()
@@ -182,6 +248,16 @@ VectorXd ControllerNLP::get_est_vels()
     return v_e;
 }
 
+void ControllerNLP::set_est_vels(const VectorXd &_v_e)
+{
+    ROS_ASSERT(v_e.size() == _v_e.size());
+
+    VectorXd v = _v_e.cwiseMax(bounds.col(0)).cwiseMin(bounds.col(1));
+
+    updateKernels();
+    computeQuantities(v.data(), true);
+}
+
 VectorXd ControllerNLP::get_est_conf()
 {
     return q_0 + (pid * dt * v_e);
@@ -193,10 +269,26 @@ bool ControllerNLP::get_nlp_info(Ipopt::Index &n, Ipopt::Index &m, Ipopt::Index
 
     n=chain.getNrOfJoints();
 
+    updateKernels();
+
     // reaching in position
-    m=1; nnz_jac_g=n;
+    switch (formulation)
+    {
+        case POS_HARD : m=1; nnz_jac_g=n;   break;
+        case POS_SOFT : m=0; nnz_jac_g=0;   break;
+        // the slack variable is the last one
+        case POS_SLACK: n++; m=1; nnz_jac_g=n; break;
+    }
+
+    // one sparse row per velocity constraint
+    for (size_t c=0; c<coll.size(); ++c)
+    {
+        m++;
+        nnz_jac_g+=coll[c].a.size();
+    }
 
-    nnz_h_lag=0;
+    // dense lower triangle (the velocity constraints are linear)
+    nnz_h_lag=(exact_hessian && not nonlinear_fk)?n*(n+1)/2:0;
     index_style=TNLP::C_STYLE;
     return true;
 }
@@ -204,7 +296,7 @@ bool ControllerNLP::get_nlp_info(Ipopt::Index &n, Ipopt::Index &m, Ipopt::Index
 bool ControllerNLP::get_bounds_info(Ipopt::Index n, Ipopt::Number *x_l, Ipopt::Number *x_u,
                                     Ipopt::Index m, Ipopt::Number *g_l, Ipopt::Number *g_u)
 {
-    for (Ipopt::Index i=0; i<n; ++i)
+    for (Ipopt::Index i=0; i<v_e.size(); ++i)
     {
         x_l[i]=bounds(i,0);
         x_u[i]=bounds(i,1);
@@ -223,8 +315,66 @@ bool ControllerNLP::get_bounds_info(Ipopt::Index n, Ipopt::Number *x_l, Ipopt::N
     }
 
     // reaching in position
-    g_l[0]=-1e-11;
-    g_u[0]=+1e-11;
+    if (formulation == POS_HARD)
+    {
+        g_l[0]=-1e-11;
+        g_u[0]=+1e-11;
+    }
+    else if (formulation == POS_SLACK)
+    {
+        x_l[n-1]=0.0;
+        x_u[n-1]=2e19;  // i.e. +inf for IPOPT
+
+        g_l[0]=-2e19;
+        g_u[0]=+1e-11;
+    }
+
+    // velocity constraints
+    for (size_t c=0; c<coll.size(); ++c)
+    {
+        g_l[n_pos_rows()+c]=coll[c].lb;
+        g_u[n_pos_rows()+c]=2e19;
+    }
+
+    return true;
+}
+
+bool ControllerNLP::get_scaling_parameters(Ipopt::Number &obj_scaling,
+                                           bool &use_x_scaling, Ipopt::Index n, Ipopt::Number *x_scaling,
+                                           bool &use_g_scaling, Ipopt::Index m, Ipopt::Number *g_scaling)
+{
+    // Avoid blowing up the scaling factors when the arm is (almost) still
+    const double eps = 1e-6;
+    double sq_l_xyz  = std::max(l_xyz * l_xyz, eps * eps);
+    double sq_l_ang  = std::max(l_ang * l_ang, eps * eps);
+
+    use_x_scaling = true;
+    for (Ipopt::Index i=0; i<v_e.size(); ++i)
+    {
+        x_scaling[i]=1.0/std::max(std::max(fabs(bounds(i,0)),fabs(bounds(i,1))),eps);
+    }
+
+    double obj = ctrl_ori?sq_l_ang:0.0;
+
+    switch (formulation)
+    {
+        case POS_HARD :                                    break;
+        case POS_SOFT : obj += w_xyz   * sq_l_xyz;         break;
+        case POS_SLACK: obj += w_slack * sq_l_xyz;
+                        x_scaling[n-1] = 1.0 / sq_l_xyz;   break;
+    }
+
+    obj_scaling = obj > 0.0 ? 1.0 / obj : 1.0;
+
+    use_g_scaling = m > 0;
+    if (n_pos_rows() > 0) { g_scaling[0] = 1.0 / sq_l_xyz; }
+
+    // Velocity constraints are normalized by the largest value they can take
+    VectorXd v_max = bounds.cwiseAbs().rowwise().maxCoeff();
+    for (size_t c=0; c<coll.size(); ++c)
+    {
+        g_scaling[n_pos_rows()+c] = 1.0 / std::max(coll[c].a.cwiseAbs().dot(v_max.head(coll[c].a.size())), eps);
+    }
 
     return true;
 }
@@ -233,13 +383,128 @@ bool ControllerNLP::get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Numbe
                         bool init_z, Ipopt::Number *z_L, Ipopt::Number *z_U,
                         Ipopt::Index m, bool init_lambda, Ipopt::Number *lambda)
 {
-    for (Ipopt::Index i=0; i<n; ++i)
+    // Either the initial velocities, or the solution predicted by the model
+    VectorXd v_p = v_0;
+
+    if (warm_start != NULL && not warm_start->predict(q_0, p_0, p_r, v_0, v_p))
+    {
+        ROS_WARN_ONCE("The warm start model is not of this chain, starting from v_0");
+        v_p = v_0;
+    }
+
+    for (Ipopt::Index i=0; i<v_e.size(); ++i)
+    {
+        x[i]=std::min(std::max(bounds(i,0),v_p[i]),bounds(i,1));
+    }
+
+    if (formulation == POS_SLACK)
     {
-        x[i]=std::min(std::max(bounds(i,0),v_0[i]),bounds(i,1));
+        // Start from a feasible slack, i.e. the positional error at the starting point
+        if (nonlinear_fk)
+        {
+            updateFK(x);
+            x[n-1]=(p_r-kin.getIsometry().translation()).squaredNorm();
+        }
+        else
+        {
+            Map<const VectorXd> v_s(x, v_e.size());
+            x[n-1]=(p_r-p_0-pid*dt*(J_0_xyz*v_s)).squaredNorm();
+        }
     }
+
     return true;
 }
 
+void ControllerNLP::updateKernels()
+{
+    NLPTermData d;
+
+    d.n_joints    = chain.getNrOfJoints();
+    d.formulation = formulation;
+    d.ctrl_ori    = ctrl_ori;
+    d.w_xyz       = w_xyz;
+    d.w_slack     = w_slack;
+    d.p_0         = p_0;
+    d.p_r         = p_r;
+    d.ori.o_0     = o_0;
+    d.ori.o_r     = o_r;
+    d.J_xyz       = pid * dt * J_0_xyz;
+    d.J_ang       = pid * dt * J_0_ang;
+
+    kernels.set_data(d);
+}
+
+void ControllerNLP::updateFK(const Ipopt::Number *x)
+{
+    q_fk = q_0 + pid * dt * Map<const VectorXd>(x, q_fk.size());
+    kin.setAng(q_fk);
+}
+
+double ControllerNLP::fkObjective(const Ipopt::Number *x, Ipopt::Index n, Ipopt::Number *grad)
+{
+    updateFK(x);
+
+    const Isometry3d &H = kin.getIsometry();
+    Map<VectorXd> grad_v(grad, grad != NULL ? q_fk.size() : 0);
+    double f = 0.0;
+
+    if (grad != NULL) { Map<VectorXd>(grad, n).setZero(); }
+
+    if (ctrl_ori)
+    {
+        // The derivative of the error is with respect to the angular velocity of the end-effector
+        Matrix3d D;
+        Vector3d err = orientationError(o_r, Quaterniond(H.linear()), D);
+        f += err.squaredNorm();
+
+        if (grad != NULL)
+        {
+            grad_v += 2.0 * pid * dt * (kin.GeoJacobian().bottomRows<3>().transpose() * (D.transpose() * err));
+        }
+    }
+
+    if (formulation == POS_SOFT)
+    {
+        Vector3d err = p_r - H.translation();
+        f += w_xyz * err.squaredNorm();
+
+        if (grad != NULL)
+        {
+            grad_v -= 2.0 * w_xyz * pid * dt * (kin.GeoJacobian().topRows<3>().transpose() * err);
+        }
+    }
+    else if (formulation == POS_SLACK)
+    {
+        f += w_slack * x[n-1];
+
+        if (grad != NULL) { grad[n-1] = w_slack; }
+    }
+
+    return f;
+}
+
+double ControllerNLP::fkPosConstraint(const Ipopt::Number *x, Ipopt::Index n, Ipopt::Number *jac)
+{
+    updateFK(x);
+
+    Vector3d err = p_r - kin.getIsometry().translation();
+    double g = err.squaredNorm();
+
+    if (jac != NULL)
+    {
+        Map<VectorXd>(jac, q_fk.size()) = -2.0 * pid * dt * (kin.GeoJacobian().topRows<3>().transpose() * err);
+    }
+
+    if (formulation == POS_SLACK)
+    {
+        g -= x[n-1];
+
+        if (jac != NULL) { jac[n-1] = -1.0; }
+    }
+
+    return g;
+}
+
 void ControllerNLP::computeQuantities(const Ipopt::Number *x, const bool new_x)
 {
     if (new_x)
@@ -250,9 +515,19 @@ void ControllerNLP::computeQuantities(const Ipopt::Number *x, const bool new_x)
             v_e[i]=x[i];
         }
 
-        p_e = p_0 + pid * dt * (J_0_xyz * v_e);
+        // The same quantities the kernels work with
+        const NLPTermData &d = kernels.get_data();
 
-        err_xyz = p_r-p_e;
+        if (nonlinear_fk)
+        {
+            updateFK(x);
+            err_xyz = p_r - kin.getIsometry().translation();
+        }
+        else
+        {
+            err_xyz = d.posError(x);
+        }
+        p_e     = p_r - err_xyz;
 
         ROS_INFO_STREAM_COND(print_level>=4, "    v_e: " <<     v_e.transpose());
         ROS_INFO_STREAM_COND(print_level>=4, "err_xyz: " << err_xyz.transpose() <<
@@ -261,29 +536,23 @@ void ControllerNLP::computeQuantities(const Ipopt::Number *x, const bool new_x)
         {
             // Now, let's compute the position and orientation errors
             // See https://math.stackexchange.com/questions/773902/integrating-body-angular-velocity/2176586#217658
-            Vector3d  w_e = J_0_ang*v_e;          // rotational (angular) speed
-            double theta =   w_e.norm();
-            if (theta > 0.0) { w_e /= theta; }
-
-            AngleAxisd w_e_aa(theta * pid * dt, w_e);   // angular increment in axis angle representation
-            ROS_INFO_STREAM_COND(print_level>=5, "w_e_aa: \t" <<
-                                 w_e_aa.axis().transpose() << " " << w_e_aa.angle());
-
-            R_e = w_e_aa.toRotationMatrix() * R_0;
-            ROS_INFO_STREAM_COND(print_level>=5, "R_e: \n" << R_e);
-
-            Quaterniond o_e(R_e);
-
-            err_ang = angularError(R_r, R_e);
-            // err_ang = angularError(o_r, o_e);
+            if (nonlinear_fk)
+            {
+                o_e = Quaterniond(kin.getIsometry().linear());
+            }
+            else
+            {
+                double   w;
+                Vector3d v;
+                d.ori.estOrientation(d.angIncrement(x), w, v);
+
+                o_e = Quaterniond(w, v[0], v[1], v[2]);
+            }
+            ROS_INFO_STREAM_COND(print_level>=5, "o_e: \t" << o_e.vec().transpose() << " " << o_e.w());
+
+            err_ang = orientationError(o_r, o_e);
             ROS_INFO_STREAM_COND(print_level>=4, "err_ang: " << err_ang.transpose() <<
                                             " squaredNorm: " << err_ang.squaredNorm());
-
-            MatrixXd L=-0.5*(skew_nr*skew(R_e.col(0))+
-                             skew_sr*skew(R_e.col(1))+
-                             skew_ar*skew(R_e.col(2)));
-
-            Derr_ang=-pid*dt*(L*J_0_ang);
         }
     }
 }
@@ -291,20 +560,18 @@ void ControllerNLP::computeQuantities(const Ipopt::Number *x, const bool new_x)
 bool ControllerNLP::eval_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
             Ipopt::Number &obj_value)
 {
-    computeQuantities(x,new_x);
-    obj_value=(ctrl_ori?err_ang.squaredNorm():0.0);
-    // ROS_INFO("err_ang.squaredNorm() %g", err_ang.squaredNorm());
+    if (print_level>=4) { computeQuantities(x,new_x); }
+
+    obj_value=nonlinear_fk?fkObjective(x,n,NULL):kernels.objective(x,n);
+
     return true;
 }
 
 bool ControllerNLP::eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
                  Ipopt::Number *grad_f)
 {
-    computeQuantities(x,new_x);
-    for (Ipopt::Index i=0; i<n; ++i)
-    {
-        grad_f[i]=(ctrl_ori?2.0*err_ang.dot(Derr_ang.col(i)):0.0);
-    }
+    if (nonlinear_fk) { fkObjective(x,n,grad_f);        }
+    else              { kernels.objective(x,n,grad_f); }
 
     return true;
 }
@@ -312,11 +579,14 @@ bool ControllerNLP::eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new
 bool ControllerNLP::eval_g(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
             Ipopt::Index m, Ipopt::Number *g)
 {
-    computeQuantities(x,new_x);
+    // reaching in position (minus the slack variable, if any)
+    if (n_pos_rows() > 0) { g[0]=nonlinear_fk?fkPosConstraint(x,n,NULL):kernels.posConstraint(x,n); }
 
-    // reaching in position
-    g[0]=err_xyz.squaredNorm();
-    // ROS_INFO("err_xyz.squaredNorm() %g", g[0]);
+    // velocity constraints
+    for (size_t c=0; c<coll.size(); ++c)
+    {
+        g[n_pos_rows()+c]=coll[c].a.dot(Map<const VectorXd>(x, coll[c].a.size()));
+    }
 
     return true;
 }
@@ -329,24 +599,84 @@ bool ControllerNLP::eval_jac_g(Ipopt::Index n, const Ipopt::Number *x, bool new_
     {
         Ipopt::Index idx=0;
 
-        // reaching in position
-        for (Ipopt::Index i=0; i<n; ++i)
+        // reaching in position (plus the slack variable, if any)
+        for (Ipopt::Index i=0; i<(n_pos_rows()>0?n:0); ++i)
         {
-            iRow[i]=0; jCol[i]=i;
+            iRow[idx]=0; jCol[idx]=i;
             idx++;
         }
+
+        // velocity constraints, only with the joints they involve
+        for (size_t c=0; c<coll.size(); ++c)
+        {
+            for (Ipopt::Index i=0; i<coll[c].a.size(); ++i)
+            {
+                iRow[idx]=n_pos_rows()+c; jCol[idx]=i;
+                idx++;
+            }
+        }
     }
     else
     {
-        computeQuantities(x,new_x);
+        Ipopt::Index idx=0;
+
+        // reaching in position (plus the slack variable, if any)
+        if (n_pos_rows() > 0)
+        {
+            if (nonlinear_fk) { fkPosConstraint(x,n,values);     }
+            else              { kernels.posConstraint(x,n,values); }
+            idx+=n;
+        }
+
+        // velocity constraints
+        for (size_t c=0; c<coll.size(); ++c)
+        {
+            for (Ipopt::Index i=0; i<coll[c].a.size(); ++i)
+            {
+                values[idx]=coll[c].a[i];
+                idx++;
+            }
+        }
+    }
 
+    return true;
+}
+
+bool ControllerNLP::eval_h(Ipopt::Index n, const Ipopt::Number *x, bool new_x, Ipopt::Number obj_factor,
+                           Ipopt::Index m, const Ipopt::Number *lambda, bool new_lambda,
+                           Ipopt::Index nele_hess, Ipopt::Index *iRow, Ipopt::Index *jCol,
+                           Ipopt::Number *values)
+{
+    if (not exact_hessian || nonlinear_fk) { return false; }
+
+    if (values==NULL)
+    {
         Ipopt::Index idx=0;
 
-        // reaching in position
+        // dense lower triangle
         for (Ipopt::Index i=0; i<n; ++i)
         {
-            values[i]=-2.0*pid*dt*(err_xyz.dot(J_0_xyz.col(i)));
-            idx++;
+            for (Ipopt::Index j=0; j<=i; ++j)
+            {
+                iRow[idx]=i; jCol[idx]=j;
+                idx++;
+            }
+        }
+    }
+    else
+    {
+        NLPMatrix H;
+        kernels.hessian(x,n,obj_factor,n_pos_rows()>0?lambda[0]:0.0,H);
+
+        Ipopt::Index idx=0;
+
+        for (Ipopt::Index i=0; i<n; ++i)
+        {
+            for (Ipopt::Index j=0; j<=i; ++j)
+            {
+                values[idx]=H(i,j);
+                idx++;
+            }
         }
     }
 
@@ -360,11 +690,14 @@ void ControllerNLP::finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n
                                       Ipopt::Number obj_value, const Ipopt::IpoptData *ip_data,
                                       Ipopt::IpoptCalculatedQuantities *ip_cq)
 {
-    for (Ipopt::Index i=0; i<n; ++i)
+    for (Ipopt::Index i=0; i<v_e.size(); ++i)
     {
         v_e[i]=x[i];
     }
 
+    // The estimated quantities have to be consistent with the solution
+    computeQuantities(x, true);
+
     // printf("\n");
     string print_str = "";
     if (status != Ipopt::SUCCESS) { print_str = "IPOPT Failed. Error code: " + toString(status) + ". "; }
@@ -412,8 +745,6 @@ void ControllerNLP::finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n
 
     if (ctrl_ori)
     {
-        Quaterniond o_e(R_e);
-        // Quaterniond o_0(R_0);
 
         // ROS_INFO_STREAM("init ori [o_0]: " << o_0.vec().transpose() << " " << o_0.w());
         // ROS_INFO_STREAM("ref  ori [o_r]: " << o_r.vec().transpose() << " " << o_r.w());
@@ -423,7 +754,6 @@ void ControllerNLP::finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n
         ROS_INFO("ori err [rad?]: %g\terr_ang %g",
                   o_e.dot(o_r),                err_ang.squaredNorm());
 
-        // ROS_INFO_STREAM("R_0: \n" << R_0);
         // ROS_INFO_STREAM("o_0: \n" << o_0.toRotationMatrix());
         // ROS_INFO_STREAM("o_r: \n" << o_r.toRotationMatrix());
     }
@@ -468,3 +798,22 @@ ControllerNLP::~ControllerNLP()
     return;
 }
 
+Ipopt::SmartPtr<Ipopt::IpoptApplication> newControllerApp(double _tol, double _max_cpu_time)
+{
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = new Ipopt::IpoptApplication;
+
+    app->Options()->SetNumericValue(            "tol", _tol);
+    app->Options()->SetNumericValue("constr_viol_tol", _tol);
+    app->Options()->SetNumericValue( "acceptable_tol", _tol);
+    app->Options()->SetIntegerValue("acceptable_iter",   10);
+    app->Options()->SetStringValue ( "mu_strategy", "adaptive");
+    // app->Options()->SetStringValue ("linear_solver", "ma57");
+    app->Options()->SetNumericValue("max_cpu_time", _max_cpu_time);
+    // The scaling method is gradient-based by default, user-scaling
+    // uses the one provided by ControllerNLP::get_scaling_parameters
+    app->Options()->SetStringValue ("nlp_scaling_method","gradient-based");
+    app->Options()->SetStringValue ("hessian_approximation","limited-memory");
+
+    return app;
+}
+
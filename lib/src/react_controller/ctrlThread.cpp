@@ -1,13 +1,61 @@
+#include <algorithm>
+#include <fstream>
+
+#include <visualization_msgs/MarkerArray.h>
+
 #include "react_controller/ctrlThread.h"
 
 using namespace   std;
 using namespace Eigen;
 
+void CtrlStats::reset()
+{
+    n_cycles   =   0;
+    n_idle     =   0;
+    n_unreachable = 0;
+    n_projected   = 0;
+    n_cached   =   0;
+    n_iters    =   0;
+    solve_time = 0.0;
+    avoid_time = 0.0;
+    n_swept    =   0;
+    n_swept_hits  = 0;
+    swept_time = 0.0;
+    exit_codes.clear();
+}
+
+string CtrlStats::toString()
+{
+    string res = "cycles " + std::to_string(n_cycles) + " idle " +
+                 std::to_string(n_idle) + " unreachable " + std::to_string(n_unreachable) +
+                 " projected " + std::to_string(n_projected) + " cached " +
+                 std::to_string(n_cached) + " iters/cycle " +
+                 std::to_string(n_cycles?double(n_iters)/n_cycles:0.0) + " solve time/cycle [ms] " +
+                 std::to_string(n_cycles?1e3*solve_time/n_cycles:0.0) + " avoidance time/cycle [ms] " +
+                 std::to_string(n_cycles?1e3*avoid_time/n_cycles:0.0) + " swept check time/step [us] " +
+                 std::to_string(n_swept?1e6*swept_time/n_swept:0.0) + " (" + std::to_string(n_swept_hits) +
+                 "/" + std::to_string(n_swept) + " steps shortened) exit codes";
+
+    for (map<int, size_t>::iterator it = exit_codes.begin(); it != exit_codes.end(); ++it)
+    {
+        res += " [" + std::to_string(it->first) + "]: " + std::to_string(it->second);
+    }
+
+    return res;
+}
+
 CtrlThread::CtrlThread(const string& _name, const string& _limb, bool _use_robot, double _ctrl_freq,
                        bool _is_debug, bool _coll_av, double _tol, double _vMax) :
                        RobotInterface(_name, _limb, _use_robot, _ctrl_freq, true, false, true, true),
                        chain(0), is_debug(_is_debug), internal_state(true), ctrl_ori(false),
-                       derivative_test(false), dT(1.0/_ctrl_freq),
+                       derivative_test(false), exact_hessian(false), nonlinear_fk(false), formulation("hard"),
+                       formulation_weight(1e3), nlp_scaling("gradient-based"),
+                       idle_tol_xyz(5e-4), idle_tol_ang(5e-3), reach_mode("reject"), ik_cache_on(false),
+                       grid_dirty(false), avoid_update_thres(0.005),
+                       avoid_hysteresis(0.02), avoid_mode("bounds"),
+                       avoid_approach(0.05), swept_check(false),
+                       swept_tol(0.005), scene_spacing(0.05), other_chain(0), batch_chain(0),
+                       dT(1.0/_ctrl_freq),
                        tol(_tol), vMax(_vMax), coll_av(_coll_av)
 {
     urdf::Model robot_model;
@@ -31,7 +79,8 @@ CtrlThread::CtrlThread(const string& _name, const string& _limb, bool _use_robot
     string base_link = "base";
     string  tip_link = getLimb()+"_gripper";
 
-    chain = new BaxterChain(robot_model, base_link, tip_link);
+    chain       = new BaxterChain(robot_model, base_link, tip_link);
+    batch_chain = new BaxterChain(robot_model, base_link, tip_link);
 
     x_n.setZero();
 
@@ -48,8 +97,215 @@ CtrlThread::CtrlThread(const string& _name, const string& _limb, bool _use_robot
         vLim(r, 1) =  lim;
     }
 
+    // Radii of the capsules that approximate the links, from the
+    // parameter server if available, otherwise from the URDF
+    double radius_default = 0.0;
+    nh.param<double>("capsule_radius_default", radius_default, 0.0);
+
+    auto readCapsuleRadii = [&](const string &_limb, BaxterChain &_chain)
+    {
+        std::vector<double> res;
+        if (not nh.getParam("capsule_radii/" + _limb, res))
+        {
+            res = capsuleRadiiFromURDF(robot_model, _chain, radius_default);
+        }
+        return res;
+    };
+
+    capsule_radii = readCapsuleRadii(getLimb(), *chain);
+
+    // Static obstacles are rasterized into a signed distance field, either
+    // offline (see build_signed_distance_field) or here at startup
+    string sdf_file;
+    nh.param<string>("static_sdf/file", sdf_file, "");
+
+    XmlRpc::XmlRpcValue static_db;
+    if (not sdf_file.empty())
+    {
+        static_sdf.load(sdf_file);
+    }
+    else if (nh.getParam("/"+getName()+"/static_obstacles", static_db))
+    {
+        double sdf_resolution;
+        nh.param<double>("static_sdf/resolution", sdf_resolution, 0.02);
+        static_sdf.build(readFromParamServer(static_db), sdf_resolution);
+    }
+
+    // Obstacles are read from a scene file, if any, rather than from the parameter server
+    // (see convert_obstacle_scene). The file can be swapped at runtime on scene/reload.
+    nh.param<string>("scene/file",    scene_file,    "");
+    nh.param<double>("scene/spacing", scene_spacing, 0.05);
+
+    if (not scene_file.empty())
+    {
+        scene_last = scene_file;
+
+        scene_pub = nh.advertise<visualization_msgs::MarkerArray>("/" + getName() + "/" +
+                                                                  getLimb() + "/scene_markers", 1, true);
+
+        ObstaclesPtr obs = loadScene(scene_file);
+        if (obs)    { obstacles.swap(*obs);  grid_dirty = true; }
+
+        publishSceneMarkers();
+
+        scene_sub = nh.subscribe("scene/reload", 1, &CtrlThread::sceneReloadCb, this);
+    }
+
+    // The avoidance handler is created once, and updated at every cycle
+    if (coll_av)
+    {
+        // Obstacles activate the collision points either through the distance
+        // from the links (tactile) or through the peripersonal space (pps)
+        string avoid_type;
+        nh.param<string>("avoidance/type", avoid_type, "tactile");
+
+        if (avoid_type == "pps")
+        {
+            double depth, half_angle;
+            int    n_rings, n_sectors;
+            nh.param<double>("avoidance/pps/depth",      depth,      0.2);
+            nh.param<double>("avoidance/pps/half_angle", half_angle, 40.0 * M_PI / 180.0);
+            nh.param<int>   ("avoidance/pps/n_rings",    n_rings,      4);
+            nh.param<int>   ("avoidance/pps/n_sectors",  n_sectors,    8);
+
+            std::unique_ptr<AvoidanceHandlerPPS> pps(new AvoidanceHandlerPPS(*chain, capsule_radii));
+            pps->set_receptive_fields(depth, half_angle);
+            pps->set_surface_sampling(size_t(std::max(n_rings, 1)), size_t(std::max(n_sectors, 1)));
+
+            avhdl = std::move(pps);
+        }
+        else
+        {
+            avhdl = std::make_unique<AvoidanceHandlerTactile>(*chain, capsule_radii);
+        }
+
+        int n_threads;
+        nh.param<int>("avoidance/n_threads", n_threads, 1);
+        avhdl->set_n_threads(size_t(std::max(n_threads, 0)));
+
+        // The links of the other arm can be avoided as well
+        bool self_collision;
+        nh.param<bool>("self_collision/enabled", self_collision, false);
+
+        if (self_collision)
+        {
+            string other_limb = getLimb() == "left" ? "right" : "left";
+
+            other_chain = new BaxterChain(robot_model, base_link, other_limb + "_gripper");
+            other_radii = readCapsuleRadii(other_limb, *other_chain);
+
+            for (size_t s = 0; s < other_chain->getNrOfSegments(); ++s)
+            {
+                const KDL::Joint &joint = other_chain->getSegment(s).getJoint();
+                if (joint.getType() != KDL::Joint::None)    { other_joints.push_back(joint.getName()); }
+            }
+
+            string joint_states;
+            nh.param<string>("self_collision/joint_states", joint_states, "/robot/joint_states");
+            other_sub = nh.subscribe(joint_states, 1, &CtrlThread::otherJointStatesCb, this);
+
+            ROS_INFO("Avoiding self-collisions with the %s arm", other_limb.c_str());
+        }
+
+        if (static_sdf.isLoaded())    { avhdl->set_static_field(&static_sdf); }
+
+        // Contacts on the tactile skin are avoided as well, if the taxels are known.
+        // Every frame replaces the previous one, so the skin has to publish empty
+        // frames when nothing touches it.
+        string skin_table, skin_topic;
+        nh.param<string>("tactile_skin/table", skin_table,                "");
+        nh.param<string>("tactile_skin/topic", skin_topic, "/tactile_skin");
+
+        if (not skin_table.empty() && skin.load(skin_table))
+        {
+            double skin_threshold;
+            nh.param<double>("tactile_skin/threshold", skin_threshold, 0.05);
+            skin.set_threshold(skin_threshold);
+
+            skin_sub = nh.subscribe(skin_topic, 1, &CtrlThread::skinCb, this);
+            ROS_INFO("Reading the tactile skin from %s", skin_topic.c_str());
+        }
+    }
+
+    // Obstacles can also come from a point cloud
+    string cloud_topic;
+    nh.param<string>("point_cloud/topic", cloud_topic, "");
+
+    if (not cloud_topic.empty())
+    {
+        double voxel_size, max_time;
+        int    max_points, max_obstacles;
+        nh.param<double>("point_cloud/voxel_size",    voxel_size,     0.05);
+        nh.param<int>   ("point_cloud/max_points",    max_points,    50000);
+        nh.param<int>   ("point_cloud/max_obstacles", max_obstacles,   500);
+        nh.param<double>("point_cloud/max_time",      max_time,      0.2*dT);
+
+        cloud_proc.set_limits(voxel_size, size_t(std::max(max_points, 1)),
+                                          size_t(std::max(max_obstacles, 0)), max_time);
+
+        // Transform from the cloud frame to the base frame, as [x y z qx qy qz qw]
+        std::vector<double> tf;
+        if (nh.getParam("point_cloud/transform", tf) && tf.size() == 7)
+        {
+            Matrix4d H(Matrix4d::Identity());
+            H.block<3,3>(0,0) = Quaterniond(tf[6], tf[3], tf[4], tf[5]).normalized().toRotationMatrix();
+            H.block<3,1>(0,3) = Vector3d(tf[0], tf[1], tf[2]);
+            cloud_proc.set_transform(H);
+        }
+
+        cloud_sub = nh.subscribe(cloud_topic, 1, &CtrlThread::pointCloudCb, this);
+        ROS_INFO("Reading obstacles from point cloud %s", cloud_topic.c_str());
+    }
+
+    // Obstacles can also be streamed on a topic, e.g. by a tracker
+    string obstacle_topic;
+    nh.param<string>("obstacle_stream/topic", obstacle_topic, "");
+
+    if (not obstacle_topic.empty())
+    {
+        obstacle_sub = nh.subscribe(obstacle_topic, 1, &CtrlThread::obstacleStreamCb, this);
+        ROS_INFO("Reading obstacles from stream %s", obstacle_topic.c_str());
+    }
+
     initializeNLP();
 
+    string reach_file;
+    nh.param<string>("reachability_map/" + getLimb(), reach_file, "");
+    if (not reach_file.empty()) { reach_map.load(reach_file); }
+
+    // Cache of the IK solutions, optionally carried across restarts by a snapshot
+    int    ik_cache_capacity;
+    double res_q, res_v, res_p, res_o, direct_tol;
+    nh.param<bool>  ("ik_cache/enabled",    ik_cache_on,       false);
+    nh.param<int>   ("ik_cache/capacity",   ik_cache_capacity,  1000);
+    nh.param<double>("ik_cache/res_q",      res_q,              1e-3);
+    nh.param<double>("ik_cache/res_v",      res_v,              1e-2);
+    nh.param<double>("ik_cache/res_p",      res_p,              1e-3);
+    nh.param<double>("ik_cache/res_o",      res_o,              1e-3);
+    nh.param<double>("ik_cache/direct_tol", direct_tol,         0.25);
+    nh.param<string>("ik_cache/file",       ik_cache_file,        "");
+
+    ik_cache.set_capacity(size_t(std::max(ik_cache_capacity, 1)));
+    ik_cache.set_resolutions(res_q, res_v, res_p, res_o);
+    ik_cache.set_direct_tol(direct_tol);
+
+    if (ik_cache_on && not ik_cache_file.empty() && ifstream(ik_cache_file.c_str()).good())
+    {
+        ik_cache.load(ik_cache_file);
+    }
+
+    // Model of the solution used as the starting point of the solver, and log of
+    // the solves to train it on (see train_warm_start)
+    string ws_model_file, ws_log_file;
+    nh.param<string>("warm_start/model", ws_model_file, "");
+    nh.param<string>("warm_start/log",   ws_log_file,   "");
+
+    if (not ws_model_file.empty()) { ws_model.load(ws_model_file); }
+    if (not ws_log_file.empty())   { ws_log.open(ws_log_file, chain->getNrOfJoints()); }
+
+    batch_ik_srv = nh.advertiseService("/" + getName() + "/" + getLimb() + "/batch_ik",
+                                       &CtrlThread::batchIKCb, this);
+
     if (waitForJointAngles(2.0))   { chain->setAng(getJointStates()); }
     else                           {              setUseRobot(false); }
 
@@ -65,43 +321,225 @@ CtrlThread::CtrlThread(const string& _name, const string& _limb, bool _use_robot
 
 void CtrlThread::initializeNLP()
 {
-    app=new Ipopt::IpoptApplication;
-    app->Options()->SetNumericValue(            "tol", tol);
-    app->Options()->SetNumericValue("constr_viol_tol", tol);
-    app->Options()->SetNumericValue( "acceptable_tol", tol);
-    app->Options()->SetIntegerValue("acceptable_iter",  10);
-    app->Options()->SetStringValue ( "mu_strategy", "adaptive");
-    // if (is_debug == false) { app->Options()->SetStringValue ("linear_solver", "ma57"); }
-    app->Options()->SetNumericValue("max_cpu_time", 0.95 * dT);
-    // app->Options()->SetStringValue ("nlp_scaling_method","gradient-based");
-    app->Options()->SetStringValue ("hessian_approximation","limited-memory");
+    app = newControllerApp(tol, 0.95 * dT);
+}
+
+void CtrlThread::pointCloudCb(const sensor_msgs::PointCloud2ConstPtr& _msg)
+{
+    // Clouds are only processed by the control thread, and only the last one
+    std::lock_guard<std::mutex> lock(cloud_mtx);
+    cloud_msg = _msg;
+}
+
+void CtrlThread::otherJointStatesCb(const sensor_msgs::JointStateConstPtr& _msg)
+{
+    other_buf.write(_msg);
+}
+
+void CtrlThread::updateOtherArm()
+{
+    sensor_msgs::JointStateConstPtr msg;
+    if (other_chain == NULL || not other_buf.read(msg))    { return; }
+
+    VectorXd q = other_chain->getAng();
+    size_t found = 0;
+
+    for (size_t j = 0; j < other_joints.size(); ++j)
+    {
+        for (size_t k = 0; k < msg->name.size() && k < msg->position.size(); ++k)
+        {
+            if (msg->name[k] == other_joints[j])
+            {
+                q[j] = msg->position[k];
+                ++found;
+                break;
+            }
+        }
+    }
+
+    // Some messages only carry a subset of the joints (e.g. the grippers)
+    if (found < other_joints.size())    { return; }
+
+    other_chain->setAng(q);
+    chainCapsules(*other_chain, other_radii, other_caps);
+    avhdl->set_other_links(other_caps);
+}
+
+void CtrlThread::skinCb(const TaxelActivationsConstPtr& _msg)
+{
+    skin_buf.write(_msg);
+}
+
+void CtrlThread::updateSkin()
+{
+    TaxelActivationsConstPtr msg;
+    if (not skin_buf.read(msg))    { return; }
+
+    if (msg->ids.size() != msg->activations.size())
+    {
+        ROS_WARN_THROTTLE(1.0, "Skipping a frame of the skin with %lu IDs and %lu activations",
+                          msg->ids.size(), msg->activations.size());
+        return;
+    }
+
+    skin.aggregate(msg->ids.data(), msg->activations.data(), msg->ids.size(), skin_contacts);
+    avhdl->set_tactile_contacts(skin_contacts);
+}
+
+CtrlThread::ObstaclesPtr CtrlThread::loadScene(const string &_file)
+{
+    ros::WallTime start = ros::WallTime::now();
+
+    ObstacleScene scene;
+    if (not scene.load(_file))
+    {
+        ROS_ERROR("Could not load the obstacle scene %s", _file.c_str());
+        return ObstaclesPtr();
+    }
+
+    ObstaclesPtr res(new std::vector<Obstacle>);
+    scene.toObstacles(*res, scene_spacing);
+
+    ROS_INFO("Obstacle scene %s: %lu obstacles in %gms", _file.c_str(), res->size(),
+             1e3 * (ros::WallTime::now() - start).toSec());
+
+    return res;
+}
+
+void CtrlThread::sceneReloadCb(const std_msgs::StringConstPtr& _msg)
+{
+    if (not _msg->data.empty())    { scene_last = _msg->data; }
+
+    ObstaclesPtr obs = loadScene(scene_last);
+    if (obs)    { scene_buf.write(obs); }
+}
+
+void CtrlThread::obstacleStreamCb(const ObstacleArrayConstPtr& _msg)
+{
+    obstacle_buf.write(_msg);
+}
+
+void CtrlThread::updateObstacles()
+{
+    sensor_msgs::PointCloud2ConstPtr msg;
+    {
+        std::lock_guard<std::mutex> lock(cloud_mtx);
+        msg.swap(cloud_msg);
+    }
+
+    if (msg)
+    {
+        cloud_proc.process(*msg, cloud_obstacles);
+        grid_dirty = true;
+
+        ROS_WARN_COND(cloud_proc.isTruncated(), "Point cloud truncated after %lu points",
+                                                 cloud_proc.getNrOfRead());
+        ROS_DEBUG("Point cloud: %lu points, %lu voxels, %lu obstacles in %gms",
+                  cloud_proc.getNrOfRead(), cloud_proc.getNrOfVoxels(),
+                  cloud_obstacles.size(), 1e3 * cloud_proc.getProcTime());
+    }
+
+    if (obstacle_buf.read(obstacle_msg))    { grid_dirty = true; }
+
+    // Obstacles of a new scene are only referenced here, so they can be taken over
+    ObstaclesPtr scene_obstacles;
+    if (scene_buf.read(scene_obstacles))
+    {
+        obstacles.swap(*scene_obstacles);
+        grid_dirty = true;
+
+        publishSceneMarkers();
+    }
+
+    if (grid_dirty)
+    {
+        size_t n_stream = obstacle_msg ? obstacle_msg->obstacles.size() : 0;
+
+        std::vector<Obstacle> all;
+        all.reserve(obstacles.size() + cloud_obstacles.size() + n_stream);
+        all.insert(all.end(),       obstacles.begin(),       obstacles.end());
+        all.insert(all.end(), cloud_obstacles.begin(), cloud_obstacles.end());
+
+        // Streamed obstacles go straight from the message to the grid, with their
+        // IDs, so that the avoidance handler can track them whatever their index
+        for (size_t i = 0; i < n_stream; ++i)
+        {
+            const geometry_msgs::Point &p = obstacle_msg->obstacles[i].position;
+            all.push_back(Obstacle(obstacle_msg->obstacles[i].size, Vector3d(p.x, p.y, p.z),
+                                   obstacle_msg->obstacles[i].id));
+        }
+
+        obstacle_grid.build(std::move(all));
+        grid_dirty = false;
+    }
 }
 
 void CtrlThread::NLPOptionsFromParameterServer()
 {
     nh.param<bool>("ctrl_ori", ctrl_ori, false);
     nh.param<bool>("derivative_test", derivative_test, false);
+    nh.param<bool>("exact_hessian",   exact_hessian,   false);
+    nh.param<bool>("nonlinear_fk",    nonlinear_fk,    false);
     nh.param<int> ("print_level", print_level, 0);
+    nh.param<string>("formulation", formulation, "hard");
+    nh.param<double>("formulation_weight", formulation_weight,
+                                           formulation=="slack"?1e4:1e3);
+    nh.param<string>("nlp_scaling", nlp_scaling, "gradient-based");
+    nh.param<double>("idle_tol_xyz", idle_tol_xyz, 5e-4);
+    nh.param<double>("idle_tol_ang", idle_tol_ang, 5e-3);
+    nh.param<string>("reachability_mode", reach_mode, "reject");
+    nh.param<double>("avoidance/update_thres", avoid_update_thres, 0.005);
+    nh.param<double>("avoidance/hysteresis",   avoid_hysteresis,   0.02);
+    nh.param<string>("avoidance/mode",           avoid_mode,     "bounds");
+    nh.param<double>("avoidance/approach_speed", avoid_approach,     0.05);
+    nh.param<bool>  ("avoidance/swept_check",    swept_check,       false);
+    nh.param<double>("avoidance/swept_tol",      swept_tol,         0.005);
+
+    // The exact Hessian is only available with the linearized prediction
+    if (exact_hessian && nonlinear_fk)
+    {
+        ROS_WARN_ONCE("The exact Hessian is not available with nonlinear_fk. Approximating it.");
+        exact_hessian = false;
+    }
 
     if (print_level >= 3)
     {
         ROS_INFO("[NLP]                  dT: %g", dT);
         ROS_INFO("[NLP]         Print Level: %i", print_level);
         ROS_INFO("[NLP] Orientation Control: %s", ctrl_ori?"on":"off");
-        ROS_INFO("[NLP]     Derivative Test: %s", derivative_test?"first-order":"none");
+        ROS_INFO("[NLP]     Derivative Test: %s", derivative_test?(exact_hessian?"second-order":
+                                                                                   "first-order"):"none");
+        ROS_INFO("[NLP]       Exact Hessian: %s", exact_hessian?"on":"off");
+        ROS_INFO("[NLP]        Nonlinear FK: %s", nonlinear_fk?"on":"off");
+        ROS_INFO("[NLP]         Formulation: %s (weight %g)", formulation.c_str(), formulation_weight);
+        ROS_INFO("[NLP]         NLP Scaling: %s", nlp_scaling.c_str());
     }
 
     setCtrlType(ctrl_ori?"pose":"position");
 
-    app->Options()->SetStringValue ("derivative_test", derivative_test?"first-order":"none");
+    // With the exact Hessian, the derivative test checks it as well
+    app->Options()->SetStringValue ("derivative_test", derivative_test?(exact_hessian?"second-order":
+                                                                        "first-order"):"none");
+    app->Options()->SetStringValue ("hessian_approximation", exact_hessian?"exact":"limited-memory");
     app->Options()->SetIntegerValue(    "print_level",     print_level);
+    app->Options()->SetStringValue ("nlp_scaling_method",  nlp_scaling);
     app->Initialize();
 
-    // Read the obstacles from the parameter server
+    // Read the obstacles from the parameter server, unless they come from a scene file
     XmlRpc::XmlRpcValue obstacles_db;
-    if(nh.getParam("/"+getName()+"/obstacles", obstacles_db))
+    if(scene_file.empty() && nh.getParam("/"+getName()+"/obstacles", obstacles_db))
     {
-        obstacles = readFromParamServer(obstacles_db);
+        std::vector<Obstacle> obs = readFromParamServer(obstacles_db);
+
+        // The grid is rebuilt only if the obstacles have changed
+        if (obs.size() != obstacles.size() ||
+            not std::equal(obs.begin(), obs.end(), obstacles.begin(),
+                           [](const Obstacle &a, const Obstacle &b)
+                           { return a.size == b.size && a.x_wrf == b.x_wrf; }))
+        {
+            obstacles  =  obs;
+            grid_dirty = true;
+        }
     }
 }
 
@@ -113,9 +551,31 @@ bool CtrlThread::goToPoseNoCheck(double px, double py, double pz,
 
     if ((not is_debug) && waitForJointAngles(2.0))   { chain->setAng(getJointStates()); }
 
+    // If we are already there, hold the current configuration without solving anything
+    idleOptionsFromParameterServer();
+
+    if (isAtTarget())
+    {
+        stats.n_idle++;
+        q_dot.setZero();
+
+        if (is_debug || not isRobotUsed()) { return true; }
+
+        if (getCtrlMode() == human_robot_collaboration_msgs::GoToPose::VELOCITY_MODE)
+        {
+            return goToJointConfNoCheck(VectorXd::Zero(chain->getNrOfJoints()));
+        }
+
+        return goToJointConfNoCheck(chain->getAng());
+    }
+
     // ROS_INFO("actual joint  pos: %s", toString(vector<double>(_q.position.data(),
     //                                _q.position.data() + _q.position.size())).c_str());
-    nlp = new ControllerNLP(*chain);
+    // The NLP, and the kinematics it compiles from the chain, are kept across cycles
+    if (not IsValid(nlp))    { nlp = new ControllerNLP(*chain); }
+
+    nlp->reset();
+    nlp->set_q_0(chain->getAng());
 
     // Solve the task
     int exit_code = -1;
@@ -147,6 +607,10 @@ bool CtrlThread::goToPoseNoCheck(double px, double py, double pz,
         q_dot = nlp->get_est_vels();
     }
 
+    // The avoidance only looked at the current configuration, while the
+    // robot is about to move through the whole step
+    if (coll_av && swept_check)    { checkStep(est); }
+
     if (isRobotUsed())
     {
         // suppressCollisionAv();
@@ -164,13 +628,44 @@ VectorXd CtrlThread::solveIK(int &_exit_code)
     NLPOptionsFromParameterServer();
 
     nlp->set_print_level(size_t(print_level));
+    nlp->set_exact_hessian(exact_hessian);
+    nlp->set_nonlinear_fk(nonlinear_fk);
+
+    if (not nlp->set_formulation(formulation, formulation_weight))
+    {
+        nlp->set_formulation("hard", formulation_weight);
+    }
+
+    // Velocity limits given to the NLP, for the log of the solves
+    MatrixXd v_lim = vLim;
 
     if (coll_av)
     {
-        avhdl = std::make_unique<AvoidanceHandlerTactile>(*chain, obstacles);
-        vlim_coll = avhdl->getV_LIM(DEG2RAD * vLim) * RAD2DEG;
+        updateObstacles();
+        updateOtherArm();
+        updateSkin();
 
-        nlp->set_v_lim(vlim_coll);
+        ros::WallTime start = ros::WallTime::now();
+
+        avhdl->set_update_thres(avoid_update_thres);
+        avhdl->set_hysteresis(avoid_hysteresis);
+        avhdl->update(chain->getAng(), obstacle_grid);
+        stats.avoid_time += (ros::WallTime::now() - start).toSec();
+
+        // Collision points either shape the velocity limits, or constrain
+        // the velocities of the collision points along their normals
+        if (avoid_mode == "constraints")
+        {
+            nlp->set_coll_constraints(avhdl->getVelocityConstraints(avoid_approach), commandGain());
+            nlp->set_v_lim(vLim);
+        }
+        else
+        {
+            vlim_coll = avhdl->getV_LIM(DEG2RAD * vLim) * RAD2DEG;
+            v_lim     = vlim_coll;
+
+            nlp->set_v_lim(vlim_coll);
+        }
     }
     else
     {
@@ -184,7 +679,92 @@ VectorXd CtrlThread::solveIK(int &_exit_code)
     // nlp->set_v_0(chain->getVel());
     nlp->init();
 
-    _exit_code=app->OptimizeTNLP(GetRawPtr(nlp));
+    if (prefilterTarget())
+    {
+        IKCacheQuery query;
+        bool         cached = false;
+        bool         warmed = false;
+
+        if (ik_cache_on)
+        {
+            // Anything the solutions depend on besides the query. The velocity limits
+            // (vLim, shaped or not by the collision points) and the guards of the joint
+            // limits only act on the bounds of the velocities, which are in the query.
+            ik_cache.set_context(formulation + " " + std::to_string(formulation_weight) + " " +
+                                 std::to_string(ctrl_ori) + " " + std::to_string(nonlinear_fk) + " " +
+                                 std::to_string(dT) + " " + std::to_string(tol) + " " +
+                                 nlp_scaling + " " + reach_mode + " " + avoid_mode + " " +
+                                 std::to_string(avoid_approach));
+
+            query = IKCacheQuery(chain->getAng(), q_dot, x_n, o_n, nlp->get_bounds());
+
+            VectorXd v_c;
+            bool  direct;
+
+            if (ik_cache.lookup(query, v_c, direct))
+            {
+                // The constraints of the collision points are not part of the query,
+                // so their solutions are only used as warm starts
+                if (direct && (not coll_av || avoid_mode != "constraints"))
+                {
+                    nlp->set_est_vels(v_c);
+                    _exit_code = Ipopt::Solve_Succeeded;
+                    cached     = true;
+
+                    stats.n_cached++;
+                }
+                else
+                {
+                    nlp->set_v_0(v_c);
+                    warmed = true;
+                }
+            }
+        }
+
+        if (not cached)
+        {
+            // A cached solution is a better starting point than the predicted one
+            if (ws_model.isLoaded() && not warmed)    { nlp->set_warm_start(&ws_model); }
+
+            ros::WallTime start = ros::WallTime::now();
+            _exit_code=app->OptimizeTNLP(GetRawPtr(nlp));
+
+            stats.n_cycles++;
+            stats.n_iters    += app->Statistics()->IterationCount();
+            stats.solve_time += (ros::WallTime::now() - start).toSec();
+            stats.exit_codes[_exit_code]++;
+
+            bool solved = _exit_code == Ipopt::Solve_Succeeded ||
+                          _exit_code == Ipopt::Solved_To_Acceptable_Level;
+
+            if (ik_cache_on && solved)
+            {
+                ik_cache.insert(query, nlp->get_est_vels());
+            }
+
+            if (ws_log.isOpen() && solved)
+            {
+                WarmStartSample sample;
+                sample.q_0      = chain->getAng();
+                sample.v_0      = q_dot;
+                sample.p_0      = nlp->get_p_0();
+                sample.p_r      = nlp->get_p_r();
+                sample.o_r      = o_n;
+                sample.v_lim    = v_lim;
+                sample.dt       = dT;
+                sample.ctrl_ori = ctrl_ori;
+                sample.v_e      = nlp->get_est_vels();
+                sample.n_iters  = app->Statistics()->IterationCount();
+
+                ws_log.append(sample);
+            }
+        }
+    }
+    else
+    {
+        // Same as IPOPT's, so that the target is rejected (with a zero velocity)
+        _exit_code = Ipopt::Infeasible_Problem_Detected;
+    }
 
     if (getCtrlMode() == human_robot_collaboration_msgs::GoToPose::VELOCITY_MODE)
     {
@@ -196,16 +776,164 @@ VectorXd CtrlThread::solveIK(int &_exit_code)
     }
 }
 
+double CtrlThread::commandGain()
+{
+    if (getCtrlMode() == human_robot_collaboration_msgs::GoToPose::VELOCITY_MODE)
+    {
+        return 1.0;
+    }
+
+    return nlp->get_pid();
+}
+
+bool CtrlThread::checkStep(VectorXd &_est)
+{
+    ros::WallTime start = ros::WallTime::now();
+
+    VectorXd q_0 = chain->getAng();
+
+    // The step the robot actually takes in this cycle, i.e. q_0 + pid*dt*v in
+    // position mode, but only q_0 + dt*v in velocity mode
+    chainCapsules(*chain, capsule_radii, swept_from);
+    chain->setAng(q_0 + commandGain() * nlp->get_dt() * nlp->get_est_vels());
+    chainCapsules(*chain, capsule_radii, swept_to);
+    chain->setAng(q_0);
+
+    // Only the obstacles within reach of the links halfway through the step can be hit
+    std::vector<std::pair<Vector3d, Vector3d> > half(swept_from.size());
+    double reach = 0.0;
+
+    for (size_t l = 0; l < swept_from.size(); ++l)
+    {
+        Vector3d a_0(swept_from.ax[l], swept_from.ay[l], swept_from.az[l]);
+        Vector3d b_0(swept_from.bx[l], swept_from.by[l], swept_from.bz[l]);
+        Vector3d a_1(swept_to  .ax[l], swept_to  .ay[l], swept_to  .az[l]);
+        Vector3d b_1(swept_to  .bx[l], swept_to  .by[l], swept_to  .bz[l]);
+
+        half[l] = std::make_pair(0.5 * (a_0 + a_1), 0.5 * (b_0 + b_1));
+        reach   = std::max(reach, swept_from.r[l] + 0.5 * std::max((a_1 - a_0).norm(),
+                                                                   (b_1 - b_0).norm()));
+    }
+
+    std::vector<size_t> near = obstacle_grid.query(half, reach + swept_tol);
+
+    swept_spheres.resize(near.size());
+    for (size_t k = 0; k < near.size(); ++k)
+    {
+        const Obstacle &o = obstacle_grid.getObstacle(near[k]);
+        swept_spheres.set(k, o.x_wrf, o.size);
+    }
+
+    SweptCollision res = sweptCapsuleCheck(swept_from, swept_to, swept_spheres, swept_tol);
+
+    stats.n_swept++;
+    stats.swept_time += (ros::WallTime::now() - start).toSec();
+
+    if (not res.collision)    { return true; }
+
+    stats.n_swept_hits++;
+
+    ROS_WARN_THROTTLE(1.0, "Link %lu would hit obstacle %lu at %g of the step, shortening it",
+                      res.link, near[res.sphere], res.toi);
+
+    if (getCtrlMode() == human_robot_collaboration_msgs::GoToPose::VELOCITY_MODE)
+    {
+        _est *= res.toi;
+    }
+    else
+    {
+        _est = q_0 + res.toi * (_est - q_0);
+    }
+
+    q_dot *= res.toi;
+
+    return false;
+}
+
+void CtrlThread::idleOptionsFromParameterServer()
+{
+    nh.param<bool>  ("ctrl_ori",     ctrl_ori,    false);
+    nh.param<double>("idle_tol_xyz", idle_tol_xyz, 5e-4);
+    nh.param<double>("idle_tol_ang", idle_tol_ang, 5e-3);
+}
+
+bool CtrlThread::isAtTarget()
+{
+    Matrix4d H = chain->getH();
+
+    if ((H.block<3,1>(0,3) - x_n).norm() >= idle_tol_xyz)     { return false; }
+
+    if (ctrl_ori)
+    {
+        Quaterniond o(Matrix3d(H.block<3,3>(0,0)));
+
+        if (o.angularDistance(o_n.normalized()) >= idle_tol_ang)  { return false; }
+    }
+
+    return true;
+}
+
+bool CtrlThread::prefilterTarget()
+{
+    if (not reach_map.isLoaded() || reach_mode == "off")    { return true; }
+
+    if (reach_mode == "project")
+    {
+        Vector3d x_s;
+
+        if (not reach_map.projectStep(nlp->get_p_0(), x_n, nlp->get_l_xyz(), x_s))
+        {
+            stats.n_unreachable++;
+            return false;
+        }
+
+        if (x_s != x_n)
+        {
+            stats.n_projected++;
+            nlp->set_x_r(x_s, o_n);
+        }
+
+        return true;
+    }
+
+    if (not reach_map.isReachable(x_n))
+    {
+        ROS_WARN_COND(print_level>=1, "Target [%g %g %g] is not reachable",
+                                                 x_n[0], x_n[1], x_n[2]);
+        stats.n_unreachable++;
+        return false;
+    }
+
+    return true;
+}
+
 void CtrlThread::publishRVIZMarkers()
 {
     vector <RVIZMarker> rviz_markers;
-    for (size_t i = 0; i < obstacles.size(); ++i)
+
+    // The obstacles of a scene have markers of their own (see publishSceneMarkers)
+    for (size_t i = 0; scene_file.empty() && i < obstacles.size(); ++i)
     {
         rviz_markers.push_back(RVIZMarker(obstacles[i].x_wrf,
                                           ColorRGBA(1.0, 0.0, 1.0),
                                           obstacles[i].size));
     }
 
+    for (size_t i = 0; i < cloud_obstacles.size(); ++i)
+    {
+        rviz_markers.push_back(RVIZMarker(cloud_obstacles[i].x_wrf,
+                                          ColorRGBA(0.0, 1.0, 1.0),
+                                          cloud_obstacles[i].size));
+    }
+
+    for (size_t i = 0; obstacle_msg && i < obstacle_msg->obstacles.size(); ++i)
+    {
+        const geometry_msgs::Point &p = obstacle_msg->obstacles[i].position;
+        rviz_markers.push_back(RVIZMarker(Vector3d(p.x, p.y, p.z),
+                                          ColorRGBA(1.0, 1.0, 0.0),
+                                          obstacle_msg->obstacles[i].size));
+    }
+
     vector <RVIZMarker> rviz_chain = asRVIZMarkers(*chain);
     rviz_markers.insert(std::end(rviz_markers),
                         std::begin(rviz_chain), std::end(rviz_chain));
@@ -222,6 +950,127 @@ void CtrlThread::publishRVIZMarkers()
     rviz_pub.setMarkers(rviz_markers);
 }
 
+void CtrlThread::publishSceneMarkers()
+{
+    // Obstacles of the same size go in the same sphere list
+    std::map<double, visualization_msgs::Marker> lists;
+
+    for (size_t i = 0; i < obstacles.size(); ++i)
+    {
+        geometry_msgs::Point p;
+        p.x = obstacles[i].x_wrf[0];
+        p.y = obstacles[i].x_wrf[1];
+        p.z = obstacles[i].x_wrf[2];
+
+        lists[obstacles[i].size].points.push_back(p);
+    }
+
+    // The previous scene may have had more lists, so its markers are deleted first
+    visualization_msgs::MarkerArray msg;
+    msg.markers.resize(1);
+    msg.markers[0].action = visualization_msgs::Marker::DELETEALL;
+
+    int id = 0;
+    for (auto it = lists.begin(); it != lists.end(); ++it)
+    {
+        visualization_msgs::Marker &m = it->second;
+
+        m.header.frame_id    = "base";
+        m.header.stamp       = ros::Time::now();
+        m.ns                 = "scene";
+        m.id                 = id++;
+        m.type               = visualization_msgs::Marker::SPHERE_LIST;
+        m.action             = visualization_msgs::Marker::ADD;
+        m.pose.orientation.w = 1.0;
+        m.scale.x = m.scale.y = m.scale.z = it->first;
+
+        // Same color as the obstacles from the parameter server
+        m.color.r = 1.0;
+        m.color.g = 0.0;
+        m.color.b = 1.0;
+        m.color.a = 1.0;
+
+        msg.markers.push_back(m);
+    }
+
+    scene_pub.publish(msg);
+
+    ROS_DEBUG("Obstacle scene: %lu obstacles published as %lu sphere lists", obstacles.size(), lists.size());
+}
+
+bool CtrlThread::batchIKCb(baxter_react_controller::BatchIK::Request  &_req,
+                           baxter_react_controller::BatchIK::Response &_res)
+{
+    size_t n_jnts = batch_chain->getNrOfJoints();
+    size_t n_pbs  = _req.poses.size();
+
+    if (_req.q_0.size() != n_pbs * n_jnts)
+    {
+        ROS_ERROR("[batch_ik] %lu poses need %lu start joint values, got %lu",
+                                     n_pbs, n_pbs * n_jnts, _req.q_0.size());
+        return false;
+    }
+
+    if (not _req.v_0.empty() && _req.v_0.size() != n_pbs * n_jnts)
+    {
+        ROS_ERROR("[batch_ik] %lu poses need %lu start joint velocities, got %lu",
+                                          n_pbs, n_pbs * n_jnts, _req.v_0.size());
+        return false;
+    }
+
+    vector<BatchIKProblem> problems;
+    problems.reserve(n_pbs);
+
+    for (size_t i = 0; i < n_pbs; ++i)
+    {
+        const geometry_msgs::Pose &p = _req.poses[i];
+
+        VectorXd q_0 = Map<const VectorXd>(&_req.q_0[i * n_jnts], n_jnts);
+        VectorXd v_0 = VectorXd::Zero(n_jnts);
+        if (not _req.v_0.empty()) { v_0 = Map<const VectorXd>(&_req.v_0[i * n_jnts], n_jnts); }
+
+        problems.push_back(BatchIKProblem(q_0, v_0,
+                           Vector3d(p.position.x, p.position.y, p.position.z),
+                           Quaterniond(p.orientation.w, p.orientation.x,
+                                       p.orientation.y, p.orientation.z)));
+    }
+
+    int n_workers;
+    string linear_solver;
+    nh.param<int>   ("batch_ik/n_workers",     n_workers,  1);
+    nh.param<string>("batch_ik/linear_solver", linear_solver, "");
+
+    // Every problem has its own start configuration, so the chain only gives the kinematics
+    BatchIKSolver solver(*batch_chain, size_t(std::max(n_workers, 0)), dT, tol);
+    solver.set_v_lim(vLim);
+    solver.set_ctrl_ori(_req.ctrl_ori);
+    solver.set_linear_solver(linear_solver);
+
+    ros::WallTime start = ros::WallTime::now();
+    vector<BatchIKResult> results = solver.solve(problems);
+    _res.total_time = (ros::WallTime::now() - start).toSec();
+
+    _res.velocities.assign(n_pbs * n_jnts, 0.0);
+    _res.exit_codes.resize(n_pbs);
+    _res.solve_times.resize(n_pbs);
+
+    for (size_t i = 0; i < n_pbs; ++i)
+    {
+        if (results[i].v_e.size() == int(n_jnts))
+        {
+            Map<VectorXd>(&_res.velocities[i * n_jnts], n_jnts) = results[i].v_e;
+        }
+
+        _res.exit_codes [i] = results[i].exit_code;
+        _res.solve_times[i] = results[i].solve_time;
+    }
+
+    ROS_INFO("[batch_ik] Solved %lu problems with %lu workers in %gs",
+              n_pbs, solver.getNrOfWorkers(), _res.total_time);
+
+    return true;
+}
+
 bool CtrlThread::debugIPOPT()
 {
     if (isRobotNotUsed())
@@ -253,6 +1102,9 @@ bool CtrlThread::debugIPOPT()
 
     vector<double> increment{0.001, 0.004};
 
+    // Statistics are only about the tests
+    stats.reset();
+
     // Let's do all the test together
     // The number of test performed is 2^2^increment.size()
 
@@ -300,15 +1152,40 @@ bool CtrlThread::debugIPOPT()
         ROS_ERROR("[%s] Number of failures: %i", getLimb().c_str(), n_failures);
     }
 
+    ROS_INFO("[%s] Formulation %s, scaling %s: %s", getLimb().c_str(),
+              formulation.c_str(), nlp_scaling.c_str(), stats.toString().c_str());
+
+    if (ik_cache_on)
+    {
+        ROS_INFO("[%s] IK cache: %s", getLimb().c_str(), ik_cache.getStats().toString().c_str());
+    }
+
     return internal_state;
     // return goToPoseNoCheck(frame.p[0], frame.p[1], frame.p[2], ox, oy, oz, ow);
 }
 
 CtrlThread::~CtrlThread()
 {
+    if (ik_cache_on && not ik_cache_file.empty())
+    {
+        ik_cache.save(ik_cache_file);
+    }
+
     if (chain)
     {
         delete chain;
         chain = 0;
     }
+
+    if (other_chain)
+    {
+        delete other_chain;
+        other_chain = 0;
+    }
+
+    if (batch_chain)
+    {
+        delete batch_chain;
+        batch_chain = 0;
+    }
 }
@@ -0,0 +1,304 @@
+#include <fstream>
+#include <string.h>
+
+#include <ros/ros.h>
+
+#include "react_controller/ikCache.h"
+
+using namespace   std;
+using namespace Eigen;
+
+#define IK_CACHE_MAGIC   "BRCIKC"
+#define IK_CACHE_VERSION        1
+
+// Cells are clamped to this, so that unbounded inputs (e.g. bounds) do not overflow
+#define IK_CACHE_MAX_CELL    1e15
+
+/**
+ * 64-bit FNV-1a hash of a buffer. Unlike std::hash, it is the same on every
+ * platform and in every run, so it can be stored in the snapshots.
+ *
+ * @param  _data the buffer
+ * @param  _size the size of the buffer [bytes]
+ * @return       the hash
+ */
+static uint64_t fnv1a(const void *_data, size_t _size)
+{
+    const uint8_t *d = static_cast<const uint8_t*>(_data);
+    uint64_t       h = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < _size; ++i)
+    {
+        h ^= d[i];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+/****************************************************************/
+/****************************************************************/
+void IKCacheStats::reset()
+{
+    n_lookups   = 0;
+    n_hits      = 0;
+    n_direct    = 0;
+    n_inserts   = 0;
+    n_evictions = 0;
+    n_clears    = 0;
+}
+
+string IKCacheStats::toString() const
+{
+    return "lookups " + std::to_string(n_lookups) + " hits " + std::to_string(n_hits) +
+           " (direct " + std::to_string(n_direct) + ") hit rate [%] " +
+           std::to_string(n_lookups?1e2*n_hits/n_lookups:0.0) + " inserts " +
+           std::to_string(n_inserts) + " evictions " + std::to_string(n_evictions) +
+           " clears " + std::to_string(n_clears);
+}
+
+/****************************************************************/
+/****************************************************************/
+IKCache::IKCache(size_t _capacity) : capacity(std::max(_capacity, size_t(1))), res_q(1e-3), res_v(1e-2),
+                                     res_p(1e-3), res_o(1e-3), direct_tol(0.25), context(0)
+{
+
+}
+
+void IKCache::set_capacity(size_t _capacity)
+{
+    capacity = std::max(_capacity, size_t(1));
+
+    while (entries.size() > capacity)
+    {
+        index.erase(entries.back().hash);
+        entries.pop_back();
+        stats.n_evictions++;
+    }
+}
+
+void IKCache::set_resolutions(double _res_q, double _res_v, double _res_p, double _res_o)
+{
+    ROS_ASSERT(_res_q > 0.0 && _res_v > 0.0 && _res_p > 0.0 && _res_o > 0.0);
+
+    res_q = _res_q;
+    res_v = _res_v;
+    res_p = _res_p;
+    res_o = _res_o;
+
+    clear();
+}
+
+bool IKCache::set_context(const string &_context)
+{
+    uint64_t c = fnv1a(_context.data(), _context.size());
+
+    if (c == context)    { return false; }
+
+    if (not entries.empty())
+    {
+        ROS_INFO("The context of the IK cache changed, dropping %lu solutions", entries.size());
+        stats.n_clears++;
+    }
+
+    clear();
+    context = c;
+
+    return true;
+}
+
+VectorXd IKCache::toInputs(const IKCacheQuery &_query)
+{
+    size_t n = _query.q_0.size();
+    ROS_ASSERT(size_t(_query.v_0.size()) == n && size_t(_query.bounds.rows()) == n);
+
+    Quaterniond o = _query.o_r.normalized();
+    if (o.w() < 0.0)    { o.coeffs() *= -1.0; }
+
+    VectorXd res(4*n + 7);
+    res << _query.q_0, _query.v_0, _query.bounds.col(0), _query.bounds.col(1),
+           _query.p_r, o.w(), o.x(), o.y(), o.z();
+
+    return res;
+}
+
+VectorXd IKCache::toResolutions(size_t _n_inputs) const
+{
+    size_t n = (_n_inputs - 7) / 4;
+
+    VectorXd res(_n_inputs);
+    res << VectorXd::Constant(n, res_q), VectorXd::Constant(3*n, res_v),
+           Vector3d::Constant(res_p),    Vector4d::Constant(res_o);
+
+    return res;
+}
+
+uint64_t IKCache::toCells(const VectorXd &_inputs, vector<int64_t> &_cells) const
+{
+    VectorXd res = toResolutions(_inputs.size());
+
+    _cells.resize(_inputs.size());
+    for (int i = 0; i < _inputs.size(); ++i)
+    {
+        double c  = floor(_inputs[i] / res[i]);
+        _cells[i] = int64_t(std::max(std::min(c, IK_CACHE_MAX_CELL), -IK_CACHE_MAX_CELL));
+    }
+
+    return fnv1a(_cells.data(), _cells.size() * sizeof(int64_t));
+}
+
+void IKCache::add(const VectorXd &_inputs, const VectorXd &_v_e)
+{
+    Entry e;
+    e.inputs = _inputs;
+    e.v_e    = _v_e;
+    e.hash   = toCells(_inputs, e.cells);
+
+    // Same cell (or a hash collision): the newest solution wins
+    unordered_map<uint64_t, Entries::iterator>::iterator it = index.find(e.hash);
+    if (it != index.end())
+    {
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    entries.push_front(e);
+    index[e.hash] = entries.begin();
+
+    if (entries.size() > capacity)
+    {
+        index.erase(entries.back().hash);
+        entries.pop_back();
+        stats.n_evictions++;
+    }
+}
+
+bool IKCache::lookup(const IKCacheQuery &_query, VectorXd &_v_e, bool &_direct)
+{
+    stats.n_lookups++;
+    _direct = false;
+
+    VectorXd inputs = toInputs(_query);
+    vector<int64_t> cells;
+    uint64_t hash = toCells(inputs, cells);
+
+    unordered_map<uint64_t, Entries::iterator>::iterator it = index.find(hash);
+    if (it == index.end() || it->second->cells != cells)    { return false; }
+
+    // Most recently used first
+    entries.splice(entries.begin(), entries, it->second);
+
+    const Entry &e = entries.front();
+    _v_e = e.v_e;
+
+    VectorXd dist = (inputs - e.inputs).cwiseAbs().cwiseQuotient(toResolutions(inputs.size()));
+    _direct = dist.maxCoeff() <= direct_tol;
+
+    // The bounds only match within the tolerance, and a solution on one of the
+    // stored ones may be beyond the current one: then it is only a warm start
+    if (_direct)
+    {
+        _direct = (_v_e.array() >= _query.bounds.col(0).array()).all() &&
+                  (_v_e.array() <= _query.bounds.col(1).array()).all();
+    }
+
+    stats.n_hits++;
+    stats.n_direct += _direct;
+
+    return true;
+}
+
+void IKCache::insert(const IKCacheQuery &_query, const VectorXd &_v_e)
+{
+    ROS_ASSERT(_v_e.size() == _query.q_0.size());
+
+    add(toInputs(_query), _v_e);
+    stats.n_inserts++;
+}
+
+void IKCache::clear()
+{
+    entries.clear();
+    index.clear();
+}
+
+bool IKCache::save(const string &_path) const
+{
+    IKCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, IK_CACHE_MAGIC, sizeof(header.magic));
+    header.version   = IK_CACHE_VERSION;
+    header.n_entries = entries.size();
+    header.n_inputs  = entries.empty() ? 0 : entries.front().inputs.size();
+    header.n_outputs = entries.empty() ? 0 : entries.front().v_e.size();
+    header.context   = context;
+
+    ofstream out(_path.c_str(), ios::binary);
+    if (not out)
+    {
+        ROS_ERROR("Could not open %s for writing", _path.c_str());
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // Least recently used first, so that loading restores the order
+    for (Entries::const_reverse_iterator it = entries.rbegin(); it != entries.rend(); ++it)
+    {
+        out.write(reinterpret_cast<const char*>(it->inputs.data()), header.n_inputs  * sizeof(double));
+        out.write(reinterpret_cast<const char*>(it->v_e   .data()), header.n_outputs * sizeof(double));
+    }
+
+    return bool(out);
+}
+
+bool IKCache::load(const string &_path)
+{
+    clear();
+
+    ifstream in(_path.c_str(), ios::binary);
+    if (not in)
+    {
+        ROS_ERROR("Could not open %s for reading", _path.c_str());
+        return false;
+    }
+
+    IKCacheHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (not in || strncmp(header.magic, IK_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != IK_CACHE_VERSION ||
+        (header.n_entries > 0 && (header.n_inputs != 4 * header.n_outputs + 7)))
+    {
+        ROS_ERROR("%s is not an IK cache snapshot (version %i)", _path.c_str(), IK_CACHE_VERSION);
+        return false;
+    }
+
+    VectorXd inputs(header.n_inputs), v_e(header.n_outputs);
+
+    for (size_t i = 0; i < header.n_entries; ++i)
+    {
+        in.read(reinterpret_cast<char*>(inputs.data()), header.n_inputs  * sizeof(double));
+        in.read(reinterpret_cast<char*>(v_e   .data()), header.n_outputs * sizeof(double));
+
+        if (not in)
+        {
+            ROS_ERROR("IK cache snapshot %s is truncated", _path.c_str());
+            clear();
+            return false;
+        }
+
+        add(inputs, v_e);
+    }
+
+    context = header.context;
+
+    ROS_INFO("Loaded IK cache snapshot %s: %lu solutions", _path.c_str(), entries.size());
+
+    return true;
+}
+
+IKCache::~IKCache()
+{
+
+}
@@ -0,0 +1,117 @@
+#include <ros/ros.h>
+
+#include "react_controller/kinematicsCache.h"
+
+using namespace   std;
+using namespace Eigen;
+
+KinematicsCache::KinematicsCache() : nrOfJoints(0), E(Isometry3d::Identity()), H(Isometry3d::Identity()),
+                                     valid_fwd(false), valid_jac(false), n_updates(0), n_joint_updates(0)
+{
+
+}
+
+KinematicsCache::KinematicsCache(const BaxterChain &_chain) : KinematicsCache()
+{
+    nrOfJoints = _chain.getNrOfJoints();
+
+    a.resize(3, nrOfJoints);
+    q   = VectorXd::Zero(nrOfJoints);
+    J   = MatrixXd::Zero(6, nrOfJoints);
+    pre .resize(nrOfJoints, Isometry3d::Identity());
+    post.resize(nrOfJoints, Isometry3d::Identity());
+
+    // Fixed transform since the motion of the previous joint
+    Isometry3d T = Isometry3d::Identity();
+
+    for (size_t i = 0; i < _chain.getNrOfSegments(); ++i)
+    {
+        const KDL::Segment &seg = _chain.getSegment(i);
+        const KDL::Joint   &jnt = seg.getJoint();
+
+        if (jnt.getType() == KDL::Joint::None)
+        {
+            T = T * toIsometry3d(seg.pose(0.0));
+            continue;
+        }
+
+        // The pose of a joint is its pose at zero angle, followed by a rotation about
+        // (or a translation along) its axis. The axis is given in the parent frame,
+        // and the pose at zero angle is either a rotation about it or a translation
+        Isometry3d J_0  = toIsometry3d(jnt.pose(0.0));
+        KDL::Vector ax  = jnt.JointAxis();
+        Vector3d   axis = J_0.linear().transpose() * Vector3d(ax.x(), ax.y(), ax.z());
+
+        P.push_back(T * J_0);
+        a.col(P.size() - 1) = axis.normalized();
+        rot.push_back(jnt.getType() == KDL::Joint::RotAxis || jnt.getType() == KDL::Joint::RotX ||
+                      jnt.getType() == KDL::Joint::RotY    || jnt.getType() == KDL::Joint::RotZ);
+
+        T = toIsometry3d(seg.getFrameToTip());
+    }
+
+    E = T;
+
+    ROS_ASSERT(P.size() == nrOfJoints);
+}
+
+size_t KinematicsCache::setAng(const VectorXd &_q)
+{
+    ROS_ASSERT(size_t(_q.size()) == nrOfJoints);
+
+    n_updates++;
+
+    // First joint whose angle changed
+    size_t k = 0;
+    if (valid_fwd)
+    {
+        while (k < nrOfJoints && _q[k] == q[k])    { ++k; }
+
+        if (k == nrOfJoints)    { return 0; }
+    }
+
+    for (size_t j = k; j < nrOfJoints; ++j)
+    {
+        q[j]   = _q[j];
+        pre[j] = j == 0 ? P[0] : post[j-1] * P[j];
+
+        if (rot[j]) { post[j] = pre[j] * AngleAxisd(q[j], a.col(j));    }
+        else        { post[j] = pre[j] * Translation3d(q[j] * a.col(j)); }
+    }
+
+    H = nrOfJoints > 0 ? post.back() * E : E;
+
+    valid_fwd = true;
+    valid_jac = false;
+    n_joint_updates += nrOfJoints - k;
+
+    return nrOfJoints - k;
+}
+
+const MatrixXd& KinematicsCache::GeoJacobian()
+{
+    if (valid_jac)    { return J; }
+
+    Vector3d p = H.translation();
+
+    for (size_t j = 0; j < nrOfJoints; ++j)
+    {
+        // The motion of a joint does not change its axis
+        Vector3d z = pre[j].linear() * a.col(j);
+
+        if (rot[j])
+        {
+            J.block<3,1>(0,j) = z.cross(p - pre[j].translation());
+            J.block<3,1>(3,j) = z;
+        }
+        else
+        {
+            J.block<3,1>(0,j) = z;
+            J.block<3,1>(3,j).setZero();
+        }
+    }
+
+    valid_jac = true;
+
+    return J;
+}
@@ -0,0 +1,69 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ros/ros.h>
+
+#include "react_controller/mappedFile.h"
+
+using namespace std;
+
+MappedFile::MappedFile() : data(NULL), size(0), path("")
+{
+
+}
+
+bool MappedFile::open(const string &_path)
+{
+    close();
+
+    int fd = ::open(_path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        ROS_ERROR("Could not open %s", _path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ROS_ERROR("Could not stat %s, or file is empty", _path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping stays valid after the file descriptor is closed
+    ::close(fd);
+
+    if (addr == MAP_FAILED)
+    {
+        ROS_ERROR("Could not map %s in memory", _path.c_str());
+        return false;
+    }
+
+    data = addr;
+    size = st.st_size;
+    path = _path;
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data != NULL)
+    {
+        munmap(data, size);
+    }
+
+    data = NULL;
+    size =    0;
+    path =   "";
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
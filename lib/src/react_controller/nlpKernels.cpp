@@ -0,0 +1,143 @@
+#include "react_controller/nlpKernels.h"
+
+using namespace Eigen;
+
+// First order: the derivatives with respect to y
+typedef Dual<3>                              D1;
+typedef Matrix<D1, 3, 1>                     D1Vector3;
+
+// Second order: the derivatives of the first order derivatives
+typedef AutoDiffScalar<Vector3d>             AD1;
+typedef Matrix<AD1, 3, 1>                    AD1Vector3;
+typedef AutoDiffScalar<AD1Vector3>           AD2;
+typedef Matrix<AD2, 3, 1>                    AD2Vector3;
+
+template<typename Term>
+void NLPKernels::addTerm(const Term &_term, double _w, const NLPJacobian &_A, const Vector3d &_y,
+                         double &_f, double *_grad, NLPMatrix *_H) const
+{
+    size_t n_joints = data.n_joints;
+
+    if (_H != NULL)
+    {
+        // y_i with derivative e_i at both orders
+        AD2Vector3 y;
+        for (int i = 0; i < 3; ++i)
+        {
+            y[i].value() = AD1(_y[i], 3, i);
+            for (int j = 0; j < 3; ++j)
+            {
+                y[i].derivatives()[j] = AD1(i == j ? 1.0 : 0.0, Vector3d::Zero());
+            }
+        }
+
+        AD2 t = _term(y);
+
+        Matrix3d H_y;
+        for (int i = 0; i < 3; ++i)    { H_y.row(i) = t.derivatives()[i].derivatives().transpose(); }
+
+        _f += _w * t.value().value();
+        _H->topLeftCorner(n_joints, n_joints).noalias() += _w * (_A.transpose() * H_y * _A);
+    }
+    else if (_grad != NULL)
+    {
+        // y_i with derivative e_i
+        D1Vector3 y;
+        for (int i = 0; i < 3; ++i)    { y[i] = D1(_y[i], i); }
+
+        D1 t = _term(y);
+
+        _f += _w * t.a;
+        Map<NLPVector>(_grad, n_joints).noalias() += _w * (_A.transpose() * t.v);
+    }
+    else
+    {
+        _f += _w * _term(_y);
+    }
+}
+
+/****************************************************************/
+/****************************************************************/
+double NLPKernels::objective(const double *_x, int _n) const
+{
+    double f = 0.0;
+
+    if (data.ctrl_ori)
+    {
+        addTerm(data.ori, 1.0, data.J_ang, data.angIncrement(_x), f, NULL, NULL);
+    }
+
+    if      (data.formulation == POS_SOFT)  { f += data.w_xyz * data.posError(_x).squaredNorm(); }
+    else if (data.formulation == POS_SLACK) { f += data.w_slack * _x[_n-1];                       }
+
+    return f;
+}
+
+double NLPKernels::objective(const double *_x, int _n, double *_grad) const
+{
+    double f = 0.0;
+    Map<NLPVector>(_grad, _n).setZero();
+
+    if (data.ctrl_ori)
+    {
+        addTerm(data.ori, 1.0, data.J_ang, data.angIncrement(_x), f, _grad, NULL);
+    }
+
+    // The positional error decreases along J_xyz
+    if (data.formulation == POS_SOFT)
+    {
+        addTerm(SquaredNormTerm(), data.w_xyz, -data.J_xyz, data.posError(_x), f, _grad, NULL);
+    }
+    else if (data.formulation == POS_SLACK)
+    {
+        f += data.w_slack * _x[_n-1];
+        _grad[_n-1] = data.w_slack;
+    }
+
+    return f;
+}
+
+double NLPKernels::posConstraint(const double *_x, int _n) const
+{
+    double g = data.posError(_x).squaredNorm();
+
+    if (data.formulation == POS_SLACK)    { g -= _x[_n-1]; }
+
+    return g;
+}
+
+double NLPKernels::posConstraint(const double *_x, int _n, double *_jac) const
+{
+    double g = 0.0;
+    Map<NLPVector>(_jac, _n).setZero();
+
+    addTerm(SquaredNormTerm(), 1.0, -data.J_xyz, data.posError(_x), g, _jac, NULL);
+
+    if (data.formulation == POS_SLACK)
+    {
+        g -= _x[_n-1];
+        _jac[_n-1] = -1.0;
+    }
+
+    return g;
+}
+
+void NLPKernels::hessian(const double *_x, int _n, double _obj_factor, double _lambda_pos, NLPMatrix &_H) const
+{
+    // Values are accumulated, but not needed
+    double f = 0.0;
+    _H.setZero(_n, _n);
+
+    if (data.ctrl_ori && _obj_factor != 0.0)
+    {
+        addTerm(data.ori, _obj_factor, data.J_ang, data.angIncrement(_x), f, NULL, &_H);
+    }
+
+    // The positional error is in the objective (POS_SOFT) or in the constraint, and the slack is linear
+    double w_pos = data.formulation == POS_SOFT ? _obj_factor * data.w_xyz : _lambda_pos;
+
+    if (w_pos != 0.0)
+    {
+        addTerm(SquaredNormTerm(), w_pos, -data.J_xyz, data.posError(_x), f, NULL, &_H);
+    }
+}
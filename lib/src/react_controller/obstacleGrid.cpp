@@ -0,0 +1,135 @@
+#include <algorithm>
+
+#include "react_controller/obstacleGrid.h"
+
+using namespace   std;
+using namespace Eigen;
+
+// Cell coordinates are packed in 21 bits each, centered around the origin
+#define CELL_BITS     21
+#define CELL_OFFSET   (int64_t(1) << (CELL_BITS - 1))
+#define CELL_MASK     ((int64_t(1) << CELL_BITS) - 1)
+
+ObstacleGrid::ObstacleGrid(double _cell_size) : cell_size(_cell_size), max_size(0.0)
+{
+    ROS_ASSERT(cell_size > 0.0);
+}
+
+ObstacleGrid::ObstacleGrid(const vector<Obstacle> &_obstacles, double _cell_size) :
+                           cell_size(_cell_size), max_size(0.0)
+{
+    ROS_ASSERT(cell_size > 0.0);
+
+    build(_obstacles);
+}
+
+void ObstacleGrid::toCell(const Vector3d &_p, int64_t &_ix, int64_t &_iy, int64_t &_iz) const
+{
+    _ix = int64_t(floor(_p[0] / cell_size));
+    _iy = int64_t(floor(_p[1] / cell_size));
+    _iz = int64_t(floor(_p[2] / cell_size));
+}
+
+int64_t ObstacleGrid::toKey(int64_t _ix, int64_t _iy, int64_t _iz)
+{
+    return (((_ix + CELL_OFFSET) & CELL_MASK) << (2 * CELL_BITS)) |
+           (((_iy + CELL_OFFSET) & CELL_MASK) <<      CELL_BITS ) |
+            ((_iz + CELL_OFFSET) & CELL_MASK);
+}
+
+void ObstacleGrid::build(const vector<Obstacle> &_obstacles)
+{
+    build(vector<Obstacle>(_obstacles));
+}
+
+void ObstacleGrid::build(vector<Obstacle> &&_obstacles)
+{
+    obstacles.swap(_obstacles);
+    max_size = 0.0;
+
+    // Sort the obstacles by cell, so that every cell is a contiguous range
+    vector<pair<int64_t, size_t> > keys(obstacles.size());
+
+    int64_t ix = 0, iy = 0, iz = 0;
+    for (size_t i = 0; i < obstacles.size(); ++i)
+    {
+        toCell(obstacles[i].x_wrf, ix, iy, iz);
+        keys[i] = make_pair(toKey(ix, iy, iz), i);
+        max_size = std::max(max_size, obstacles[i].size);
+    }
+
+    sort(keys.begin(), keys.end());
+
+    sorted.resize(keys.size());
+    cells.clear();
+    cells.reserve(keys.size());
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        sorted[i] = keys[i].second;
+
+        if (i == 0 || keys[i].first != keys[i-1].first)
+        {
+            cells[keys[i].first] = make_pair(i, i+1);
+        }
+        else
+        {
+            cells[keys[i].first].second = i+1;
+        }
+    }
+}
+
+vector<size_t> ObstacleGrid::query(const vector<pair<Vector3d, Vector3d> > &_segments,
+                                   double _dist) const
+{
+    vector<size_t>  res;
+    vector<uint8_t> found(obstacles.size(), 0);
+
+    // Obstacles are binned by their center, so the segments need
+    // to be inflated by the size of the biggest obstacle as well
+    double inflate = _dist + max_size;
+
+    for (size_t s = 0; s < _segments.size(); ++s)
+    {
+        const Vector3d &base = _segments[s].first;
+        const Vector3d &tip  = _segments[s].second;
+
+        int64_t x0, y0, z0, x1, y1, z1;
+        toCell(base.cwiseMin(tip) - Vector3d::Constant(inflate), x0, y0, z0);
+        toCell(base.cwiseMax(tip) + Vector3d::Constant(inflate), x1, y1, z1);
+
+        for (int64_t ix = x0; ix <= x1; ++ix)
+        {
+            for (int64_t iy = y0; iy <= y1; ++iy)
+            {
+                for (int64_t iz = z0; iz <= z1; ++iz)
+                {
+                    auto cell = cells.find(toKey(ix, iy, iz));
+                    if (cell == cells.end())    { continue; }
+
+                    for (size_t k = cell->second.first; k < cell->second.second; ++k)
+                    {
+                        size_t i = sorted[k];
+                        if (found[i])    { continue; }
+
+                        if (distanceToSegment(base, tip, obstacles[i].x_wrf) -
+                                                         obstacles[i].size <= _dist)
+                        {
+                            found[i] = 1;
+                            res.push_back(i);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    sort(res.begin(), res.end());
+
+    return res;
+}
+
+ObstacleGrid::~ObstacleGrid()
+{
+
+}
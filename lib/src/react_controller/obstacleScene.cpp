@@ -0,0 +1,305 @@
+#include <fstream>
+#include <algorithm>
+#include <string.h>
+
+#include "react_controller/obstacleScene.h"
+
+using namespace   std;
+using namespace Eigen;
+
+#define OBSTACLE_SCENE_MAGIC   "BRCSCN"
+#define OBSTACLE_SCENE_VERSION        1
+
+/**
+ * Reads a list of numbers from the parameter server, accepting both integers and doubles.
+ *
+ * @param  _param the parameter
+ * @param  _sizes the sizes the list is allowed to have
+ * @param  _res   the numbers
+ * @return        true/false if success/failure
+ */
+static bool readNumbers(XmlRpc::XmlRpcValue &_param, const vector<int> &_sizes, vector<double> &_res)
+{
+    if (_param.getType() != XmlRpc::XmlRpcValue::TypeArray ||
+        std::find(_sizes.begin(), _sizes.end(), _param.size()) == _sizes.end())
+    {
+        return false;
+    }
+
+    _res.resize(_param.size());
+
+    for (int i = 0; i < _param.size(); ++i)
+    {
+        if      (_param[i].getType() == XmlRpc::XmlRpcValue::TypeDouble) { _res[i] = double(_param[i]); }
+        else if (_param[i].getType() == XmlRpc::XmlRpcValue::TypeInt)    { _res[i] =    int(_param[i]); }
+        else                                                             { return false;                }
+    }
+
+    return true;
+}
+
+/****************************************************************/
+/****************************************************************/
+ObstacleScene::ObstacleScene() : spheres(NULL), capsules(NULL), boxes(NULL), loaded(false)
+{
+    memset(&header, 0, sizeof(header));
+}
+
+void ObstacleScene::fromBuffers()
+{
+    strncpy(header.magic, OBSTACLE_SCENE_MAGIC, sizeof(header.magic));
+    header.version    = OBSTACLE_SCENE_VERSION;
+    header.n_spheres  = sphere_buf .size();
+    header.n_capsules = capsule_buf.size();
+    header.n_boxes    = box_buf    .size();
+
+    spheres  = sphere_buf .data();
+    capsules = capsule_buf.data();
+    boxes    = box_buf    .data();
+    loaded   = true;
+}
+
+bool ObstacleScene::build(const vector<SceneSphere>  &_spheres,
+                          const vector<SceneCapsule> &_capsules,
+                          const vector<SceneBox>     &_boxes)
+{
+    for (size_t i = 0; i < _spheres .size(); ++i)    { if (_spheres [i].r < 0.0f) { return false; } }
+    for (size_t i = 0; i < _capsules.size(); ++i)    { if (_capsules[i].r < 0.0f) { return false; } }
+    for (size_t i = 0; i < _boxes   .size(); ++i)
+    {
+        if (_boxes[i].h[0] < 0.0f || _boxes[i].h[1] < 0.0f || _boxes[i].h[2] < 0.0f)    { return false; }
+    }
+
+    file.close();
+
+    sphere_buf  = _spheres;
+    capsule_buf = _capsules;
+    box_buf     = _boxes;
+
+    fromBuffers();
+
+    return true;
+}
+
+bool ObstacleScene::fromParam(XmlRpc::XmlRpcValue &_param)
+{
+    vector<SceneSphere>   sph;
+    vector<SceneCapsule>  cap;
+    vector<SceneBox>      box;
+    vector<double>        v;
+
+    // The obstacles of the controller are a list of spheres
+    bool is_list = _param.getType() == XmlRpc::XmlRpcValue::TypeArray;
+
+    if (not is_list && _param.getType() != XmlRpc::XmlRpcValue::TypeStruct)
+    {
+        ROS_ERROR("The obstacle scene is neither a list nor a dictionary");
+        return false;
+    }
+
+    if (is_list || _param.hasMember("spheres"))
+    {
+        XmlRpc::XmlRpcValue &list = is_list ? _param : _param["spheres"];
+
+        for (int i = 0; list.getType() == XmlRpc::XmlRpcValue::TypeArray && i < list.size(); ++i)
+        {
+            if (not readNumbers(list[i], {4}, v) || v[3] < 0.0)
+            {
+                ROS_ERROR("Sphere %i is not [x, y, z, radius]", i);
+                return false;
+            }
+
+            SceneSphere s = {{float(v[0]), float(v[1]), float(v[2])}, float(v[3])};
+            sph.push_back(s);
+        }
+    }
+
+    if (not is_list && _param.hasMember("capsules"))
+    {
+        XmlRpc::XmlRpcValue &list = _param["capsules"];
+
+        for (int i = 0; list.getType() == XmlRpc::XmlRpcValue::TypeArray && i < list.size(); ++i)
+        {
+            if (not readNumbers(list[i], {7}, v) || v[6] < 0.0)
+            {
+                ROS_ERROR("Capsule %i is not [ax, ay, az, bx, by, bz, radius]", i);
+                return false;
+            }
+
+            SceneCapsule c = {{float(v[0]), float(v[1]), float(v[2])},
+                              {float(v[3]), float(v[4]), float(v[5])}, float(v[6]), 0.0f};
+            cap.push_back(c);
+        }
+    }
+
+    if (not is_list && _param.hasMember("boxes"))
+    {
+        XmlRpc::XmlRpcValue &list = _param["boxes"];
+
+        for (int i = 0; list.getType() == XmlRpc::XmlRpcValue::TypeArray && i < list.size(); ++i)
+        {
+            if (not readNumbers(list[i], {6, 10}, v) || v[3] < 0.0 || v[4] < 0.0 || v[5] < 0.0)
+            {
+                ROS_ERROR("Box %i is not [x, y, z, hx, hy, hz(, qx, qy, qz, qw)]", i);
+                return false;
+            }
+
+            Quaterniond q = v.size() == 10 ? Quaterniond(v[9], v[6], v[7], v[8]) : Quaterniond::Identity();
+
+            if (q.norm() < 1e-9)
+            {
+                ROS_ERROR("Box %i has a null orientation", i);
+                return false;
+            }
+
+            q.normalize();
+
+            SceneBox b = {{float(v[0]), float(v[1]), float(v[2])},
+                          {float(v[3]), float(v[4]), float(v[5])},
+                          {float(q.x()), float(q.y()), float(q.z()), float(q.w())}};
+            box.push_back(b);
+        }
+    }
+
+    return build(sph, cap, box);
+}
+
+bool ObstacleScene::save(const string &_path) const
+{
+    if (not loaded)    { return false; }
+
+    ofstream out(_path.c_str(), ios::binary);
+    if (not out)
+    {
+        ROS_ERROR("Could not open %s for writing", _path.c_str());
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(&header),  sizeof(header));
+    out.write(reinterpret_cast<const char*>(spheres),  getNrOfSpheres()  * sizeof(SceneSphere));
+    out.write(reinterpret_cast<const char*>(capsules), getNrOfCapsules() * sizeof(SceneCapsule));
+    out.write(reinterpret_cast<const char*>(boxes),    getNrOfBoxes()    * sizeof(SceneBox));
+
+    return bool(out);
+}
+
+bool ObstacleScene::load(const string &_path)
+{
+    sphere_buf .clear();
+    capsule_buf.clear();
+    box_buf    .clear();
+    memset(&header, 0, sizeof(header));
+    spheres  = NULL;
+    capsules = NULL;
+    boxes    = NULL;
+    loaded   = false;
+
+    if (not file.open(_path))    { return false; }
+
+    const ObstacleSceneHeader *h = reinterpret_cast<const ObstacleSceneHeader*>(file.getData());
+
+    if (file.getSize() < sizeof(header) ||
+        strncmp(h->magic, OBSTACLE_SCENE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != OBSTACLE_SCENE_VERSION)
+    {
+        ROS_ERROR("%s is not an obstacle scene (version %i)", _path.c_str(), OBSTACLE_SCENE_VERSION);
+        file.close();
+        return false;
+    }
+
+    size_t size = sizeof(header) + size_t(h->n_spheres)  * sizeof(SceneSphere)
+                                 + size_t(h->n_capsules) * sizeof(SceneCapsule)
+                                 + size_t(h->n_boxes)    * sizeof(SceneBox);
+
+    if (file.getSize() < size)
+    {
+        ROS_ERROR("Obstacle scene %s is truncated", _path.c_str());
+        file.close();
+        return false;
+    }
+
+    header = *h;
+
+    // The header and the records are multiples of 8 bytes, so the records are aligned
+    const uint8_t *data = file.getData() + sizeof(header);
+    spheres  = reinterpret_cast<const SceneSphere*>(data);
+    data    += getNrOfSpheres()  * sizeof(SceneSphere);
+    capsules = reinterpret_cast<const SceneCapsule*>(data);
+    data    += getNrOfCapsules() * sizeof(SceneCapsule);
+    boxes    = reinterpret_cast<const SceneBox*>(data);
+    loaded   = true;
+
+    ROS_INFO("Loaded obstacle scene %s: %lu spheres, %lu capsules, %lu boxes", _path.c_str(),
+             getNrOfSpheres(), getNrOfCapsules(), getNrOfBoxes());
+
+    return true;
+}
+
+size_t ObstacleScene::toObstacles(vector<Obstacle> &_obstacles, double _spacing) const
+{
+    _obstacles.clear();
+
+    if (not loaded)    { return 0; }
+
+    _obstacles.reserve(getNrOfSpheres() + getNrOfCapsules() + getNrOfBoxes());
+
+    for (size_t i = 0; i < getNrOfSpheres(); ++i)
+    {
+        const SceneSphere &s = spheres[i];
+        _obstacles.push_back(Obstacle(s.r, Vector3d(s.c[0], s.c[1], s.c[2])));
+    }
+
+    for (size_t i = 0; i < getNrOfCapsules(); ++i)
+    {
+        const SceneCapsule &c = capsules[i];
+        Vector3d a(c.a[0], c.a[1], c.a[2]), b(c.b[0], c.b[1], c.b[2]);
+
+        // Spheres every radius along the axis, grown to cover the gaps between them
+        size_t n    = std::max(size_t(ceil((b - a).norm() / std::max(double(c.r), 1e-3))), size_t(1));
+        double step = (b - a).norm() / n;
+        double r    = sqrt(c.r * c.r + 0.25 * step * step);
+
+        for (size_t k = 0; k <= n; ++k)
+        {
+            _obstacles.push_back(Obstacle(r, a + (b - a) * (double(k) / n)));
+        }
+    }
+
+    for (size_t i = 0; i < getNrOfBoxes(); ++i)
+    {
+        const SceneBox &b = boxes[i];
+        Vector3d    c(b.c[0], b.c[1], b.c[2]);
+        Vector3d    h(b.h[0], b.h[1], b.h[2]);
+        Matrix3d    R = Quaterniond(b.q[3], b.q[0], b.q[1], b.q[2]).normalized().toRotationMatrix();
+
+        // One sphere per cell, through the corners of the cell
+        Vector3i n;
+        Vector3d cell;
+        for (int k = 0; k < 3; ++k)
+        {
+            n[k]    = std::max(int(ceil(2.0 * h[k] / std::max(_spacing, 1e-3))), 1);
+            cell[k] = 2.0 * h[k] / n[k];
+        }
+
+        double r = 0.5 * cell.norm();
+
+        for (int ix = 0; ix < n[0]; ++ix)
+        {
+            for (int iy = 0; iy < n[1]; ++iy)
+            {
+                for (int iz = 0; iz < n[2]; ++iz)
+                {
+                    Vector3d p = -h + cell.cwiseProduct(Vector3d(ix + 0.5, iy + 0.5, iz + 0.5));
+                    _obstacles.push_back(Obstacle(r, c + R * p));
+                }
+            }
+        }
+    }
+
+    return _obstacles.size();
+}
+
+ObstacleScene::~ObstacleScene()
+{
+
+}
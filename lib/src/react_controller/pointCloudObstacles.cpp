@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string.h>
+
+#include "react_controller/pointCloudObstacles.h"
+
+using namespace   std;
+using namespace Eigen;
+
+// Voxel coordinates are packed in 21 bits each, centered around the origin
+#define VOXEL_BITS     21
+#define VOXEL_OFFSET   (int64_t(1) << (VOXEL_BITS - 1))
+#define VOXEL_MASK     ((int64_t(1) << VOXEL_BITS) - 1)
+
+// Number of points read between two checks of the processing time
+#define TIME_CHECK_PERIOD 4096
+
+PointCloudObstacles::PointCloudObstacles(double _voxel_size, size_t _max_points,
+                                         size_t _max_obstacles, double _max_time) :
+                                         R(Matrix3d::Identity()), p(Vector3d::Zero()),
+                                         n_read(0), n_voxels(0), truncated(false), proc_time(0.0)
+{
+    set_limits(_voxel_size, _max_points, _max_obstacles, _max_time);
+}
+
+void PointCloudObstacles::set_limits(double _voxel_size, size_t _max_points,
+                                     size_t _max_obstacles, double _max_time)
+{
+    ROS_ASSERT(_voxel_size > 0.0 && _max_points > 0);
+
+    voxel_size    =    _voxel_size;
+    max_points    =    _max_points;
+    max_obstacles = _max_obstacles;
+    max_time      =      _max_time;
+
+    points.resize(max_points);
+    voxels.resize(max_points);
+}
+
+void PointCloudObstacles::set_transform(const Matrix4d &_H)
+{
+    R = _H.block<3,3>(0,0);
+    p = _H.block<3,1>(0,3);
+}
+
+bool PointCloudObstacles::process(const sensor_msgs::PointCloud2 &_cloud, vector<Obstacle> &_obstacles)
+{
+    ros::WallTime start = ros::WallTime::now();
+
+    _obstacles.clear();
+    n_read    =     0;
+    n_voxels  =     0;
+    truncated = false;
+
+    // Find the xyz fields
+    int offset[3] = {-1, -1, -1};
+    for (size_t i = 0; i < _cloud.fields.size(); ++i)
+    {
+        const sensor_msgs::PointField &f = _cloud.fields[i];
+        int k = f.name == "x" ? 0 : f.name == "y" ? 1 : f.name == "z" ? 2 : -1;
+
+        if (k != -1 && f.datatype == sensor_msgs::PointField::FLOAT32)    { offset[k] = f.offset; }
+    }
+
+    if (offset[0] < 0 || offset[1] < 0 || offset[2] < 0)
+    {
+        ROS_ERROR("Point cloud has no FLOAT32 x, y and z fields");
+        return false;
+    }
+
+    size_t n_points = size_t(_cloud.width) * _cloud.height;
+
+    if (_cloud.data.size() < n_points * _cloud.point_step)
+    {
+        ROS_ERROR("Point cloud is truncated");
+        return false;
+    }
+
+    // Bigger clouds are subsampled with a constant stride
+    size_t stride = (n_points + max_points - 1) / max_points;
+
+    size_t n = 0;
+    for (size_t i = 0; i < n_points; i += stride)
+    {
+        if (n % TIME_CHECK_PERIOD == 0 && n > 0 &&
+            (ros::WallTime::now() - start).toSec() > max_time)
+        {
+            truncated = true;
+            break;
+        }
+
+        const uint8_t *ptr = &_cloud.data[i * _cloud.point_step];
+
+        float xyz[3];
+        memcpy(&xyz[0], ptr + offset[0], sizeof(float));
+        memcpy(&xyz[1], ptr + offset[1], sizeof(float));
+        memcpy(&xyz[2], ptr + offset[2], sizeof(float));
+
+        if (!std::isfinite(xyz[0]) || !std::isfinite(xyz[1]) || !std::isfinite(xyz[2]))  { continue; }
+
+        Vector3d pt = R * Vector3d(xyz[0], xyz[1], xyz[2]) + p;
+
+        int64_t ix = int64_t(floor(pt[0] / voxel_size));
+        int64_t iy = int64_t(floor(pt[1] / voxel_size));
+        int64_t iz = int64_t(floor(pt[2] / voxel_size));
+
+        VoxelPoint &v = points[n++];
+        v.key = (((ix + VOXEL_OFFSET) & VOXEL_MASK) << (2 * VOXEL_BITS)) |
+                (((iy + VOXEL_OFFSET) & VOXEL_MASK) <<      VOXEL_BITS ) |
+                 ((iz + VOXEL_OFFSET) & VOXEL_MASK);
+        v.x   = float(pt[0]);
+        v.y   = float(pt[1]);
+        v.z   = float(pt[2]);
+    }
+
+    n_read = n;
+
+    // Group the points by voxel, and accumulate them
+    sort(points.begin(), points.begin() + n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i == 0 || points[i].key != points[i-1].key)
+        {
+            voxels[n_voxels].count = 0;
+            voxels[n_voxels].sum.setZero();
+            ++n_voxels;
+        }
+
+        Voxel &v = voxels[n_voxels-1];
+        v.count++;
+        v.sum += Vector3d(points[i].x, points[i].y, points[i].z);
+    }
+
+    // Keep the most populated voxels only
+    size_t n_obstacles = std::min(n_voxels, max_obstacles);
+
+    if (n_obstacles < n_voxels)
+    {
+        nth_element(voxels.begin(), voxels.begin() + n_obstacles, voxels.begin() + n_voxels,
+                    [](const Voxel &a, const Voxel &b) { return a.count > b.count; });
+    }
+
+    // Spheres are centered in the centroids, and contain the whole voxel
+    double size = sqrt(3.0) * voxel_size;
+
+    for (size_t i = 0; i < n_obstacles; ++i)
+    {
+        _obstacles.push_back(Obstacle(size, voxels[i].sum / voxels[i].count));
+    }
+
+    proc_time = (ros::WallTime::now() - start).toSec();
+
+    return true;
+}
+
+PointCloudObstacles::~PointCloudObstacles()
+{
+
+}
+
+void syntheticPointCloud(sensor_msgs::PointCloud2 &_cloud, const vector<Obstacle> &_spheres,
+                         size_t _n_points, double _noise, unsigned int _seed)
+{
+    mt19937 gen(_seed);
+    normal_distribution<double> normal(0.0, 1.0);
+
+    _cloud.fields.resize(3);
+    const char *names[3] = {"x", "y", "z"};
+    for (size_t k = 0; k < 3; ++k)
+    {
+        _cloud.fields[k].name     = names[k];
+        _cloud.fields[k].offset   = uint32_t(k * sizeof(float));
+        _cloud.fields[k].datatype = sensor_msgs::PointField::FLOAT32;
+        _cloud.fields[k].count    = 1;
+    }
+
+    _cloud.height       = 1;
+    _cloud.width        = uint32_t(_spheres.size() * _n_points);
+    _cloud.is_bigendian = false;
+    _cloud.point_step   = uint32_t(3 * sizeof(float));
+    _cloud.row_step     = _cloud.point_step * _cloud.width;
+    _cloud.is_dense     = true;
+    _cloud.data.resize(_cloud.row_step);
+
+    float *data = reinterpret_cast<float*>(_cloud.data.data());
+
+    for (size_t i = 0; i < _spheres.size(); ++i)
+    {
+        for (size_t j = 0; j < _n_points; ++j)
+        {
+            // Uniform sampling on the sphere, by normalizing a gaussian vector
+            Vector3d dir(normal(gen), normal(gen), normal(gen));
+            Vector3d pt = _spheres[i].x_wrf + _spheres[i].size * dir.normalized() +
+                          _noise * Vector3d(normal(gen), normal(gen), normal(gen));
+
+            for (size_t k = 0; k < 3; ++k)    { *data++ = float(pt[k]); }
+        }
+    }
+}
@@ -0,0 +1,220 @@
+#include <fstream>
+#include <random>
+#include <string.h>
+
+#include "react_controller/reachabilityMap.h"
+
+using namespace   std;
+using namespace Eigen;
+
+#define REACHABILITY_MAP_MAGIC   "BRCRMAP"
+#define REACHABILITY_MAP_VERSION       1
+
+ReachabilityMap::ReachabilityMap() : voxels(NULL)
+{
+    memset(&header, 0, sizeof(header));
+}
+
+bool ReachabilityMap::toIndex(const Vector3d &_p, size_t &_idx) const
+{
+    if (voxels == NULL) { return false; }
+
+    double ix = floor((_p[0] - header.origin[0]) / header.resolution);
+    double iy = floor((_p[1] - header.origin[1]) / header.resolution);
+    double iz = floor((_p[2] - header.origin[2]) / header.resolution);
+
+    if (ix < 0 || ix >= header.nx ||
+        iy < 0 || iy >= header.ny ||
+        iz < 0 || iz >= header.nz)     { return false; }
+
+    _idx = (size_t(iz) * header.ny + size_t(iy)) * header.nx + size_t(ix);
+
+    return true;
+}
+
+bool ReachabilityMap::build(BaxterChain _chain, double _resolution, size_t _n_samples,
+                            int _dilate, unsigned int _seed)
+{
+    if (_resolution <= 0.0 || _n_samples == 0)    { return false; }
+
+    file.close();
+    voxels = NULL;
+
+    // First, sample the end-effector positions and compute their bounding box
+    mt19937 gen(_seed);
+    vector<Vector3d> samples(_n_samples);
+    Vector3d p_min = Vector3d::Constant( numeric_limits<double>::max());
+    Vector3d p_max = Vector3d::Constant(-numeric_limits<double>::max());
+
+    VectorXd q(_chain.getNrOfJoints());
+    for (size_t i = 0; i < _n_samples; ++i)
+    {
+        for (size_t j = 0; j < _chain.getNrOfJoints(); ++j)
+        {
+            q[j] = uniform_real_distribution<double>(_chain.getMin(j), _chain.getMax(j))(gen);
+        }
+
+        _chain.setAng(q);
+        samples[i] = _chain.getH().block<3,1>(0,3);
+
+        p_min = p_min.cwiseMin(samples[i]);
+        p_max = p_max.cwiseMax(samples[i]);
+    }
+
+    // Leave room for the dilation on every side
+    int pad = std::max(_dilate, 0) + 1;
+
+    strncpy(header.magic, REACHABILITY_MAP_MAGIC, sizeof(header.magic));
+    header.version    = REACHABILITY_MAP_VERSION;
+    header.resolution = _resolution;
+    header.n_samples  = _n_samples;
+
+    uint32_t *dims[3] = {&header.nx, &header.ny, &header.nz};
+    for (int k = 0; k < 3; ++k)
+    {
+        header.origin[k] = p_min[k] - pad * _resolution;
+        *dims[k] = uint32_t(ceil((p_max[k] - p_min[k]) / _resolution)) + 2 * pad;
+    }
+
+    vector<uint8_t> cells(getNrOfVoxels(), 0);
+    buffer.assign((getNrOfVoxels() + 7) / 8, 0);
+    voxels = buffer.data();
+
+    size_t idx = 0;
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        if (toIndex(samples[i], idx)) { cells[idx] = 1; }
+    }
+
+    // 6-connected dilation
+    const long nx = header.nx, nxy = long(header.nx) * header.ny;
+    for (int d = 0; d < _dilate; ++d)
+    {
+        vector<uint8_t> dilated(cells);
+
+        for (long iz = 1; iz < long(header.nz) - 1; ++iz)
+        {
+            for (long iy = 1; iy < long(header.ny) - 1; ++iy)
+            {
+                for (long ix = 1; ix < long(header.nx) - 1; ++ix)
+                {
+                    long i = iz * nxy + iy * nx + ix;
+
+                    if (cells[i-1]  || cells[i+1]  || cells[i-nx]  ||
+                        cells[i+nx] || cells[i-nxy]|| cells[i+nxy])  { dilated[i] = 1; }
+                }
+            }
+        }
+
+        cells.swap(dilated);
+    }
+
+    header.n_reachable = 0;
+    for (size_t i = 0; i < cells.size(); ++i)
+    {
+        if (cells[i])
+        {
+            buffer[i >> 3] |= uint8_t(1 << (i & 7));
+            header.n_reachable++;
+        }
+    }
+
+    ROS_INFO("Built reachability map from %lu samples: %u x %u x %u voxels "
+             "of %gm, %lu reachable", _n_samples, header.nx, header.ny, header.nz,
+             _resolution, getNrOfReachable());
+
+    return true;
+}
+
+bool ReachabilityMap::save(const string &_path) const
+{
+    if (voxels == NULL)    { return false; }
+
+    ofstream out(_path.c_str(), ios::binary);
+    if (not out)
+    {
+        ROS_ERROR("Could not open %s for writing", _path.c_str());
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(voxels),  (getNrOfVoxels() + 7) / 8);
+
+    return bool(out);
+}
+
+bool ReachabilityMap::load(const string &_path)
+{
+    voxels = NULL;
+    buffer.clear();
+
+    if (not file.open(_path))    { return false; }
+
+    const ReachabilityMapHeader *h = reinterpret_cast<const ReachabilityMapHeader*>(file.getData());
+
+    if (file.getSize() < sizeof(header) ||
+        strncmp(h->magic, REACHABILITY_MAP_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != REACHABILITY_MAP_VERSION)
+    {
+        ROS_ERROR("%s is not a reachability map (version %i)", _path.c_str(),
+                                                 REACHABILITY_MAP_VERSION);
+        file.close();
+        return false;
+    }
+
+    header = *h;
+
+    if (file.getSize() < sizeof(header) + (getNrOfVoxels() + 7) / 8)
+    {
+        ROS_ERROR("Reachability map %s is truncated", _path.c_str());
+        file.close();
+        return false;
+    }
+
+    voxels = file.getData() + sizeof(header);
+
+    ROS_INFO("Loaded reachability map %s: %u x %u x %u voxels of %gm, %lu reachable",
+              _path.c_str(), header.nx, header.ny, header.nz,
+              header.resolution, getNrOfReachable());
+
+    return true;
+}
+
+bool ReachabilityMap::isReachable(const Vector3d &_p) const
+{
+    size_t idx = 0;
+    if (not toIndex(_p, idx))    { return false; }
+
+    return (voxels[idx >> 3] >> (idx & 7)) & 1;
+}
+
+bool ReachabilityMap::projectStep(const Vector3d &_p_0, const Vector3d &_p_r,
+                                  double _max_step, Vector3d &_p_s) const
+{
+    Vector3d dir = _p_r - _p_0;
+    double  dist = dir.norm();
+
+    _p_s = _p_r;
+
+    if (dist <= _max_step && isReachable(_p_r))    { return true; }
+    if (dist < 1e-9)                               { return false; }
+
+    dir /= dist;
+    dist = std::min(dist, _max_step);
+
+    // Walk back towards the current position, half a voxel at a time
+    for (double d = dist; d > 0.0; d -= 0.5 * header.resolution)
+    {
+        _p_s = _p_0 + d * dir;
+
+        if (isReachable(_p_s))    { return true; }
+    }
+
+    _p_s = _p_0;
+    return false;
+}
+
+ReachabilityMap::~ReachabilityMap()
+{
+
+}
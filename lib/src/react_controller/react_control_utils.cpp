@@ -24,15 +24,18 @@ Matrix3d skew(const Vector3d &w)
     return S;
 }
 
-Matrix4d toMatrix4d(KDL::Frame _f)
+Matrix4d toMatrix4d(const KDL::Frame &_f)
 {
-    Matrix4d result(Matrix4d::Identity());
+    return toIsometry3d(_f).matrix();
+}
 
-    Vector3d p(VectorXd::Map(&_f.p.data[0], 3   ));
-    Matrix3d r(MatrixXd::Map(&_f.M.data[0], 3, 3).transpose());
+Isometry3d toIsometry3d(const KDL::Frame &_f)
+{
+    // KDL stores the rotation row-major
+    Isometry3d result(Isometry3d::Identity());
 
-    result.block<3,3>(0,0) = r;
-    result.block<3,1>(0,3) = p;
+    result.linear()      = Map<const Matrix<double, 3, 3, RowMajor> >(_f.M.data);
+    result.translation() = Map<const Vector3d>(_f.p.data);
 
     return result;
 }
@@ -49,26 +52,88 @@ Vector3d angularError(const Quaterniond& _a, const Quaterniond& _b)
     return _b.w()*_a.vec() - _a.w()*_b.vec() -skew(_a.vec())*_b.vec();
 }
 
-bool changeFoR(const Vector3d orig, const Matrix4d transform, Vector3d &new_pt)
+Vector3d orientationError(const Quaterniond& _r, const Quaterniond& _e, Matrix3d& _J)
+{
+    // Scalar and vector part of _r * _e^-1, on the positive hemisphere
+    double   eta = _e.w()*_r.w() + _e.vec().dot(_r.vec());
+    double     s = eta < 0.0 ? -2.0 : 2.0;
+    Vector3d err = s * (_e.w()*_r.vec() - _r.w()*_e.vec() - _r.vec().cross(_e.vec()));
+
+    _J = -0.5 * skew(err);
+    _J.diagonal().array() -= std::abs(eta);
+
+    return err;
+}
+
+Vector3d orientationError(const Quaterniond& _r, const Quaterniond& _e)
+{
+    double eta = _e.w()*_r.w() + _e.vec().dot(_r.vec());
+
+    return (eta < 0.0 ? -2.0 : 2.0) * (_e.w()*_r.vec() - _r.w()*_e.vec() - _r.vec().cross(_e.vec()));
+}
+
+Vector3d incrementOrientationError(const Quaterniond& _r, const Quaterniond& _0,
+                                   const Vector3d& _inc, Matrix3d& _J)
 {
-    Vector4d tmp(0, 0, 0, 1);
-    tmp.block<3,1>(0,0) = orig;
-    new_pt = (transform.inverse() * tmp).block<3,1>(0,0);
+    double th2 = _inc.squaredNorm();
+    double th  = sqrt(th2);
+
+    // The increment as a quaternion, and the coefficients of the left Jacobian
+    // I + a S(inc) + b S(inc)^2; close to zero, their series avoid 0/0
+    double c, s, a, b;
+
+    if (th2 < 1e-6)
+    {
+        c = 1.0 - th2 / 8.0;
+        s = 0.5 - th2 / 48.0;
+        a = 0.5 - th2 / 24.0;
+        b = 1.0 / 6.0 - th2 / 120.0;
+    }
+    else
+    {
+        c = cos(0.5 * th);
+        s = sin(0.5 * th) / th;
+        a = (1.0 - cos(th)) / th2;
+        b = (th - sin(th)) / (th2 * th);
+    }
+
+    Quaterniond o_e = Quaterniond(c, s * _inc[0], s * _inc[1], s * _inc[2]) * _0;
+
+    Matrix3d D;
+    Vector3d err = orientationError(_r, o_e, D);
+
+    Matrix3d S = skew(_inc);
+    _J.noalias() = D + D * (a * S + b * (S * S));
+
+    return err;
+}
+
+bool changeFoR(const Vector3d &orig, const Matrix4d &transform, Vector3d &new_pt)
+{
+    // The transform is rigid, so its inverse is [R^T, -R^T p]
+    new_pt = transform.block<3,3>(0,0).transpose() * (orig - transform.block<3,1>(0,3));
     return true;
 }
 
-KDL::Frame toKDLFrame(Matrix4d mat)
+bool changeFoR(const Vector3d &orig, const Isometry3d &transform, Vector3d &new_pt)
 {
-    KDL::Vector x, y, z, pos;
+    new_pt = transform.linear().transpose() * (orig - transform.translation());
+    return true;
+}
 
-    tf::vectorEigenToKDL(mat.block<3,1>(0,0), x);
-    tf::vectorEigenToKDL(mat.block<3,1>(0,1), y);
-    tf::vectorEigenToKDL(mat.block<3,1>(0,2), z);
-    KDL::Rotation rot = KDL::Rotation(x, y, z);
+KDL::Frame toKDLFrame(const Matrix4d &mat)
+{
+    return toKDLFrame(Isometry3d(mat));
+}
 
-    tf::vectorEigenToKDL(mat.block<3,1>(0,3), pos);
+KDL::Frame toKDLFrame(const Isometry3d &H)
+{
+    KDL::Frame result;
+
+    Map<Matrix<double, 3, 3, RowMajor> >(result.M.data) = H.linear();
+    Map<Vector3d>(result.p.data)                         = H.translation();
 
-    return KDL::Frame(rot, pos);
+    return result;
 }
 
 VectorXd stdToEigen(std::vector<double> vec)
@@ -91,6 +156,27 @@ Vector3d projectOntoSegment(Vector3d base, Vector3d tip, Vector3d point)
     return base + ((ap).dot(ab)) / ((ab).dot(ab)) * ab;
 }
 
+double distanceToSegment(const Vector3d &base, const Vector3d &tip, const Vector3d &point)
+{
+    Vector3d ab =   tip - base;
+    Vector3d ap = point - base;
+
+    double den = ab.dot(ab);
+    double   t = den > 0.0 ? std::max(0.0, std::min(1.0, ap.dot(ab) / den)) : 0.0;
+
+    return (ap - t * ab).norm();
+}
+
+double distanceToMagnitude(double dist)
+{
+    double rho   = 0.4;
+    double alpha = 6.0;
+
+    if (dist > ACTIVATION_DIST)    { return 0.0; }
+
+    return 1.0/(1.0+exp((dist*(2.0/rho)-1.0)*alpha));
+}
+
 std::vector<Obstacle> readFromParamServer(XmlRpc::XmlRpcValue _param)
 {
     std::vector<Obstacle> res;
@@ -0,0 +1,314 @@
+#include <fstream>
+#include <string.h>
+
+#include "react_controller/signedDistanceField.h"
+
+using namespace   std;
+using namespace Eigen;
+
+#define SIGNED_DISTANCE_FIELD_MAGIC   "BRCSDF"
+#define SIGNED_DISTANCE_FIELD_VERSION        1
+
+SignedDistanceField::SignedDistanceField() : values(NULL)
+{
+    memset(&header, 0, sizeof(header));
+}
+
+bool SignedDistanceField::toCell(const Vector3d &_p, size_t &_idx, Vector3d &_f) const
+{
+    if (values == NULL) { return false; }
+
+    const uint32_t n[3] = {header.nx, header.ny, header.nz};
+    size_t i[3];
+
+    for (int k = 0; k < 3; ++k)
+    {
+        double u = (_p[k] - header.origin[k]) / header.resolution;
+
+        if (not (u >= 0.0 && u <= n[k] - 1))    { return false; }
+
+        // Points on the upper boundary belong to the last cell
+        i[k]  = std::min(size_t(u), size_t(n[k] - 2));
+        _f[k] = u - i[k];
+    }
+
+    _idx = (i[2] * header.ny + i[1]) * header.nx + i[0];
+
+    return true;
+}
+
+bool SignedDistanceField::build(const vector<Obstacle> &_obstacles, double _resolution,
+                                double _max_dist)
+{
+    if (_resolution <= 0.0 || _max_dist <= 0.0 || _obstacles.empty())    { return false; }
+
+    file.close();
+    values = NULL;
+
+    // The grid covers the obstacles, plus max_dist and a vertex on every side
+    Vector3d p_min = Vector3d::Constant( numeric_limits<double>::max());
+    Vector3d p_max = Vector3d::Constant(-numeric_limits<double>::max());
+
+    for (size_t i = 0; i < _obstacles.size(); ++i)
+    {
+        p_min = p_min.cwiseMin(_obstacles[i].x_wrf - Vector3d::Constant(_obstacles[i].size));
+        p_max = p_max.cwiseMax(_obstacles[i].x_wrf + Vector3d::Constant(_obstacles[i].size));
+    }
+
+    double pad = _max_dist + _resolution;
+
+    strncpy(header.magic, SIGNED_DISTANCE_FIELD_MAGIC, sizeof(header.magic));
+    header.version     = SIGNED_DISTANCE_FIELD_VERSION;
+    header.resolution  = _resolution;
+    header.max_dist    = _max_dist;
+    header.n_obstacles = _obstacles.size();
+
+    uint32_t *dims[3] = {&header.nx, &header.ny, &header.nz};
+    for (int k = 0; k < 3; ++k)
+    {
+        header.origin[k] = p_min[k] - pad;
+        *dims[k] = uint32_t(ceil((p_max[k] - p_min[k] + 2.0 * pad) / _resolution)) + 1;
+    }
+
+    buffer.assign(getNrOfVertices(), float(_max_dist));
+
+    // Every obstacle only affects the vertices within max_dist from its surface
+    const size_t nx = header.nx, nxy = size_t(header.nx) * header.ny;
+    for (size_t i = 0; i < _obstacles.size(); ++i)
+    {
+        const Obstacle &o = _obstacles[i];
+        size_t lo[3], hi[3];
+
+        for (int k = 0; k < 3; ++k)
+        {
+            double r = o.size + _max_dist;
+            lo[k] = size_t(std::max(0.0,  floor((o.x_wrf[k] - r - header.origin[k]) / _resolution)));
+            hi[k] = std::min(size_t(*dims[k] - 1),
+                             size_t(ceil((o.x_wrf[k] + r - header.origin[k]) / _resolution)));
+        }
+
+        for (size_t iz = lo[2]; iz <= hi[2]; ++iz)
+        {
+            for (size_t iy = lo[1]; iy <= hi[1]; ++iy)
+            {
+                for (size_t ix = lo[0]; ix <= hi[0]; ++ix)
+                {
+                    Vector3d p(header.origin[0] + ix * _resolution,
+                               header.origin[1] + iy * _resolution,
+                               header.origin[2] + iz * _resolution);
+
+                    float &v = buffer[iz * nxy + iy * nx + ix];
+                    v = std::min(v, float((p - o.x_wrf).norm() - o.size));
+                }
+            }
+        }
+    }
+
+    values = buffer.data();
+
+    ROS_INFO("Built signed distance field from %lu obstacles: %u x %u x %u vertices "
+             "every %gm, truncated at %gm", _obstacles.size(), header.nx, header.ny,
+             header.nz, _resolution, _max_dist);
+
+    return true;
+}
+
+bool SignedDistanceField::save(const string &_path) const
+{
+    if (values == NULL)    { return false; }
+
+    ofstream out(_path.c_str(), ios::binary);
+    if (not out)
+    {
+        ROS_ERROR("Could not open %s for writing", _path.c_str());
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(values),  getNrOfVertices() * sizeof(float));
+
+    return bool(out);
+}
+
+bool SignedDistanceField::load(const string &_path)
+{
+    values = NULL;
+    buffer.clear();
+
+    if (not file.open(_path))    { return false; }
+
+    const SignedDistanceFieldHeader *h =
+                reinterpret_cast<const SignedDistanceFieldHeader*>(file.getData());
+
+    if (file.getSize() < sizeof(header) ||
+        strncmp(h->magic, SIGNED_DISTANCE_FIELD_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != SIGNED_DISTANCE_FIELD_VERSION)
+    {
+        ROS_ERROR("%s is not a signed distance field (version %i)", _path.c_str(),
+                                                  SIGNED_DISTANCE_FIELD_VERSION);
+        file.close();
+        return false;
+    }
+
+    header = *h;
+
+    if (header.nx < 2 || header.ny < 2 || header.nz < 2 ||
+        file.getSize() < sizeof(header) + getNrOfVertices() * sizeof(float))
+    {
+        ROS_ERROR("Signed distance field %s is truncated", _path.c_str());
+        file.close();
+        return false;
+    }
+
+    // The header is a multiple of 8 bytes, so the values are aligned
+    values = reinterpret_cast<const float*>(file.getData() + sizeof(header));
+
+    ROS_INFO("Loaded signed distance field %s: %u x %u x %u vertices every %gm, "
+             "%lu obstacles", _path.c_str(), header.nx, header.ny, header.nz,
+             header.resolution, getNrOfObstacles());
+
+    return true;
+}
+
+bool SignedDistanceField::distance(const Vector3d &_p, double &_d) const
+{
+    size_t idx = 0;
+    Vector3d f;
+    if (not toCell(_p, idx, f))    { return false; }
+
+    const size_t nx = header.nx, nxy = size_t(header.nx) * header.ny;
+    const float *c = values + idx;
+
+    // Interpolate along x, then y, then z
+    double c00 = c[0]         + f[0] * (c[1]           - c[0]);
+    double c10 = c[nx]        + f[0] * (c[nx + 1]      - c[nx]);
+    double c01 = c[nxy]       + f[0] * (c[nxy + 1]     - c[nxy]);
+    double c11 = c[nxy + nx]  + f[0] * (c[nxy + nx + 1] - c[nxy + nx]);
+
+    double c0 = c00 + f[1] * (c10 - c00);
+    double c1 = c01 + f[1] * (c11 - c01);
+
+    _d = c0 + f[2] * (c1 - c0);
+
+    return true;
+}
+
+bool SignedDistanceField::distance(const Vector3d &_p, double &_d, Vector3d &_grad) const
+{
+    size_t idx = 0;
+    Vector3d f;
+    if (not toCell(_p, idx, f))    { return false; }
+
+    const size_t nx = header.nx, nxy = size_t(header.nx) * header.ny;
+    const float *c = values + idx;
+
+    double c000 = c[0],        c100 = c[1];
+    double c010 = c[nx],       c110 = c[nx + 1];
+    double c001 = c[nxy],      c101 = c[nxy + 1];
+    double c011 = c[nxy + nx], c111 = c[nxy + nx + 1];
+
+    double gx = 1.0 - f[0], gy = 1.0 - f[1], gz = 1.0 - f[2];
+
+    _d = gz   * (gy   * (gx * c000 + f[0] * c100) + f[1] * (gx * c010 + f[0] * c110)) +
+         f[2] * (gy   * (gx * c001 + f[0] * c101) + f[1] * (gx * c011 + f[0] * c111));
+
+    // The gradient of the interpolant, i.e. its partial derivatives
+    _grad[0] = gz   * (gy * (c100 - c000) + f[1] * (c110 - c010)) +
+               f[2] * (gy * (c101 - c001) + f[1] * (c111 - c011));
+    _grad[1] = gz   * (gx * (c010 - c000) + f[0] * (c110 - c100)) +
+               f[2] * (gx * (c011 - c001) + f[0] * (c111 - c101));
+    _grad[2] = gy   * (gx * (c001 - c000) + f[0] * (c101 - c100)) +
+               f[1] * (gx * (c011 - c010) + f[0] * (c111 - c110));
+
+    _grad /= header.resolution;
+
+    return true;
+}
+
+bool SignedDistanceField::closestPoint(const Vector3d &_a, const Vector3d &_b,
+                                       Vector3d &_x, double &_d, Vector3d &_grad) const
+{
+    double t = 0.0;
+    return closestPoint(_a, _b, _x, _d, _grad, t);
+}
+
+bool SignedDistanceField::closestPoint(const Vector3d &_a, const Vector3d &_b,
+                                       Vector3d &_x, double &_d, Vector3d &_grad,
+                                       double &_t) const
+{
+    if (values == NULL)    { return false; }
+
+    size_t n_samples = size_t(ceil((_b - _a).norm() / (0.5 * header.resolution))) + 1;
+
+    double   d_min = header.max_dist, d = 0.0;
+    Vector3d p;
+
+    for (size_t s = 0; s < n_samples; ++s)
+    {
+        double t = n_samples > 1 ? double(s) / (n_samples - 1) : 0.0;
+        p = _a + (_b - _a) * t;
+
+        if (distance(p, d) && d < d_min)
+        {
+            d_min = d;
+            _x    = p;
+            _t    = t;
+        }
+    }
+
+    if (d_min >= header.max_dist)    { return false; }
+
+    return distance(_x, _d, _grad);
+}
+
+bool SignedDistanceField::closestPointLocal(const Vector3d &_a, const Vector3d &_b, double &_t,
+                                            Vector3d &_x, double &_d, Vector3d &_grad) const
+{
+    if (values == NULL)    { return false; }
+
+    size_t n_samples = size_t(ceil((_b - _a).norm() / (0.5 * header.resolution))) + 1;
+
+    // A segment shorter than the sampling step has nothing to walk along
+    if (n_samples == 1)    { return closestPoint(_a, _b, _x, _d, _grad, _t); }
+
+    // Points outside of the field are as far as max_dist
+    long last   = long(n_samples) - 1;
+    auto sample = [&](long _s)
+    {
+        double d = header.max_dist;
+        distance(Vector3d(_a + (_b - _a) * (double(_s) / last)), d);
+        return std::min(d, header.max_dist);
+    };
+
+    long   s     = std::lround(std::min(std::max(_t, 0.0), 1.0) * last);
+    double d_min = sample(s);
+
+    // Walk towards the neighbor that is closer to the obstacles, if any
+    double d_prev = s > 0    ? sample(s - 1) : header.max_dist;
+    double d_next = s < last ? sample(s + 1) : header.max_dist;
+    long   step   = d_prev < d_next ? -1 : 1;
+    double d      = std::min(d_prev, d_next);
+
+    while (d < d_min)
+    {
+        d_min = d;
+        s    += step;
+
+        if (s + step < 0 || s + step > last)    { break; }
+
+        d = sample(s + step);
+    }
+
+    _t = double(s) / last;
+
+    if (d_min >= header.max_dist)    { return false; }
+
+    _x = _a + (_b - _a) * _t;
+
+    return distance(_x, _d, _grad);
+}
+
+SignedDistanceField::~SignedDistanceField()
+{
+
+}
@@ -0,0 +1,150 @@
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "react_controller/tactileSkin.h"
+
+using namespace   std;
+using namespace Eigen;
+
+TactileSkin::TactileSkin(double _threshold) : threshold(_threshold)
+{
+
+}
+
+bool TactileSkin::build(const vector<Taxel> &_taxels)
+{
+    rows.clear();
+    patch_begin.clear();
+    patch_link .clear();
+
+    // Taxels are sorted by patch, so that every patch is a contiguous range of rows
+    vector<size_t> order(_taxels.size());
+    for (size_t i = 0; i < order.size(); ++i)    { order[i] = i; }
+
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                     { return _taxels[a].patch < _taxels[b].patch; });
+
+    size_t n = _taxels.size();
+    px.resize(n); py.resize(n); pz.resize(n);
+    nx.resize(n); ny.resize(n); nz.resize(n);
+    act.setZero(n);
+
+    for (size_t r = 0; r < n; ++r)
+    {
+        const Taxel &t = _taxels[order[r]];
+
+        if (t.id >= rows.size())    { rows.resize(t.id + 1, -1); }
+
+        if (rows[t.id] >= 0)
+        {
+            ROS_ERROR("Taxel %u is listed more than once", t.id);
+            return false;
+        }
+
+        if (r == 0 || t.patch != _taxels[order[r-1]].patch)
+        {
+            patch_begin.push_back(r);
+            patch_link .push_back(t.link);
+        }
+        else if (t.link != patch_link.back())
+        {
+            ROS_ERROR("Patch %lu spans more than one link", t.patch);
+            return false;
+        }
+
+        Vector3d normal = t.normal.normalized();
+
+        rows[t.id] = r;
+        px[r] = t.pos[0];  py[r] = t.pos[1];  pz[r] = t.pos[2];
+        nx[r] = normal[0]; ny[r] = normal[1]; nz[r] = normal[2];
+    }
+
+    patch_begin.push_back(n);
+
+    ROS_INFO("Built tactile skin with %lu taxels in %lu patches", n, getNrOfPatches());
+
+    return true;
+}
+
+bool TactileSkin::load(const string &_path)
+{
+    ifstream in(_path.c_str());
+    if (not in)
+    {
+        ROS_ERROR("Could not open %s", _path.c_str());
+        return false;
+    }
+
+    vector<Taxel> taxels;
+    string line;
+
+    for (size_t l = 1; getline(in, line); ++l)
+    {
+        if (line.empty() || line[0] == '#')    { continue; }
+
+        istringstream ss(line);
+        uint32_t id;
+        size_t   link, patch;
+        Vector3d pos, normal;
+
+        if (not (ss >> id >> link >> patch >> pos[0] >> pos[1] >> pos[2]
+                                          >> normal[0] >> normal[1] >> normal[2]))
+        {
+            ROS_ERROR("Line %lu of %s is not a taxel", l, _path.c_str());
+            return false;
+        }
+
+        taxels.push_back(Taxel(id, link, patch, pos, normal));
+    }
+
+    return build(taxels);
+}
+
+size_t TactileSkin::aggregate(const uint32_t *_ids, const float *_activations, size_t _n,
+                              vector<TactileContact> &_contacts)
+{
+    _contacts.clear();
+
+    // Scatter the activations into the table
+    act.setZero();
+
+    size_t n_known = 0;
+    for (size_t i = 0; i < _n; ++i)
+    {
+        if (_ids[i] >= rows.size() || rows[_ids[i]] < 0)    { continue; }
+
+        act[rows[_ids[i]]] = std::min(std::max(double(_activations[i]), 0.0), 1.0);
+        ++n_known;
+    }
+
+    // Inactive taxels do not contribute to the contacts
+    act = (act > threshold).select(act, 0.0);
+
+    for (size_t p = 0; p < patch_link.size(); ++p)
+    {
+        size_t b = patch_begin[p], n = patch_begin[p+1] - b;
+
+        auto w = act.segment(b, n);
+        double w_sum = w.sum();
+
+        if (w_sum <= 0.0)    { continue; }
+
+        TactileContact c;
+        c.link     = patch_link[p];
+        c.mag      = w.maxCoeff();
+        c.n_taxels = (w > 0.0).count();
+        c.x_erf    = Vector3d((w * px.segment(b, n)).sum(), (w * py.segment(b, n)).sum(),
+                              (w * pz.segment(b, n)).sum()) / w_sum;
+        c.n_erf    = Vector3d((w * nx.segment(b, n)).sum(), (w * ny.segment(b, n)).sum(),
+                              (w * nz.segment(b, n)).sum());
+
+        // Opposite normals cancel out, in which case the contact is ill-defined
+        if (c.n_erf.squaredNorm() < 1e-12)    { continue; }
+
+        c.n_erf.normalize();
+        _contacts.push_back(c);
+    }
+
+    return n_known;
+}
@@ -0,0 +1,100 @@
+#include "react_controller/threadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t _n_threads) : job(NULL), n_items(0), chunk(1), next(0),
+                                            generation(0), n_busy(0), stop(false)
+{
+    if (_n_threads == 0)
+    {
+        _n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 1; i < _n_threads; ++i)
+    {
+        threads.push_back(thread(&ThreadPool::worker, this, i));
+    }
+}
+
+void ThreadPool::worker(size_t _id)
+{
+    size_t seen = 0;
+
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(mtx);
+            cv_start.wait(lock, [&]{ return stop || generation != seen; });
+
+            if (stop)    { return; }
+
+            seen = generation;
+        }
+
+        run(_id);
+
+        {
+            lock_guard<mutex> lock(mtx);
+            if (--n_busy == 0)    { cv_done.notify_one(); }
+        }
+    }
+}
+
+void ThreadPool::run(size_t _id)
+{
+    for (size_t b = next.fetch_add(chunk); b < n_items; b = next.fetch_add(chunk))
+    {
+        size_t e = std::min(b + chunk, n_items);
+
+        for (size_t i = b; i < e; ++i)
+        {
+            (*job)(i, _id);
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t _n, const function<void(size_t, size_t)> &_fun,
+                             size_t _chunk)
+{
+    _chunk = std::max(_chunk, size_t(1));
+
+    // Waking up the workers is not worth it for small loops
+    if (threads.empty() || _n <= _chunk)
+    {
+        for (size_t i = 0; i < _n; ++i)    { _fun(i, 0); }
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(mtx);
+
+        job     =  &_fun;
+        n_items =     _n;
+        chunk   = _chunk;
+        next    =      0;
+        n_busy  = threads.size();
+        generation++;
+    }
+    cv_start.notify_all();
+
+    run(0);
+
+    unique_lock<mutex> lock(mtx);
+    cv_done.wait(lock, [&]{ return n_busy == 0; });
+
+    job = NULL;
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        stop = true;
+    }
+    cv_start.notify_all();
+
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+}
@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <string.h>
+
+#include <ros/ros.h>
+
+#include "react_controller/warmStartModel.h"
+
+using namespace   std;
+using namespace Eigen;
+
+#define WARM_START_LOG_MAGIC     "BRCWSL"
+#define WARM_START_LOG_VERSION          1
+#define WARM_START_MODEL_MAGIC   "BRCWSM"
+#define WARM_START_MODEL_VERSION        1
+
+/**
+ * Flattens a sample into the record of a warm start log (see WarmStartLogHeader)
+ */
+static VectorXd toRecord(const WarmStartSample &_s, size_t _n_joints)
+{
+    VectorXd res(5 * _n_joints + 13);
+    res << _s.q_0, _s.v_0, _s.p_0, _s.p_r, _s.o_r.w(), _s.o_r.x(), _s.o_r.y(), _s.o_r.z(),
+           Map<const VectorXd>(_s.v_lim.data(), 2 * _n_joints), _s.dt, double(_s.ctrl_ori),
+           _s.v_e, double(_s.n_iters);
+
+    return res;
+}
+
+static WarmStartSample fromRecord(const VectorXd &_r, size_t _n_joints)
+{
+    size_t n = _n_joints;
+
+    WarmStartSample res;
+    res.q_0      = _r.segment(0,     n);
+    res.v_0      = _r.segment(n,     n);
+    res.p_0      = _r.segment<3>(2*n);
+    res.p_r      = _r.segment<3>(2*n + 3);
+    res.o_r      = Quaterniond(_r[2*n + 6], _r[2*n + 7], _r[2*n + 8], _r[2*n + 9]);
+    res.v_lim    = Map<const MatrixXd>(_r.data() + 2*n + 10, n, 2);
+    res.dt       = _r[4*n + 10];
+    res.ctrl_ori = _r[4*n + 11] != 0.0;
+    res.v_e      = _r.segment(4*n + 12, n);
+    res.n_iters  = size_t(_r[5*n + 12]);
+
+    return res;
+}
+
+/**
+ * One step of Adam on a parameter
+ *
+ * @param _p    the parameter
+ * @param _g    its gradient
+ * @param _m    the first  moment of the gradient
+ * @param _v    the second moment of the gradient
+ * @param _lr   the step size, already corrected for the bias of the moments
+ */
+template<typename T>
+static void adamStep(T &_p, const T &_g, T &_m, T &_v, double _lr)
+{
+    _m = 0.9   * _m + 0.1   * _g;
+    _v = 0.999 * _v + 0.001 * _g.cwiseAbs2();
+
+    _p.array() -= _lr * _m.array() / (_v.array().sqrt() + 1e-8);
+}
+
+/****************************************************************/
+/****************************************************************/
+WarmStartLog::WarmStartLog() : n_joints(0)
+{
+
+}
+
+bool WarmStartLog::open(const string &_path, size_t _n_joints)
+{
+    close();
+
+    WarmStartLogHeader header;
+    memset(&header, 0, sizeof(header));
+
+    // Existing logs are appended to, if they are of the same chain
+    {
+        ifstream in(_path.c_str(), ios::binary | ios::ate);
+
+        if (in && in.tellg() > 0)
+        {
+            in.seekg(0);
+            in.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+            if (not in || strncmp(header.magic, WARM_START_LOG_MAGIC, sizeof(header.magic)) != 0 ||
+                header.version != WARM_START_LOG_VERSION || header.n_joints != _n_joints)
+            {
+                ROS_ERROR("%s is not a warm start log of %lu joints (version %i)",
+                          _path.c_str(), _n_joints, WARM_START_LOG_VERSION);
+                return false;
+            }
+        }
+    }
+
+    out.open(_path.c_str(), ios::binary | ios::app);
+    if (not out)
+    {
+        ROS_ERROR("Could not open %s for writing", _path.c_str());
+        return false;
+    }
+
+    if (header.version == 0)
+    {
+        strncpy(header.magic, WARM_START_LOG_MAGIC, sizeof(header.magic));
+        header.version  = WARM_START_LOG_VERSION;
+        header.n_joints = _n_joints;
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    n_joints = _n_joints;
+
+    return bool(out);
+}
+
+bool WarmStartLog::append(const WarmStartSample &_sample)
+{
+    if (not out.is_open())    { return false; }
+
+    ROS_ASSERT(size_t(_sample.q_0.size()) == n_joints && size_t(_sample.v_0  .size()) == n_joints &&
+               size_t(_sample.v_e.size()) == n_joints && size_t(_sample.v_lim.rows()) == n_joints &&
+               _sample.v_lim.cols() == 2);
+
+    VectorXd r = toRecord(_sample, n_joints);
+    out.write(reinterpret_cast<const char*>(r.data()), r.size() * sizeof(double));
+
+    return bool(out);
+}
+
+void WarmStartLog::close()
+{
+    if (out.is_open())    { out.close(); }
+
+    n_joints = 0;
+}
+
+bool WarmStartLog::read(const string &_path, vector<WarmStartSample> &_samples)
+{
+    _samples.clear();
+
+    ifstream in(_path.c_str(), ios::binary);
+    if (not in)
+    {
+        ROS_ERROR("Could not open %s for reading", _path.c_str());
+        return false;
+    }
+
+    WarmStartLogHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (not in || strncmp(header.magic, WARM_START_LOG_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != WARM_START_LOG_VERSION || header.n_joints == 0)
+    {
+        ROS_ERROR("%s is not a warm start log (version %i)", _path.c_str(), WARM_START_LOG_VERSION);
+        return false;
+    }
+
+    VectorXd r(5 * header.n_joints + 13);
+
+    while (in.read(reinterpret_cast<char*>(r.data()), r.size() * sizeof(double)))
+    {
+        _samples.push_back(fromRecord(r, header.n_joints));
+    }
+
+    ROS_WARN_COND(in.gcount() > 0, "Dropped the truncated last sample of %s", _path.c_str());
+
+    return true;
+}
+
+WarmStartLog::~WarmStartLog()
+{
+    close();
+}
+
+/****************************************************************/
+/****************************************************************/
+WarmStartModel::WarmStartModel() : n_joints(0), n_hidden(0), loaded(false)
+{
+
+}
+
+VectorXd WarmStartModel::toFeatures(const VectorXd &_q_0, const Vector3d &_p_0,
+                                    const Vector3d &_p_r, const VectorXd &_v_0)
+{
+    VectorXd res(_q_0.size() + 3 + _v_0.size());
+    res << _q_0, _p_r - _p_0, _v_0;
+
+    return res;
+}
+
+bool WarmStartModel::predict(const VectorXd &_q_0, const Vector3d &_p_0,
+                             const Vector3d &_p_r, const VectorXd &_v_0, VectorXd &_v_e) const
+{
+    if (not loaded || size_t(_q_0.size()) != n_joints || size_t(_v_0.size()) != n_joints)
+    {
+        return false;
+    }
+
+    VectorXd x = (toFeatures(_q_0, _p_0, _p_r, _v_0) - mu_x).cwiseQuotient(sigma_x);
+    VectorXd h = (W_1 * x + b_1).array().tanh().matrix();
+
+    _v_e = _v_0 + mu_y + sigma_y.cwiseProduct(W_2 * h + b_2);
+
+    return true;
+}
+
+bool WarmStartModel::train(const vector<WarmStartSample> &_samples, const WarmStartTraining &_options)
+{
+    if (_samples.empty() || _options.n_hidden == 0 || _options.batch_size == 0)
+    {
+        ROS_ERROR("Need some samples, hidden units and a batch size to train a warm start model");
+        return false;
+    }
+
+    size_t n = _samples[0].q_0.size();
+    size_t d = 2 * n + 3;
+    size_t h = _options.n_hidden;
+    size_t N = _samples.size();
+
+    MatrixXd X(d, N), Y(n, N);
+    for (size_t s = 0; s < N; ++s)
+    {
+        const WarmStartSample &sm = _samples[s];
+
+        if (size_t(sm.q_0.size()) != n || size_t(sm.v_0.size()) != n || size_t(sm.v_e.size()) != n)
+        {
+            ROS_ERROR("Sample %lu is not of %lu joints", s, n);
+            return false;
+        }
+
+        X.col(s) = toFeatures(sm.q_0, sm.p_0, sm.p_r, sm.v_0);
+        Y.col(s) = sm.v_e - sm.v_0;
+    }
+
+    // Normalization. Features that never change (e.g. v_0 if the robot
+    // always started at rest) are only centered
+    n_joints = n;
+    n_hidden = h;
+    mu_x     = X.rowwise().mean();
+    mu_y     = Y.rowwise().mean();
+    sigma_x  = ((X.colwise() - mu_x).cwiseAbs2().rowwise().sum() / N).cwiseSqrt().cwiseMax(1e-6);
+    sigma_y  = ((Y.colwise() - mu_y).cwiseAbs2().rowwise().sum() / N).cwiseSqrt().cwiseMax(1e-6);
+
+    X = (X.colwise() - mu_x).cwiseQuotient(sigma_x.replicate(1, N));
+    Y = (Y.colwise() - mu_y).cwiseQuotient(sigma_y.replicate(1, N));
+
+    // Glorot initialization of the hidden layer. The output layer starts
+    // from zero, i.e. from predicting the mean change
+    mt19937 rng(_options.seed);
+    uniform_real_distribution<double> uni(-1.0, 1.0);
+    double a = sqrt(6.0 / (d + h));
+
+    W_1 = MatrixXd::NullaryExpr(h, d, [&](){ return a * uni(rng); });
+    b_1 = VectorXd::Zero(h);
+    W_2 = MatrixXd::Zero(n, h);
+    b_2 = VectorXd::Zero(n);
+
+    MatrixXd m_W_1 = MatrixXd::Zero(h, d), v_W_1 = MatrixXd::Zero(h, d);
+    VectorXd m_b_1 = VectorXd::Zero(h),    v_b_1 = VectorXd::Zero(h);
+    MatrixXd m_W_2 = MatrixXd::Zero(n, h), v_W_2 = MatrixXd::Zero(n, h);
+    VectorXd m_b_2 = VectorXd::Zero(n),    v_b_2 = VectorXd::Zero(n);
+
+    vector<size_t> idx(N);
+    iota(idx.begin(), idx.end(), 0);
+
+    size_t B = std::min(_options.batch_size, N);
+    size_t t = 0;
+    double loss = 0.0;
+
+    MatrixXd X_b(d, B), Y_b(n, B);
+
+    for (size_t e = 0; e < _options.n_epochs; ++e)
+    {
+        shuffle(idx.begin(), idx.end(), rng);
+        loss = 0.0;
+
+        // The last partial batch is skipped, it is shuffled into the next epochs
+        for (size_t k = 0; k + B <= N; k += B)
+        {
+            for (size_t i = 0; i < B; ++i)
+            {
+                X_b.col(i) = X.col(idx[k + i]);
+                Y_b.col(i) = Y.col(idx[k + i]);
+            }
+
+            // Forward
+            MatrixXd H = ((W_1 * X_b).colwise() + b_1).array().tanh().matrix();
+            MatrixXd E = ((W_2 * H).colwise() + b_2) - Y_b;
+            loss += E.squaredNorm();
+
+            // Backward
+            MatrixXd g_W_2 = E * H.transpose() / B + _options.weight_decay * W_2;
+            VectorXd g_b_2 = E.rowwise().sum() / B;
+            MatrixXd Z     = (W_2.transpose() * E).cwiseProduct((1.0 - H.array().square()).matrix());
+            MatrixXd g_W_1 = Z * X_b.transpose() / B + _options.weight_decay * W_1;
+            VectorXd g_b_1 = Z.rowwise().sum() / B;
+
+            ++t;
+            double lr = _options.learning_rate * sqrt(1.0 - pow(0.999, t)) / (1.0 - pow(0.9, t));
+
+            adamStep(W_1, g_W_1, m_W_1, v_W_1, lr);
+            adamStep(b_1, g_b_1, m_b_1, v_b_1, lr);
+            adamStep(W_2, g_W_2, m_W_2, v_W_2, lr);
+            adamStep(b_2, g_b_2, m_b_2, v_b_2, lr);
+        }
+
+        ROS_DEBUG("Epoch %lu: normalized loss %g", e, loss / ((N / B) * B * n));
+    }
+
+    loaded = true;
+
+    ROS_INFO("Warm start model trained on %lu samples: %lu hidden units, %lu epochs, "
+             "normalized loss %g", N, h, _options.n_epochs, loss / ((N / B) * B * n));
+
+    return true;
+}
+
+double WarmStartModel::evaluate(const vector<WarmStartSample> &_samples) const
+{
+    double   err = 0.0;
+    size_t   cnt = 0;
+    VectorXd v_e;
+
+    for (size_t s = 0; s < _samples.size(); ++s)
+    {
+        const WarmStartSample &sm = _samples[s];
+
+        if (predict(sm.q_0, sm.p_0, sm.p_r, sm.v_0, v_e))
+        {
+            err += (v_e - sm.v_e).squaredNorm();
+            cnt += n_joints;
+        }
+    }
+
+    return cnt ? sqrt(err / cnt) : 0.0;
+}
+
+bool WarmStartModel::save(const string &_path) const
+{
+    if (not loaded)
+    {
+        ROS_ERROR("No warm start model to save");
+        return false;
+    }
+
+    WarmStartModelHeader header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, WARM_START_MODEL_MAGIC, sizeof(header.magic));
+    header.version  = WARM_START_MODEL_VERSION;
+    header.n_joints = n_joints;
+    header.n_hidden = n_hidden;
+
+    ofstream out(_path.c_str(), ios::binary);
+    if (not out)
+    {
+        ROS_ERROR("Could not open %s for writing", _path.c_str());
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    const double* blocks[] = {mu_x.data(), sigma_x.data(), mu_y.data(), sigma_y.data(),
+                              W_1.data(), b_1.data(), W_2.data(), b_2.data()};
+    size_t        sizes[]  = {size_t(mu_x.size()), size_t(sigma_x.size()), size_t(mu_y.size()),
+                              size_t(sigma_y.size()), size_t(W_1.size()), size_t(b_1.size()),
+                              size_t(W_2.size()), size_t(b_2.size())};
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        out.write(reinterpret_cast<const char*>(blocks[i]), sizes[i] * sizeof(double));
+    }
+
+    return bool(out);
+}
+
+bool WarmStartModel::load(const string &_path)
+{
+    loaded = false;
+
+    ifstream in(_path.c_str(), ios::binary);
+    if (not in)
+    {
+        ROS_ERROR("Could not open %s for reading", _path.c_str());
+        return false;
+    }
+
+    WarmStartModelHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (not in || strncmp(header.magic, WARM_START_MODEL_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != WARM_START_MODEL_VERSION || header.n_joints == 0 || header.n_hidden == 0)
+    {
+        ROS_ERROR("%s is not a warm start model (version %i)", _path.c_str(), WARM_START_MODEL_VERSION);
+        return false;
+    }
+
+    n_joints = header.n_joints;
+    n_hidden = header.n_hidden;
+
+    size_t d = getNrOfInputs();
+
+    mu_x.resize(d);                  sigma_x.resize(d);
+    mu_y.resize(n_joints);           sigma_y.resize(n_joints);
+    W_1 .resize(n_hidden, d);            b_1.resize(n_hidden);
+    W_2 .resize(n_joints, n_hidden);     b_2.resize(n_joints);
+
+    double* blocks[] = {mu_x.data(), sigma_x.data(), mu_y.data(), sigma_y.data(),
+                        W_1.data(), b_1.data(), W_2.data(), b_2.data()};
+    size_t  sizes[]  = {d, d, n_joints, n_joints, n_hidden * d, n_hidden, n_joints * n_hidden, n_joints};
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        in.read(reinterpret_cast<char*>(blocks[i]), sizes[i] * sizeof(double));
+    }
+
+    if (not in)
+    {
+        ROS_ERROR("Warm start model %s is truncated", _path.c_str());
+        return false;
+    }
+
+    loaded = true;
+
+    ROS_INFO("Loaded warm start model %s: %lu joints, %lu hidden units",
+             _path.c_str(), n_joints, n_hidden);
+
+    return true;
+}
+
+WarmStartModel::~WarmStartModel()
+{
+
+}
@@ -0,0 +1,70 @@
+#include <ros/ros.h>
+
+#include "react_controller/reachabilityMap.h"
+
+using namespace std;
+
+/**
+ * Offline tool that builds the reachability map of one of the arms and saves
+ * it to file. Parameters (private namespace):
+ *  - limb:       left or right (default right)
+ *  - file:       the output file (default <limb>_reachability.map)
+ *  - resolution: the side of a voxel [m] (default 0.02)
+ *  - n_samples:  the number of FK samples (default 2000000)
+ *  - dilate:     the number of dilation steps (default 1)
+ */
+int main(int argc, char ** argv)
+{
+    ros::init(argc, argv, "build_reachability_map");
+    ros::NodeHandle _n("~");
+
+    string limb;
+    _n.param<string>("limb", limb, "right");
+    limb!="left"?limb="right":limb="left";
+
+    string file;
+    _n.param<string>("file", file, limb + "_reachability.map");
+
+    double resolution;
+    _n.param<double>("resolution", resolution, 0.02);
+
+    int n_samples, dilate;
+    _n.param<int>("n_samples", n_samples, 2000000);
+    _n.param<int>("dilate",       dilate,       1);
+
+    urdf::Model robot_model;
+    string xml_string, urdf_xml, full_urdf_xml;
+
+    _n.param<string>("urdf_xml", urdf_xml, "/robot_description");
+    _n.searchParam(urdf_xml, full_urdf_xml);
+
+    if (!_n.getParam(full_urdf_xml, xml_string))
+    {
+        ROS_FATAL("Could not load the xml from parameter server: %s", urdf_xml.c_str());
+        return 1;
+    }
+    robot_model.initString(xml_string);
+
+    BaxterChain chain(robot_model, "base", limb + "_gripper");
+
+    ros::WallTime start = ros::WallTime::now();
+
+    ReachabilityMap map;
+    if (not map.build(chain, resolution, size_t(std::max(n_samples, 1)), dilate))
+    {
+        ROS_FATAL("Could not build the reachability map");
+        return 1;
+    }
+
+    ROS_INFO("Map built in %gs", (ros::WallTime::now() - start).toSec());
+
+    if (not map.save(file))
+    {
+        ROS_FATAL("Could not save the reachability map to %s", file.c_str());
+        return 1;
+    }
+
+    ROS_INFO("Map saved to %s", file.c_str());
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <ros/ros.h>
+
+#include "react_controller/signedDistanceField.h"
+
+using namespace std;
+
+/**
+ * Offline tool that rasterizes the static obstacles of the workspace into a
+ * signed distance field and saves it to file. Parameters (private namespace):
+ *  - obstacles:  the static obstacles, in the same format as the obstacles of the controller
+ *  - file:       the output file (default static_obstacles.sdf)
+ *  - resolution: the distance between two neighboring vertices [m] (default 0.02)
+ *  - max_dist:   the distance the field is truncated to [m] (default ACTIVATION_DIST)
+ */
+int main(int argc, char ** argv)
+{
+    ros::init(argc, argv, "build_signed_distance_field");
+    ros::NodeHandle _n("~");
+
+    string file;
+    _n.param<string>("file", file, "static_obstacles.sdf");
+
+    double resolution, max_dist;
+    _n.param<double>("resolution", resolution,            0.02);
+    _n.param<double>("max_dist",     max_dist, ACTIVATION_DIST);
+
+    XmlRpc::XmlRpcValue obstacles_db;
+    if (not _n.getParam("obstacles", obstacles_db))
+    {
+        ROS_FATAL("No static obstacles found in %s/obstacles", _n.getNamespace().c_str());
+        return 1;
+    }
+
+    vector<Obstacle> obstacles = readFromParamServer(obstacles_db);
+
+    ros::WallTime start = ros::WallTime::now();
+
+    SignedDistanceField sdf;
+    if (not sdf.build(obstacles, resolution, max_dist))
+    {
+        ROS_FATAL("Could not build the signed distance field");
+        return 1;
+    }
+
+    ROS_INFO("Field built in %gs", (ros::WallTime::now() - start).toSec());
+
+    if (not sdf.save(file))
+    {
+        ROS_FATAL("Could not save the signed distance field to %s", file.c_str());
+        return 1;
+    }
+
+    ROS_INFO("Field saved to %s", file.c_str());
+
+    return 0;
+}
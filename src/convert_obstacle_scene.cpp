@@ -0,0 +1,58 @@
+#include <ros/ros.h>
+
+#include "react_controller/obstacleScene.h"
+
+using namespace std;
+
+/**
+ * Offline tool that converts an obstacle scene from the parameter server (e.g.
+ * loaded from a YAML file with rosparam) into a binary scene file, which the
+ * controller memory-maps at startup (see the scene/file parameter). Parameters
+ * (private namespace):
+ *  - obstacles: the scene, either a list of spheres as [x, y, z, size] (the format
+ *               of the obstacles of the controller) or a dictionary of spheres,
+ *               capsules and boxes (see ObstacleScene::fromParam)
+ *  - file:      the output file (default obstacles.scene)
+ */
+int main(int argc, char ** argv)
+{
+    ros::init(argc, argv, "convert_obstacle_scene");
+    ros::NodeHandle _n("~");
+
+    string file;
+    _n.param<string>("file", file, "obstacles.scene");
+
+    XmlRpc::XmlRpcValue obstacles_db;
+    if (not _n.getParam("obstacles", obstacles_db))
+    {
+        ROS_FATAL("No obstacle scene found in %s/obstacles", _n.getNamespace().c_str());
+        return 1;
+    }
+
+    ros::WallTime start = ros::WallTime::now();
+
+    ObstacleScene scene;
+    if (not scene.fromParam(obstacles_db))
+    {
+        ROS_FATAL("Could not convert the obstacle scene");
+        return 1;
+    }
+
+    ROS_INFO("Scene converted in %gs: %lu spheres, %lu capsules, %lu boxes",
+             (ros::WallTime::now() - start).toSec(), scene.getNrOfSpheres(),
+             scene.getNrOfCapsules(), scene.getNrOfBoxes());
+
+    // The scene is written aside and renamed, so that a controller reloading
+    // the file (see scene/reload) never maps a scene that is half written
+    string tmp = file + ".tmp";
+
+    if (not scene.save(tmp) || rename(tmp.c_str(), file.c_str()) != 0)
+    {
+        ROS_FATAL("Could not save the obstacle scene to %s", file.c_str());
+        return 1;
+    }
+
+    ROS_INFO("Scene saved to %s", file.c_str());
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <ros/ros.h>
+
+#include "baxter_react_controller/ObstacleArray.h"
+#include "react_controller/react_control_utils.h"
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * Publishes a set of obstacles moving along circles, to test the obstacle
+ * stream without a tracker. Parameters (private namespace):
+ *  - topic:     the topic to publish to (default /obstacle_stream)
+ *  - frame_id:  the frame of the obstacles (default base)
+ *  - rate:      the publishing rate [Hz] (default 100)
+ *  - obstacles: the centers of the circles, as a list of [x,y,z,size]
+ *               (default one obstacle in front of the robot)
+ *  - radius:    the radius of the circles [m] (default 0.1)
+ *  - speed:     the speed of the obstacles along the circles [m/s] (default 0.1)
+ */
+int main(int argc, char ** argv)
+{
+    ros::init(argc, argv, "obstacle_stream_publisher");
+    ros::NodeHandle _n("~");
+
+    string topic, frame_id;
+    _n.param<string>(   "topic",    topic, "/obstacle_stream");
+    _n.param<string>("frame_id", frame_id,             "base");
+
+    double rate, radius, speed;
+    _n.param<double>(  "rate",   rate, 100.0);
+    _n.param<double>("radius", radius,   0.1);
+    _n.param<double>( "speed",  speed,   0.1);
+
+    vector<Obstacle> centers;
+    XmlRpc::XmlRpcValue obstacles_db;
+    if (_n.getParam("obstacles", obstacles_db)) { centers = readFromParamServer(obstacles_db); }
+    if (centers.empty())                        { centers.push_back(Obstacle(0.05, Vector3d(0.8, -0.3, 0.2))); }
+
+    ros::Publisher pub = _n.advertise<baxter_react_controller::ObstacleArray>(topic, 1);
+
+    ROS_INFO("Publishing %lu obstacles on %s at %gHz", centers.size(), topic.c_str(), rate);
+
+    ros::Rate r(rate);
+    ros::Time start = ros::Time::now();
+
+    while (ros::ok())
+    {
+        // A new message every time, as the subscribers may still hold the previous one
+        baxter_react_controller::ObstacleArrayPtr msg(new baxter_react_controller::ObstacleArray);
+        msg->header.stamp    = ros::Time::now();
+        msg->header.frame_id = frame_id;
+        msg->obstacles.resize(centers.size());
+
+        double t = (msg->header.stamp - start).toSec();
+
+        for (size_t i = 0; i < centers.size(); ++i)
+        {
+            // Obstacles are spread evenly along the circle
+            double phase = speed / radius * t + 2.0 * M_PI * i / centers.size();
+
+            msg->obstacles[i].id         = int(i);
+            msg->obstacles[i].size       = centers[i].size;
+            msg->obstacles[i].position.x = centers[i].x_wrf[0] + radius * cos(phase);
+            msg->obstacles[i].position.y = centers[i].x_wrf[1] + radius * sin(phase);
+            msg->obstacles[i].position.z = centers[i].x_wrf[2];
+        }
+
+        // Subscribers in the same process get the message itself, not a copy
+        pub.publish(msg);
+        r.sleep();
+    }
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "react_controller/pointCloudObstacles.h"
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * Publishes a synthetic point cloud, made of points sampled on the surface of
+ * a set of spheres, to test the point cloud pipeline without a real sensor.
+ * Parameters (private namespace):
+ *  - topic:    the topic to publish to (default /synthetic_point_cloud)
+ *  - frame_id: the frame of the cloud (default base)
+ *  - rate:     the publishing rate [Hz] (default 30)
+ *  - n_points: the number of points per sphere (default 5000)
+ *  - noise:    the standard deviation of the noise on the points [m] (default 0.005)
+ *  - spheres:  the spheres, as a list of [x,y,z,size] (default one sphere in front of the robot)
+ *  - speed:    the speed of the spheres along the y axis, to move them back and forth [m/s] (default 0)
+ */
+int main(int argc, char ** argv)
+{
+    ros::init(argc, argv, "synthetic_point_cloud");
+    ros::NodeHandle _n("~");
+
+    string topic, frame_id;
+    _n.param<string>(   "topic",    topic, "/synthetic_point_cloud");
+    _n.param<string>("frame_id", frame_id,                   "base");
+
+    double rate, noise, speed;
+    _n.param<double>( "rate",  rate,  30.0);
+    _n.param<double>("noise", noise, 0.005);
+    _n.param<double>("speed", speed,   0.0);
+
+    int n_points;
+    _n.param<int>("n_points", n_points, 5000);
+
+    vector<Obstacle> spheres;
+    XmlRpc::XmlRpcValue spheres_db;
+    if (_n.getParam("spheres", spheres_db))    { spheres = readFromParamServer(spheres_db); }
+    if (spheres.empty())                       { spheres.push_back(Obstacle(0.1, Vector3d(0.8, -0.3, 0.2))); }
+
+    ros::Publisher pub = _n.advertise<sensor_msgs::PointCloud2>(topic, 1);
+
+    ROS_INFO("Publishing %lu spheres (%i points each) on %s at %gHz",
+              spheres.size(), n_points, topic.c_str(), rate);
+
+    sensor_msgs::PointCloud2 cloud;
+    cloud.header.frame_id = frame_id;
+
+    ros::Rate r(rate);
+    ros::Time start = ros::Time::now();
+    unsigned int seed = 1;
+
+    while (ros::ok())
+    {
+        double offset = 0.2 * sin(speed / 0.2 * (ros::Time::now() - start).toSec());
+
+        vector<Obstacle> moved(spheres);
+        for (size_t i = 0; i < moved.size(); ++i)    { moved[i].x_wrf[1] += offset; }
+
+        syntheticPointCloud(cloud, moved, size_t(std::max(n_points, 1)), noise, seed++);
+        cloud.header.stamp = ros::Time::now();
+
+        pub.publish(cloud);
+        r.sleep();
+    }
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include <ros/ros.h>
+
+#include "react_controller/controllerNLP.h"
+#include "react_controller/warmStartModel.h"
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * Offline tool that trains the warm start model of the controller on the solves
+ * it recorded (see the warm_start/log parameter of the controller), saves it to
+ * file, and reports how much it reduces the iterations of IPOPT on held-out
+ * solves. The last part of the log is held out, so that the evaluation is on
+ * trajectories the model has not seen rather than on neighbours of its samples.
+ * The held-out problems are solved again, without and with the model; the
+ * constraints of the collision points are not part of the log, so they are
+ * solved without them. Parameters (private namespace):
+ *  - log:                the log of the solves (required)
+ *  - file:               the output file (default warm_start.model)
+ *  - limb:               left or right (default right)
+ *  - holdout:            the fraction of the log held out (default 0.2)
+ *  - n_eval:             the maximum number of held-out problems solved again (default 500)
+ *  - n_hidden:           the number of hidden units (default 32)
+ *  - n_epochs:           the number of passes over the samples (default 200)
+ *  - batch_size:         the number of samples per step (default 64)
+ *  - learning_rate:      the step size (default 1e-3)
+ *  - weight_decay:       the L2 regularization of the weights (default 1e-5)
+ *  - formulation:        the formulation of the controller (default hard)
+ *  - formulation_weight: its weight (default 1e3, or 1e4 for slack)
+ *  - tol:                the tolerance of the solver (default 1e-6)
+ *  - nlp_scaling:        the scaling method of the NLP (default gradient-based)
+ */
+int main(int argc, char ** argv)
+{
+    ros::init(argc, argv, "train_warm_start");
+    ros::NodeHandle _n("~");
+
+    string log, file, limb, formulation, nlp_scaling;
+    _n.param<string>("log",  log,  "");
+    _n.param<string>("file", file, "warm_start.model");
+    _n.param<string>("limb", limb, "right");
+    limb!="left"?limb="right":limb="left";
+
+    double holdout, tol, formulation_weight;
+    int    n_eval;
+    _n.param<double>("holdout",  holdout, 0.2);
+    _n.param<int>   ("n_eval",    n_eval, 500);
+    _n.param<string>("formulation", formulation, "hard");
+    _n.param<double>("formulation_weight", formulation_weight, formulation=="slack"?1e4:1e3);
+    _n.param<double>("tol", tol, 1e-6);
+    _n.param<string>("nlp_scaling", nlp_scaling, "gradient-based");
+
+    WarmStartTraining options;
+    int n_hidden, n_epochs, batch_size;
+    _n.param<int>   ("n_hidden",      n_hidden,   int(options.n_hidden));
+    _n.param<int>   ("n_epochs",      n_epochs,   int(options.n_epochs));
+    _n.param<int>   ("batch_size",    batch_size, int(options.batch_size));
+    _n.param<double>("learning_rate", options.learning_rate, options.learning_rate);
+    _n.param<double>("weight_decay",  options.weight_decay,  options.weight_decay);
+    options.n_hidden   = size_t(std::max(n_hidden,   1));
+    options.n_epochs   = size_t(std::max(n_epochs,   1));
+    options.batch_size = size_t(std::max(batch_size, 1));
+
+    vector<WarmStartSample> samples;
+    if (log.empty() || not WarmStartLog::read(log, samples) || samples.empty())
+    {
+        ROS_FATAL("No samples to train on, set %s/log to a warm start log", _n.getNamespace().c_str());
+        return 1;
+    }
+
+    size_t n_test = std::min(size_t(std::max(holdout, 0.0) * samples.size()), samples.size() - 1);
+    vector<WarmStartSample> train(samples.begin(), samples.end() - n_test);
+    vector<WarmStartSample> test (samples.end() - n_test, samples.end());
+
+    ros::WallTime start = ros::WallTime::now();
+
+    WarmStartModel model;
+    if (not model.train(train, options))
+    {
+        ROS_FATAL("Could not train the warm start model");
+        return 1;
+    }
+
+    ROS_INFO("Model trained in %gs on %lu samples, %lu held out",
+             (ros::WallTime::now() - start).toSec(), train.size(), test.size());
+
+    if (not model.save(file))
+    {
+        ROS_FATAL("Could not save the warm start model to %s", file.c_str());
+        return 1;
+    }
+
+    ROS_INFO("Model saved to %s", file.c_str());
+
+    if (test.empty())    { return 0; }
+
+    // Evaluation report: error of the starting point, and iterations of the solver
+    double err_0 = 0.0;
+    for (size_t s = 0; s < test.size(); ++s)
+    {
+        err_0 += (test[s].v_e - test[s].v_0).squaredNorm();
+    }
+    err_0 = sqrt(err_0 / (test.size() * test[0].v_e.size()));
+
+    ROS_INFO("Held-out RMS error of the starting point [rad/s]: v_0 %g, model %g",
+             err_0, model.evaluate(test));
+
+    urdf::Model robot_model;
+    string xml_string, urdf_xml, full_urdf_xml;
+
+    _n.param<string>("urdf_xml", urdf_xml, "/robot_description");
+    _n.searchParam(urdf_xml, full_urdf_xml);
+
+    if (!_n.getParam(full_urdf_xml, xml_string))
+    {
+        ROS_WARN("Could not load the xml from parameter server: %s. Skipping the solves.",
+                 urdf_xml.c_str());
+        return 0;
+    }
+    robot_model.initString(xml_string);
+
+    BaxterChain chain(robot_model, "base", limb + "_gripper");
+
+    if (chain.getNrOfJoints() != model.getNrOfJoints())
+    {
+        ROS_FATAL("The log is of %lu joints, the %s arm has %lu", model.getNrOfJoints(),
+                  limb.c_str(), chain.getNrOfJoints());
+        return 1;
+    }
+
+    // Iterations are what matters here, so the solves are not cut by the time
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = newControllerApp(tol, 1.0);
+    app->Options()->SetIntegerValue("print_level", 0);
+    app->Options()->SetStringValue ("nlp_scaling_method", nlp_scaling);
+    app->Initialize();
+
+    size_t stride = std::max(test.size() / size_t(std::max(n_eval, 1)), size_t(1));
+    size_t n_solves = 0, iters[2] = {0, 0}, n_solved[2] = {0, 0};
+    double t_solve[2] = {0.0, 0.0};
+
+    for (size_t s = 0; s < test.size(); s += stride)
+    {
+        const WarmStartSample &sm = test[s];
+        chain.setAng(sm.q_0);
+
+        for (size_t m = 0; m < 2; ++m)
+        {
+            Ipopt::SmartPtr<ControllerNLP> nlp = new ControllerNLP(chain, sm.dt, sm.ctrl_ori);
+            nlp->set_formulation(formulation, formulation_weight);
+            nlp->set_v_lim(sm.v_lim);
+            nlp->set_dt(sm.dt);
+            nlp->set_x_r(sm.p_r, sm.o_r);
+            nlp->set_v_0(sm.v_0);
+            nlp->init();
+
+            if (m == 1)    { nlp->set_warm_start(&model); }
+
+            start = ros::WallTime::now();
+            int exit_code = app->OptimizeTNLP(GetRawPtr(nlp));
+            t_solve[m] += (ros::WallTime::now() - start).toSec();
+
+            iters[m]    += app->Statistics()->IterationCount();
+            n_solved[m] += exit_code == Ipopt::Solve_Succeeded ||
+                           exit_code == Ipopt::Solved_To_Acceptable_Level;
+        }
+
+        n_solves++;
+    }
+
+    ROS_INFO("Held-out solves: %lu", n_solves);
+    ROS_INFO("  from v_0:   %6.2f iterations, %7.3fms, %lu solved", double(iters[0]) / n_solves,
+             1e3 * t_solve[0] / n_solves, n_solved[0]);
+    ROS_INFO("  from model: %6.2f iterations, %7.3fms, %lu solved", double(iters[1]) / n_solves,
+             1e3 * t_solve[1] / n_solves, n_solved[1]);
+    ROS_INFO("  iterations reduced by %.1f%%", iters[0] ? 1e2 * (double(iters[0]) - iters[1]) / iters[0] : 0.0);
+
+    return 0;
+}
@@ -0,0 +1,2101 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <fstream>
+
+#include "react_controller/ctrlThread.h"
+#include "react_controller/batchIKSolver.h"
+#include "react_controller/reachabilityMap.h"
+#include "react_controller/pointCloudObstacles.h"
+#include "react_controller/signedDistanceField.h"
+#include "react_controller/collisionGeometry.h"
+#include "react_controller/tactileSkin.h"
+#include "react_controller/obstacleScene.h"
+#include "react_controller/kinematicsCache.h"
+
+using namespace std;
+using namespace Eigen;
+
+BaxterChain getChain(const std::string &_tip_link)
+{
+    urdf::Model robot_model;
+    string xml_string;
+    ros::NodeHandle _n("baxter_react_controller");
+
+    string urdf_xml,full_urdf_xml;
+    _n.param<std::string>("urdf_xml",urdf_xml,"/robot_description");
+    _n.searchParam(urdf_xml,full_urdf_xml);
+
+    ROS_ASSERT(_n.getParam(full_urdf_xml, xml_string));
+
+    _n.param(full_urdf_xml,xml_string,std::string());
+    robot_model.initString(xml_string);
+
+    return BaxterChain(robot_model, "base", _tip_link);
+}
+
+/**
+ * Generates a set of reachable IK problems: every start configuration is
+ * picked at random within the inner part of the joint ranges, and the target
+ * is the corresponding end-effector pose displaced by a few millimeters.
+ */
+vector<BatchIKProblem> randomProblems(BaxterChain _chain, size_t _n, unsigned int _seed = 1)
+{
+    srand(_seed);
+    vector<BatchIKProblem> res;
+
+    for (size_t i = 0; i < _n; ++i)
+    {
+        VectorXd q(_chain.getNrOfJoints());
+        for (size_t j = 0; j < _chain.getNrOfJoints(); ++j)
+        {
+            double mid = (_chain.getMax(j) + _chain.getMin(j)) / 2.0;
+            double rng = (_chain.getMax(j) - _chain.getMin(j)) / 2.0;
+            q[j] = mid + 0.6 * rng * (2.0 * rand() / RAND_MAX - 1.0);
+        }
+        _chain.setAng(q);
+
+        Matrix4d H = _chain.getH();
+        Vector3d p = H.block<3,1>(0,3) + 0.004 * Vector3d::Random();
+
+        res.push_back(BatchIKProblem(q, VectorXd::Zero(q.size()), p,
+                                     Quaterniond(Matrix3d(H.block<3,3>(0,0)))));
+    }
+
+    return res;
+}
+
+TEST(BenchmarkTest, batchIK)
+{
+    BaxterChain chain(getChain("right_gripper"));
+
+    int n_problems;
+    ros::NodeHandle nh("~");
+    nh.param<int>("batch_ik/n_problems", n_problems, 400);
+
+    string linear_solver;
+    nh.param<string>("batch_ik/linear_solver", linear_solver, "");
+
+    vector<BatchIKProblem> problems = randomProblems(chain, size_t(n_problems));
+
+    size_t max_workers = std::max(1u, std::thread::hardware_concurrency());
+    double t_serial = 0.0;
+
+    for (size_t n_workers = 1; n_workers <= max_workers; n_workers *= 2)
+    {
+        BatchIKSolver solver(chain, n_workers);
+        solver.set_linear_solver(linear_solver);
+
+        ros::WallTime start = ros::WallTime::now();
+        vector<BatchIKResult> results = solver.solve(problems);
+        double t_batch = (ros::WallTime::now() - start).toSec();
+
+        if (n_workers == 1) { t_serial = t_batch; }
+
+        size_t n_success = 0;
+        double t_solve   = 0.0;
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            n_success += (results[i].exit_code == Ipopt::Solve_Succeeded);
+            t_solve   +=  results[i].solve_time;
+        }
+
+        EXPECT_EQ(results.size(), problems.size());
+
+        printf("[batchIK] workers %2lu  problems %4lu  success %4lu  "
+               "total %8.4fs  per problem %8.3fms  throughput %8.1f/s  speedup %5.2fx\n",
+               solver.getNrOfWorkers(), problems.size(), n_success, t_batch,
+               1e3 * t_solve / results.size(), results.size() / t_batch, t_serial / t_batch);
+    }
+}
+
+TEST(BenchmarkTest, formulations)
+{
+    // Runs the debugIPOPT offset grid (without the robot) for every
+    // formulation of the positional task and every scaling method
+    ros::NodeHandle nh("baxter_react_controller");
+    vector<string> formulations{"hard", "soft", "slack"};
+    vector<string> scalings{"gradient-based", "user-scaling", "none"};
+
+    for (size_t i = 0; i < formulations.size(); ++i)
+    {
+        for (size_t j = 0; j < scalings.size(); ++j)
+        {
+            nh.setParam("formulation", formulations[i]);
+            nh.setParam("nlp_scaling",     scalings[j]);
+
+            CtrlThread arm("baxter_react_controller", "right", false, 50.0, true);
+            CtrlStats stats = arm.getStats();
+
+            EXPECT_EQ(stats.n_cycles + stats.n_idle, 54);
+
+            printf("[formulations] %5s %14s: cpu time exceeded %3lu %s\n",
+                    formulations[i].c_str(), scalings[j].c_str(),
+                    stats.exit_codes[Ipopt::Maximum_CpuTime_Exceeded], stats.toString().c_str());
+        }
+    }
+
+    nh.deleteParam("formulation");
+    nh.deleteParam("nlp_scaling");
+}
+
+TEST(BenchmarkTest, reachabilityMap)
+{
+    BaxterChain chain(getChain("right_gripper"));
+
+    ros::WallTime start = ros::WallTime::now();
+    ReachabilityMap map;
+    ASSERT_TRUE(map.build(chain, 0.02, 200000));
+    printf("[reachabilityMap] build (2e5 samples)  %8.3fs\n", (ros::WallTime::now() - start).toSec());
+
+    ASSERT_TRUE(map.save("/tmp/benchmark_reachability.map"));
+
+    ReachabilityMap mapped;
+    start = ros::WallTime::now();
+    ASSERT_TRUE(mapped.load("/tmp/benchmark_reachability.map"));
+    printf("[reachabilityMap] load                 %8.3fms  (%lu voxels, %lu reachable)\n",
+           1e3 * (ros::WallTime::now() - start).toSec(), mapped.getNrOfVoxels(), mapped.getNrOfReachable());
+
+    // The current end-effector position is reachable by definition
+    Vector3d p_0 = chain.getH().block<3,1>(0,3);
+    EXPECT_TRUE (mapped.isReachable(p_0));
+    EXPECT_FALSE(mapped.isReachable(Vector3d(5.0, 5.0, 5.0)));
+
+    size_t n_queries = 1000000;
+    vector<Vector3d> queries(n_queries);
+    for (size_t i = 0; i < n_queries; ++i)
+    {
+        queries[i] = p_0 + 1.5 * Vector3d::Random();
+    }
+
+    size_t n_reachable = 0;
+    start = ros::WallTime::now();
+    for (size_t i = 0; i < n_queries; ++i)
+    {
+        n_reachable += mapped.isReachable(queries[i]);
+    }
+    double t_lookup = (ros::WallTime::now() - start).toSec();
+
+    Vector3d p_s;
+    start = ros::WallTime::now();
+    for (size_t i = 0; i < n_queries; ++i)
+    {
+        mapped.projectStep(p_0, queries[i], 0.05, p_s);
+    }
+    double t_project = (ros::WallTime::now() - start).toSec();
+
+    printf("[reachabilityMap] isReachable          %8.1fns  (%lu/%lu reachable)\n",
+           1e9 * t_lookup / n_queries, n_reachable, n_queries);
+    printf("[reachabilityMap] projectStep (5cm)    %8.1fns\n", 1e9 * t_project / n_queries);
+}
+
+TEST(BenchmarkTest, obstacleCulling)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    Vector3d p_0 = chain.getH().block<3,1>(0,3);
+
+    srand(1);
+    size_t n_reps = 20;
+
+    for (size_t n_obstacles = 1; n_obstacles <= 10000; n_obstacles *= 10)
+    {
+        // Obstacles are spread in a 4m cube centered on the end-effector
+        vector<Obstacle> obstacles;
+        for (size_t i = 0; i < n_obstacles; ++i)
+        {
+            obstacles.push_back(Obstacle(0.05, p_0 + 2.0 * Vector3d::Random()));
+        }
+
+        ros::WallTime start = ros::WallTime::now();
+        ObstacleGrid grid(obstacles);
+        double t_build = (ros::WallTime::now() - start).toSec();
+
+        size_t n_candidates = 0, n_ctrl_points = 0;
+        start = ros::WallTime::now();
+        for (size_t r = 0; r < n_reps; ++r)
+        {
+            AvoidanceHandlerTactile avhdl(chain, grid);
+            n_candidates  = avhdl.getNrOfCandidates();
+            n_ctrl_points = avhdl.getCtrlPoints().size();
+        }
+        double t_handler = (ros::WallTime::now() - start).toSec() / n_reps;
+
+        EXPECT_LE(n_ctrl_points, n_candidates);
+
+        printf("[obstacleCulling] %5lu obstacles: grid build %8.3fms, handler %8.3fms "
+               "(%4lu candidates, %4lu control points)\n", n_obstacles, 1e3 * t_build,
+               1e3 * t_handler, n_candidates, n_ctrl_points);
+    }
+}
+
+TEST(BenchmarkTest, sphereCapsuleKernel)
+{
+    srand(1);
+    size_t n_links = 7, n_reps = 20;
+
+    Capsules caps;
+    caps.resize(n_links);
+    for (size_t l = 0; l < n_links; ++l)
+    {
+        caps.set(l, Vector3d::Random(), Vector3d::Random(), 0.05);
+    }
+
+    for (size_t n_spheres = 10; n_spheres <= 10000; n_spheres *= 10)
+    {
+        Spheres spheres;
+        spheres.resize(n_spheres);
+        for (size_t i = 0; i < n_spheres; ++i)
+        {
+            spheres.set(i, 2.0 * Vector3d::Random(), 0.05);
+        }
+
+        SphereCapsuleDistances res;
+        ros::WallTime start = ros::WallTime::now();
+        for (size_t r = 0; r < n_reps; ++r)
+        {
+            sphereCapsuleDistances(caps, spheres, res);
+        }
+        double t_kernel = (ros::WallTime::now() - start).toSec() / n_reps;
+
+        // Scalar reference, one pair at a time
+        double sum = 0.0;
+        start = ros::WallTime::now();
+        for (size_t r = 0; r < n_reps; ++r)
+        {
+            for (size_t l = 0; l < n_links; ++l)
+            {
+                Vector3d a(caps.ax[l], caps.ay[l], caps.az[l]);
+                Vector3d b(caps.bx[l], caps.by[l], caps.bz[l]);
+
+                for (size_t i = 0; i < n_spheres; ++i)
+                {
+                    sum += distanceToSegment(a, b, Vector3d(spheres.x[i], spheres.y[i], spheres.z[i]));
+                }
+            }
+        }
+        double t_scalar = (ros::WallTime::now() - start).toSec() / n_reps;
+
+        EXPECT_NEAR(sum / n_reps, (res.dist + 0.1).sum(), 1e-6 * n_spheres);
+
+        printf("[sphereCapsuleKernel] %5lu spheres x %lu links: kernel %8.3fus "
+               "(%5.2fns/pair), scalar %8.3fus\n", n_spheres, n_links, 1e6 * t_kernel,
+               1e9 * t_kernel / (n_spheres * n_links), 1e6 * t_scalar);
+    }
+}
+
+TEST(BenchmarkTest, pointCloud)
+{
+    // A VGA depth camera yields about 300k points per frame
+    vector<Obstacle> spheres;
+    for (size_t i = 0; i < 20; ++i)
+    {
+        spheres.push_back(Obstacle(0.1, Vector3d(1.0, 0.0, 0.5) + Vector3d::Random()));
+    }
+
+    sensor_msgs::PointCloud2 cloud;
+    syntheticPointCloud(cloud, spheres, 15000, 0.005);
+
+    size_t max_points[] = {10000, 50000, 300000};
+
+    for (size_t m = 0; m < 3; ++m)
+    {
+        PointCloudObstacles proc(0.05, max_points[m], 500, 1.0);
+        vector<Obstacle> obstacles;
+
+        size_t n_reps = 20;
+        ros::WallTime start = ros::WallTime::now();
+        for (size_t r = 0; r < n_reps; ++r)
+        {
+            ASSERT_TRUE(proc.process(cloud, obstacles));
+        }
+        double t_proc = (ros::WallTime::now() - start).toSec() / n_reps;
+
+        printf("[pointCloud] %6u points, max_points %6lu: %8.3fms (%6lu read, "
+               "%4lu voxels, %3lu obstacles)\n", cloud.width, max_points[m], 1e3 * t_proc,
+               proc.getNrOfRead(), proc.getNrOfVoxels(), obstacles.size());
+    }
+
+    // With a time cap the processing stops early
+    PointCloudObstacles proc(0.05, 300000, 500, 0.001);
+    vector<Obstacle> obstacles;
+    ASSERT_TRUE(proc.process(cloud, obstacles));
+    printf("[pointCloud] time cap 1ms: %8.3fms (%6lu read, truncated %s)\n",
+           1e3 * proc.getProcTime(), proc.getNrOfRead(), proc.isTruncated()?"yes":"no");
+}
+
+TEST(BenchmarkTest, persistentAvoidance)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    VectorXd q_0(chain.getNrOfJoints());
+    for (size_t j = 0; j < chain.getNrOfJoints(); ++j)
+    {
+        q_0[j] = 0.5 * (chain.getMin(j) + chain.getMax(j));
+    }
+    chain.setAng(q_0);
+
+    Vector3d p_0 = chain.getH().block<3,1>(0,3);
+
+    srand(1);
+    vector<Obstacle> obstacles;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        obstacles.push_back(Obstacle(0.05, p_0 + 1.0 * Vector3d::Random()));
+    }
+    ObstacleGrid grid(obstacles);
+
+    // A slow motion followed by a still phase, as in a typical reaching task
+    vector<VectorXd> traj;
+    for (size_t t = 0; t < 200; ++t)
+    {
+        traj.push_back(q_0 + 0.2 * sin(2.0 * M_PI * t / 400.0) * VectorXd::Ones(q_0.size()));
+    }
+    for (size_t t = 0; t < 100; ++t)
+    {
+        traj.push_back(traj.back());
+    }
+
+    MatrixXd v_lim(q_0.size(), 2);
+    v_lim.col(0).setConstant(-1.0);
+    v_lim.col(1).setConstant( 1.0);
+
+    // Reference: a new handler at every cycle
+    vector<MatrixXd> V_LIM(traj.size());
+    ros::WallTime start = ros::WallTime::now();
+    for (size_t t = 0; t < traj.size(); ++t)
+    {
+        chain.setAng(traj[t]);
+        AvoidanceHandlerTactile avhdl(chain, grid);
+        V_LIM[t] = avhdl.getV_LIM(v_lim);
+    }
+    double t_fresh = (ros::WallTime::now() - start).toSec() / traj.size();
+
+    printf("[persistentAvoidance] new handler per cycle: %8.3fms/cycle\n", 1e3 * t_fresh);
+
+    double thres[] = {0.0, 0.005, 0.02};
+
+    for (size_t k = 0; k < 3; ++k)
+    {
+        chain.setAng(q_0);
+        AvoidanceHandlerTactile avhdl(chain, vector<double>());
+        avhdl.set_update_thres(thres[k]);
+
+        double err = 0.0;
+        for (size_t t = 0; t < traj.size(); ++t)
+        {
+            avhdl.update(traj[t], grid);
+            err = std::max(err, (avhdl.getV_LIM(v_lim) - V_LIM[t]).cwiseAbs().maxCoeff());
+        }
+
+        // Without threshold the persistent handler has to match the reference
+        if (thres[k] == 0.0)    { EXPECT_NEAR(0.0, err, 1e-9); }
+
+        AvoidanceStats stats = avhdl.getStats();
+        printf("[persistentAvoidance] update_thres %5.3fm: %8.3fms/cycle, max V_LIM error "
+               "%g\n    %s\n", thres[k], 1e3 * stats.t_total / stats.n_updates, err,
+               stats.toString().c_str());
+    }
+}
+
+TEST(BenchmarkTest, staticField)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    VectorXd q_0(chain.getNrOfJoints());
+    for (size_t j = 0; j < chain.getNrOfJoints(); ++j)
+    {
+        q_0[j] = 0.5 * (chain.getMin(j) + chain.getMax(j));
+    }
+    chain.setAng(q_0);
+
+    Vector3d p_0 = chain.getH().block<3,1>(0,3);
+
+    // A table below the end-effector, approximated by spheres, and a pedestal
+    vector<Obstacle> obstacles;
+    for (double x = -0.6; x <= 0.6; x += 0.05)
+    {
+        for (double y = -0.4; y <= 0.4; y += 0.05)
+        {
+            obstacles.push_back(Obstacle(0.025, p_0 + Vector3d(x, y, -0.3)));
+        }
+    }
+    obstacles.push_back(Obstacle(0.2, p_0 + Vector3d(-0.3, 0.0, -0.6)));
+
+    double res[] = {0.04, 0.02, 0.01};
+
+    for (size_t k = 0; k < 3; ++k)
+    {
+        ros::WallTime start = ros::WallTime::now();
+        SignedDistanceField sdf;
+        ASSERT_TRUE(sdf.build(obstacles, res[k]));
+        double t_build = (ros::WallTime::now() - start).toSec();
+
+        ASSERT_TRUE(sdf.save("/tmp/benchmark_static.sdf"));
+        SignedDistanceField mapped;
+        ASSERT_TRUE(mapped.load("/tmp/benchmark_static.sdf"));
+
+        // Random links around the table: closest distance from the field vs from the spheres
+        srand(1);
+        size_t n_links = 7, n_reps = 1000;
+
+        vector<Capsules> caps(n_reps);
+        for (size_t r = 0; r < n_reps; ++r)
+        {
+            caps[r].resize(n_links);
+            for (size_t l = 0; l < n_links; ++l)
+            {
+                Vector3d a = p_0 + Vector3d(0.6, 0.4, 0.4).cwiseProduct(Vector3d::Random());
+                caps[r].set(l, a, a + 0.15 * Vector3d::Random(), 0.0);
+            }
+        }
+
+        Spheres spheres;
+        spheres.resize(obstacles.size());
+        for (size_t i = 0; i < obstacles.size(); ++i)
+        {
+            spheres.set(i, obstacles[i].x_wrf, obstacles[i].size);
+        }
+
+        vector<double> d_analytic(n_reps * n_links), d_field(n_reps * n_links, ACTIVATION_DIST);
+
+        SphereCapsuleDistances dists;
+        start = ros::WallTime::now();
+        for (size_t r = 0; r < n_reps; ++r)
+        {
+            sphereCapsuleDistances(caps[r], spheres, dists);
+            for (size_t l = 0; l < n_links; ++l)
+            {
+                d_analytic[r * n_links + l] = dists.dist.col(l).minCoeff();
+            }
+        }
+        double t_analytic = (ros::WallTime::now() - start).toSec() / n_reps;
+
+        Vector3d x, grad;
+        start = ros::WallTime::now();
+        for (size_t r = 0; r < n_reps; ++r)
+        {
+            for (size_t l = 0; l < n_links; ++l)
+            {
+                Vector3d a(caps[r].ax[l], caps[r].ay[l], caps[r].az[l]);
+                Vector3d b(caps[r].bx[l], caps[r].by[l], caps[r].bz[l]);
+                mapped.closestPoint(a, b, x, d_field[r * n_links + l], grad);
+            }
+        }
+        double t_field = (ros::WallTime::now() - start).toSec() / n_reps;
+
+        // Accuracy only matters within the activation range
+        double err_max = 0.0, err_avg = 0.0;
+        size_t n_err   = 0;
+        for (size_t i = 0; i < d_analytic.size(); ++i)
+        {
+            if (d_analytic[i] > 0.35)    { continue; }
+
+            double err = fabs(d_analytic[i] - d_field[i]);
+            err_max  = std::max(err_max, err);
+            err_avg += err;
+            n_err++;
+        }
+        err_avg /= n_err?n_err:1;
+
+        EXPECT_LT(err_max, res[k]);
+
+        printf("[staticField] %lu spheres, resolution %4.2fm: build %8.3fms (%8lu vertices, %6.2fMB)\n"
+               "    7 links: analytic %8.3fus, field %8.3fus, error avg %6.4fm max %6.4fm\n",
+               obstacles.size(), res[k], 1e3 * t_build, mapped.getNrOfVertices(),
+               mapped.getNrOfVertices() * sizeof(float) / 1e6, 1e6 * t_analytic,
+               1e6 * t_field, err_avg, err_max);
+    }
+
+    // The whole avoidance stage, with the static obstacles in the grid or in the field
+    SignedDistanceField sdf;
+    ASSERT_TRUE(sdf.build(obstacles, 0.02));
+
+    ObstacleGrid grid(obstacles), empty;
+
+    AvoidanceHandlerTactile analytic(chain, vector<double>());
+    AvoidanceHandlerTactile    field(chain, vector<double>());
+    analytic.set_update_thres(0.0);
+    field   .set_update_thres(0.0);
+    field   .set_static_field(&sdf);
+
+    for (size_t t = 0; t < 200; ++t)
+    {
+        VectorXd q = q_0 + 0.2 * sin(2.0 * M_PI * t / 200.0) * VectorXd::Ones(q_0.size());
+        analytic.update(q, grid);
+        field   .update(q, empty);
+    }
+
+    AvoidanceStats s_analytic = analytic.getStats(), s_field = field.getStats();
+    printf("[staticField] handler: analytic %8.3fms/cycle, field %8.3fms/cycle\n",
+           1e3 * s_analytic.t_total / s_analytic.n_updates, 1e3 * s_field.t_total / s_field.n_updates);
+}
+
+TEST(BenchmarkTest, parallelAvoidance)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    VectorXd q_0(chain.getNrOfJoints());
+    for (size_t j = 0; j < chain.getNrOfJoints(); ++j)
+    {
+        q_0[j] = 0.5 * (chain.getMin(j) + chain.getMax(j));
+    }
+    chain.setAng(q_0);
+
+    Vector3d p_0 = chain.getH().block<3,1>(0,3);
+
+    // The arm moves at every cycle, so that every collision point is recomputed
+    vector<VectorXd> traj;
+    for (size_t t = 0; t < 50; ++t)
+    {
+        traj.push_back(q_0 + 0.2 * sin(2.0 * M_PI * t / 50.0) * VectorXd::Ones(q_0.size()));
+    }
+
+    MatrixXd v_lim(q_0.size(), 2);
+    v_lim.col(0).setConstant(-1.0);
+    v_lim.col(1).setConstant( 1.0);
+
+    size_t n_cores = std::max(1u, std::thread::hardware_concurrency());
+    vector<size_t> n_threads = {1, 2, 4};
+    if (n_cores > 4)    { n_threads.push_back(n_cores); }
+
+    for (size_t n_obstacles = 10; n_obstacles <= 1000; n_obstacles *= 10)
+    {
+        srand(1);
+        vector<Obstacle> obstacles;
+        for (size_t i = 0; i < n_obstacles; ++i)
+        {
+            obstacles.push_back(Obstacle(0.05, p_0 + 0.5 * Vector3d::Random()));
+        }
+        ObstacleGrid grid(obstacles);
+
+        vector<MatrixXd> V_LIM(traj.size());
+        double t_serial = 0.0;
+
+        for (size_t k = 0; k < n_threads.size(); ++k)
+        {
+            AvoidanceHandlerTactile avhdl(chain, vector<double>());
+            avhdl.set_update_thres(0.0);
+            avhdl.set_n_threads(n_threads[k]);
+
+            size_t n_points = 0;
+            bool  identical = true;
+            ros::WallTime start = ros::WallTime::now();
+            for (size_t t = 0; t < traj.size(); ++t)
+            {
+                avhdl.update(traj[t], grid);
+                MatrixXd V = avhdl.getV_LIM(v_lim);
+                n_points  += avhdl.getCtrlPoints().size();
+
+                // The results do not depend on the number of threads
+                if (k == 0)    { V_LIM[t] = V; }
+                else           { identical = identical && V == V_LIM[t]; }
+            }
+            double t_cycle = (ros::WallTime::now() - start).toSec() / traj.size();
+
+            if (k == 0)    { t_serial = t_cycle; }
+            EXPECT_TRUE(identical);
+
+            printf("[parallelAvoidance] %4lu obstacles, %2lu threads: %8.3fms/cycle, speedup "
+                   "%5.2f (%5.1f control points/cycle)\n", n_obstacles, n_threads[k],
+                   1e3 * t_cycle, t_serial / t_cycle, double(n_points) / traj.size());
+        }
+    }
+}
+
+TEST(BenchmarkTest, selfCollision)
+{
+    BaxterChain right(getChain("right_gripper"));
+    BaxterChain  left(getChain( "left_gripper"));
+
+    MatrixXd v_lim(right.getNrOfJoints(), 2);
+    v_lim.col(0).setConstant(-1.0);
+    v_lim.col(1).setConstant( 1.0);
+
+    vector<double> radii(right.getNrOfJoints(), 0.06);
+
+    // Random configurations of both arms, biased towards the middle of the workspace
+    srand(1);
+    size_t n_cycles = 500;
+    vector<VectorXd> q_r(n_cycles), q_l(n_cycles);
+    for (size_t t = 0; t < n_cycles; ++t)
+    {
+        q_r[t].resize(right.getNrOfJoints());
+        q_l[t].resize( left.getNrOfJoints());
+
+        for (size_t j = 0; j < right.getNrOfJoints(); ++j)
+        {
+            double u = 0.5 * (1.0 + double(rand()) / RAND_MAX);
+            q_r[t][j] = right.getMin(j) + u * (right.getMax(j) - right.getMin(j));
+            q_l[t][j] =  left.getMin(j) + (1.0 - u) * (left.getMax(j) - left.getMin(j));
+        }
+    }
+
+    // Self-collisions: broad phase on bounding spheres, narrow phase on capsules
+    AvoidanceHandlerTactile self(right, radii);
+    self.set_update_thres(0.0);
+
+    Capsules     other;
+    ObstacleGrid empty;
+    size_t n_points = 0;
+    double t_self   = 0.0;
+
+    for (size_t t = 0; t < n_cycles; ++t)
+    {
+        ros::WallTime start = ros::WallTime::now();
+        left.setAng(q_l[t]);
+        chainCapsules(left, radii, other);
+        self.set_other_links(other);
+
+        self.update(q_r[t], empty);
+        self.getV_LIM(v_lim);
+        t_self += (ros::WallTime::now() - start).toSec();
+
+        n_points += self.getCtrlPoints().size();
+    }
+
+    AvoidanceStats stats = self.getStats();
+    printf("[selfCollision] capsules: %8.3fus/cycle, of which broad and narrow phase %8.3fus "
+           "(%5.2f of %lu pairs in the narrow phase, %5.2f control points)\n",
+           1e6 * t_self / n_cycles, 1e6 * stats.t_self / n_cycles,
+           double(stats.n_self_pairs) / n_cycles, other.size() * (right.getNrOfJoints() - 1),
+           double(n_points) / n_cycles);
+
+    // Reference: the other arm as spheres every 5cm along its links, through the grid
+    AvoidanceHandlerTactile spheres(right, radii);
+    spheres.set_update_thres(0.0);
+
+    double t_spheres = 0.0;
+    for (size_t t = 0; t < n_cycles; ++t)
+    {
+        ros::WallTime start = ros::WallTime::now();
+        left.setAng(q_l[t]);
+        chainCapsules(left, radii, other);
+
+        vector<Obstacle> obstacles;
+        for (size_t m = 0; m < other.size(); ++m)
+        {
+            Vector3d a(other.ax[m], other.ay[m], other.az[m]);
+            Vector3d b(other.bx[m], other.by[m], other.bz[m]);
+            size_t n = size_t(ceil((b - a).norm() / 0.05)) + 1;
+
+            for (size_t k = 0; k < n; ++k)
+            {
+                obstacles.push_back(Obstacle(other.r[m], a + (b - a) * (n > 1 ? k / double(n - 1) : 0.0)));
+            }
+        }
+
+        spheres.update(q_r[t], ObstacleGrid(obstacles));
+        spheres.getV_LIM(v_lim);
+        t_spheres += (ros::WallTime::now() - start).toSec();
+    }
+
+    printf("[selfCollision] spheres:  %8.3fus/cycle. Share of a 10ms cycle: capsules %5.1f%%, "
+           "spheres %5.1f%%\n", 1e6 * t_spheres / n_cycles, 1e2 * t_self / n_cycles / 0.01,
+           1e2 * t_spheres / n_cycles / 0.01);
+}
+
+TEST(BenchmarkTest, tactileSkin)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    size_t n_links = chain.getNrOfJoints() - 1;
+
+    // 5000 taxels in patches of 100, spread over the links as cylinders of radius 6cm
+    size_t n_taxels = 5000, patch_size = 100;
+    vector<Taxel> taxels;
+    for (uint32_t k = 0; k < n_taxels; ++k)
+    {
+        size_t patch = k / patch_size;
+        double angle = 2.0 * M_PI * (k % patch_size) / patch_size / 4.0 + patch * M_PI / 2.0;
+        Vector3d normal(cos(angle), sin(angle), 0.0);
+
+        taxels.push_back(Taxel(k, patch % n_links, patch, 0.06 * normal +
+                               Vector3d(0.0, 0.0, -0.002 * (k % patch_size)), normal));
+    }
+
+    TactileSkin skin;
+    ASSERT_TRUE(skin.build(taxels));
+
+    // Dense frames (every taxel reported) with a few touched areas
+    srand(1);
+    size_t n_frames = 1000;
+    vector<uint32_t> ids(n_taxels);
+    vector<vector<float> > acts(n_frames, vector<float>(n_taxels, 0.0f));
+    for (uint32_t k = 0; k < n_taxels; ++k)    { ids[k] = k; }
+
+    for (size_t t = 0; t < n_frames; ++t)
+    {
+        for (size_t c = 0; c < 5; ++c)
+        {
+            size_t center = rand() % n_taxels;
+            for (size_t k = center; k < std::min(center + 20, n_taxels); ++k)
+            {
+                acts[t][k] = float(rand()) / RAND_MAX;
+            }
+        }
+    }
+
+    vector<TactileContact> contacts;
+    size_t n_contacts = 0;
+    double t_max = 0.0;
+
+    ros::WallTime start = ros::WallTime::now();
+    for (size_t t = 0; t < n_frames; ++t)
+    {
+        ros::WallTime s = ros::WallTime::now();
+        skin.aggregate(ids.data(), acts[t].data(), n_taxels, contacts);
+        t_max = std::max(t_max, (ros::WallTime::now() - s).toSec());
+
+        n_contacts += contacts.size();
+    }
+    double t_aggregate = (ros::WallTime::now() - start).toSec();
+
+    printf("[tactileSkin] %lu taxels in %lu patches: aggregation %8.3fus/frame (max %8.3fus), "
+           "%5.2f contacts/frame\n", n_taxels, skin.getNrOfPatches(), 1e6 * t_aggregate / n_frames,
+           1e6 * t_max, double(n_contacts) / n_frames);
+
+    EXPECT_LT(t_aggregate / n_frames, 1e-3);
+
+    // The contacts then go through the avoidance handler as any other collision point
+    MatrixXd v_lim(chain.getNrOfJoints(), 2);
+    v_lim.col(0).setConstant(-1.0);
+    v_lim.col(1).setConstant( 1.0);
+
+    AvoidanceHandlerTactile avhdl(chain, vector<double>(chain.getNrOfJoints(), 0.06));
+    ObstacleGrid empty;
+
+    start = ros::WallTime::now();
+    for (size_t t = 0; t < n_frames; ++t)
+    {
+        skin.aggregate(ids.data(), acts[t].data(), n_taxels, contacts);
+        avhdl.set_tactile_contacts(contacts);
+        avhdl.update(chain.getAng(), empty);
+        avhdl.getV_LIM(v_lim);
+    }
+    double t_total = (ros::WallTime::now() - start).toSec();
+
+    printf("[tactileSkin] aggregation, update and velocity limits %8.3fus/frame\n",
+           1e6 * t_total / n_frames);
+}
+
+TEST(BenchmarkTest, peripersonalSpace)
+{
+    // The kernel alone: 50 objects against 200 points on the surface of the arm
+    srand(1);
+    size_t n_objects = 50, n_points = 200, n_reps = 1000;
+
+    MatrixX3d points  = 0.5 * MatrixX3d::Random(n_points, 3);
+    MatrixX3d normals =       MatrixX3d::Random(n_points, 3);
+    normals.rowwise().normalize();
+    Matrix3Xd centers = 0.6 * Matrix3Xd::Random(3, n_objects);
+    ArrayXd   sizes   = ArrayXd::Constant(n_objects, 0.05);
+
+    double depth = 0.2, cos_half = cos(40.0 * M_PI / 180.0);
+
+    ArrayXXd act;
+    double sum = 0.0;
+    ros::WallTime start = ros::WallTime::now();
+    for (size_t r = 0; r < n_reps; ++r)
+    {
+        receptiveFieldActivations(points, normals, centers, sizes, depth, cos_half, act);
+        sum += act.sum();
+    }
+    double t_batched = (ros::WallTime::now() - start).toSec() / n_reps;
+
+    // Reference: one field and one object at a time
+    double sum_ref = 0.0;
+    start = ros::WallTime::now();
+    for (size_t r = 0; r < n_reps; ++r)
+    {
+        for (size_t m = 0; m < n_objects; ++m)
+        {
+            for (size_t p = 0; p < n_points; ++p)
+            {
+                Vector3d d = centers.col(m) - points.row(p).transpose();
+                double   n = d.norm();
+                double   h = n - sizes[m];
+                double   c = n > 1e-9 ? d.dot(normals.row(p).transpose()) / n : 1.0;
+
+                double x      = std::min(std::max(h / depth, 0.0), 1.0);
+                double radial = 1.0 - x * x * (3.0 - 2.0 * x);
+                sum_ref += radial * std::min(std::max((c - cos_half) / (1.0 - cos_half), 0.0), 1.0);
+            }
+        }
+    }
+    double t_scalar = (ros::WallTime::now() - start).toSec() / n_reps;
+
+    EXPECT_NEAR(sum, sum_ref, 1e-6 * n_reps * n_objects);
+
+    printf("[peripersonalSpace] %lu objects x %lu points: batched %8.3fus, scalar %8.3fus "
+           "(speedup %5.2fx)\n", n_objects, n_points, 1e6 * t_batched, 1e6 * t_scalar,
+           t_scalar / t_batched);
+
+    // The whole avoidance stage, with objects moving around the arm at every cycle
+    BaxterChain chain(getChain("right_gripper"));
+    vector<double> radii(chain.getNrOfJoints(), 0.06);
+
+    MatrixXd v_lim(chain.getNrOfJoints(), 2);
+    v_lim.col(0).setConstant(-1.0);
+    v_lim.col(1).setConstant( 1.0);
+
+    // 6 links, 5 rings of 7 taxels each, i.e. 210 taxels
+    AvoidanceHandlerPPS     pps(chain, radii);
+    AvoidanceHandlerTactile tactile(chain, radii);
+    pps.set_surface_sampling(5, 7);
+
+    Vector3d ee = chain.getH().block<3,1>(0,3);
+    size_t n_cycles = 200;
+    vector<ObstacleGrid> grids(n_cycles);
+    for (size_t t = 0; t < n_cycles; ++t)
+    {
+        vector<Obstacle> obstacles;
+        for (size_t m = 0; m < n_objects; ++m)
+        {
+            obstacles.push_back(Obstacle(0.05, ee + 0.4 * Vector3d::Random()));
+        }
+        grids[t] = ObstacleGrid(obstacles);
+    }
+
+    AvoidanceHandler *handlers[2] = { &pps, &tactile };
+    for (size_t h = 0; h < 2; ++h)
+    {
+        size_t n_ctrl_points = 0;
+        start = ros::WallTime::now();
+        for (size_t t = 0; t < n_cycles; ++t)
+        {
+            handlers[h]->update(chain.getAng(), grids[t]);
+            handlers[h]->getV_LIM(v_lim);
+            n_ctrl_points += handlers[h]->getCtrlPoints().size();
+        }
+        double t_cycle = (ros::WallTime::now() - start).toSec() / n_cycles;
+
+        printf("[peripersonalSpace] %-7s handler (%3lu taxels): %8.3fus/cycle, %5.2f control "
+               "points/cycle\n", handlers[h]->getType().c_str(), h == 0 ? pps.getNrOfSurfacePoints() : 0,
+               1e6 * t_cycle, double(n_ctrl_points) / n_cycles);
+    }
+}
+
+TEST(BenchmarkTest, collisionConstraints)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    size_t n_joints = chain.getNrOfJoints();
+    vector<double> radii(n_joints, 0.06);
+
+    MatrixXd vLim(n_joints, 2);
+    vLim.col(0).setConstant(-45.0);
+    vLim.col(1).setConstant( 45.0);
+
+    double dt = 0.01;
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = newControllerApp(1e-6, 0.95 * dt);
+    app->Options()->SetIntegerValue("print_level", 0);
+    app->Initialize();
+
+    // Cluttered scenes: reaching a pose of a nearby configuration, with
+    // obstacles scattered around the straight path of the end-effector
+    srand(2);
+    size_t n_scenes = 10, n_obstacles = 20, max_cycles = 500;
+    vector<VectorXd> q_start(n_scenes);
+    vector<Vector3d> p_target(n_scenes);
+    vector<ObstacleGrid> grids(n_scenes);
+
+    for (size_t s = 0; s < n_scenes; ++s)
+    {
+        VectorXd q(n_joints), q_t(n_joints);
+        for (size_t j = 0; j < n_joints; ++j)
+        {
+            double mid = (chain.getMax(j) + chain.getMin(j)) / 2.0;
+            double rng = (chain.getMax(j) - chain.getMin(j)) / 2.0;
+            q  [j] = mid + 0.4 * rng * (2.0 * rand() / RAND_MAX - 1.0);
+            q_t[j] = std::min(std::max(q[j] + 0.4 * (2.0 * rand() / RAND_MAX - 1.0),
+                                       chain.getMin(j)), chain.getMax(j));
+        }
+
+        chain.setAng(q);
+        Vector3d p_0 = chain.getH().block<3,1>(0,3);
+        chain.setAng(q_t);
+        p_target[s] = chain.getH().block<3,1>(0,3);
+        q_start [s] = q;
+
+        vector<Obstacle> obstacles;
+        for (size_t m = 0; m < n_obstacles; ++m)
+        {
+            Vector3d side = Vector3d::Random();
+            side = (0.12 + 0.1 * rand() / RAND_MAX) * side.normalized();
+
+            obstacles.push_back(Obstacle(0.03, p_0 + (p_target[s] - p_0) * rand() / RAND_MAX + side));
+        }
+        grids[s] = ObstacleGrid(obstacles);
+    }
+
+    vector<string> modes{"bounds", "constraints"};
+    for (size_t mode = 0; mode < modes.size(); ++mode)
+    {
+        size_t n_done = 0, n_solves = 0, n_rows = 0;
+        double t_done = 0.0, t_solve = 0.0, t_solve_max = 0.0;
+        double clearance = std::numeric_limits<double>::max();
+
+        for (size_t s = 0; s < n_scenes; ++s)
+        {
+            chain.setAng(q_start[s]);
+            AvoidanceHandlerTactile avhdl(chain, radii);
+            VectorXd v = VectorXd::Zero(n_joints);
+
+            Capsules caps;
+            Spheres  spheres;
+            SphereCapsuleDistances dists;
+            spheres.resize(grids[s].getNrOfObstacles());
+            for (size_t m = 0; m < grids[s].getNrOfObstacles(); ++m)
+            {
+                spheres.set(m, grids[s].getObstacle(m).x_wrf, grids[s].getObstacle(m).size);
+            }
+
+            size_t c = 0;
+            for (; c < max_cycles; ++c)
+            {
+                if ((chain.getH().block<3,1>(0,3) - p_target[s]).norm() < 5e-3)    { break; }
+
+                ros::WallTime start = ros::WallTime::now();
+                avhdl.update(chain.getAng(), grids[s]);
+
+                Ipopt::SmartPtr<ControllerNLP> nlp = new ControllerNLP(chain, dt);
+                nlp->set_formulation("slack", 1e4);
+
+                if (modes[mode] == "constraints")
+                {
+                    vector<VelocityConstraint> coll = avhdl.getVelocityConstraints(0.05);
+                    nlp->set_coll_constraints(coll, nlp->get_pid());
+                    nlp->set_v_lim(vLim);
+                    n_rows += coll.size();
+                }
+                else
+                {
+                    nlp->set_v_lim(avhdl.getV_LIM(DEG2RAD * vLim) * RAD2DEG);
+                }
+
+                nlp->set_ctrl_ori(false);
+                nlp->set_dt(dt);
+                nlp->set_x_r(p_target[s], Quaterniond::Identity());
+                nlp->set_v_0(v);
+                nlp->init();
+                app->OptimizeTNLP(GetRawPtr(nlp));
+
+                double t = (ros::WallTime::now() - start).toSec();
+                t_solve    += t;
+                t_solve_max = std::max(t_solve_max, t);
+                n_solves++;
+
+                v = nlp->get_est_vels();
+                chain.setAng(nlp->get_est_conf());
+
+                chainCapsules(chain, radii, caps);
+                sphereCapsuleDistances(caps, spheres, dists);
+                if (dists.dist.size() > 0)    { clearance = std::min(clearance, dists.dist.minCoeff()); }
+            }
+
+            if (c < max_cycles)    { n_done++;  t_done += c * dt; }
+        }
+
+        printf("[collisionConstraints] %11s: reached %2lu/%2lu targets in %6.3fs on average, "
+               "solve latency %7.3fms (max %7.3fms), %5.2f constraints/cycle, min clearance %6.1fmm\n",
+               modes[mode].c_str(), n_done, n_scenes, n_done ? t_done / n_done : 0.0,
+               1e3 * t_solve / std::max(n_solves, size_t(1)), 1e3 * t_solve_max,
+               double(n_rows) / std::max(n_solves, size_t(1)), 1e3 * clearance);
+    }
+}
+
+TEST(BenchmarkTest, temporalCoherence)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    VectorXd q_0(chain.getNrOfJoints());
+    for (size_t j = 0; j < chain.getNrOfJoints(); ++j)
+    {
+        q_0[j] = 0.5 * (chain.getMin(j) + chain.getMax(j));
+    }
+    chain.setAng(q_0);
+
+    Vector3d p_0 = chain.getH().block<3,1>(0,3);
+
+    // A slowly moving scene: tracked obstacles drifting around the arm, which are
+    // reported in a different order at every cycle, and a table below the arm
+    srand(3);
+    size_t n_obstacles = 300, n_cycles = 300;
+
+    vector<Obstacle> obstacles;
+    vector<Vector3d> drift;
+    for (size_t i = 0; i < n_obstacles; ++i)
+    {
+        obstacles.push_back(Obstacle(0.03, p_0 + 0.5 * Vector3d::Random(), int(i)));
+        drift    .push_back(1e-3 * Vector3d::Random().normalized());
+    }
+
+    vector<Obstacle> table;
+    for (double x = -0.6; x <= 0.6; x += 0.05)
+    {
+        for (double y = -0.4; y <= 0.4; y += 0.05)
+        {
+            table.push_back(Obstacle(0.025, p_0 + Vector3d(x, y, -0.3)));
+        }
+    }
+
+    SignedDistanceField sdf;
+    ASSERT_TRUE(sdf.build(table, 0.02));
+
+    vector<VectorXd>       traj(n_cycles);
+    vector<ObstacleGrid>  grids(n_cycles);
+    vector<ObstacleGrid> grids_anon(n_cycles);
+
+    vector<size_t> order(n_obstacles);
+    for (size_t i = 0; i < n_obstacles; ++i)    { order[i] = i; }
+
+    for (size_t t = 0; t < n_cycles; ++t)
+    {
+        traj[t] = q_0 + 0.1 * sin(2.0 * M_PI * t / n_cycles) * VectorXd::Ones(q_0.size());
+
+        std::random_shuffle(order.begin(), order.end());
+
+        vector<Obstacle> tracked, anonymous;
+        for (size_t i = 0; i < n_obstacles; ++i)
+        {
+            Obstacle &o = obstacles[order[i]];
+            o.x_wrf += drift[order[i]];
+
+            tracked  .push_back(o);
+            anonymous.push_back(Obstacle(o.size, o.x_wrf));
+        }
+
+        grids     [t] = ObstacleGrid(tracked);
+        grids_anon[t] = ObstacleGrid(anonymous);
+    }
+
+    MatrixXd v_lim(q_0.size(), 2);
+    v_lim.col(0).setConstant(-1.0);
+    v_lim.col(1).setConstant( 1.0);
+
+    // Reference: every collision point recomputed from scratch at every cycle
+    vector<MatrixXd> V_LIM(n_cycles);
+    {
+        AvoidanceHandlerTactile avhdl(chain, vector<double>());
+        avhdl.set_update_thres(0.0);
+        avhdl.set_static_field(&sdf);
+
+        for (size_t t = 0; t < n_cycles; ++t)
+        {
+            avhdl.update(traj[t], grids_anon[t]);
+            V_LIM[t] = avhdl.getV_LIM(v_lim);
+        }
+
+        AvoidanceStats stats = avhdl.getStats();
+        printf("[temporalCoherence] from scratch:              %8.3fms/cycle\n",
+               1e3 * stats.t_total / stats.n_updates);
+    }
+
+    string names[] = {"anonymous", "tracked", "tracked + hysteresis"};
+    double hyst [] = {0.0, 0.0, 0.02};
+    size_t n_reused[3];
+
+    for (size_t k = 0; k < 3; ++k)
+    {
+        chain.setAng(q_0);
+        AvoidanceHandlerTactile avhdl(chain, vector<double>());
+        avhdl.set_static_field(&sdf);
+        avhdl.set_hysteresis(hyst[k]);
+
+        double err = 0.0;
+        for (size_t t = 0; t < n_cycles; ++t)
+        {
+            avhdl.update(traj[t], k == 0 ? grids_anon[t] : grids[t]);
+            err = std::max(err, (avhdl.getV_LIM(v_lim) - V_LIM[t]).cwiseAbs().maxCoeff());
+        }
+
+        AvoidanceStats stats = avhdl.getStats();
+        n_reused[k] = stats.n_reused;
+
+        printf("[temporalCoherence] %-26s %8.3fms/cycle, max V_LIM error %g\n    %s\n",
+               (names[k] + ":").c_str(), 1e3 * stats.t_total / stats.n_updates, err,
+               stats.toString().c_str());
+    }
+
+    // Without IDs shuffled obstacles land on someone else's slot, with IDs they follow theirs
+    EXPECT_GT(n_reused[1], n_reused[0]);
+}
+
+TEST(BenchmarkTest, obstacleScene)
+{
+    // A mapped cell, with tens of thousands of spheres in the obstacle database
+    srand(4);
+    size_t n_obstacles = 20000;
+
+    XmlRpc::XmlRpcValue db;
+    db.setSize(n_obstacles);
+    for (size_t i = 0; i < n_obstacles; ++i)
+    {
+        Vector3d p = 2.0 * Vector3d::Random();
+        db[i].setSize(4);
+        db[i][0] = p[0];
+        db[i][1] = p[1];
+        db[i][2] = p[2];
+        db[i][3] = 0.01 + 0.04 * rand() / RAND_MAX;
+    }
+
+    ros::NodeHandle nh("baxter_react_controller");
+    nh.setParam("benchmark/obstacles", db);
+
+    // The obstacles as the controller reads them from the parameter server
+    ros::WallTime start = ros::WallTime::now();
+    XmlRpc::XmlRpcValue param;
+    ASSERT_TRUE(nh.getParam("benchmark/obstacles", param));
+    vector<Obstacle> from_param = readFromParamServer(param);
+    double t_param = (ros::WallTime::now() - start).toSec();
+
+    // Offline conversion, as in convert_obstacle_scene
+    start = ros::WallTime::now();
+    ObstacleScene converted;
+    ASSERT_TRUE(converted.fromParam(param));
+    ASSERT_TRUE(converted.save("/tmp/benchmark.scene"));
+    double t_convert = (ros::WallTime::now() - start).toSec();
+
+    // The obstacles as the controller reads them from the mapped scene
+    start = ros::WallTime::now();
+    ObstacleScene mapped;
+    ASSERT_TRUE(mapped.load("/tmp/benchmark.scene"));
+    vector<Obstacle> from_scene;
+    mapped.toObstacles(from_scene);
+    double t_scene = (ros::WallTime::now() - start).toSec();
+
+    ASSERT_EQ(from_param.size(), from_scene.size());
+
+    double err = 0.0;
+    for (size_t i = 0; i < from_param.size(); ++i)
+    {
+        err = std::max(err, (from_param[i].x_wrf - from_scene[i].x_wrf).norm());
+        err = std::max(err, fabs(from_param[i].size - from_scene[i].size));
+    }
+
+    // Single precision is plenty for obstacles within a few meters
+    EXPECT_LT(err, 1e-6);
+
+    printf("[obstacleScene] %lu spheres: parameter server %8.3fms, conversion %8.3fms, "
+           "mapped scene %8.3fms (%.2fMB), max error %g\n", n_obstacles, 1e3 * t_param,
+           1e3 * t_convert, 1e3 * t_scene, n_obstacles * sizeof(SceneSphere) / 1e6, err);
+
+    nh.deleteParam("benchmark/obstacles");
+}
+
+TEST(BenchmarkTest, sweptCheck)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    size_t n_joints = chain.getNrOfJoints();
+    vector<double> radii(n_joints, 0.06);
+
+    VectorXd q_0(n_joints);
+    for (size_t j = 0; j < n_joints; ++j)
+    {
+        q_0[j] = 0.5 * (chain.getMin(j) + chain.getMax(j));
+    }
+    chain.setAng(q_0);
+
+    Vector3d p_0 = chain.getH().block<3,1>(0,3);
+
+    // Small obstacles around the arm, and fast steps from nearby configurations
+    srand(5);
+    vector<Obstacle> obstacles;
+    for (size_t i = 0; i < 500; ++i)
+    {
+        obstacles.push_back(Obstacle(0.01, p_0 + 0.6 * Vector3d::Random()));
+    }
+    ObstacleGrid grid(obstacles);
+
+    size_t n_steps = 2000;
+    vector<VectorXd> q_from(n_steps), q_to(n_steps);
+    for (size_t k = 0; k < n_steps; ++k)
+    {
+        q_from[k] = q_0 + 0.3 * VectorXd::Random(n_joints);
+        q_to  [k] = q_from[k] + 0.1 * VectorXd::Random(n_joints);
+    }
+
+    Capsules from, to;
+    Spheres  spheres;
+    SphereCapsuleDistances dists;
+    size_t n_hits = 0, n_discrete = 0, n_iters = 0, n_near = 0;
+
+    ros::WallTime start = ros::WallTime::now();
+    for (size_t k = 0; k < n_steps; ++k)
+    {
+        // Same as CtrlThread::checkStep
+        chain.setAng(q_from[k]);
+        chainCapsules(chain, radii, from);
+        chain.setAng(q_to[k]);
+        chainCapsules(chain, radii, to);
+
+        vector<pair<Vector3d, Vector3d> > half(from.size());
+        double reach = 0.0;
+        for (size_t l = 0; l < from.size(); ++l)
+        {
+            Vector3d da(to.ax[l] - from.ax[l], to.ay[l] - from.ay[l], to.az[l] - from.az[l]);
+            Vector3d db(to.bx[l] - from.bx[l], to.by[l] - from.by[l], to.bz[l] - from.bz[l]);
+            half[l] = make_pair(Vector3d(from.ax[l], from.ay[l], from.az[l]) + 0.5 * da,
+                                Vector3d(from.bx[l], from.by[l], from.bz[l]) + 0.5 * db);
+            reach   = std::max(reach, from.r[l] + 0.5 * std::max(da.norm(), db.norm()));
+        }
+
+        vector<size_t> near = grid.query(half, reach + 0.005);
+        spheres.resize(near.size());
+        for (size_t i = 0; i < near.size(); ++i)
+        {
+            spheres.set(i, grid.getObstacle(near[i]).x_wrf, grid.getObstacle(near[i]).size);
+        }
+
+        SweptCollision res = sweptCapsuleCheck(from, to, spheres, 0.005);
+        n_hits  += res.collision;
+        n_iters += res.n_iters;
+        n_near  += near.size();
+    }
+    double t_swept = (ros::WallTime::now() - start).toSec() / n_steps;
+
+    // What a check of the commanded configuration alone would have caught,
+    // among the steps that start clear of the obstacles
+    spheres.resize(obstacles.size());
+    for (size_t i = 0; i < obstacles.size(); ++i)
+    {
+        spheres.set(i, obstacles[i].x_wrf, obstacles[i].size);
+    }
+
+    for (size_t k = 0; k < n_steps; ++k)
+    {
+        chain.setAng(q_from[k]);
+        chainCapsules(chain, radii, from);
+        sphereCapsuleDistances(from, spheres, dists);
+
+        if (dists.dist.minCoeff() < 0.005)    { continue; }
+
+        chain.setAng(q_to[k]);
+        chainCapsules(chain, radii, to);
+        sphereCapsuleDistances(to, spheres, dists);
+
+        if (dists.dist.minCoeff() < 0.005)
+        {
+            n_discrete++;
+
+            // The swept check has to catch any of these
+            EXPECT_TRUE(sweptCapsuleCheck(from, to, spheres, 0.005).collision);
+        }
+    }
+
+    printf("[sweptCheck] %lu steps: %8.3fus/step (FK included), %5.2f obstacles and %5.2f "
+           "advancement steps/step, %lu hits (%lu at the commanded configuration)\n", n_steps,
+           1e6 * t_swept, double(n_near) / n_steps, double(n_iters) / n_steps, n_hits, n_discrete);
+}
+
+TEST(BenchmarkTest, rigidTransforms)
+{
+    BaxterChain chain(getChain("right_gripper"));
+
+    srand(1);
+    size_t n_poses = 1000, n_reps = 100;
+
+    vector<VectorXd> q(n_poses);
+    vector<KDL::Frame> frames(n_poses);
+    vector<Matrix4d,   aligned_allocator<Matrix4d>   > mats(n_poses);
+    vector<Isometry3d, aligned_allocator<Isometry3d> > isos(n_poses);
+    vector<Vector3d,   aligned_allocator<Vector3d>   > pts(n_poses);
+
+    for (size_t i = 0; i < n_poses; ++i)
+    {
+        q[i] = VectorXd::Zero(chain.getNrOfJoints());
+        for (size_t j = 0; j < chain.getNrOfJoints(); ++j)
+        {
+            double mid = (chain.getMax(j) + chain.getMin(j)) / 2.0;
+            double rng = (chain.getMax(j) - chain.getMin(j)) / 2.0;
+            q[i][j] = mid + 0.6 * rng * (2.0 * rand() / RAND_MAX - 1.0);
+        }
+        chain.setAng(q[i]);
+
+        mats[i]   = chain.getH();
+        isos[i]   = chain.getIsometry();
+        frames[i] = toKDLFrame(isos[i]);
+        pts[i]    = mats[i].block<3,1>(0,3) + 0.2 * Vector3d::Random();
+    }
+
+    // Point conversions: general 4x4 inverse, and the rigid ones
+    Vector3d res, sum_gen(Vector3d::Zero()), sum_mat(Vector3d::Zero()), sum_iso(Vector3d::Zero());
+
+    ros::WallTime start = ros::WallTime::now();
+    for (size_t r = 0; r < n_reps; ++r)
+    {
+        for (size_t i = 0; i < n_poses; ++i)
+        {
+            sum_gen += (mats[i].inverse() * pts[i].homogeneous()).head<3>();
+        }
+    }
+    double t_gen = (ros::WallTime::now() - start).toSec() / (n_reps * n_poses);
+
+    start = ros::WallTime::now();
+    for (size_t r = 0; r < n_reps; ++r)
+    {
+        for (size_t i = 0; i < n_poses; ++i)
+        {
+            changeFoR(pts[i], mats[i], res);
+            sum_mat += res;
+        }
+    }
+    double t_mat = (ros::WallTime::now() - start).toSec() / (n_reps * n_poses);
+
+    start = ros::WallTime::now();
+    for (size_t r = 0; r < n_reps; ++r)
+    {
+        for (size_t i = 0; i < n_poses; ++i)
+        {
+            changeFoR(pts[i], isos[i], res);
+            sum_iso += res;
+        }
+    }
+    double t_iso = (ros::WallTime::now() - start).toSec() / (n_reps * n_poses);
+
+    EXPECT_TRUE(sum_mat.isApprox(sum_gen, 1e-9));
+    EXPECT_TRUE(sum_iso.isApprox(sum_gen, 1e-9));
+
+    printf("[rigidTransforms] changeFoR: general inverse %7.2fns, Matrix4d %7.2fns, "
+           "Isometry3d %7.2fns\n", 1e9 * t_gen, 1e9 * t_mat, 1e9 * t_iso);
+
+    // Conversions to and from KDL
+    double sum = 0.0;
+    start = ros::WallTime::now();
+    for (size_t r = 0; r < n_reps; ++r)
+    {
+        for (size_t i = 0; i < n_poses; ++i)    { sum += toMatrix4d(frames[i])(0,3); }
+    }
+    double t_to_mat = (ros::WallTime::now() - start).toSec() / (n_reps * n_poses);
+
+    start = ros::WallTime::now();
+    for (size_t r = 0; r < n_reps; ++r)
+    {
+        for (size_t i = 0; i < n_poses; ++i)    { sum -= toIsometry3d(frames[i]).translation()[0]; }
+    }
+    double t_to_iso = (ros::WallTime::now() - start).toSec() / (n_reps * n_poses);
+
+    start = ros::WallTime::now();
+    for (size_t r = 0; r < n_reps; ++r)
+    {
+        for (size_t i = 0; i < n_poses; ++i)    { sum += toKDLFrame(mats[i]).p[0]; }
+    }
+    double t_from_mat = (ros::WallTime::now() - start).toSec() / (n_reps * n_poses);
+
+    start = ros::WallTime::now();
+    for (size_t r = 0; r < n_reps; ++r)
+    {
+        for (size_t i = 0; i < n_poses; ++i)    { sum -= toKDLFrame(isos[i]).p[0]; }
+    }
+    double t_from_iso = (ros::WallTime::now() - start).toSec() / (n_reps * n_poses);
+
+    EXPECT_NEAR(0.0, sum, 1e-6);
+
+    printf("[rigidTransforms] toMatrix4d %7.2fns, toIsometry3d %7.2fns, "
+           "toKDLFrame(Matrix4d) %7.2fns, toKDLFrame(Isometry3d) %7.2fns\n",
+           1e9 * t_to_mat, 1e9 * t_to_iso, 1e9 * t_from_mat, 1e9 * t_from_iso);
+
+    // Forward kinematics and the projection of obstacles onto the last link
+    start = ros::WallTime::now();
+    for (size_t i = 0; i < n_poses; ++i)
+    {
+        chain.setAng(q[i]);
+        sum += chain.getH()(0,3);
+    }
+    double t_get_h = (ros::WallTime::now() - start).toSec() / n_poses;
+
+    start = ros::WallTime::now();
+    for (size_t i = 0; i < n_poses; ++i)
+    {
+        chain.setAng(q[i]);
+        sum -= chain.getIsometry().translation()[0];
+    }
+    double t_get_iso = (ros::WallTime::now() - start).toSec() / n_poses;
+
+    CollisionPoint coll_pt;
+    start = ros::WallTime::now();
+    for (size_t i = 0; i < n_poses; ++i)
+    {
+        chain.setAng(q[i]);
+        chain.obstacleToCollisionPoint(Obstacle(0.05, pts[i]), coll_pt);
+    }
+    double t_obstacle = (ros::WallTime::now() - start).toSec() / n_poses;
+
+    EXPECT_NEAR(0.0, sum, 1e-6);
+
+    printf("[rigidTransforms] getH %7.3fus, getIsometry %7.3fus, "
+           "obstacleToCollisionPoint %7.3fus\n", 1e6 * t_get_h, 1e6 * t_get_iso, 1e6 * t_obstacle);
+}
+
+TEST(BenchmarkTest, orientationKernel)
+{
+    // One evaluation of the orientation error and of its derivative in the NLP,
+    // as it was (angle-axis error and dynamic matrices) and with the fixed-size kernel
+    srand(1);
+    size_t n_evals = 100000, n_joints = 7;
+    double pid = 10.0, dt = 0.01;
+
+    MatrixXd J_0_ang = MatrixXd::Random(3, n_joints);
+    Quaterniond o_0(Vector4d::Random().normalized());
+    Quaterniond o_r = Quaterniond(AngleAxisd(0.3, Vector3d::Random().normalized())) * o_0;
+    Matrix3d    R_0 = o_0.toRotationMatrix();
+    Matrix3d    R_r = o_r.toRotationMatrix();
+
+    MatrixXd skew_nr = skew(R_r.col(0));
+    MatrixXd skew_sr = skew(R_r.col(1));
+    MatrixXd skew_ar = skew(R_r.col(2));
+
+    vector<VectorXd> v_e(1000);
+    for (size_t i = 0; i < v_e.size(); ++i)    { v_e[i] = VectorXd::Random(n_joints); }
+
+    double   sum_old = 0.0, sum_new = 0.0;
+    MatrixXd Derr_old;
+    Matrix<double, 3, Dynamic> Derr_new;
+
+    ros::WallTime start = ros::WallTime::now();
+    for (size_t k = 0; k < n_evals; ++k)
+    {
+        Vector3d w_e = J_0_ang * v_e[k % v_e.size()];
+        double theta = w_e.norm();
+        if (theta > 0.0) { w_e /= theta; }
+
+        Matrix3d R_e = AngleAxisd(theta * pid * dt, w_e).toRotationMatrix() * R_0;
+        Vector3d err = angularError(R_r, R_e);
+
+        MatrixXd L=-0.5*(skew_nr*skew(R_e.col(0))+
+                         skew_sr*skew(R_e.col(1))+
+                         skew_ar*skew(R_e.col(2)));
+
+        Derr_old = -pid*dt*(L*J_0_ang);
+        sum_old += err.squaredNorm() + Derr_old(0,0);
+    }
+    double t_old = (ros::WallTime::now() - start).toSec() / n_evals;
+
+    start = ros::WallTime::now();
+    for (size_t k = 0; k < n_evals; ++k)
+    {
+        Matrix3d J;
+        Vector3d err = incrementOrientationError(o_r, o_0, pid * dt * (J_0_ang * v_e[k % v_e.size()]), J);
+
+        Derr_new.noalias() = pid*dt*(J*J_0_ang);
+        sum_new += err.squaredNorm() + Derr_new(0,0);
+    }
+    double t_new = (ros::WallTime::now() - start).toSec() / n_evals;
+
+    // The errors are within angle^3/24 of each other, and the derivatives differ by
+    // as much as the angular increment (the old one left out its derivative)
+    EXPECT_NEAR(sum_old / n_evals, sum_new / n_evals, 0.05);
+
+    printf("[orientationKernel] angle-axis error + dynamic L %7.1fns, "
+           "quaternion kernel %7.1fns, speedup %5.2fx\n",
+           1e9 * t_old, 1e9 * t_new, t_old / t_new);
+}
+
+TEST(BenchmarkTest, nlpKernels)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    size_t n_joints = chain.getNrOfJoints();
+    double dt = 0.01;
+
+    MatrixXd vLim(n_joints, 2);
+    vLim.col(0).setConstant(-45.0);
+    vLim.col(1).setConstant( 45.0);
+
+    vector<BatchIKProblem> problems = randomProblems(chain, 20);
+    vector<string> formulations{"hard", "soft", "slack"};
+
+    // IPOPT's derivative checker, on the gradients, the Jacobians and the Hessians of the kernels
+    for (size_t f = 0; f < formulations.size(); ++f)
+    {
+        string log = "/tmp/nlp_kernels_" + formulations[f] + ".log";
+
+        {
+            Ipopt::SmartPtr<Ipopt::IpoptApplication> app = newControllerApp(1e-6, 1.0);
+            app->Options()->SetIntegerValue("print_level", 0);
+            app->Options()->SetStringValue ("output_file", log);
+            app->Options()->SetStringValue ("hessian_approximation", "exact");
+            app->Options()->SetStringValue ("derivative_test", "second-order");
+            app->Options()->SetNumericValue("derivative_test_tol", 1e-4);
+            app->Initialize();
+
+            Ipopt::SmartPtr<ControllerNLP> nlp = new ControllerNLP(chain, dt, true);
+            nlp->set_formulation(formulations[f], formulations[f] == "slack" ? 1e4 : 1e3);
+            nlp->set_exact_hessian(true);
+
+            for (size_t i = 0; i < problems.size(); ++i)
+            {
+                // Rotate the target too, for the orientation term to count
+                Quaterniond o_r = problems[i].o_r * Quaterniond(AngleAxisd(0.05, Vector3d::UnitZ()));
+
+                nlp->set_q_0(problems[i].q_0);
+                nlp->set_v_lim(vLim);
+                nlp->set_dt(dt);
+                nlp->set_x_r(problems[i].p_r, o_r);
+                nlp->set_v_0(VectorXd::Random(n_joints));
+                nlp->init();
+                app->OptimizeTNLP(GetRawPtr(nlp));
+            }
+        }
+
+        ifstream in(log.c_str());
+        string line;
+        size_t n_checks = 0, n_errors = 0;
+
+        while (getline(in, line))
+        {
+            n_checks += line.find("No errors detected by derivative checker") != string::npos;
+
+            if (line.find("Derivative checker detected") != string::npos)
+            {
+                n_checks++;
+                n_errors++;
+            }
+        }
+
+        EXPECT_EQ(problems.size(), n_checks);
+        EXPECT_EQ(0u, n_errors) << "see " << log;
+
+        printf("[nlpKernels] derivative checker (%5s): %2lu/%2lu problems with errors\n",
+               formulations[f].c_str(), n_errors, n_checks);
+    }
+
+    // The generated kernels against the code in the NLP they replaced, and against
+    // hand-written exact derivatives, at the points IPOPT would evaluate them at
+    chain.setAng(problems[0].q_0);
+    MatrixXd J_0 = chain.GeoJacobian();
+    double   pid = 10.0;
+
+    NLPTermData d;
+    d.n_joints    = n_joints;
+    d.formulation = POS_SOFT;
+    d.ctrl_ori    = true;
+    d.p_0         = chain.getIsometry().translation();
+    d.p_r         = problems[0].p_r;
+    d.ori.o_0     = Quaterniond(chain.getIsometry().linear());
+    d.ori.o_r     = problems[0].o_r * Quaterniond(AngleAxisd(0.05, Vector3d::UnitZ()));
+    d.J_xyz       = pid * dt * J_0.topRows(3);
+    d.J_ang       = pid * dt * J_0.bottomRows(3);
+
+    NLPKernels kernels;
+    kernels.set_data(d);
+
+    size_t n_evals = 100000;
+    vector<VectorXd> x(1000);
+    for (size_t i = 0; i < x.size(); ++i)    { x[i] = VectorXd::Random(n_joints); }
+
+    MatrixXd J_0_xyz = J_0.topRows(3), J_0_ang = J_0.bottomRows(3);
+    VectorXd grad(n_joints), jac(n_joints), grad_ref(n_joints), jac_ref(n_joints);
+    double   sum = 0.0, sum_ref = 0.0;
+
+    ros::WallTime start = ros::WallTime::now();
+    for (size_t k = 0; k < n_evals; ++k)
+    {
+        const VectorXd &v_e = x[k % x.size()];
+
+        Vector3d err_xyz = d.p_r - d.p_0 - pid * dt * (J_0_xyz * v_e);
+
+        Vector3d  w_e = pid * dt * (J_0_ang*v_e);
+        double theta  = w_e.norm();
+        double c      = theta > 1e-8 ? sin(0.5*theta)/theta : 0.5;
+        Quaterniond o_e = Quaterniond(cos(0.5*theta), c*w_e[0], c*w_e[1], c*w_e[2]) * d.ori.o_0;
+
+        Matrix3d D;
+        Vector3d err_ang = orientationError(d.ori.o_r, o_e, D);
+        Matrix<double, 3, Dynamic> Derr_ang = pid*dt*(D*J_0_ang);   // without the increment
+
+        for (size_t i = 0; i < n_joints; ++i)
+        {
+            grad_ref[i] = 2.0*err_ang.dot(Derr_ang.col(i)) - 2.0*d.w_xyz*pid*dt*(err_xyz.dot(J_0_xyz.col(i)));
+            jac_ref [i] = -2.0*pid*dt*(err_xyz.dot(J_0_xyz.col(i)));
+        }
+
+        sum_ref += err_ang.squaredNorm() + d.w_xyz * err_xyz.squaredNorm() + grad_ref[0] + jac_ref[0];
+    }
+    double t_ref = (ros::WallTime::now() - start).toSec() / n_evals;
+
+    start = ros::WallTime::now();
+    for (size_t k = 0; k < n_evals; ++k)
+    {
+        const VectorXd &v_e = x[k % x.size()];
+
+        sum += kernels.objective(v_e.data(), n_joints, grad.data());
+        kernels.posConstraint(v_e.data(), n_joints, jac.data());
+        sum += grad[0] + jac[0];
+    }
+    double t_kernels = (ros::WallTime::now() - start).toSec() / n_evals;
+
+    // The exact derivatives, hand-written with the derivative of the increment
+    MatrixXd J_xyz = d.J_xyz, J_ang = d.J_ang;
+    double   sum_hand = 0.0;
+
+    start = ros::WallTime::now();
+    for (size_t k = 0; k < n_evals; ++k)
+    {
+        const VectorXd &v_e = x[k % x.size()];
+
+        Vector3d err_xyz = d.p_r - d.p_0 - J_xyz * v_e;
+
+        Matrix3d Derr;
+        Vector3d err_ang = incrementOrientationError(d.ori.o_r, d.ori.o_0, J_ang * v_e, Derr);
+
+        grad_ref = 2.0 * (J_ang.transpose() * (Derr.transpose() * err_ang))
+                 - 2.0 * d.w_xyz * (J_xyz.transpose() * err_xyz);
+        jac_ref  = -2.0 * (J_xyz.transpose() * err_xyz);
+
+        sum_hand += err_ang.squaredNorm() + d.w_xyz * err_xyz.squaredNorm() + grad_ref[0] + jac_ref[0];
+    }
+    double t_hand = (ros::WallTime::now() - start).toSec() / n_evals;
+
+    NLPMatrix H;
+    start = ros::WallTime::now();
+    for (size_t k = 0; k < n_evals / 10; ++k)
+    {
+        kernels.hessian(x[k % x.size()].data(), n_joints, 1.0, 1.0, H);
+        sum += H(0,0);
+    }
+    double t_hess = (ros::WallTime::now() - start).toSec() / (n_evals / 10);
+
+    EXPECT_TRUE(std::isfinite(sum) && std::isfinite(sum_ref) && std::isfinite(sum_hand));
+
+    // The generated derivatives agree with the hand-written ones
+    for (size_t i = 0; i < x.size(); ++i)
+    {
+        Vector3d err_xyz = d.p_r - d.p_0 - J_xyz * x[i];
+
+        Matrix3d Derr;
+        Vector3d err_ang = incrementOrientationError(d.ori.o_r, d.ori.o_0, J_ang * x[i], Derr);
+
+        grad_ref = 2.0 * (J_ang.transpose() * (Derr.transpose() * err_ang))
+                 - 2.0 * d.w_xyz * (J_xyz.transpose() * err_xyz);
+        jac_ref  = -2.0 * (J_xyz.transpose() * err_xyz);
+
+        kernels.posConstraint(x[i].data(), n_joints, jac.data());
+        EXPECT_LT((jac - jac_ref).norm(), 1e-9 * std::max(jac_ref.norm(), 1.0));
+
+        kernels.objective(x[i].data(), n_joints, grad.data());
+        EXPECT_LT((grad - grad_ref).norm(), 1e-9 * std::max(grad_ref.norm(), 1.0));
+    }
+
+    // The generated kernels are the ones the NLP runs, so they must not be slower
+    // than the code they replaced, give or take the derivative of the increment
+    EXPECT_LT(t_kernels, 1.25 * t_ref);
+
+    printf("[nlpKernels] value+gradient+jacobian: NLP before %7.1fns, hand-written %7.1fns, "
+           "generated kernels %7.1fns; hessian (AD) %7.1fns\n",
+           1e9 * t_ref, 1e9 * t_hand, 1e9 * t_kernels, 1e9 * t_hess);
+}
+
+TEST(BenchmarkTest, nonlinearFK)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    size_t n_joints = chain.getNrOfJoints();
+
+    // The kinematics alone: BaxterChain against the cache, at new configurations
+    // and at configurations that only differ in the wrist
+    size_t n_evals = 20000;
+    vector<VectorXd> q(1000);
+    for (size_t i = 0; i < q.size(); ++i)
+    {
+        q[i] = VectorXd::Zero(n_joints);
+        for (size_t j = 0; j < n_joints; ++j)
+        {
+            q[i][j] = chain.getMin(j) + (chain.getMax(j) - chain.getMin(j)) * rand() / RAND_MAX;
+        }
+    }
+
+    double sum = 0.0;
+    ros::WallTime start = ros::WallTime::now();
+    for (size_t k = 0; k < n_evals; ++k)
+    {
+        chain.setAng(q[k % q.size()]);
+        sum += chain.getIsometry().translation()[0] + chain.GeoJacobian()(0,0);
+    }
+    double t_chain = (ros::WallTime::now() - start).toSec() / n_evals;
+
+    KinematicsCache kin(chain);
+    start = ros::WallTime::now();
+    for (size_t k = 0; k < n_evals; ++k)
+    {
+        kin.setAng(q[k % q.size()]);
+        sum += kin.getIsometry().translation()[0] + kin.GeoJacobian()(0,0);
+    }
+    double t_cache = (ros::WallTime::now() - start).toSec() / n_evals;
+
+    VectorXd q_w = q[0];
+    start = ros::WallTime::now();
+    for (size_t k = 0; k < n_evals; ++k)
+    {
+        q_w[n_joints-1] = q[k % q.size()][n_joints-1];
+        kin.setAng(q_w);
+        sum += kin.getIsometry().translation()[0] + kin.GeoJacobian()(0,0);
+    }
+    double t_wrist = (ros::WallTime::now() - start).toSec() / n_evals;
+
+    EXPECT_TRUE(std::isfinite(sum));
+
+    printf("[nonlinearFK] fk+jacobian: BaxterChain %7.1fns, cache %7.1fns, cache (wrist only) %7.1fns\n",
+           1e9 * t_chain, 1e9 * t_cache, 1e9 * t_wrist);
+
+    // Closed loop: reaching poses of configurations far from the start one,
+    // with the pose of the end-effector predicted to first order or by the
+    // forward kinematics
+    MatrixXd vLim(n_joints, 2);
+    vLim.col(0).setConstant(-45.0);
+    vLim.col(1).setConstant( 45.0);
+
+    double dt = 0.01;
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = newControllerApp(1e-6, 0.95 * dt);
+    app->Options()->SetIntegerValue("print_level", 0);
+    app->Initialize();
+
+    srand(4);
+    size_t n_targets = 20, max_cycles = 500;
+    vector<VectorXd>       q_start(n_targets);
+    vector<Isometry3d, aligned_allocator<Isometry3d> > target(n_targets);
+
+    for (size_t s = 0; s < n_targets; ++s)
+    {
+        VectorXd q_s(n_joints), q_t(n_joints);
+        for (size_t j = 0; j < n_joints; ++j)
+        {
+            double mid = (chain.getMax(j) + chain.getMin(j)) / 2.0;
+            double rng = (chain.getMax(j) - chain.getMin(j)) / 2.0;
+            q_s[j] = mid + 0.5 * rng * (2.0 * rand() / RAND_MAX - 1.0);
+            q_t[j] = std::min(std::max(q_s[j] + 0.6 * (2.0 * rand() / RAND_MAX - 1.0),
+                                       chain.getMin(j)), chain.getMax(j));
+        }
+
+        chain.setAng(q_t);
+        target [s] = chain.getIsometry();
+        q_start[s] = q_s;
+    }
+
+    vector<string> modes{"linearized", "nonlinear"};
+    for (size_t mode = 0; mode < modes.size(); ++mode)
+    {
+        size_t n_done = 0, n_cycles = 0, n_solves = 0;
+        double t_solve = 0.0, t_solve_max = 0.0;
+
+        for (size_t s = 0; s < n_targets; ++s)
+        {
+            chain.setAng(q_start[s]);
+            VectorXd v = VectorXd::Zero(n_joints);
+            Quaterniond o_t(target[s].linear());
+
+            size_t c = 0;
+            for (; c < max_cycles; ++c)
+            {
+                Isometry3d H = chain.getIsometry();
+                if ((H.translation() - target[s].translation()).norm() < 5e-3 &&
+                    orientationError(o_t, Quaterniond(H.linear())).norm() < 1e-2)    { break; }
+
+                ros::WallTime start = ros::WallTime::now();
+                Ipopt::SmartPtr<ControllerNLP> nlp = new ControllerNLP(chain, dt, true);
+                nlp->set_nonlinear_fk(modes[mode] == "nonlinear");
+                nlp->set_v_lim(vLim);
+                nlp->set_dt(dt);
+                nlp->set_x_r(target[s].translation(), o_t);
+                nlp->set_v_0(v);
+                nlp->init();
+                app->OptimizeTNLP(GetRawPtr(nlp));
+
+                double t = (ros::WallTime::now() - start).toSec();
+                t_solve    += t;
+                t_solve_max = std::max(t_solve_max, t);
+                n_solves++;
+
+                v = nlp->get_est_vels();
+                chain.setAng(nlp->get_est_conf());
+            }
+
+            if (c < max_cycles)    { n_done++;  n_cycles += c; }
+        }
+
+        printf("[nonlinearFK] %10s: reached %2lu/%2lu targets in %6.1f cycles on average, "
+               "solve latency %7.3fms (max %7.3fms)\n",
+               modes[mode].c_str(), n_done, n_targets, n_done ? double(n_cycles) / n_done : 0.0,
+               1e3 * t_solve / std::max(n_solves, size_t(1)), 1e3 * t_solve_max);
+    }
+}
+
+TEST(BenchmarkTest, ikCache)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    size_t n_joints = chain.getNrOfJoints();
+
+    MatrixXd vLim(n_joints, 2);
+    vLim.col(0).setConstant(-45.0);
+    vLim.col(1).setConstant( 45.0);
+
+    double dt = 0.01;
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = newControllerApp(1e-6, 0.95 * dt);
+    app->Options()->SetIntegerValue("print_level", 0);
+    app->Initialize();
+
+    // A loop of waypoints, each one the pose of a configuration around the home one,
+    // repeated from the home configuration at every lap (e.g. a pick and place task)
+    srand(5);
+    size_t n_waypoints = 5, n_laps = 5, cycles_per_waypoint = 30;
+    VectorXd q_home(n_joints);
+    vector<Isometry3d, aligned_allocator<Isometry3d> > waypoints(n_waypoints);
+
+    for (size_t j = 0; j < n_joints; ++j)
+    {
+        q_home[j] = (chain.getMax(j) + chain.getMin(j)) / 2.0;
+    }
+
+    for (size_t w = 0; w < n_waypoints; ++w)
+    {
+        VectorXd q_w(n_joints);
+        for (size_t j = 0; j < n_joints; ++j)
+        {
+            q_w[j] = std::min(std::max(q_home[j] + 0.4 * (2.0 * rand() / RAND_MAX - 1.0),
+                                       chain.getMin(j)), chain.getMax(j));
+        }
+
+        chain.setAng(q_w);
+        waypoints[w] = chain.getIsometry();
+    }
+
+    vector<string> modes{"off", "warm start", "direct"};
+    for (size_t mode = 0; mode < modes.size(); ++mode)
+    {
+        IKCache cache(10000);
+        cache.set_direct_tol(modes[mode] == "direct" ? 0.25 : 0.0);
+
+        size_t n_cycles = 0, n_iters = 0, n_solves = 0;
+        double t_cycle = 0.0, t_cycle_max = 0.0, err = 0.0;
+
+        for (size_t l = 0; l < n_laps; ++l)
+        {
+            chain.setAng(q_home);
+            VectorXd v = VectorXd::Zero(n_joints);
+
+            for (size_t w = 0; w < n_waypoints; ++w)
+            {
+                Vector3d    p_w(waypoints[w].translation());
+                Quaterniond o_w(waypoints[w].linear());
+
+                for (size_t c = 0; c < cycles_per_waypoint; ++c)
+                {
+                    ros::WallTime start = ros::WallTime::now();
+                    Ipopt::SmartPtr<ControllerNLP> nlp = new ControllerNLP(chain, dt, true);
+                    nlp->set_v_lim(vLim);
+                    nlp->set_dt(dt);
+                    nlp->set_x_r(p_w, o_w);
+                    nlp->set_v_0(v);
+                    nlp->init();
+
+                    IKCacheQuery query(chain.getAng(), v, p_w, o_w, nlp->get_bounds());
+                    VectorXd v_c;
+                    bool  direct = false;
+
+                    if (modes[mode] != "off" && cache.lookup(query, v_c, direct))
+                    {
+                        if (direct) { nlp->set_est_vels(v_c); }
+                        else        { nlp->set_v_0(v_c);      }
+                    }
+
+                    if (not direct)
+                    {
+                        int exit_code = app->OptimizeTNLP(GetRawPtr(nlp));
+                        n_iters += app->Statistics()->IterationCount();
+                        n_solves++;
+
+                        if (modes[mode] != "off" && (exit_code == Ipopt::Solve_Succeeded ||
+                                                     exit_code == Ipopt::Solved_To_Acceptable_Level))
+                        {
+                            cache.insert(query, nlp->get_est_vels());
+                        }
+                    }
+
+                    double t = (ros::WallTime::now() - start).toSec();
+                    t_cycle    += t;
+                    t_cycle_max = std::max(t_cycle_max, t);
+                    n_cycles++;
+
+                    v = nlp->get_est_vels();
+                    chain.setAng(nlp->get_est_conf());
+                }
+
+                err += (chain.getIsometry().translation() - p_w).norm();
+            }
+        }
+
+        const IKCacheStats &stats = cache.getStats();
+
+        printf("[ikCache] %10s: hit rate %5.1f%% (direct %5.1f%%), iters/solve %5.2f, "
+               "cycle latency %7.3fms (max %7.3fms), error at the waypoints %6.3fmm\n",
+               modes[mode].c_str(), stats.n_lookups ? 1e2 * stats.n_hits   / stats.n_lookups : 0.0,
+                                    stats.n_lookups ? 1e2 * stats.n_direct / stats.n_lookups : 0.0,
+               double(n_iters) / std::max(n_solves, size_t(1)), 1e3 * t_cycle / n_cycles,
+               1e3 * t_cycle_max, 1e3 * err / (n_laps * n_waypoints));
+    }
+
+    // The cache alone: lookups of stored problems
+    IKCache cache(10000);
+    vector<IKCacheQuery> queries(1000);
+    MatrixX2d bounds(n_joints, 2);
+    bounds << vLim.col(0) * DEG2RAD, vLim.col(1) * DEG2RAD;
+
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        queries[i] = IKCacheQuery(VectorXd::Random(n_joints), VectorXd::Random(n_joints),
+                                  Vector3d::Random(), Quaterniond::UnitRandom(), bounds);
+        cache.insert(queries[i], VectorXd::Random(n_joints));
+    }
+
+    size_t n_lookups = 100000, n_hits = 0;
+    VectorXd v_c;
+    bool direct;
+
+    ros::WallTime start = ros::WallTime::now();
+    for (size_t k = 0; k < n_lookups; ++k)
+    {
+        n_hits += cache.lookup(queries[k % queries.size()], v_c, direct);
+    }
+    double t_lookup = (ros::WallTime::now() - start).toSec() / n_lookups;
+
+    EXPECT_EQ(n_lookups, n_hits);
+
+    printf("[ikCache] lookup %7.1fns (%lu solutions)\n", 1e9 * t_lookup, cache.size());
+}
+
+TEST(BenchmarkTest, warmStartModel)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    size_t n_joints = chain.getNrOfJoints();
+
+    MatrixXd vLim(n_joints, 2);
+    vLim.col(0).setConstant(-45.0);
+    vLim.col(1).setConstant( 45.0);
+
+    double dt = 0.01;
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = newControllerApp(1e-6, 1.0);
+    app->Options()->SetIntegerValue("print_level", 0);
+    app->Initialize();
+
+    // Closed-loop trajectories towards targets near random configurations,
+    // logged as the controller does. The last ones are held out
+    srand(6);
+    size_t n_trajs = 60, n_held_out = 12, n_cycles = 60;
+    vector<WarmStartSample> train, test;
+
+    for (size_t t = 0; t < n_trajs; ++t)
+    {
+        VectorXd q_s(n_joints), q_t(n_joints);
+        for (size_t j = 0; j < n_joints; ++j)
+        {
+            double mid = (chain.getMax(j) + chain.getMin(j)) / 2.0;
+            double rng = (chain.getMax(j) - chain.getMin(j)) / 2.0;
+            q_s[j] = mid + 0.5 * rng * (2.0 * rand() / RAND_MAX - 1.0);
+            q_t[j] = std::min(std::max(q_s[j] + 0.4 * (2.0 * rand() / RAND_MAX - 1.0),
+                                       chain.getMin(j)), chain.getMax(j));
+        }
+
+        chain.setAng(q_t);
+        Vector3d p_t = chain.getIsometry().translation();
+
+        chain.setAng(q_s);
+        VectorXd v = VectorXd::Zero(n_joints);
+
+        for (size_t c = 0; c < n_cycles; ++c)
+        {
+            Ipopt::SmartPtr<ControllerNLP> nlp = new ControllerNLP(chain, dt);
+            nlp->set_v_lim(vLim);
+            nlp->set_dt(dt);
+            nlp->set_x_r(p_t, Quaterniond::Identity());
+            nlp->set_v_0(v);
+            nlp->init();
+
+            int exit_code = app->OptimizeTNLP(GetRawPtr(nlp));
+
+            if (exit_code == Ipopt::Solve_Succeeded || exit_code == Ipopt::Solved_To_Acceptable_Level)
+            {
+                WarmStartSample s;
+                s.q_0     = chain.getAng();
+                s.v_0     = v;
+                s.p_0     = nlp->get_p_0();
+                s.p_r     = p_t;
+                s.v_lim   = vLim;
+                s.dt      = dt;
+                s.v_e     = nlp->get_est_vels();
+                s.n_iters = app->Statistics()->IterationCount();
+
+                (t < n_trajs - n_held_out ? train : test).push_back(s);
+            }
+
+            v = nlp->get_est_vels();
+            chain.setAng(nlp->get_est_conf());
+        }
+    }
+
+    ASSERT_FALSE(test.empty());
+
+    ros::WallTime start = ros::WallTime::now();
+    WarmStartModel model;
+    ASSERT_TRUE(model.train(train));
+    double t_train = (ros::WallTime::now() - start).toSec();
+
+    double err_0 = 0.0;
+    for (size_t s = 0; s < test.size(); ++s)
+    {
+        err_0 += (test[s].v_e - test[s].v_0).squaredNorm();
+    }
+    err_0 = sqrt(err_0 / (test.size() * n_joints));
+
+    // Prediction alone
+    size_t n_evals = 100000;
+    VectorXd v_p;
+    double sum = 0.0;
+    start = ros::WallTime::now();
+    for (size_t k = 0; k < n_evals; ++k)
+    {
+        const WarmStartSample &s = test[k % test.size()];
+        model.predict(s.q_0, s.p_0, s.p_r, s.v_0, v_p);
+        sum += v_p[0];
+    }
+    double t_predict = (ros::WallTime::now() - start).toSec() / n_evals;
+    EXPECT_TRUE(std::isfinite(sum));
+
+    printf("[warmStartModel] %lu training samples, %lu held out, trained in %.2fs, "
+           "prediction %.0fns\n", train.size(), test.size(), t_train, 1e9 * t_predict);
+    printf("[warmStartModel] held-out RMS error of the starting point [rad/s]: v_0 %.4f, model %.4f\n",
+           err_0, model.evaluate(test));
+
+    // The held-out problems, solved again from v_0 and from the model
+    vector<string> modes{"v_0", "model"};
+    size_t iters[2] = {0, 0};
+
+    for (size_t m = 0; m < modes.size(); ++m)
+    {
+        double t_solve = 0.0;
+
+        for (size_t s = 0; s < test.size(); ++s)
+        {
+            chain.setAng(test[s].q_0);
+
+            Ipopt::SmartPtr<ControllerNLP> nlp = new ControllerNLP(chain, dt);
+            nlp->set_v_lim(vLim);
+            nlp->set_dt(dt);
+            nlp->set_x_r(test[s].p_r, Quaterniond::Identity());
+            nlp->set_v_0(test[s].v_0);
+            nlp->init();
+
+            if (modes[m] == "model")    { nlp->set_warm_start(&model); }
+
+            start = ros::WallTime::now();
+            app->OptimizeTNLP(GetRawPtr(nlp));
+            t_solve  += (ros::WallTime::now() - start).toSec();
+            iters[m] += app->Statistics()->IterationCount();
+        }
+
+        printf("[warmStartModel] from %5s: %5.2f iterations/solve, solve latency %7.3fms\n",
+               modes[m].c_str(), double(iters[m]) / test.size(), 1e3 * t_solve / test.size());
+    }
+
+    printf("[warmStartModel] iterations reduced by %.1f%%\n",
+           iters[0] ? 1e2 * (double(iters[0]) - iters[1]) / iters[0] : 0.0);
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "benchmark_react_controller");
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "react_controller/baxterChain.h"
+#include "react_controller/kinematicsCache.h"
 
 using namespace std;
 using namespace Eigen;
@@ -302,6 +303,40 @@ TEST(BaxterChainTest, testFWDKin)
     }
 }
 
+TEST(BaxterChainTest, testKinematicsCache)
+{
+    BaxterChain chain(getChain("right_gripper"));
+    KinematicsCache kin(chain);
+
+    EXPECT_EQ(chain.getNrOfJoints(), kin.getNrOfJoints());
+
+    srand(1);
+    for (size_t t = 0; t < 20; ++t)
+    {
+        // Within the joint limits, which BaxterChain clamps to
+        VectorXd q(chain.getNrOfJoints());
+        for (size_t j = 0; j < chain.getNrOfJoints(); ++j)
+        {
+            q[j] = chain.getMin(j) + (chain.getMax(j) - chain.getMin(j)) * rand() / RAND_MAX;
+        }
+
+        chain.setAng(q);
+        EXPECT_EQ(kin.getNrOfJoints(), kin.setAng(q));
+        EXPECT_LT((kin.getIsometry().matrix() - chain.getIsometry().matrix()).norm(), 1e-10);
+        EXPECT_LT((kin.GeoJacobian() - chain.GeoJacobian()).norm(), 1e-10);
+
+        // Nothing to update at the same configuration, and only the
+        // joints from the first one that moved otherwise
+        EXPECT_EQ(0u, kin.setAng(q));
+
+        q[4] = 0.5 * (q[4] + chain.getMin(4));
+        chain.setAng(q);
+        EXPECT_EQ(kin.getNrOfJoints() - 4, kin.setAng(q));
+        EXPECT_LT((kin.getIsometry().matrix() - chain.getIsometry().matrix()).norm(), 1e-10);
+        EXPECT_LT((kin.GeoJacobian() - chain.GeoJacobian()).norm(), 1e-10);
+    }
+}
+
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv)
 {
@@ -3,6 +3,7 @@
 #include "react_controller/ctrlThread.h"
 
 using namespace std;
+using namespace Eigen;
 
 // Declare a test
 TEST(IPOPTtest, testRightArm20ms)
@@ -33,6 +34,215 @@ TEST(IPOPTtest, testLeftArm40ms)
     EXPECT_TRUE(arm.getInternalState());
 }
 
+TEST(IPOPTtest, testIdleOrientation)
+{
+    // With the orientation controlled, a target at the current position but with
+    // another orientation is not reached, even before the first solve
+    ros::NodeHandle nh("baxter_react_controller");
+    nh.setParam("ctrl_ori", true);
+
+    CtrlThread arm("baxter_react_controller", "right", false);
+
+    BaxterChain chain(*arm.getChain());
+    Matrix4d       H = chain.getH();
+    Quaterniond  o_r = Quaterniond(Matrix3d(H.block<3,3>(0,0))) *
+                       Quaterniond(AngleAxisd(0.3, Vector3d::UnitZ()));
+
+    arm.resetStats();
+    EXPECT_TRUE(arm.goToPoseNoCheck(H(0,3), H(1,3), H(2,3), o_r.x(), o_r.y(), o_r.z(), o_r.w()));
+    EXPECT_EQ(0u, arm.getStats().n_idle);
+    EXPECT_EQ(1u, arm.getStats().n_cycles);
+
+    // Without the robot the chain does not move, so without controlling the
+    // orientation the same target is reached (and read at runtime)
+    nh.setParam("ctrl_ori", false);
+
+    arm.resetStats();
+    EXPECT_TRUE(arm.goToPoseNoCheck(H(0,3), H(1,3), H(2,3), o_r.x(), o_r.y(), o_r.z(), o_r.w()));
+    EXPECT_EQ(1u, arm.getStats().n_idle);
+    EXPECT_EQ(0u, arm.getStats().n_cycles);
+
+    nh.deleteParam("ctrl_ori");
+}
+
+TEST(IPOPTtest, testSlotSections)
+{
+    // One more obstacle in the grid and one less contact of the skin keep the number
+    // of slots, but move the static obstacles by one slot: they must not be reused
+    CtrlThread arm("baxter_react_controller", "right", false);
+
+    BaxterChain chain(*arm.getChain());
+    VectorXd      q = chain.getAng();
+
+    vector<Obstacle> statics;
+    for (size_t i = 0; i < chain.getNrOfJoints(); ++i)
+    {
+        statics.push_back(Obstacle(0.05, chain.getH(i).block<3,1>(0,3) + Vector3d(0.0, 0.0, 0.15)));
+    }
+
+    SignedDistanceField sdf;
+    ASSERT_TRUE(sdf.build(statics, 0.02));
+
+    // Obstacles far from the arm, which only take their slots in the grid
+    Vector3d far(10.0, 10.0, 10.0);
+    ObstacleGrid one(vector<Obstacle>(1, Obstacle(0.05, far)));
+    ObstacleGrid two(vector<Obstacle>(2, Obstacle(0.05, far)));
+
+    TactileContact contact;
+    contact.link     = 2;
+    contact.x_erf    = Vector3d::Zero();
+    contact.n_erf    = Vector3d::UnitZ();
+    contact.mag      = 0.5;
+    contact.n_taxels = 1;
+
+    MatrixXd v_lim(q.size(), 2);
+    v_lim.col(0).setConstant(-1.0);
+    v_lim.col(1).setConstant( 1.0);
+
+    AvoidanceHandlerTactile avhdl(chain, vector<double>());
+    avhdl.set_static_field(&sdf);
+    avhdl.set_tactile_contacts(vector<TactileContact>(1, contact));
+    avhdl.update(q, one);
+    avhdl.set_tactile_contacts(vector<TactileContact>());
+    avhdl.update(q, two);
+
+    AvoidanceHandlerTactile scratch(chain, vector<double>());
+    scratch.set_static_field(&sdf);
+    scratch.update(q, two);
+
+    EXPECT_TRUE(avhdl.getV_LIM(v_lim).isApprox(scratch.getV_LIM(v_lim)));
+    EXPECT_EQ(scratch.getCtrlChains().size(), avhdl.getCtrlChains().size());
+}
+
+TEST(IPOPTtest, testVelocityConstraints)
+{
+    // The end-effector may approach a target along x at 0.05m/s at most, with
+    // a constraint that only involves the first four joints
+    CtrlThread arm("baxter_react_controller", "right", false);
+
+    BaxterChain chain(*arm.getChain());
+    VectorXd    q_0 = chain.getAng();
+    Matrix4d      H = chain.getH();
+    MatrixXd  J_xyz = chain.GeoJacobian().topRows(3);
+
+    double v_approach = 0.05;
+    VelocityConstraint c;
+    c.a  = -J_xyz.leftCols(4).transpose() * Vector3d::UnitX();
+    c.lb = -v_approach;
+
+    MatrixXd v_lim(q_0.size(), 2);
+    v_lim.col(0).setConstant(-45.0);
+    v_lim.col(1).setConstant( 45.0);
+
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = newControllerApp(1e-8, 1.0);
+    app->Options()->SetIntegerValue("print_level", 0);
+    app->Initialize();
+
+    // In position mode the joints move at pid*v (towards q_0 + pid*dt*v),
+    // in velocity mode at v
+    for (size_t mode = 0; mode < 2; ++mode)
+    {
+        Ipopt::SmartPtr<ControllerNLP> nlp = new ControllerNLP(chain, 0.01, false);
+        double gain = mode == 0 ? nlp->get_pid() : 1.0;
+
+        nlp->set_formulation("soft", 1e3);
+        nlp->set_v_lim(v_lim);
+        nlp->set_x_r(H.block<3,1>(0,3) + Vector3d(0.05, 0.0, 0.0), Quaterniond(Matrix3d(H.block<3,3>(0,0))));
+        nlp->set_v_0(VectorXd::Zero(q_0.size()));
+        nlp->set_coll_constraints(vector<VelocityConstraint>(1, c), gain);
+        nlp->init();
+
+        // One sparse row, with the four joints it involves
+        Ipopt::Index n, m, nnz_jac_g, nnz_h_lag;
+        Ipopt::TNLP::IndexStyleEnum index_style;
+        ASSERT_TRUE(nlp->get_nlp_info(n, m, nnz_jac_g, nnz_h_lag, index_style));
+        ASSERT_EQ(1, m);
+        ASSERT_EQ(4, nnz_jac_g);
+
+        vector<Ipopt::Index> iRow(nnz_jac_g), jCol(nnz_jac_g);
+        ASSERT_TRUE(nlp->eval_jac_g(n, NULL, true, m, nnz_jac_g, iRow.data(), jCol.data(), NULL));
+        for (Ipopt::Index k = 0; k < nnz_jac_g; ++k)
+        {
+            EXPECT_EQ(0, iRow[k]);
+            EXPECT_EQ(k, jCol[k]);
+        }
+
+        int exit_code = app->OptimizeTNLP(GetRawPtr(nlp));
+        EXPECT_TRUE(exit_code == Ipopt::Solve_Succeeded || exit_code == Ipopt::Solved_To_Acceptable_Level);
+
+        // The bound is on the speed the joints actually move at, and the target is
+        // far enough for the constraint to be active
+        VectorXd v = mode == 0 ? VectorXd((nlp->get_est_conf() - q_0) / nlp->get_dt())
+                               : nlp->get_est_vels();
+        double   s = c.a.dot(v.head(4));
+
+        EXPECT_GE(s, -v_approach - 1e-6)  << "mode " << mode;
+        EXPECT_LT(s, -0.9 * v_approach)   << "mode " << mode;
+    }
+}
+
+TEST(IPOPTtest, testReset)
+{
+    // An NLP that is reset and set up again solves as a new one would
+    CtrlThread arm("baxter_react_controller", "right", false);
+
+    BaxterChain chain(*arm.getChain());
+    VectorXd    q_0 = chain.getAng();
+    Matrix4d      H = chain.getH();
+
+    VelocityConstraint c;
+    c.a  = -chain.GeoJacobian().topRows(3).leftCols(4).transpose() * Vector3d::UnitX();
+    c.lb = -0.05;
+
+    MatrixXd v_lim(q_0.size(), 2);
+    v_lim.col(0).setConstant(-45.0);
+    v_lim.col(1).setConstant( 45.0);
+
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = newControllerApp(1e-8, 1.0);
+    app->Options()->SetIntegerValue("print_level", 0);
+    app->Initialize();
+
+    Ipopt::SmartPtr<ControllerNLP> reused = new ControllerNLP(chain, 0.01, false);
+    Ipopt::SmartPtr<ControllerNLP> fresh  = new ControllerNLP(chain, 0.01, false);
+
+    for (size_t k = 0; k < 3; ++k)
+    {
+        // The reused NLP solves with a constraint first, the fresh one never does
+        vector<Ipopt::SmartPtr<ControllerNLP> > nlps{reused, fresh};
+
+        for (size_t i = 0; i < nlps.size(); ++i)
+        {
+            Ipopt::SmartPtr<ControllerNLP> nlp = nlps[i];
+
+            nlp->set_q_0(q_0);
+            nlp->set_formulation("soft", 1e3);
+            nlp->set_v_lim(v_lim);
+            nlp->set_x_r(H.block<3,1>(0,3) + Vector3d(0.05, 0.01 * k, 0.0),
+                         Quaterniond(Matrix3d(H.block<3,3>(0,0))));
+            nlp->set_v_0(VectorXd::Zero(q_0.size()));
+            if (i == 0 && k == 0)    { nlp->set_coll_constraints(vector<VelocityConstraint>(1, c), nlp->get_pid()); }
+            nlp->init();
+
+            int exit_code = app->OptimizeTNLP(GetRawPtr(nlp));
+            EXPECT_TRUE(exit_code == Ipopt::Solve_Succeeded || exit_code == Ipopt::Solved_To_Acceptable_Level);
+        }
+
+        if (k > 0)
+        {
+            EXPECT_LT((reused->get_est_vels() - fresh->get_est_vels()).norm(), 1e-6) << "cycle " << k;
+        }
+
+        // Nothing is left behind after a reset
+        reused->reset();
+        EXPECT_EQ(0.0, reused->get_est_vels().norm());
+
+        Ipopt::Index n, m, nnz_jac_g, nnz_h_lag;
+        Ipopt::TNLP::IndexStyleEnum index_style;
+        ASSERT_TRUE(reused->get_nlp_info(n, m, nnz_jac_g, nnz_h_lag, index_style));
+        EXPECT_EQ(0, m);
+    }
+}
+
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv)
 {
@@ -1,6 +1,23 @@
 #include <gtest/gtest.h>
 
+#include <limits>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <string.h>
+
 #include "react_controller/react_control_utils.h"
+#include "react_controller/obstacleGrid.h"
+#include "react_controller/collisionGeometry.h"
+#include "react_controller/pointCloudObstacles.h"
+#include "react_controller/signedDistanceField.h"
+#include "react_controller/threadPool.h"
+#include "react_controller/tripleBuffer.h"
+#include "react_controller/tactileSkin.h"
+#include "react_controller/obstacleScene.h"
+#include "react_controller/nlpKernels.h"
+#include "react_controller/ikCache.h"
+#include "react_controller/warmStartModel.h"
 
 using namespace std;
 using namespace Eigen;
@@ -110,6 +127,42 @@ TEST(UtilsTest, changeFoR)
 
 }
 
+TEST(UtilsTest, rigidTransforms)
+{
+    // A rotation about every axis, and a translation
+    Isometry3d H(Isometry3d::Identity());
+    H.linear()      = (AngleAxisd(0.3, Vector3d::UnitX()) *
+                       AngleAxisd(-1.2, Vector3d::UnitY()) *
+                       AngleAxisd(2.5, Vector3d::UnitZ())).toRotationMatrix();
+    H.translation() = Vector3d(0.5, -0.2, 1.1);
+
+    // KDL frames go back and forth with no loss, and as toMatrix4d does
+    KDL::Frame frame = toKDLFrame(H);
+    EXPECT_TRUE(toIsometry3d(frame).isApprox(H, 1e-12));
+    EXPECT_TRUE(toMatrix4d(frame).isApprox(H.matrix(), 1e-12));
+    EXPECT_EQ(toKDLFrame(H.matrix()), frame);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_DOUBLE_EQ(frame.p.data[i], H.translation()[i]);
+
+        for (int j = 0; j < 3; ++j)
+        {
+            EXPECT_DOUBLE_EQ(frame.M.data[3*i + j], H.linear()(i, j));
+        }
+    }
+
+    // The rigid inverse matches the general one
+    Vector3d orig(3, 4, 1), new_point, expected;
+    expected = (H.matrix().inverse() * orig.homogeneous()).head<3>();
+
+    changeFoR(orig, H, new_point);
+    EXPECT_TRUE(new_point.isApprox(expected, 1e-12)) << new_point.transpose() << endl;
+
+    changeFoR(orig, H.matrix(), new_point);
+    EXPECT_TRUE(new_point.isApprox(expected, 1e-12)) << new_point.transpose() << endl;
+}
+
 Matrix3d rotateMat(const Matrix3d& _ori_mat, double _rot_x, double _rot_y, double _rot_z)
 {
     Matrix3d new_mat;
@@ -177,6 +230,193 @@ TEST(UtilsTest, angleAxisErrAng)
     // testAngularErrors(R0, 180.0, 180.0, 180.0);      // 180° rotation about all axes
 }
 
+TEST(UtilsTest, orientationError)
+{
+    srand(1);
+
+    for (size_t k = 0; k < 100; ++k)
+    {
+        Quaterniond r(Vector4d::Random().normalized());
+        double angle = 0.5 * double(k) / 100;
+        Quaterniond e = Quaterniond(AngleAxisd(angle, Vector3d::Random().normalized())) * r;
+
+        Matrix3d J;
+        Vector3d err = orientationError(r, e, J);
+
+        // Same as the quaternion error, and the sign of either quaternion does not matter
+        EXPECT_TRUE(err.isApprox(orientationError(r, e), 1e-12));
+        EXPECT_TRUE(err.isApprox(orientationError(r, Quaterniond(-e.coeffs())), 1e-12));
+        EXPECT_NEAR(0.0, (err.cwiseAbs() - 2.0 * angularError(r, e).cwiseAbs()).norm(), 1e-12);
+        EXPECT_NEAR(2.0 * sin(0.5 * angle), err.norm(), 1e-9);
+
+        // Close to the angle-axis error for small angles
+        Vector3d aa = angularError(r.toRotationMatrix(), e.toRotationMatrix());
+        EXPECT_NEAR(0.0, (err - aa).norm(), angle * angle * angle / 24.0 + 1e-9) << "angle " << angle;
+
+        // The derivative against finite differences
+        double h = 1e-6;
+        for (int i = 0; i < 3; ++i)
+        {
+            Quaterniond de(AngleAxisd(h, Vector3d::Unit(i)));
+            Vector3d num = (orientationError(r, de * e) - orientationError(r, de.inverse() * e)) / (2.0 * h);
+
+            EXPECT_NEAR(0.0, (num - J.col(i)).norm(), 1e-6) << "angle " << angle << " axis " << i;
+        }
+
+        // And against the derivative of the sin-based error (Siciliano & Sciavicco, page 139)
+        Matrix3d R_r = r.toRotationMatrix(), R_e = e.toRotationMatrix();
+        Matrix3d L   = -0.5 * (skew(R_r.col(0)) * skew(R_e.col(0)) +
+                               skew(R_r.col(1)) * skew(R_e.col(1)) +
+                               skew(R_r.col(2)) * skew(R_e.col(2)));
+        EXPECT_NEAR(0.0, (J + L).norm(), 0.5 * angle + 1e-9) << "angle " << angle;
+    }
+
+    // Opposite orientations give the largest error, not a null one
+    Quaterniond r(Quaterniond::Identity());
+    Quaterniond e(AngleAxisd(M_PI - 1e-3, Vector3d::UnitZ()));
+    EXPECT_NEAR(2.0, orientationError(r, e).norm(), 1e-6);
+    EXPECT_NEAR(0.0, orientationError(r, r).norm(), 1e-12);
+}
+
+TEST(UtilsTest, incrementOrientationError)
+{
+    // The error as a function of the joint velocities of the NLP, i.e. of
+    // exp(pid * dt * J_ang * v) * o_0, with made up Jacobians
+    srand(2);
+    double pid = 10.0, dt = 0.01;
+
+    for (size_t k = 0; k < 100; ++k)
+    {
+        MatrixXd    J_ang = MatrixXd::Random(3, 7);
+        Quaterniond   o_0(Vector4d::Random().normalized());
+        Quaterniond   o_r = Quaterniond(AngleAxisd(0.3, Vector3d::Random().normalized())) * o_0;
+
+        // From rest to increments of about a radian
+        VectorXd v = (5.0 * k / 100) * VectorXd::Random(7);
+
+        Matrix3d J;
+        Vector3d inc = pid * dt * (J_ang * v);
+        Vector3d err = incrementOrientationError(o_r, o_0, inc, J);
+
+        double th = inc.norm();
+        Quaterniond o_e = Quaterniond(AngleAxisd(th, th > 0.0 ? Vector3d(inc / th)
+                                                              : Vector3d::UnitX())) * o_0;
+        Matrix3d D;
+        EXPECT_TRUE(err.isApprox(orientationError(o_r, o_e, D), 1e-12));
+
+        // Against central differences of the full error
+        MatrixXd Derr = pid * dt * (J * J_ang);
+        double   h    = 1e-6;
+
+        for (int i = 0; i < 7; ++i)
+        {
+            VectorXd v_p = v, v_m = v;
+            v_p[i] += h;
+            v_m[i] -= h;
+
+            Matrix3d J_p, J_m;
+            Vector3d num = (incrementOrientationError(o_r, o_0, pid * dt * (J_ang * v_p), J_p) -
+                            incrementOrientationError(o_r, o_0, pid * dt * (J_ang * v_m), J_m)) / (2.0 * h);
+
+            EXPECT_NEAR(0.0, (num - Derr.col(i)).norm(), 1e-6) << "increment " << th << " joint " << i;
+        }
+
+        // The derivative at the end orientation alone only holds at rest
+        if (th < 1e-12)    { EXPECT_TRUE(J.isApprox(D, 1e-12)); }
+        if (th > 0.5)      { EXPECT_GT((J - D).norm(), 0.1 * th); }
+    }
+}
+
+TEST(UtilsTest, nlpKernels)
+{
+    // A 7-joint problem with made up Jacobians, in every formulation
+    srand(3);
+    NLPTermData d;
+    d.n_joints = 7;
+    d.ctrl_ori = true;
+    d.J_xyz    = 0.1 * Matrix<double, 3, Dynamic>::Random(3, d.n_joints);
+    d.J_ang    = 0.1 * Matrix<double, 3, Dynamic>::Random(3, d.n_joints);
+    d.p_0      = Vector3d::Random();
+    d.p_r      = d.p_0 + 0.01 * Vector3d::Random();
+    d.ori.o_0  = Quaterniond(Vector4d::Random().normalized());
+    d.ori.o_r  = Quaterniond(AngleAxisd(0.3, Vector3d::UnitX())) * d.ori.o_0;
+
+    vector<PosFormulation> formulations{POS_HARD, POS_SOFT, POS_SLACK};
+
+    for (size_t f = 0; f < formulations.size(); ++f)
+    {
+        d.formulation = formulations[f];
+        int n = d.formulation == POS_SLACK ? 8 : 7;
+
+        NLPKernels k;
+        k.set_data(d);
+
+        // At a random point, and at rest (where the angular increment is null)
+        for (size_t r = 0; r < 2; ++r)
+        {
+            VectorXd x = r == 0 ? VectorXd(VectorXd::Random(n)) : VectorXd(VectorXd::Zero(n));
+            VectorXd grad(n), jac(n);
+
+            EXPECT_NEAR(k.objective(x.data(), n),     k.objective(x.data(), n, grad.data()),    1e-12);
+            EXPECT_NEAR(k.posConstraint(x.data(), n), k.posConstraint(x.data(), n, jac.data()), 1e-12);
+
+            // The generated first derivatives against hand-written ones
+            VectorXd v = x.head(d.n_joints);
+            Vector3d err_xyz = d.p_r - d.p_0 - d.J_xyz * v;
+
+            Matrix3d Derr;
+            Vector3d err_ang = incrementOrientationError(d.ori.o_r, d.ori.o_0, d.J_ang * v, Derr);
+
+            VectorXd grad_hw = VectorXd::Zero(n), jac_hw = VectorXd::Zero(n);
+            jac_hw.head(d.n_joints) = -2.0 * (d.J_xyz.transpose() * err_xyz);
+            grad_hw.head(d.n_joints) = 2.0 * (d.J_ang.transpose() * (Derr.transpose() * err_ang));
+            if      (d.formulation == POS_SOFT)  { grad_hw.head(d.n_joints) += d.w_xyz * jac_hw.head(d.n_joints); }
+            else if (d.formulation == POS_SLACK) { grad_hw[d.n_joints] = d.w_slack; jac_hw[d.n_joints] = -1.0; }
+
+            EXPECT_LT((grad - grad_hw).norm(), 1e-10 * std::max(grad.norm(), 1.0));
+            EXPECT_LT((jac  - jac_hw ).norm(), 1e-10 * std::max(jac .norm(), 1.0));
+
+            NLPMatrix H;
+            k.hessian(x.data(), n, 0.5, 2.0, H);
+            EXPECT_LT((H - H.transpose()).norm(), 1e-10);
+
+            // Against central differences of the values and of the first derivatives
+            double h = 1e-6;
+            for (int i = 0; i < n; ++i)
+            {
+                VectorXd x_p = x, x_m = x;
+                x_p[i] += h;
+                x_m[i] -= h;
+
+                EXPECT_NEAR((k.objective(x_p.data(), n) - k.objective(x_m.data(), n)) / (2.0 * h),
+                            grad[i], 1e-6) << "formulation " << f << " variable " << i;
+                EXPECT_NEAR((k.posConstraint(x_p.data(), n) - k.posConstraint(x_m.data(), n)) / (2.0 * h),
+                            jac[i], 1e-6) << "formulation " << f << " variable " << i;
+
+                VectorXd g_p(n), g_m(n), j_p(n), j_m(n);
+                k.objective(x_p.data(), n, g_p.data());
+                k.objective(x_m.data(), n, g_m.data());
+                k.posConstraint(x_p.data(), n, j_p.data());
+                k.posConstraint(x_m.data(), n, j_m.data());
+
+                VectorXd row = 0.5 * (g_p - g_m) / (2.0 * h);
+                if (d.formulation != POS_SOFT)    { row += 2.0 * (j_p - j_m) / (2.0 * h); }
+
+                EXPECT_LT((row - VectorXd(H.row(i).transpose())).norm(), 1e-5)
+                          << "formulation " << f << " variable " << i;
+            }
+
+            // The orientation error is the one of orientationError
+            Vector3d w  = d.J_ang * x.head(d.n_joints);
+            double   th = w.norm();
+            Quaterniond o_e = Quaterniond(AngleAxisd(th, th > 0.0 ? Vector3d(w / th)
+                                                                  : Vector3d::UnitX())) * d.ori.o_0;
+            Vector3d err = d.ori.error(d.angIncrement(x.data()));
+            EXPECT_LT((err - orientationError(d.ori.o_r, o_e)).norm(), 1e-12);
+        }
+    }
+}
+
 TEST(UtilsTest, testProjectOntoSegment)
 {
     Vector3d base(0, 0, 0);
@@ -210,6 +450,843 @@ TEST(UtilsTest, testProjectOntoSegment)
     EXPECT_EQ(expect, projection);
 }
 
+TEST(UtilsTest, testDistanceToSegment)
+{
+    Vector3d base(0, 0, 0);
+    Vector3d tip(1, 0, 0);
+
+    EXPECT_DOUBLE_EQ(1.0, distanceToSegment(base, tip, Vector3d( 0.5,  1, 0)));
+    EXPECT_DOUBLE_EQ(0.0, distanceToSegment(base, tip, Vector3d(0.25,  0, 0)));
+
+    // Beyond the tip and the base the distance is computed from the endpoints
+    EXPECT_DOUBLE_EQ(0.5, distanceToSegment(base, tip, Vector3d( 1.5,  0, 0)));
+    EXPECT_DOUBLE_EQ(5.0, distanceToSegment(base, tip, Vector3d(-3.0, -4, 0)));
+
+    // Degenerate segment
+    EXPECT_DOUBLE_EQ(2.0, distanceToSegment(base, base, Vector3d(0, 0, 2)));
+}
+
+TEST(UtilsTest, testObstacleGrid)
+{
+    srand(1);
+
+    vector<Obstacle> obstacles;
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        obstacles.push_back(Obstacle(0.1 * (Vector3d::Random()[0] + 1.0), 3.0 * Vector3d::Random()));
+    }
+
+    vector<pair<Vector3d, Vector3d> > segments;
+    segments.push_back(make_pair(Vector3d(   0,   0,   0), Vector3d(0.4,   0, 0.2)));
+    segments.push_back(make_pair(Vector3d( 0.4,   0, 0.2), Vector3d(0.7, 0.3, 0.2)));
+    segments.push_back(make_pair(Vector3d(-2.9, 2.9, 2.9), Vector3d(-2.9, 2.9, 2.9)));
+
+    for (double cell_size = 0.1; cell_size < 2.0; cell_size *= 2.0)
+    {
+        ObstacleGrid grid(obstacles, cell_size);
+        EXPECT_EQ(obstacles.size(), grid.getNrOfObstacles());
+
+        for (double dist = 0.0; dist < 1.0; dist += 0.25)
+        {
+            // The grid has to give the same result as a brute-force search
+            vector<size_t> expected;
+            for (size_t i = 0; i < obstacles.size(); ++i)
+            {
+                for (size_t s = 0; s < segments.size(); ++s)
+                {
+                    if (distanceToSegment(segments[s].first, segments[s].second,
+                                          obstacles[i].x_wrf) - obstacles[i].size <= dist)
+                    {
+                        expected.push_back(i);
+                        break;
+                    }
+                }
+            }
+
+            EXPECT_EQ(expected, grid.query(segments, dist)) << "cell_size " << cell_size
+                                                            << " dist " << dist;
+        }
+    }
+
+    ObstacleGrid empty;
+    EXPECT_TRUE(empty.query(segments, 1.0).empty());
+}
+
+TEST(UtilsTest, testSphereCapsuleDistances)
+{
+    srand(2);
+
+    Capsules caps;
+    caps.resize(4);
+    caps.set(0, Vector3d(0, 0, 0), Vector3d(  1,   0,   0), 0.05);
+    caps.set(1, Vector3d(1, 0, 0), Vector3d(  1, 0.5, 0.5), 0.10);
+    caps.set(2, Vector3d(1, 1, 1), Vector3d(  1,   1,   1), 0.00);  // degenerate
+    caps.set(3, Vector3d(-1, 2, 0), Vector3d(0.3, -0.4, 2), 0.02);
+
+    Spheres spheres;
+    spheres.resize(100);
+    for (size_t i = 0; i < spheres.size(); ++i)
+    {
+        spheres.set(i, 2.0 * Vector3d::Random(), 0.1 * (Vector3d::Random()[0] + 1.0));
+    }
+    // A sphere centered on the first segment
+    spheres.set(0, Vector3d(0.5, 0, 0), 0.1);
+
+    SphereCapsuleDistances res;
+    sphereCapsuleDistances(caps, spheres, res);
+
+    ASSERT_EQ(size_t(res.dist.rows()), spheres.size());
+    ASSERT_EQ(size_t(res.dist.cols()),    caps.size());
+
+    for (size_t l = 0; l < caps.size(); ++l)
+    {
+        Vector3d a(caps.ax[l], caps.ay[l], caps.az[l]);
+        Vector3d b(caps.bx[l], caps.by[l], caps.bz[l]);
+
+        for (size_t i = 0; i < spheres.size(); ++i)
+        {
+            Vector3d c(spheres.x[i], spheres.y[i], spheres.z[i]);
+
+            double d = distanceToSegment(a, b, c);
+            EXPECT_NEAR(d - caps.r[l] - spheres.r[i], res.dist(i, l), 1e-12);
+
+            // The closest point lies on the surface of the capsule,
+            // and the normal points from there to the sphere
+            Vector3d p = res.closestPoint(caps, i, l);
+
+            if (d > 1e-9)
+            {
+                EXPECT_NEAR(caps.r[l], distanceToSegment(a, b, p), 1e-12);
+                EXPECT_NEAR(1.0, res.normal(i, l).norm(), 1e-12);
+                EXPECT_NEAR(d - caps.r[l], (c - p).norm(), 1e-12);
+                EXPECT_NEAR(0.0, (c - p).normalized().cross(res.normal(i, l)).norm(), 1e-9);
+            }
+        }
+    }
+
+    EXPECT_DOUBLE_EQ(-0.15, res.dist(0, 0));
+    EXPECT_DOUBLE_EQ(  0.0, res.normal(0, 0).norm());
+}
+
+TEST(UtilsTest, testSegmentSegmentDistance)
+{
+    Vector3d cp, cq;
+
+    // Crossing segments
+    EXPECT_NEAR(0.5, segmentSegmentDistance(Vector3d(-1, 0, 0), Vector3d(1, 0, 0),
+                                            Vector3d(0, -1, 0.5), Vector3d(0, 1, 0.5), cp, cq), 1e-12);
+    EXPECT_NEAR(0.0, cp.norm(), 1e-12);
+    EXPECT_NEAR(0.0, (cq - Vector3d(0, 0, 0.5)).norm(), 1e-12);
+
+    // Parallel segments, and degenerate ones
+    EXPECT_NEAR(1.0, segmentSegmentDistance(Vector3d(0, 0, 0), Vector3d(1, 0, 0),
+                                            Vector3d(0.5, 1, 0), Vector3d(2, 1, 0), cp, cq), 1e-12);
+    EXPECT_NEAR(1.0, segmentSegmentDistance(Vector3d(0, 0, 0), Vector3d(0, 0, 0),
+                                            Vector3d(1, 0, 0), Vector3d(1, 0, 0), cp, cq), 1e-12);
+    EXPECT_NEAR(sqrt(2.0), segmentSegmentDistance(Vector3d(0, 0, 0), Vector3d(1, 0, 0),
+                                                  Vector3d(2, 1, 0), Vector3d(2, 1, 0), cp, cq), 1e-12);
+
+    // Random segments, against dense sampling
+    srand(1);
+    for (size_t i = 0; i < 100; ++i)
+    {
+        Vector3d p0 = Vector3d::Random(), p1 = Vector3d::Random();
+        Vector3d q0 = Vector3d::Random(), q1 = Vector3d::Random();
+
+        double d = segmentSegmentDistance(p0, p1, q0, q1, cp, cq);
+        EXPECT_NEAR(d, (cp - cq).norm(), 1e-12);
+
+        double ref = 1e9;
+        for (int s = 0; s <= 200; ++s)
+        {
+            ref = std::min(ref, distanceToSegment(q0, q1, p0 + (p1 - p0) * (s / 200.0)));
+        }
+
+        EXPECT_LE(d, ref + 1e-12);
+        EXPECT_NEAR(ref, d, 0.01);
+    }
+}
+
+TEST(UtilsTest, testSweptCapsuleCheck)
+{
+    // A link that moves across a small sphere, which it does not touch at either end
+    Capsules from, to;
+    from.resize(1);
+    to  .resize(1);
+    from.set(0, Vector3d(-0.2, 0.0, 0.0), Vector3d(-0.2, 0.0, 0.3), 0.05);
+    to  .set(0, Vector3d( 0.2, 0.0, 0.0), Vector3d( 0.2, 0.0, 0.3), 0.05);
+
+    Spheres spheres;
+    spheres.resize(2);
+    spheres.set(0, Vector3d(0.0, 0.5, 0.15), 0.02);
+    spheres.set(1, Vector3d(0.0, 0.0, 0.15), 0.02);
+
+    SweptCollision res = sweptCapsuleCheck(from, to, spheres, 1e-3);
+    EXPECT_TRUE(res.collision);
+    EXPECT_EQ(0u, res.link);
+    EXPECT_EQ(1u, res.sphere);
+    EXPECT_NEAR((0.2 - 0.07) / 0.4, res.toi, 0.005);
+    EXPECT_LE(res.n_iters, 5u);
+
+    // Far from the motion
+    spheres.set(1, Vector3d(0.0, 0.2, 0.15), 0.02);
+    res = sweptCapsuleCheck(from, to, spheres, 1e-3);
+    EXPECT_FALSE(res.collision);
+    EXPECT_DOUBLE_EQ(1.0, res.toi);
+
+    // Touched at the start, or still
+    spheres.set(1, Vector3d(-0.13, 0.0, 0.15), 0.02);
+    EXPECT_FALSE(sweptCapsuleCheck(from, to,   spheres, 1e-3).collision);
+    spheres.set(1, Vector3d(-0.2, 0.0, 0.4), 0.02);
+    EXPECT_FALSE(sweptCapsuleCheck(from, from, spheres, 1e-3).collision);
+
+    // A grazing motion runs out of steps, which counts as a hit
+    spheres.set(1, Vector3d(0.0, 0.0711, 0.15), 0.02);
+    EXPECT_FALSE(sweptCapsuleCheck(from, to, spheres, 1e-3, 1000).collision);
+    EXPECT_TRUE (sweptCapsuleCheck(from, to, spheres, 1e-3,    1).collision);
+}
+
+TEST(UtilsTest, testReceptiveFieldActivations)
+{
+    srand(3);
+    size_t n_points = 40, n_spheres = 30;
+    double depth = 0.2, cos_half = cos(M_PI / 4.0);
+
+    MatrixX3d points  = 0.3 * MatrixX3d::Random(n_points, 3);
+    MatrixX3d normals =       MatrixX3d::Random(n_points, 3);
+    normals.rowwise().normalize();
+
+    Matrix3Xd centers = 0.4 * Matrix3Xd::Random(3, n_spheres);
+    ArrayXd   sizes   = 0.05 * (ArrayXd::Random(n_spheres) + 1.0);
+
+    // A sphere touching the first point, and one right behind it
+    centers.col(0) = points.row(0).transpose() + 0.5 * sizes[0] * normals.row(0).transpose();
+    centers.col(1) = points.row(0).transpose() - (sizes[1] + 0.1) * normals.row(0).transpose();
+
+    ArrayXXd act;
+    receptiveFieldActivations(points, normals, centers, sizes, depth, cos_half, act);
+    ASSERT_EQ(n_points,  size_t(act.rows()));
+    ASSERT_EQ(n_spheres, size_t(act.cols()));
+
+    EXPECT_NEAR(1.0, act(0,0), 1e-9);
+    EXPECT_NEAR(0.0, act(0,1), 1e-9);
+
+    size_t n_active = 0;
+    for (size_t p = 0; p < n_points; ++p)
+    {
+        for (size_t m = 0; m < n_spheres; ++m)
+        {
+            Vector3d d = centers.col(m) - points.row(p).transpose();
+            double   h = d.norm() - sizes[m];
+            double   c = d.dot(normals.row(p).transpose()) / d.norm();
+
+            double x       = std::min(std::max(h / depth, 0.0), 1.0);
+            double radial  = 1.0 - x * x * (3.0 - 2.0 * x);
+            double angular = std::min(std::max((c - cos_half) / (1.0 - cos_half), 0.0), 1.0);
+
+            EXPECT_NEAR(radial * angular, act(p,m), 1e-9);
+            EXPECT_GE(act(p,m), 0.0);
+            EXPECT_LE(act(p,m), 1.0);
+
+            n_active += act(p,m) > 0.0;
+        }
+    }
+
+    // Both active and inactive fields are covered
+    EXPECT_GT(n_active, 0u);
+    EXPECT_LT(n_active, n_points * n_spheres);
+}
+
+TEST(UtilsTest, testPointCloudObstacles)
+{
+    vector<Obstacle> spheres;
+    spheres.push_back(Obstacle(0.10, Vector3d( 0.8, -0.3, 0.2)));
+    spheres.push_back(Obstacle(0.05, Vector3d(-0.5,  0.5, 1.0)));
+
+    sensor_msgs::PointCloud2 cloud;
+    syntheticPointCloud(cloud, spheres, 2000);
+    ASSERT_EQ(4000u, cloud.width * cloud.height);
+
+    // Add a NaN point, that has to be skipped
+    float nan = std::numeric_limits<float>::quiet_NaN();
+    memcpy(&cloud.data[0], &nan, sizeof(float));
+
+    PointCloudObstacles proc(0.05, 10000, 1000, 1.0);
+    vector<Obstacle> obstacles;
+    ASSERT_TRUE(proc.process(cloud, obstacles));
+
+    EXPECT_EQ(3999u, proc.getNrOfRead());
+    EXPECT_FALSE(proc.isTruncated());
+    EXPECT_EQ(proc.getNrOfVoxels(), obstacles.size());
+    EXPECT_LT(obstacles.size(), 200u);
+
+    // Every obstacle is on the surface of one of the spheres
+    for (size_t i = 0; i < obstacles.size(); ++i)
+    {
+        double dist = 1e9;
+        for (size_t j = 0; j < spheres.size(); ++j)
+        {
+            dist = std::min(dist, fabs((obstacles[i].x_wrf - spheres[j].x_wrf).norm() - spheres[j].size));
+        }
+
+        EXPECT_LT(dist, 0.05);
+        EXPECT_DOUBLE_EQ(sqrt(3.0) * 0.05, obstacles[i].size);
+    }
+
+    // Caps on the number of points and obstacles
+    proc.set_limits(0.05, 1000, 10, 1.0);
+    ASSERT_TRUE(proc.process(cloud, obstacles));
+    EXPECT_EQ(999u,  proc.getNrOfRead());
+    EXPECT_EQ(10u,   obstacles.size());
+
+    // Transform of the cloud frame
+    Matrix4d H(Matrix4d::Identity());
+    H.block<3,1>(0,3) = Vector3d(1.0, 2.0, 3.0);
+    proc.set_limits(0.05, 10000, 1000, 1.0);
+    proc.set_transform(H);
+
+    ASSERT_TRUE(proc.process(cloud, obstacles));
+    ASSERT_FALSE(obstacles.empty());
+
+    for (size_t i = 0; i < obstacles.size(); ++i)
+    {
+        double dist = 1e9;
+        for (size_t j = 0; j < spheres.size(); ++j)
+        {
+            Vector3d center = spheres[j].x_wrf + H.block<3,1>(0,3);
+            dist = std::min(dist, fabs((obstacles[i].x_wrf - center).norm() - spheres[j].size));
+        }
+
+        EXPECT_LT(dist, 0.05);
+    }
+
+    // A cloud without xyz fields is rejected
+    cloud.fields.clear();
+    EXPECT_FALSE(proc.process(cloud, obstacles));
+    EXPECT_TRUE(obstacles.empty());
+}
+
+TEST(UtilsTest, testSignedDistanceField)
+{
+    vector<Obstacle> obstacles;
+    obstacles.push_back(Obstacle(0.20, Vector3d(0.8, -0.3, 0.0)));
+    obstacles.push_back(Obstacle(0.05, Vector3d(0.6,  0.2, 0.3)));
+
+    SignedDistanceField sdf;
+    EXPECT_FALSE(sdf.isLoaded());
+    EXPECT_FALSE(sdf.build(vector<Obstacle>(), 0.01));
+
+    ASSERT_TRUE(sdf.build(obstacles, 0.01, 0.3));
+    EXPECT_TRUE(sdf.isLoaded());
+    EXPECT_EQ(2u, sdf.getNrOfObstacles());
+
+    // Interpolated distances and gradients match the analytic ones
+    srand(1);
+    double d = 0.0;
+    Vector3d grad;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        Vector3d p = Vector3d(0.7, -0.1, 0.1) + 0.4 * Vector3d::Random();
+
+        size_t   j = 0;
+        double ref = 1e9;
+        for (size_t k = 0; k < obstacles.size(); ++k)
+        {
+            double dk = (p - obstacles[k].x_wrf).norm() - obstacles[k].size;
+            if (dk < ref)    { ref = dk; j = k; }
+        }
+
+        ASSERT_TRUE(sdf.distance(p, d, grad));
+
+        if (ref < 0.25)
+        {
+            EXPECT_NEAR(ref, d, 0.005);
+
+            // Away from the medial axis and from the centers, the gradient is the radial direction
+            double d_other = (p - obstacles[1-j].x_wrf).norm() - obstacles[1-j].size;
+            if (d_other - ref > 0.05 && (p - obstacles[j].x_wrf).norm() > 0.05)
+            {
+                EXPECT_GT(grad.normalized().dot((p - obstacles[j].x_wrf).normalized()), 0.99);
+            }
+        }
+        else
+        {
+            EXPECT_LE(d, 0.3 + 1e-6);
+        }
+    }
+
+    // Points outside of the field are farther than the truncation distance
+    EXPECT_FALSE(sdf.distance(Vector3d(5.0, 5.0, 5.0), d));
+
+    // The closest point of a segment that passes close to the big sphere
+    Vector3d x;
+    ASSERT_TRUE(sdf.closestPoint(Vector3d(0.5, -0.3, 0.3), Vector3d(1.1, -0.3, 0.3), x, d, grad));
+    EXPECT_NEAR(0.1, d, 0.01);
+    EXPECT_NEAR(0.8, x[0], 0.01);
+    EXPECT_GT(grad.normalized()[2], 0.99);
+
+    EXPECT_FALSE(sdf.closestPoint(Vector3d(0.0, 1.0, 1.0), Vector3d(0.1, 1.0, 1.0), x, d, grad));
+
+    // The local search walks from the seed down to the same closest point (up to a sample)
+    double t = 0.0, t_local = 0.0;
+    Vector3d x_local, grad_local;
+    double   d_local = 0.0;
+    ASSERT_TRUE(sdf.closestPoint(Vector3d(0.5, -0.3, 0.3), Vector3d(1.1, -0.3, 0.3), x, d, grad, t));
+    EXPECT_NEAR(0.5, t, 0.01);
+
+    for (size_t i = 0; i < 2; ++i)
+    {
+        t_local = i == 0 ? 0.0 : 1.0;
+        ASSERT_TRUE(sdf.closestPointLocal(Vector3d(0.5, -0.3, 0.3), Vector3d(1.1, -0.3, 0.3),
+                                          t_local, x_local, d_local, grad_local));
+        EXPECT_NEAR(t, t_local, 0.01);
+        EXPECT_NEAR(d, d_local, 1e-3);
+        EXPECT_NEAR(0.0, (x - x_local).norm(), 0.01);
+    }
+
+    // ... and stops at the first local minimum, here the one of the big sphere
+    Vector3d a(0.6, 0.2, 0.4), b(0.8, -0.3, 0.3);
+    ASSERT_TRUE(sdf.closestPoint(a, b, x, d, grad, t));
+    EXPECT_LT(t, 0.1);
+    EXPECT_NEAR(0.05, d, 0.01);
+
+    t_local = 0.9;
+    ASSERT_TRUE(sdf.closestPointLocal(a, b, t_local, x_local, d_local, grad_local));
+    EXPECT_NEAR(1.0, t_local, 0.01);
+    EXPECT_NEAR(0.1, d_local, 0.01);
+
+    t_local = 0.5;
+    EXPECT_FALSE(sdf.closestPointLocal(Vector3d(0.0, 1.0, 1.0), Vector3d(0.1, 1.0, 1.0),
+                                       t_local, x_local, d_local, grad_local));
+
+    // Saved and mapped fields yield the same distances
+    ASSERT_TRUE(sdf.save("/tmp/test_utils.sdf"));
+
+    SignedDistanceField mapped;
+    ASSERT_TRUE(mapped.load("/tmp/test_utils.sdf"));
+    EXPECT_EQ(sdf.getNrOfVertices(), mapped.getNrOfVertices());
+    EXPECT_DOUBLE_EQ(0.3, mapped.getMaxDistance());
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+        Vector3d p = Vector3d(0.7, -0.1, 0.1) + 0.4 * Vector3d::Random();
+        double d_mapped = 0.0;
+
+        ASSERT_TRUE(sdf   .distance(p, d));
+        ASSERT_TRUE(mapped.distance(p, d_mapped));
+        EXPECT_DOUBLE_EQ(d, d_mapped);
+    }
+
+    EXPECT_FALSE(mapped.load("/tmp/does_not_exist.sdf"));
+    EXPECT_FALSE(mapped.isLoaded());
+}
+
+TEST(UtilsTest, testThreadPool)
+{
+    size_t n_threads[] = {1, 2, 4};
+    size_t    chunks[] = {1, 3, 64};
+
+    for (size_t t = 0; t < 3; ++t)
+    {
+        ThreadPool pool(n_threads[t]);
+        EXPECT_EQ(n_threads[t], pool.getNrOfThreads());
+
+        for (size_t c = 0; c < 3; ++c)
+        {
+            for (size_t n = 0; n <= 1000; n = n ? 10 * n : 1)
+            {
+                // Every item is processed exactly once, and by a valid thread
+                vector<int>    count(n, 0);
+                vector<size_t> owner(n, 0);
+
+                pool.parallelFor(n, [&](size_t i, size_t id)
+                {
+                    count[i]++;
+                    owner[i] = id;
+                }, chunks[c]);
+
+                for (size_t i = 0; i < n; ++i)
+                {
+                    EXPECT_EQ(1, count[i]);
+                    EXPECT_LT(owner[i], n_threads[t]);
+                }
+            }
+        }
+    }
+}
+
+TEST(UtilsTest, testTripleBuffer)
+{
+    TripleBuffer<std::shared_ptr<const int> > buf;
+    std::shared_ptr<const int> val;
+
+    EXPECT_FALSE(buf.read(val));
+
+    // Only the latest value is read, and only once
+    buf.write(std::make_shared<const int>(1));
+    buf.write(std::make_shared<const int>(2));
+    ASSERT_TRUE(buf.read(val));
+    EXPECT_EQ(2, *val);
+    EXPECT_FALSE(buf.read(val));
+    EXPECT_EQ(2, *val);
+
+    // The buffer does not keep the values the reader has taken
+    std::weak_ptr<const int> weak(val);
+    val.reset();
+    EXPECT_TRUE(weak.expired());
+
+    // Values are read in order while a writer thread keeps publishing
+    int n_values = 100000;
+    std::thread writer([&]()
+    {
+        for (int i = 1; i <= n_values; ++i)    { buf.write(std::make_shared<const int>(i)); }
+    });
+
+    int last = 0;
+    bool ordered = true;
+    while (last < n_values)
+    {
+        if (buf.read(val))
+        {
+            ordered = ordered && *val > last;
+            last    = *val;
+        }
+    }
+    writer.join();
+
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ(n_values, last);
+}
+
+TEST(UtilsTest, testTactileSkin)
+{
+    // Two patches on link 2 (facing up and down) and one on link 4
+    vector<Taxel> taxels;
+    for (uint32_t k = 0; k < 4; ++k)
+    {
+        taxels.push_back(Taxel(     k, 2, 0, Vector3d(0.01 * k, 0.0,  0.05), Vector3d(0, 0,  2)));
+        taxels.push_back(Taxel(10 + k, 2, 1, Vector3d(0.01 * k, 0.0, -0.05), Vector3d(0, 0, -1)));
+        taxels.push_back(Taxel(20 + k, 4, 2, Vector3d(0.0, 0.01 * k,  0.0),  Vector3d(1, 0,  0)));
+    }
+
+    TactileSkin skin(0.1);
+    ASSERT_TRUE(skin.build(taxels));
+    EXPECT_EQ(12u, skin.getNrOfTaxels());
+    EXPECT_EQ( 3u, skin.getNrOfPatches());
+
+    // Activations are weighted, clamped, and the ones below threshold or unknown are skipped
+    vector<uint32_t> ids = {   1,   3,  11,  12,  99};
+    vector<float>   acts = {0.2f, 0.6f, 0.05f, 2.0f, 1.0f};
+
+    vector<TactileContact> contacts;
+    EXPECT_EQ(4u, skin.aggregate(ids.data(), acts.data(), ids.size(), contacts));
+    ASSERT_EQ(2u, contacts.size());
+
+    EXPECT_EQ(2u, contacts[0].link);
+    EXPECT_EQ(2u, contacts[0].n_taxels);
+    EXPECT_NEAR(0.6, contacts[0].mag, 1e-6);
+    EXPECT_TRUE(contacts[0].x_erf.isApprox(Vector3d((0.2 * 0.01 + 0.6 * 0.03) / 0.8, 0.0, 0.05), 1e-6));
+    EXPECT_TRUE(contacts[0].n_erf.isApprox(Vector3d(0.0, 0.0, 1.0)));
+
+    EXPECT_EQ(2u, contacts[1].link);
+    EXPECT_EQ(1u, contacts[1].n_taxels);
+    EXPECT_DOUBLE_EQ(1.0, contacts[1].mag);
+    EXPECT_TRUE(contacts[1].x_erf.isApprox(Vector3d(0.02, 0.0, -0.05)));
+    EXPECT_TRUE(contacts[1].n_erf.isApprox(Vector3d(0.0, 0.0, -1.0)));
+
+    // A new frame replaces the previous one
+    EXPECT_EQ(0u, skin.aggregate(ids.data(), acts.data(), 0, contacts));
+    EXPECT_TRUE(contacts.empty());
+
+    // Duplicate IDs and patches across links are rejected
+    taxels.push_back(Taxel(0, 2, 0, Vector3d::Zero(), Vector3d::UnitZ()));
+    EXPECT_FALSE(skin.build(taxels));
+    taxels.back() = Taxel(30, 3, 0, Vector3d::Zero(), Vector3d::UnitZ());
+    EXPECT_FALSE(skin.build(taxels));
+}
+
+TEST(UtilsTest, testObstacleScene)
+{
+    vector<SceneSphere>  spheres  = {{{0.5f, 0.0f, 0.2f}, 0.1f}};
+    vector<SceneCapsule> capsules = {{{0.0f, 0.0f, 0.0f}, {0.3f, 0.0f, 0.0f}, 0.05f, 0.0f}};
+    vector<SceneBox>     boxes    = {{{0.0f, 0.5f, 0.0f}, {0.2f, 0.1f, 0.02f},
+                                      {0.0f, 0.0f, float(sin(M_PI/8)), float(cos(M_PI/8))}}};
+
+    ObstacleScene scene;
+    EXPECT_FALSE(scene.isLoaded());
+    EXPECT_FALSE(scene.save("/tmp/test_utils.scene"));
+
+    ASSERT_TRUE(scene.build(spheres, capsules, boxes));
+    ASSERT_TRUE(scene.save("/tmp/test_utils.scene"));
+
+    // The mapped scene holds the same primitives
+    ObstacleScene mapped;
+    ASSERT_TRUE(mapped.load("/tmp/test_utils.scene"));
+    ASSERT_EQ(1u, mapped.getNrOfSpheres());
+    ASSERT_EQ(1u, mapped.getNrOfCapsules());
+    ASSERT_EQ(1u, mapped.getNrOfBoxes());
+    EXPECT_EQ(0, memcmp(&spheres[0],  &mapped.getSphere(0),  sizeof(SceneSphere)));
+    EXPECT_EQ(0, memcmp(&capsules[0], &mapped.getCapsule(0), sizeof(SceneCapsule)));
+    EXPECT_EQ(0, memcmp(&boxes[0],    &mapped.getBox(0),     sizeof(SceneBox)));
+
+    // Capsules and boxes are covered by the spheres they are converted into
+    vector<Obstacle> obstacles;
+    ASSERT_EQ(obstacles.size(), mapped.toObstacles(obstacles, 0.05));
+    EXPECT_FLOAT_EQ(0.1, obstacles[0].size);
+
+    Matrix3d R = AngleAxisd(M_PI/4, Vector3d::UnitZ()).toRotationMatrix();
+
+    srand(1);
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        // Points within the cylinder of the capsule, or within the box
+        Vector3d u = Vector3d::Random(), p;
+        if (i % 2)
+        {
+            p = Vector3d(0.15 + 0.15 * u[0], 0.0, 0.0) +
+                0.05 * u.tail<2>().norm() / sqrt(2.0) * Vector3d(0.0, u[1], u[2]).normalized();
+        }
+        else
+        {
+            p = Vector3d(0.0, 0.5, 0.0) + R * Vector3d(0.2, 0.1, 0.02).cwiseProduct(u);
+        }
+
+        bool covered = false;
+        for (size_t j = 1; j < obstacles.size() && not covered; ++j)
+        {
+            covered = (p - obstacles[j].x_wrf).norm() <= obstacles[j].size + 1e-6;
+        }
+        EXPECT_TRUE(covered);
+    }
+
+    // Files that are not scenes, or that are truncated, are rejected
+    EXPECT_FALSE(mapped.load("/tmp/test_utils.sdf"));
+    EXPECT_FALSE(mapped.isLoaded());
+
+    {
+        ifstream in("/tmp/test_utils.scene", ios::binary);
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        ofstream out("/tmp/test_utils_truncated.scene", ios::binary);
+        out.write(data.data(), data.size() - 1);
+    }
+    EXPECT_FALSE(mapped.load("/tmp/test_utils_truncated.scene"));
+
+    // Negative sizes are rejected
+    spheres[0].r = -0.1f;
+    EXPECT_FALSE(scene.build(spheres, capsules, boxes));
+}
+
+TEST(UtilsTest, testIKCache)
+{
+    IKCache cache(2);
+    cache.set_resolutions(1e-2, 1e-1, 1e-2, 1e-2);
+    cache.set_direct_tol(0.25);
+    EXPECT_TRUE(cache.set_context("hard 1000"));
+
+    MatrixX2d bounds(3, 2);
+    bounds << -1.0, 1.0, -1.0, 1.0, -1.0, 1.0;
+
+    IKCacheQuery a(Vector3d(0.101, 0.201, 0.301), Vector3d::Zero(), Vector3d(0.501, 0.601, 0.701),
+                   Quaterniond::Identity(), bounds);
+    IKCacheQuery b(a), c(a);
+    b.p_r[0] += 0.1;
+    c.p_r[1] += 0.1;
+
+    VectorXd v_a(3), v_b(3), v_c(3), v;
+    v_a << 0.1, 0.2, 0.3;
+    v_b << 0.4, 0.5, 0.6;
+    v_c << 0.7, 0.8, 0.9;
+
+    bool direct = true;
+    EXPECT_FALSE(cache.lookup(a, v, direct));
+    EXPECT_FALSE(direct);
+
+    cache.insert(a, v_a);
+    cache.insert(b, v_b);
+    EXPECT_EQ(2u, cache.size());
+
+    // Same inputs: the solution can be used as it is
+    ASSERT_TRUE(cache.lookup(a, v, direct));
+    EXPECT_TRUE(direct);
+    EXPECT_EQ(v_a, v);
+
+    // Same cell, but farther than the tolerance: only a warm start
+    IKCacheQuery a_w(a);
+    a_w.q_0[1] += 0.005;
+    ASSERT_TRUE(cache.lookup(a_w, v, direct));
+    EXPECT_FALSE(direct);
+    EXPECT_EQ(v_a, v);
+
+    // Next cell: miss
+    IKCacheQuery a_m(a);
+    a_m.q_0[1] += 0.01;
+    EXPECT_FALSE(cache.lookup(a_m, v, direct));
+
+    // The sign of the quaternion does not matter
+    IKCacheQuery a_o(a);
+    a_o.o_r.coeffs() *= -1.0;
+    EXPECT_TRUE(cache.lookup(a_o, v, direct));
+
+    // a was used last, so b is evicted
+    cache.insert(c, v_c);
+    EXPECT_EQ(2u, cache.size());
+    EXPECT_TRUE (cache.lookup(a, v, direct));
+    EXPECT_FALSE(cache.lookup(b, v, direct));
+    ASSERT_TRUE (cache.lookup(c, v, direct));
+    EXPECT_EQ(v_c, v);
+
+    // A new solution of the same cell replaces the old one
+    cache.insert(a_w, v_b);
+    EXPECT_EQ(2u, cache.size());
+    ASSERT_TRUE(cache.lookup(a, v, direct));
+    EXPECT_EQ(v_b, v);
+
+    IKCacheStats stats = cache.getStats();
+    EXPECT_EQ(9u, stats.n_lookups);
+    EXPECT_EQ(6u, stats.n_hits);
+    EXPECT_EQ(4u, stats.n_direct);
+    EXPECT_EQ(4u, stats.n_inserts);
+    EXPECT_EQ(1u, stats.n_evictions);
+
+    // Snapshots keep the solutions, their order and the context
+    ASSERT_TRUE(cache.save("/tmp/test_utils.ikcache"));
+
+    IKCache loaded(10);
+    loaded.set_resolutions(1e-2, 1e-1, 1e-2, 1e-2);
+    ASSERT_TRUE(loaded.load("/tmp/test_utils.ikcache"));
+    EXPECT_EQ(2u, loaded.size());
+    EXPECT_FALSE(loaded.set_context("hard 1000"));
+    ASSERT_TRUE(loaded.lookup(a, v, direct));
+    EXPECT_EQ(v_b, v);
+    ASSERT_TRUE(loaded.lookup(c, v, direct));
+    EXPECT_EQ(v_c, v);
+
+    // Smaller than the snapshot: the least recently used solutions are dropped
+    IKCache small(1);
+    small.set_resolutions(1e-2, 1e-1, 1e-2, 1e-2);
+    ASSERT_TRUE(small.load("/tmp/test_utils.ikcache"));
+    EXPECT_EQ(1u, small.size());
+    EXPECT_TRUE(small.lookup(a, v, direct));
+
+    // A different context clears the cache
+    EXPECT_TRUE(loaded.set_context("soft 1000"));
+    EXPECT_EQ(0u, loaded.size());
+    EXPECT_EQ(1u, loaded.getStats().n_clears);
+
+    // Files that are not snapshots are rejected
+    EXPECT_FALSE(loaded.load("/tmp/test_utils.scene"));
+    EXPECT_FALSE(loaded.load("/tmp/does_not_exist.ikcache"));
+    EXPECT_EQ(0u, loaded.size());
+
+    // Within the tolerance of the stored bounds, but beyond the current ones: only a warm start
+    IKCache bounded(1);
+    bounded.set_resolutions(1e-2, 1e-1, 1e-2, 1e-2);
+
+    IKCacheQuery d(a);
+    d.bounds(2, 1) = 0.35;
+    VectorXd v_d(3);
+    v_d << 0.1, 0.2, 0.35;
+
+    bounded.insert(d, v_d);
+    ASSERT_TRUE(bounded.lookup(d, v, direct));
+    EXPECT_TRUE(direct);
+
+    d.bounds(2, 1) = 0.34;
+    ASSERT_TRUE(bounded.lookup(d, v, direct));
+    EXPECT_FALSE(direct);
+    EXPECT_EQ(v_d, v);
+}
+
+TEST(UtilsTest, testWarmStartModel)
+{
+    // Solutions that are a smooth function of the features
+    srand(1);
+    size_t n_joints = 7;
+    MatrixXd A = 0.5 * MatrixXd::Random(n_joints, 2 * n_joints + 3);
+    vector<WarmStartSample> train, test;
+
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        WarmStartSample s;
+        s.q_0   = VectorXd::Random(n_joints);
+        s.v_0   = 0.1 * VectorXd::Random(n_joints);
+        s.p_0   = Vector3d::Random();
+        s.p_r   = s.p_0 + 0.05 * Vector3d::Random();
+        s.v_lim = MatrixXd::Ones(n_joints, 2);
+        s.dt    = 0.01;
+
+        VectorXd f = WarmStartModel::toFeatures(s.q_0, s.p_0, s.p_r, s.v_0);
+        s.v_e      = s.v_0 + 0.3 * (A * f).array().sin().matrix();
+
+        (i < 1500 ? train : test).push_back(s);
+    }
+
+    WarmStartModel model;
+    VectorXd v;
+    EXPECT_FALSE(model.predict(test[0].q_0, test[0].p_0, test[0].p_r, test[0].v_0, v));
+
+    WarmStartTraining options;
+    options.n_epochs = 100;
+    ASSERT_TRUE(model.train(train, options));
+    EXPECT_TRUE(model.isLoaded());
+    EXPECT_EQ(n_joints, model.getNrOfJoints());
+
+    // The model is a better starting point than v_0 on samples it has not seen
+    double err_0 = 0.0;
+    for (size_t s = 0; s < test.size(); ++s)
+    {
+        err_0 += (test[s].v_e - test[s].v_0).squaredNorm();
+    }
+    err_0 = sqrt(err_0 / (test.size() * n_joints));
+
+    EXPECT_LT(model.evaluate(test), 0.25 * err_0);
+    EXPECT_FALSE(model.predict(VectorXd::Zero(6), Vector3d::Zero(), Vector3d::Zero(), VectorXd::Zero(6), v));
+
+    // Models are saved and loaded as they are
+    ASSERT_TRUE(model.save("/tmp/test_utils.model"));
+    WarmStartModel loaded;
+    ASSERT_TRUE(loaded.load("/tmp/test_utils.model"));
+    EXPECT_EQ(model.getNrOfHidden(), loaded.getNrOfHidden());
+    EXPECT_EQ(model.evaluate(test),  loaded.evaluate(test));
+    EXPECT_FALSE(loaded.load("/tmp/test_utils.scene"));
+    EXPECT_FALSE(loaded.isLoaded());
+
+    // Logs are appended to across runs, but only by the same chain
+    remove("/tmp/test_utils.wslog");
+    WarmStartLog log;
+    ASSERT_TRUE(log.open("/tmp/test_utils.wslog", n_joints));
+    for (size_t s = 0; s < 5; ++s)    { EXPECT_TRUE(log.append(train[s])); }
+    log.close();
+    EXPECT_FALSE(log.append(train[5]));
+
+    ASSERT_TRUE(log.open("/tmp/test_utils.wslog", n_joints));
+    train[5].o_r      = Quaterniond(0.5, 0.5, -0.5, 0.5);
+    train[5].ctrl_ori = true;
+    train[5].n_iters  = 12;
+    EXPECT_TRUE(log.append(train[5]));
+    log.close();
+    EXPECT_FALSE(log.open("/tmp/test_utils.wslog", n_joints - 1));
+
+    vector<WarmStartSample> samples;
+    ASSERT_TRUE(WarmStartLog::read("/tmp/test_utils.wslog", samples));
+    ASSERT_EQ(6u, samples.size());
+    for (size_t s = 0; s < samples.size(); ++s)
+    {
+        EXPECT_EQ(train[s].q_0,   samples[s].q_0);
+        EXPECT_EQ(train[s].v_0,   samples[s].v_0);
+        EXPECT_EQ(train[s].p_0,   samples[s].p_0);
+        EXPECT_EQ(train[s].p_r,   samples[s].p_r);
+        EXPECT_EQ(train[s].v_lim, samples[s].v_lim);
+        EXPECT_EQ(train[s].v_e,   samples[s].v_e);
+        EXPECT_EQ(train[s].o_r.coeffs(), samples[s].o_r.coeffs());
+        EXPECT_EQ(train[s].dt,       samples[s].dt);
+        EXPECT_EQ(train[s].ctrl_ori, samples[s].ctrl_ori);
+        EXPECT_EQ(train[s].n_iters,  samples[s].n_iters);
+    }
+
+    EXPECT_FALSE(WarmStartLog::read("/tmp/test_utils.model", samples));
+}
+
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv)
 {